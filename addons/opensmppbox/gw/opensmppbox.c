@@ -2485,6 +2485,7 @@ static void init_smppbox(Cfg *cfg)
 	}
 	if (cfg_get_integer(&bearerbox_port, grp, octstr_imm("bearerbox-port")) == -1)
 		bearerbox_port = BB_DEFAULT_SMSBOX_PORT;
+	config_bearerbox_batching(grp);
 #ifdef HAVE_LIBSSL
 #if 0
 	cfg_get_bool(&bearerbox_port_ssl, grp, octstr_imm("bearerbox-port-ssl"));
@@ -892,6 +892,7 @@ static int read_config(Octstr *filename)
         bearerbox_port = 13001;
 
     cfg_get_bool(&bearerbox_port_ssl, grp, octstr_imm("bearerbox-port-ssl"));
+    config_bearerbox_batching(grp);
 
     /* Box ID */
     box_id = cfg_get(grp, octstr_imm("box-id"));
@@ -794,6 +794,7 @@ static void init_sqlbox(Cfg *cfg)
     grp = cfg_get_single_group(cfg, octstr_imm("sqlbox"));
     if (cfg_get_integer(&bearerbox_port, grp, octstr_imm("bearerbox-port")) == -1)
         panic(0, "Missing or bad 'bearerbox-port' in sqlbox group");
+    config_bearerbox_batching(grp);
 #ifdef HAVE_LIBSSL
     cfg_get_bool(&bearerbox_port_ssl, grp, octstr_imm("smsbox-port-ssl"));
     conn_config_ssl(grp);
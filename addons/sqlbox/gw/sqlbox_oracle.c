@@ -311,6 +311,7 @@ found:
 
     pool = dbpool_create(DBPOOL_ORACLE, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * XXX should a failing connect throw panic?!
@@ -5,11 +5,14 @@
 #include "sqlbox_sqlite3.h"
 
 #define sql_update sqlite3_update
-#define sql_select sqlite3_select
 
 static Octstr *sqlbox_logtable;
 static Octstr *sqlbox_insert_table;
 
+/* the fetch queries, built once for the configured insert table */
+static Octstr *sqlbox_select_query;
+static Octstr *sqlbox_delete_query;
+
 /*
  * Our connection pool to sqlite3.
  */
@@ -42,23 +45,6 @@ static int sqlite3_update(DBPoolConn *conn, const Octstr *sql)
     return sqlite3_changes(conn->conn);
 }
 
-sqlite3_stmt* sqlite3_select(DBPoolConn *conn, const Octstr *sql)
-{
-    int res;
-    sqlite3_stmt *stmt = NULL;
-
-#if defined(SQLBOX_TRACE)
-    debug("SQLBOX", 0, "sql: %s", octstr_get_cstr(sql));
-#endif
-
-    res = sqlite3_prepare_v2(conn->conn, octstr_get_cstr(sql), -1, &stmt, NULL);
-    if (res != SQLITE_OK) {
-        error(0, "SQLITE3: Could not compile query: %s", sqlite3_errmsg(conn->conn));
-        return NULL;
-    }
-    return stmt;
-}
-
 void sqlbox_configure_sqlite3(Cfg* cfg)
 {
     CfgGroup *grp;
@@ -76,6 +62,8 @@ void sqlbox_configure_sqlite3(Cfg* cfg)
     if (sqlbox_insert_table == NULL) {
         panic(0, "Parameter 'sql-insert-table' configured.");
     }
+    sqlbox_select_query = octstr_format(SQLBOX_SQLITE3_SELECT_QUERY, sqlbox_insert_table);
+    sqlbox_delete_query = octstr_format(SQLBOX_SQLITE3_DELETE_QUERY, sqlbox_insert_table);
 
     pc = dbpool_conn_consume(pool);
     if (pc == NULL) {
@@ -101,7 +89,8 @@ Msg *sqlite3_fetch_msg()
     sqlite3_stmt *res = NULL;
     int rows = 0;
     Msg *msg = NULL;
-    Octstr *sql, *delet, *id = NULL;
+    Octstr *id = NULL;
+    List *binds;
 
     pc = dbpool_conn_consume(pool);
     if (pc == NULL) {
@@ -109,11 +98,15 @@ Msg *sqlite3_fetch_msg()
         return NULL;
     }
 
-    sql = octstr_format(SQLBOX_SQLITE3_SELECT_QUERY, sqlbox_insert_table);
 #if defined(SQLBOX_TRACE)
-     debug("SQLBOX", 0, "sql: %s", octstr_get_cstr(sql));
+     debug("SQLBOX", 0, "sql: %s", octstr_get_cstr(sqlbox_select_query));
 #endif
-    res = sql_select(pc, sql);
+    /* prepared once per connection, we only reset it after use */
+    res = dbpool_conn_statement(pc, sqlbox_select_query);
+    if (res == NULL) {
+        dbpool_conn_produce(pc);
+        return NULL;
+    }
     do {
         state=sqlite3_step(res);
         if (state==SQLITE_ROW){
@@ -148,20 +141,20 @@ Msg *sqlite3_fetch_msg()
             msg->sms.boxc_id    = (sqlite3_column_text(res, 24) == NULL) ? octstr_duplicate(sqlbox_id):octstr_null_create((char *)sqlite3_column_text(res, 24));
         }
     } while (state==SQLITE_ROW);
-    sqlite3_finalize(res);
+    sqlite3_reset(res);
 
     if ( rows > 0) {
         /* delete current row */
-        delet = octstr_format(SQLBOX_SQLITE3_DELETE_QUERY, sqlbox_insert_table, id);
 #if defined(SQLBOX_TRACE)
-     debug("SQLBOX", 0, "sql: %s", octstr_get_cstr(delet));
+     debug("SQLBOX", 0, "sql: %s", octstr_get_cstr(sqlbox_delete_query));
 #endif
-        sql_update(pc, delet);
+        binds = gwlist_create();
+        gwlist_append(binds, id);
+        dbpool_conn_update(pc, sqlbox_delete_query, binds);
+        gwlist_destroy(binds, NULL);
         octstr_destroy(id);
-        octstr_destroy(delet);
     }
 
-    octstr_destroy(sql);
     dbpool_conn_produce(pc);
     return msg;
 }
@@ -221,6 +214,8 @@ void sqlite3_save_msg(Msg *msg, Octstr *momt /*, Octstr smsbox_id */)
 void sqlite3_leave()
 {
     dbpool_destroy(pool);
+    octstr_destroy(sqlbox_select_query);
+    octstr_destroy(sqlbox_delete_query);
 }
 
 struct server_type *sqlbox_init_sqlite3(Cfg* cfg)
@@ -288,6 +283,7 @@ found:
 
     pool = dbpool_create(DBPOOL_SQLITE3, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * XXX should a failing connect throw panic?!
@@ -31,7 +31,7 @@ msgdata, time, smsc_id, service, account, sms_type, mclass, mwi, coding, compres
 deferred, dlr_mask, dlr_url, pid, alt_dcs, rpi, charset, boxc_id, binfo, meta_data) VALUES (NULL, \
 %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S, %S)"
 
-#define SQLBOX_SQLITE3_DELETE_QUERY "DELETE FROM %S WHERE sql_id = %S"
+#define SQLBOX_SQLITE3_DELETE_QUERY "DELETE FROM %S WHERE sql_id = ?1"
 
 #endif /* HAVE_SQLITE3 || HAVE_SDB */
 
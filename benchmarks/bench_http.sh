@@ -35,9 +35,41 @@ avg_rps=$(awk '{ sum += $2; count++ } END { printf "%.0f", sum/count }' bench_ht
 
 plot benchmarks/bench_http "time (s)" "requests/s (Hz)" "bench_http.dat" ""
 
+# sendsms throughput of smsbox with a growing number of sendsms-threads
+sendsms_url="http://127.0.0.1:13013/cgi-bin/sendsms?from=123&to=234&text=bench&username=tester&password=foobar"
+clients=8
+sendsms_rows=""
+for threads in 1 2 4 8
+do
+    sed -e "s/^group = smsbox\$/group = smsbox\nsendsms-threads = $threads/" \
+        gw/smskannel.conf > /dev/shm/bench_sendsms.conf
+    gw/bearerbox -v 4 /dev/shm/bench_sendsms.conf &
+    bbpid=$!
+    sleep 2
+    test/fakesmsc -H 127.0.0.1 -r 20000 -m 0 '123 234 text nop' > /dev/null 2>&1 &
+    fakepid=$!
+    sleep 1
+    gw/smsbox -v 4 /dev/shm/bench_sendsms.conf &
+    smspid=$!
+    sleep 2
+
+    start=$(date +%s.%N)
+    test/test_http -q -v 4 -t $clients -r $(($times / $clients)) "$sendsms_url"
+    end=$(date +%s.%N)
+    rps=$(echo "$start $end" | awk -v n=$(($times / $clients * $clients)) \
+        '{ printf "%.0f", n / ($2 - $1) }')
+    sendsms_rows="$sendsms_rows<tr><td>$threads</td><td>$rps</td></tr>"
+
+    kill -INT $smspid $fakepid $bbpid
+    wait $smspid $fakepid $bbpid || true
+done
+rm -f /dev/shm/bench_sendsms.conf
+
 sed -e "s/#TIMES#/$times/g" \
     -e "s/#AVG_RPS#/$avg_rps/g" \
     -e "s/#DURATION#/$duration/g" \
+    -e "s|#SENDSMS_ROWS#|$sendsms_rows|g" \
+    -e "s/#CLIENTS#/$clients/g" \
     benchmarks/bench_http.txt
 
 rm -f /dev/shm/bench_http.log
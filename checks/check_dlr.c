@@ -0,0 +1,333 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_dlr.c - check DLR storage, with and without the write-behind buffer
+ */
+
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/dbpool.h"
+#include "gw/msg.h"
+#include "gw/dlr.h"
+#include "gw/dlr_p.h"
+
+#define CONF_FILE "check_dlr.conf"
+#define DB_FILE "check_dlr.db"
+#define ENTRIES 50
+#define MASK (DLR_SUCCESS | DLR_FAIL | DLR_BUFFERED)
+
+
+static void write_conf(char *storage, long write_behind)
+{
+    FILE *f;
+
+    if ((f = fopen(CONF_FILE, "w")) == NULL)
+        panic(errno, "could not write <%s>", CONF_FILE);
+    fprintf(f, "group = core\n"
+               "dlr-storage = %s\n"
+               "dlr-write-behind = %ld\n"
+               "dlr-batch-size = 3\n\n"
+               "group = dlr-db\n"
+               "id = dlr\n"
+               "table = dlr\n"
+               "field-smsc = smsc\n"
+               "field-timestamp = ts\n"
+               "field-source = source\n"
+               "field-destination = destination\n"
+               "field-service = service\n"
+               "field-url = url\n"
+               "field-mask = mask\n"
+               "field-status = status\n"
+               "field-boxc-id = boxc\n\n"
+               "group = sqlite3-connection\n"
+               "id = dlr\n"
+               "database = %s\n", storage, write_behind, DB_FILE);
+    fclose(f);
+}
+
+
+static void add(char *prefix, long i, int mask, int use_dst)
+{
+    Msg *msg;
+    Octstr *ts;
+
+    msg = msg_create(sms);
+    msg->sms.sender = octstr_create("123");
+    msg->sms.receiver = octstr_format("4670123%04ld", i);
+    msg->sms.dlr_mask = mask;
+    msg->sms.dlr_url = octstr_format("http://localhost/dlr?i=%ld", i);
+    ts = octstr_format("%s%ld", prefix, i);
+    dlr_add(octstr_imm("smsc"), ts, msg, use_dst);
+    octstr_destroy(ts);
+    msg_destroy(msg);
+}
+
+
+static void find(char *prefix, long i, int typ, int use_dst, int found)
+{
+    Msg *msg;
+    Octstr *ts, *receiver;
+
+    ts = octstr_format("%s%ld", prefix, i);
+    receiver = octstr_format("4670123%04ld", i);
+    msg = dlr_find(octstr_imm("smsc"), ts, receiver, typ, use_dst);
+    if ((msg != NULL) != found)
+        panic(0, "DLR <%s> was %sfound", octstr_get_cstr(ts), found ? "not " : "");
+    if (msg != NULL) {
+        if (octstr_compare(msg->sms.receiver, receiver) != 0)
+            panic(0, "DLR <%s> went to <%s>", octstr_get_cstr(ts),
+                  octstr_get_cstr(msg->sms.receiver));
+        msg_destroy(msg);
+    }
+    octstr_destroy(receiver);
+    octstr_destroy(ts);
+}
+
+
+#ifdef HAVE_SQLITE3
+static DBPool *open_db(void)
+{
+    DBConf *conf;
+
+    conf = gw_malloc(sizeof(*conf));
+    conf->sqlite3 = gw_malloc(sizeof(*conf->sqlite3));
+    conf->sqlite3->file = octstr_create(DB_FILE);
+    conf->sqlite3->lock_timeout = 0;
+    return dbpool_create(DBPOOL_SQLITE3, conf, 1);
+}
+
+
+static long db_update(char *sql)
+{
+    DBPool *pool;
+    DBPoolConn *conn;
+    List *result = NULL, *row;
+    long n = -1;
+
+    pool = open_db();
+    conn = dbpool_conn_consume(pool);
+    if (strncmp(sql, "SELECT", 6) == 0) {
+        if (dbpool_conn_select(conn, octstr_imm(sql), NULL, &result) == 0 &&
+            (row = gwlist_extract_first(result)) != NULL) {
+            n = strtol(octstr_get_cstr(gwlist_get(row, 0)), NULL, 10);
+            gwlist_destroy(row, octstr_destroy_item);
+        }
+        gwlist_destroy(result, NULL);
+    } else {
+        n = dbpool_conn_update(conn, octstr_imm(sql), NULL);
+    }
+    dbpool_conn_produce(conn);
+    dbpool_destroy(pool);
+
+    return n;
+}
+#endif
+
+
+static void check_storage(char *storage, long write_behind)
+{
+    Cfg *cfg;
+    long i;
+
+    write_conf(storage, write_behind);
+    cfg = cfg_create(octstr_imm(CONF_FILE));
+    if (cfg_read(cfg) == -1)
+        panic(0, "could not read <%s>", CONF_FILE);
+    dlr_init(cfg);
+
+    /* intermediate reports right away, most are still buffered */
+    for (i = 0; i < ENTRIES; i++) {
+        add("a", i, MASK, 0);
+        if (i % 2 == 0)
+            find("a", i, DLR_BUFFERED, 0, 1);
+    }
+    find("b", 0, DLR_SUCCESS, 0, 0);
+
+    /* final reports remove the entry, wherever it is by now */
+    for (i = 0; i < ENTRIES; i++) {
+        find("a", i, DLR_SUCCESS, 0, 1);
+        find("a", i, DLR_SUCCESS, 0, 0);
+    }
+
+    /* final reports right away, mostly never stored at all */
+    for (i = 0; i < ENTRIES; i++) {
+        add("c", i, MASK, 0);
+        find("c", i, DLR_SUCCESS, 0, 1);
+        find("c", i, DLR_BUFFERED, 0, 0);
+    }
+
+    /* matched by destination too, and entries without a final report */
+    for (i = 0; i < ENTRIES; i++) {
+        add("d", i, MASK, 1);
+        add("e", i, DLR_BUFFERED, 0);
+    }
+    for (i = 0; i < ENTRIES; i++) {
+        find("d", i, DLR_BUFFERED, 1, 1);
+        find("d", i, DLR_SUCCESS, 1, 1);
+        find("d", i, DLR_SUCCESS, 1, 0);
+        find("e", i, DLR_BUFFERED, 0, 1);
+        find("e", i, DLR_BUFFERED, 0, 0);
+    }
+
+    /* these are stored at the latest on shutdown */
+    for (i = 0; i < ENTRIES; i++)
+        add("b", i, MASK, 0);
+
+    dlr_shutdown();
+    cfg_destroy(cfg);
+}
+
+
+#ifdef HAVE_SQLITE3
+static void check_sqlite3(long write_behind)
+{
+    DBPoolStatus before, after;
+    long n;
+
+    dbpool_status(&before);
+    unlink(DB_FILE);
+    db_update("CREATE TABLE dlr (smsc TEXT, ts TEXT, source TEXT, destination TEXT, "
+              "service TEXT, url TEXT, mask INTEGER, status INTEGER, boxc TEXT)");
+    check_storage("sqlite3", write_behind);
+    /* connections in constant use are not checked at every checkout */
+    dbpool_status(&after);
+    if (after.checks != before.checks || after.reconnects != before.reconnects)
+        panic(0, "%ld database connection checks done, %ld reconnects",
+              after.checks - before.checks, after.reconnects - before.reconnects);
+    /* each statement is prepared once and reused afterwards */
+    if (after.prepared - before.prepared > 32 || after.reused - before.reused < ENTRIES)
+        panic(0, "%ld statements prepared, %ld reused",
+              after.prepared - before.prepared, after.reused - before.reused);
+    if ((n = db_update("SELECT count(*) FROM dlr WHERE ts NOT LIKE 'b%'")) != 0)
+        panic(0, "%ld removed DLR entries left in the database", n);
+    if ((n = db_update("SELECT count(*) FROM dlr WHERE ts LIKE 'b%'")) != ENTRIES)
+        panic(0, "%ld of %d DLR entries stored in the database", n, ENTRIES);
+    unlink(DB_FILE);
+}
+
+
+/*
+ * A row the database refuses must not take the rest of its batch along.
+ */
+static void check_sqlite3_batch_error(void)
+{
+    Cfg *cfg;
+    struct dlr_storage *storage;
+    struct dlr_entry *entry;
+    List *entries;
+    long i, n;
+
+    unlink(DB_FILE);
+    db_update("CREATE TABLE dlr (smsc TEXT, ts TEXT, source TEXT, "
+              "destination TEXT CHECK (length(destination) < 20), "
+              "service TEXT, url TEXT, mask INTEGER, status INTEGER, boxc TEXT)");
+    write_conf("sqlite3", 0);
+    cfg = cfg_create(octstr_imm(CONF_FILE));
+    if (cfg_read(cfg) == -1)
+        panic(0, "could not read <%s>", CONF_FILE);
+    storage = dlr_init_sqlite3(cfg);
+
+    entries = gwlist_create();
+    for (i = 0; i < 5; i++) {
+        entry = dlr_entry_create();
+        entry->smsc = octstr_create("smsc");
+        entry->timestamp = octstr_format("f%ld", i);
+        entry->source = octstr_create("123");
+        entry->destination = octstr_format(i == 2 ? "4670123%020ld" : "4670123%04ld", i);
+        entry->service = octstr_create("");
+        entry->url = octstr_create("");
+        entry->boxc_id = octstr_create("");
+        entry->mask = MASK;
+        gwlist_append(entries, entry);
+    }
+    /* the refused row is logged as an error, which is expected here */
+    log_set_output_level(GW_PANIC);
+    storage->dlr_add_batch(entries);
+    log_set_output_level(GW_INFO);
+    gwlist_destroy(entries, (void(*)(void *)) dlr_entry_destroy);
+
+    storage->dlr_shutdown();
+    cfg_destroy(cfg);
+
+    if ((n = db_update("SELECT count(*) FROM dlr")) != 4)
+        panic(0, "%ld of 4 valid DLR entries of a failed batch stored", n);
+    unlink(DB_FILE);
+}
+#endif
+
+
+int main(void)
+{
+    gwlib_init();
+    log_set_output_level(GW_INFO);
+
+    check_storage("internal", 0);
+    check_storage("internal", 4);
+
+#ifdef HAVE_SQLITE3
+    check_sqlite3(0);
+    check_sqlite3(4);
+    check_sqlite3_batch_error();
+#endif
+
+    unlink(CONF_FILE);
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,272 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_mpmcqueue.c - check that gwlib/gw-mpmcqueue.c works
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "gwlib/gwlib.h"
+
+#define NUM_PRODUCERS (4)
+#define NUM_CONSUMERS (4)
+#define NUM_ITEMS_PER_PRODUCER (10*1000)
+
+/* small ring so that the overflow path gets its share of work */
+#define RING_SIZE (16)
+
+struct producer_info {
+	gw_mpmcqueue_t *queue;
+	long start_index;
+	long id;
+};
+
+
+static char received[NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER];
+static long last_num[NUM_PRODUCERS];
+static int order_errors;
+
+
+typedef struct {
+	long producer;
+	long num;
+	long index;
+} Item;
+
+
+static Item *new_item(long producer, long num, long index) {
+	Item *item;
+
+	item = gw_malloc(sizeof(Item));
+	item->producer = producer;
+	item->num = num;
+	item->index = index;
+	return item;
+}
+
+
+static void producer(void *arg) {
+	long i, index;
+	struct producer_info *info;
+
+	info = arg;
+
+	index = info->start_index;
+	for (i = 0; i < NUM_ITEMS_PER_PRODUCER; ++i, ++index) {
+		gw_mpmcqueue_produce(info->queue,
+			new_item(info->start_index / NUM_ITEMS_PER_PRODUCER, i, index));
+		if (i % 1000 == 0)
+			gwthread_sleep(0.01);
+	}
+	gw_mpmcqueue_remove_producer(info->queue);
+}
+
+
+static void consumer(void *arg) {
+	gw_mpmcqueue_t *queue;
+	Item *item;
+
+	queue = arg;
+	for (;;) {
+		item = gw_mpmcqueue_consume(queue);
+		if (item == NULL)
+			break;
+		received[item->index] = 1;
+		gw_free(item);
+	}
+}
+
+
+/* single consumer, so items of every producer must arrive in order */
+static void ordered_consumer(void *arg) {
+	gw_mpmcqueue_t *queue;
+	Item *item;
+
+	queue = arg;
+	for (;;) {
+		item = gw_mpmcqueue_consume(queue);
+		if (item == NULL)
+			break;
+		if (item->num != last_num[item->producer] + 1) {
+			error(0, "Out of order: producer=%ld item=%ld after %ld",
+				item->producer, item->num, last_num[item->producer]);
+			order_errors = 1;
+		}
+		last_num[item->producer] = item->num;
+		received[item->index] = 1;
+		gw_free(item);
+	}
+}
+
+
+static void run_producers_and_consumers(int num_consumers,
+					void (*func)(void *)) {
+	gw_mpmcqueue_t *queue;
+	int i;
+	struct producer_info tab[NUM_PRODUCERS];
+	long p, n, index;
+	int errors;
+
+	queue = gw_mpmcqueue_create(RING_SIZE);
+	memset(received, 0, sizeof(received));
+	for (i = 0; i < NUM_PRODUCERS; ++i)
+		last_num[i] = -1;
+	order_errors = 0;
+
+	for (i = 0; i < NUM_PRODUCERS; ++i) {
+		tab[i].queue = queue;
+		tab[i].start_index = i * NUM_ITEMS_PER_PRODUCER;
+		gw_mpmcqueue_add_producer(queue);
+		tab[i].id = gwthread_create(producer, tab + i);
+	}
+	for (i = 0; i < num_consumers; ++i)
+		gwthread_create(func, queue);
+
+	gwthread_join_every(producer);
+	gwthread_join_every(func);
+
+	if (gw_mpmcqueue_len(queue) != 0)
+		panic(0, "queue has %ld items left after consumers ended",
+		      gw_mpmcqueue_len(queue));
+
+	errors = 0;
+	for (p = 0; p < NUM_PRODUCERS; ++p) {
+		for (n = 0; n < NUM_ITEMS_PER_PRODUCER; ++n) {
+			index = p * NUM_ITEMS_PER_PRODUCER + n;
+			if (!received[index]) {
+				error(0, "Not received: producer=%ld "
+				         "item=%ld index=%ld",
+					 tab[p].id, n, index);
+				errors = 1;
+			}
+		}
+	}
+
+	if (errors)
+		panic(0, "Not all items were received.");
+	if (order_errors)
+		panic(0, "Items of a producer were received out of order.");
+
+	gw_mpmcqueue_destroy(queue, NULL);
+}
+
+
+static void main_for_single_thread(void) {
+	static char *items[] = {
+		"one",
+		"two",
+		"three",
+	};
+	int num_items = sizeof(items) / sizeof(items[0]);
+	gw_mpmcqueue_t *queue;
+	int i, j;
+	char *p;
+
+	queue = gw_mpmcqueue_create(2);
+
+	if (gw_mpmcqueue_extract_first(queue) != NULL)
+		panic(0, "extract from empty queue returned an item");
+	if (gw_mpmcqueue_consume(queue) != NULL)
+		panic(0, "consume without producers did not return NULL");
+	if (gw_mpmcqueue_wait_until_nonempty(queue) != -1)
+		panic(0, "wait on empty queue without producers did not fail");
+
+	/* overflow the ring several times over and check the order */
+	for (j = 0; j < 3; ++j)
+		for (i = 0; i < num_items; ++i)
+			gw_mpmcqueue_produce(queue, items[i]);
+	if (gw_mpmcqueue_len(queue) != 3 * num_items)
+		panic(0, "queue length %ld, expected %d",
+		      gw_mpmcqueue_len(queue), 3 * num_items);
+	for (j = 0; j < 3; ++j) {
+		for (i = 0; i < num_items; ++i) {
+			p = gw_mpmcqueue_extract_first(queue);
+			if (p != items[i])
+				panic(0, "got `%s', expected `%s'",
+				      p ? p : "(null)", items[i]);
+		}
+	}
+	if (gw_mpmcqueue_len(queue) != 0)
+		panic(0, "queue is not empty after extracting everything");
+
+	/* timed consume must return after the timeout with a producer around */
+	gw_mpmcqueue_add_producer(queue);
+	if (gw_mpmcqueue_producer_count(queue) != 1)
+		panic(0, "producer count is wrong");
+	if (gw_mpmcqueue_timed_consume(queue, 1) != NULL)
+		panic(0, "timed consume on empty queue returned an item");
+	gw_mpmcqueue_produce(queue, items[0]);
+	if (gw_mpmcqueue_timed_consume(queue, 1) != items[0])
+		panic(0, "timed consume did not return the item");
+	gw_mpmcqueue_remove_producer(queue);
+
+	gw_mpmcqueue_produce(queue, items[1]);
+	gw_mpmcqueue_destroy(queue, NULL);
+}
+
+
+int main(void) {
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+	main_for_single_thread();
+	run_producers_and_consumers(NUM_CONSUMERS, consumer);
+	run_producers_and_consumers(1, ordered_consumer);
+	gwlib_shutdown();
+	return 0;
+}
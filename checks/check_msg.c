@@ -0,0 +1,211 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_msg.c - check that both Msg codecs in gw/msg.c round trip
+ */
+
+#include <string.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+
+
+static Msg *create_sms(void)
+{
+    Msg *msg;
+
+    msg = msg_create(sms);
+    msg->sms.sender = octstr_create("12345");
+    msg->sms.receiver = octstr_create("+358401234567");
+    msg->sms.msgdata = octstr_create_from_data("bin\0ary", 7);
+    msg->sms.udhdata = octstr_create("");
+    msg->sms.smsc_id = octstr_create("smsc-1");
+    msg->sms.time = 1234567890;
+    msg->sms.mclass = -1;
+    msg->sms.dlr_mask = 31;
+    uuid_generate(msg->sms.id);
+    return msg;
+}
+
+
+/* the legacy packing of two messages compares all fields */
+static void check_same(const char *what, Msg *a, Msg *b)
+{
+    Octstr *os_a, *os_b;
+
+    os_a = msg_pack(a);
+    os_b = msg_pack(b);
+    if (octstr_compare(os_a, os_b) != 0)
+        panic(0, "%s: messages differ after the round trip", what);
+    octstr_destroy(os_a);
+    octstr_destroy(os_b);
+}
+
+
+static void check_round_trip(Msg *msg)
+{
+    Octstr *os;
+    Msg *msg2;
+
+    os = msg_pack(msg);
+    msg2 = msg_unpack(os);
+    if (msg2 == NULL)
+        panic(0, "legacy: could not unpack");
+    check_same("legacy", msg, msg2);
+    octstr_destroy(os);
+    msg_destroy(msg2);
+
+    os = msg_pack_binary(msg);
+    msg2 = msg_unpack(os);
+    if (msg2 == NULL)
+        panic(0, "binary: could not unpack");
+    check_same("binary", msg, msg2);
+    if (msg2->type == sms && msg2->sms.udhdata == NULL)
+        panic(0, "binary: empty string came back as NULL");
+    if (msg2->type == sms && msg2->sms.service != NULL)
+        panic(0, "binary: NULL string came back as non-NULL");
+    octstr_destroy(os);
+    msg_destroy(msg2);
+}
+
+
+static void check_invalid(Msg *msg)
+{
+    Octstr *os, *bad;
+    Msg *msg2;
+    long i;
+
+    os = msg_pack_binary(msg);
+
+    /* every truncation must be rejected, not read past the end */
+    for (i = 0; i < octstr_len(os); i++) {
+        bad = octstr_copy(os, 0, i);
+        msg2 = msg_unpack(bad);
+        if (msg2 != NULL)
+            panic(0, "binary: truncated packet of %ld octets accepted", i);
+        octstr_destroy(bad);
+    }
+
+    bad = octstr_duplicate(os);
+    octstr_set_char(bad, 3, MSG_BINARY_VERSION + 1);
+    if ((msg2 = msg_unpack(bad)) != NULL)
+        panic(0, "binary: unknown version accepted");
+    octstr_destroy(bad);
+
+    octstr_destroy(os);
+}
+
+
+static void check_feature(void)
+{
+    Msg *msg, *msg2;
+    Octstr *os;
+
+    msg = msg_codec_feature();
+    if (msg_codec_feature_version(msg) != MSG_BINARY_VERSION)
+        panic(0, "codec feature does not announce the binary version");
+
+    /* the announcement itself always travels in the legacy format */
+    os = msg_pack(msg);
+    msg2 = msg_unpack(os);
+    if (msg_codec_feature_version(msg2) != MSG_BINARY_VERSION)
+        panic(0, "codec feature lost in the legacy round trip");
+    octstr_destroy(os);
+    msg_destroy(msg2);
+    msg_destroy(msg);
+
+    msg = msg_create(admin);
+    msg->admin.command = cmd_identify;
+    if (msg_codec_feature_version(msg) != -1)
+        panic(0, "identify message taken as codec feature");
+    msg_destroy(msg);
+}
+
+
+int main(void)
+{
+    Msg *msg;
+
+    /* log synchronously, so the level applies to what is logged meanwhile */
+    log_set_skip_async();
+    gwlib_init();
+    log_set_output_level(GW_INFO);
+
+    msg = create_sms();
+    check_round_trip(msg);
+    /* the checks below expect errors, keep them out of the log */
+    log_set_output_level(GW_PANIC);
+    check_invalid(msg);
+    log_set_output_level(GW_INFO);
+    msg_destroy(msg);
+
+    msg = msg_create(heartbeat);
+    msg->heartbeat.load = 42;
+    check_round_trip(msg);
+    msg_destroy(msg);
+
+    msg = msg_create(ack);
+    msg->ack.nack = ack_failed;
+    uuid_generate(msg->ack.id);
+    check_round_trip(msg);
+    msg_destroy(msg);
+
+    check_feature();
+
+    gwlib_shutdown();
+    return 0;
+}
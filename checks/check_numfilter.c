@@ -0,0 +1,239 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_numfilter.c - check the compiled white/black number lists
+ */
+
+
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/numfilter.h"
+
+#define LIST_FILE "check_numfilter.list"
+
+
+static NumberFilter *compiled(char **lines, char *file, char *base)
+{
+    NumberFilter *filter;
+
+    filter = number_filter_create();
+    for (; *lines != NULL; lines++)
+        number_filter_add_number(filter, 0, NUMFILTER_BLACK, *lines);
+    if (number_filter_write(filter, octstr_imm(file),
+                            base ? octstr_imm(base) : NULL) == -1)
+        panic(0, "number_filter_write failed for <%s>", file);
+    number_filter_destroy(filter);
+
+    filter = number_filter_create();
+    if (number_filter_add_url(filter, 0, NUMFILTER_BLACK, octstr_imm(LIST_FILE)) == -1)
+        panic(0, "number_filter_add_url could not map <%s>", LIST_FILE);
+    number_filter_compile(filter);
+    return filter;
+}
+
+
+static void check_file(NumberFilter *filter, char *in, char *out, long numbers)
+{
+    char *p, *q;
+    long n, prefixes;
+    Octstr *os;
+
+    for (p = in; *p != '\0'; p = q + (*q != '\0')) {
+        q = p + strcspn(p, " ");
+        os = octstr_create_from_data(p, q - p);
+        if (number_filter_check(filter, os, ~0UL) != 1)
+            panic(0, "number list file did not hold <%s>", octstr_get_cstr(os));
+        octstr_destroy(os);
+    }
+    for (p = out; *p != '\0'; p = q + (*q != '\0')) {
+        q = p + strcspn(p, " ");
+        os = octstr_create_from_data(p, q - p);
+        if (number_filter_check(filter, os, ~0UL) != 0)
+            panic(0, "number list file held <%s>", octstr_get_cstr(os));
+        octstr_destroy(os);
+    }
+    if ((n = number_filter_size(filter, &prefixes)) != numbers)
+        panic(0, "number list file held %ld numbers should be %ld", n, numbers);
+}
+
+
+static void check_files(void)
+{
+    static char *old[] = { "111", "222", "333", "45*", "55*", NULL };
+    static char *new[] = { "111", "+333", "444", "45*", "66*", NULL };
+    static char *other[] = { "111", "222", "333", "999", "45*", "55*", NULL };
+    NumberFilter *filter;
+    FILE *f;
+
+    unlink(LIST_FILE ".delta");
+    filter = compiled(old, LIST_FILE, NULL);
+    check_file(filter, "111 222 333 4501 5501", "444 6601 777", 3);
+    number_filter_destroy(filter);
+
+    /* the delta is applied to the list it was made for */
+    filter = compiled(new, LIST_FILE ".delta", LIST_FILE);
+    check_file(filter, "111 333 444 4501 6601", "222 5501 777", 3);
+    number_filter_destroy(filter);
+
+    /* and ignored for any other */
+    filter = compiled(other, LIST_FILE, NULL);
+    check_file(filter, "111 222 333 999 4501 5501", "444 6601 777", 4);
+    number_filter_destroy(filter);
+
+    /* a local file can also be a text list */
+    if ((f = fopen(LIST_FILE, "w")) == NULL)
+        panic(0, "Cannot create <%s>", LIST_FILE);
+    fprintf(f, "# numbers\n111\n45*\n");
+    fclose(f);
+    filter = number_filter_create();
+    number_filter_add_url(filter, 0, NUMFILTER_BLACK, octstr_imm("file://" LIST_FILE));
+    number_filter_compile(filter);
+    check_file(filter, "111 4501", "222 4", 1);
+    number_filter_destroy(filter);
+
+    unlink(LIST_FILE);
+    unlink(LIST_FILE ".delta");
+}
+
+
+int main(void)
+{
+    NumberFilter *filter;
+    regex_t *regex;
+    unsigned long result;
+    long numbers, prefixes;
+    int i;
+    static struct {
+	int list;
+	enum numfilter_type type;
+	char *line;
+    } entries[] = {
+	{ 0, NUMFILTER_WHITE, "+358 40 123 4567" },
+	{ 0, NUMFILTER_WHITE, "0358401234568: comment" },
+	{ 0, NUMFILTER_WHITE, "4412*" },
+	{ 1, NUMFILTER_BLACK, "358-40-123-4567" },
+	{ 1, NUMFILTER_BLACK, "99*" },
+	{ 1, NUMFILTER_BLACK, "12345678901234567890" },
+    };
+    static struct {
+	char *number;
+	unsigned long rejected;
+    } tab[] = {
+	{ "+358401234567", 0x02 },
+	{ "00358401234567", 0x02 },
+	{ "358401234568", 0x00 },
+	{ "441234", 0x00 },
+	{ "4412", 0x00 },
+	{ "441", 0x01 },
+	{ "990001", 0x07 },
+	{ "991", 0x07 },
+	{ "12345678901234567890", 0x03 },
+	{ "92345678901234567890", 0x07 },
+	{ "111", 0x01 },
+	{ "", 0x01 },
+    };
+
+    gwlib_init();
+    log_set_output_level(GW_INFO);
+
+    filter = number_filter_create();
+    for (i = 0; (size_t) i < sizeof(entries) / sizeof(entries[0]); ++i) {
+	if (number_filter_add_number(filter, entries[i].list, entries[i].type,
+	                             entries[i].line) == -1)
+	    panic(0, "number_filter_add_number rejected <%s>", entries[i].line);
+    }
+    if (number_filter_add_number(filter, 0, NUMFILTER_WHITE, "# comment") != -1)
+	panic(0, "number_filter_add_number accepted a line without number");
+    regex = gw_regex_comp(octstr_imm("^9"), REG_EXTENDED);
+    number_filter_add_regex(filter, 2, NUMFILTER_BLACK, regex);
+    number_filter_compile(filter);
+
+    if (number_filter_lists(filter) != 0x07)
+	panic(0, "number_filter_lists returned %lx should be 7",
+	      number_filter_lists(filter));
+    numbers = number_filter_size(filter, &prefixes);
+    /* the white- and black-listed 358401234567 share one entry */
+    if (numbers != 3 || prefixes != 2)
+	panic(0, "number_filter_size returned %ld/%ld should be 3/2",
+	      numbers, prefixes);
+
+    for (i = 0; (size_t) i < sizeof(tab) / sizeof(tab[0]); ++i) {
+	result = number_filter_check(filter, octstr_imm(tab[i].number), ~0UL);
+	if (result != tab[i].rejected) {
+	    panic(0, "number_filter_check did not work for <%s>, "
+	             "returned %lx should be %lx",
+		  tab[i].number, result, tab[i].rejected);
+	}
+	result = number_filter_check(filter, octstr_imm(tab[i].number), 0x02);
+	if (result != (tab[i].rejected & 0x02))
+	    panic(0, "number_filter_check did not mask lists for <%s>",
+		  tab[i].number);
+    }
+
+    if (number_filter_check(filter, NULL, ~0UL) != 0x01)
+	panic(0, "number_filter_check did not reject NULL by the white-list");
+    if (number_filter_first(0x06) != 1)
+	panic(0, "number_filter_first did not work");
+
+    number_filter_destroy(filter);
+
+    check_files();
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_route.c - check the compiled SMSC routing table
+ */
+
+
+#include "gwlib/gwlib.h"
+#include "gw/bb_route.c"
+
+
+/* the table only asks for regex routed connections, there are none here */
+int smscconn_usable(SMSCConn *conn, Msg *msg)
+{
+    panic(0, "smscconn_usable called for a connection without regex");
+    return -1;
+}
+
+
+static SMSCConn *route_conn_create(char *allowed_id, char *denied_id,
+                             char *allowed_prefix, char *denied_prefix)
+{
+    SMSCConn *conn;
+
+    conn = gw_malloc(sizeof(*conn));
+    memset(conn, 0, sizeof(*conn));
+    if (allowed_id != NULL)
+        conn->allowed_smsc_id = octstr_split(octstr_imm(allowed_id), octstr_imm(";"));
+    if (denied_id != NULL)
+        conn->denied_smsc_id = octstr_split(octstr_imm(denied_id), octstr_imm(";"));
+    if (allowed_prefix != NULL)
+        conn->allowed_prefix = octstr_create(allowed_prefix);
+    if (denied_prefix != NULL)
+        conn->denied_prefix = octstr_create(denied_prefix);
+
+    return conn;
+}
+
+
+static void route_conn_destroy(SMSCConn *conn)
+{
+    gwlist_destroy(conn->allowed_smsc_id, octstr_destroy_item);
+    gwlist_destroy(conn->denied_smsc_id, octstr_destroy_item);
+    octstr_destroy(conn->allowed_prefix);
+    octstr_destroy(conn->denied_prefix);
+    gw_free(conn);
+}
+
+
+static void check_match(RouteTable *table, char *smsc_id, char *receiver,
+                        long conn, int expected)
+{
+    RouteMask usable[1], preferred[1];
+    Msg *msg;
+
+    msg = msg_create(sms);
+    msg->sms.smsc_id = smsc_id ? octstr_create(smsc_id) : NULL;
+    msg->sms.receiver = octstr_create(receiver);
+    usable[0] = preferred[0] = 0;
+    route_table_match(table, msg, usable, preferred);
+    if (ROUTE_MASK_ISSET(usable, conn) != expected)
+        panic(0, "connection %ld %s for smsc-id <%s> receiver <%s>", conn,
+              expected ? "not usable" : "usable",
+              smsc_id ? smsc_id : "", receiver);
+    msg_destroy(msg);
+}
+
+
+int main(void)
+{
+    List *conns;
+    RouteTable *table;
+
+    gwlib_init();
+
+    conns = gwlist_create();
+    /* 0: allowed and denied smsc-id, the denied list is ignored */
+    gwlist_append(conns, route_conn_create("A;B", "B;C", NULL, NULL));
+    /* 1: denied smsc-id only */
+    gwlist_append(conns, route_conn_create(NULL, "B;C", NULL, NULL));
+    /* 2: allowed and denied prefix, denied only wins outside allowed */
+    gwlist_append(conns, route_conn_create(NULL, NULL, "4670", "46;4671"));
+    table = route_table_create(conns);
+
+    check_match(table, "A", "123", 0, 1);
+    check_match(table, "B", "123", 0, 1);
+    check_match(table, "C", "123", 0, 0);
+    check_match(table, NULL, "123", 0, 0);
+
+    check_match(table, "A", "123", 1, 1);
+    check_match(table, "B", "123", 1, 0);
+    check_match(table, NULL, "123", 1, 1);
+
+    check_match(table, NULL, "4670123", 2, 1);
+    check_match(table, NULL, "4671123", 2, 0);
+    check_match(table, NULL, "4680123", 2, 0);
+    check_match(table, NULL, "123", 2, 1);
+
+    route_table_destroy(table);
+    while (gwlist_len(conns) > 0)
+        route_conn_destroy(gwlist_extract_first(conns));
+    gwlist_destroy(conns, NULL);
+
+    gwlib_shutdown();
+    return 0;
+}
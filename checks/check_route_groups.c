@@ -0,0 +1,168 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_route_groups.c - check parking of messages per route group
+ */
+
+
+#include "gwlib/gwlib.h"
+#include "gw/bb_route.c"
+
+
+/* only the routing table needs it, it is not created here */
+int smscconn_usable(SMSCConn *conn, Msg *msg)
+{
+    panic(0, "smscconn_usable called without a routing table");
+    return -1;
+}
+
+
+/* connections 0 and 1 belong to one group, 2 to another */
+static RouteMask group01[1] = { 3UL };
+static RouteMask group2[1] = { 4UL };
+
+
+static int is_active(long index, void *data)
+{
+    return ROUTE_MASK_ISSET((RouteMask *) data, index);
+}
+
+
+static Msg *park(RouteGroups *groups, RouteMask *usable, char *receiver,
+                 time_t validity)
+{
+    Msg *msg;
+
+    msg = msg_create(sms);
+    msg->sms.receiver = octstr_create(receiver);
+    msg->sms.validity = validity;
+    route_groups_park(groups, msg, usable, 1);
+
+    return msg;
+}
+
+
+/* the messages of one group come back in order, the groups in any order */
+static void check_msgs(List *msgs, Msg *first, Msg *second, int ordered,
+                       const char *what)
+{
+    if (gwlist_len(msgs) != (first != NULL) + (second != NULL) ||
+        (first != NULL && gwlist_search_equal(msgs, first) == -1) ||
+        (second != NULL && gwlist_search_equal(msgs, second) == -1) ||
+        (ordered && gwlist_get(msgs, 0) != first))
+        panic(0, "%s: got %ld messages, not the expected ones", what,
+              gwlist_len(msgs));
+    gwlist_destroy(msgs, msg_destroy_item);
+}
+
+
+int main(void)
+{
+    RouteGroups *groups;
+    RouteMask active[1];
+    List *msgs;
+    Msg *a, *b, *c, *expired;
+    time_t now;
+
+    gwlib_init();
+
+    now = time(NULL);
+    groups = route_groups_create();
+
+    /* parking */
+    a = park(groups, group01, "1", SMS_PARAM_UNDEFINED);
+    c = park(groups, group2, "3", now + 60);
+    b = park(groups, group01, "2", SMS_PARAM_UNDEFINED);
+    expired = park(groups, group2, "4", now - 1);
+    if (route_groups_len(groups) != 4)
+        panic(0, "parked %ld messages, not 4", route_groups_len(groups));
+
+    /* nothing is up, only the expired message comes back */
+    active[0] = 0;
+    msgs = gwlist_create();
+    route_groups_take(groups, msgs, 3, is_active, active, now);
+    check_msgs(msgs, expired, NULL, 1, "all down");
+
+    /* connection 1 comes up, its group is dispatched in order */
+    active[0] = 2UL;
+    msgs = gwlist_create();
+    route_groups_take(groups, msgs, 3, is_active, active, now);
+    check_msgs(msgs, a, b, 1, "connection 1 up");
+    if (route_groups_len(groups) != 1)
+        panic(0, "%ld messages left parked, not 1", route_groups_len(groups));
+
+    /* the routes are rebuilt, everything comes back */
+    b = park(groups, group01, "5", SMS_PARAM_UNDEFINED);
+    msgs = gwlist_create();
+    route_groups_flush(groups, msgs);
+    check_msgs(msgs, c, b, 0, "routes rebuilt");
+    if (route_groups_len(groups) != 0)
+        panic(0, "%ld messages left after flush", route_groups_len(groups));
+
+    /* the groups are gone, even when all connections come up */
+    active[0] = 7UL;
+    msgs = gwlist_create();
+    route_groups_take(groups, msgs, 3, is_active, active, now);
+    check_msgs(msgs, NULL, NULL, 0, "after flush");
+
+    /* messages still parked go with the groups */
+    park(groups, group2, "6", SMS_PARAM_UNDEFINED);
+    route_groups_destroy(groups);
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,164 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_timerwheel.c - check that gwlib/gw-timerwheel.c works
+ */
+
+#include <time.h>
+
+#include "gwlib/gwlib.h"
+
+/* how late an item may come out, to allow for a busy test machine */
+#define SLACK_MS (50)
+
+typedef struct {
+	long delay;
+	long long added;
+	long long expired;
+} Item;
+
+
+static long long now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+
+int main(void) {
+	/* spans level 0, the cascades from level 1, and items out of reach */
+	static long delays[] = {
+		0, 1, 2, 5, 63, 64, 65, 100, 127, 128, 200, 333, 640, 1000,
+		1024, 1300, 1300, 7, 3 * 3600 * 1000L, 40 * 3600 * 1000L
+	};
+	Item items[sizeof(delays) / sizeof(delays[0])];
+	gw_timerwheel_t *wheel;
+	List *due;
+	Item *item;
+	long i, n, wait, left, expired;
+
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+
+	n = sizeof(delays) / sizeof(delays[0]);
+	wheel = gw_timerwheel_create();
+	due = gwlist_create();
+	if (gw_timerwheel_expire(wheel, due) != -1)
+		panic(0, "empty wheel did not return -1");
+
+	for (i = 0; i < n; i++) {
+		items[i].delay = delays[i];
+		items[i].added = now_ms();
+		items[i].expired = 0;
+		if (gw_timerwheel_add(wheel, &items[i], delays[i]) != (i == 0))
+			panic(0, "add of delay %ld was wrongly (not) the earliest", delays[i]);
+	}
+	if (gw_timerwheel_len(wheel) != n)
+		panic(0, "wheel holds %ld items, should be %ld", gw_timerwheel_len(wheel), n);
+
+	expired = 0;
+	left = n - 2;
+	while (left > 0) {
+		wait = gw_timerwheel_expire(wheel, due);
+		while ((item = gwlist_extract_first(due)) != NULL) {
+			item->expired = now_ms();
+			/* both clocks count whole milliseconds */
+			if (item->expired - item->added < item->delay - 1)
+				panic(0, "item of delay %ld expired after %lld ms", item->delay,
+				      item->expired - item->added);
+			if (item->expired - item->added > item->delay + SLACK_MS)
+				panic(0, "item of delay %ld expired only after %lld ms", item->delay,
+				      item->expired - item->added);
+			if (item->delay < expired)
+				panic(0, "item of delay %ld expired after one of %ld", item->delay, expired);
+			expired = item->delay;
+			left--;
+		}
+		if (left == 0)
+			break;
+		if (wait <= 0 || wait > 1000)
+			panic(0, "wheel asked for a wait of %ld ms", wait);
+		gwthread_sleep(wait / 1000.0);
+	}
+
+	for (i = 0; i < n - 2; i++)
+		if (items[i].expired == 0)
+			panic(0, "item of delay %ld did not expire", items[i].delay);
+	if (gw_timerwheel_len(wheel) != 2)
+		panic(0, "wheel holds %ld items, should be 2", gw_timerwheel_len(wheel));
+
+	gw_timerwheel_drain(wheel, due);
+	if (gwlist_len(due) != 2 || gw_timerwheel_len(wheel) != 0)
+		panic(0, "drain returned %ld items", gwlist_len(due));
+	if (gw_timerwheel_expire(wheel, due) != -1)
+		panic(0, "drained wheel did not return -1");
+
+	while (gwlist_extract_first(due) != NULL)
+		;
+	gw_timerwheel_add(wheel, &items[0], 1000);
+	gw_timerwheel_close(wheel, due);
+	if (gwlist_len(due) != 1 || gw_timerwheel_len(wheel) != 0)
+		panic(0, "close returned %ld items", gwlist_len(due));
+	if (gw_timerwheel_add(wheel, &items[1], 0) != -1 || gw_timerwheel_len(wheel) != 0)
+		panic(0, "closed wheel took an item");
+
+	gwlist_destroy(due, NULL);
+	gw_timerwheel_destroy(wheel, NULL);
+	gwlib_shutdown();
+	return 0;
+}
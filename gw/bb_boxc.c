@@ -86,8 +86,8 @@
 
 extern volatile sig_atomic_t bb_status;
 extern volatile sig_atomic_t restart;
-extern List *incoming_sms;
-extern List *outgoing_sms;
+extern gw_mpmcqueue_t *incoming_sms;
+extern gw_mpmcqueue_t *outgoing_sms;
 
 extern List *flow_threads;
 extern List *suspended;
@@ -116,6 +116,11 @@ static Octstr *smsbox_interface;
 /* max pending messages on the line to smsbox */
 static long smsbox_max_pending;
 
+/* coalesce writes to smsboxes up to this many octets, 0 for no batching */
+static long smsbox_batch_size;
+/* and send them at the latest after this many seconds */
+static double smsbox_batch_delay;
+
 static Octstr *box_allow_ip;
 static Octstr *box_deny_ip;
 
@@ -125,6 +130,34 @@ static Counter *boxid;
 /* sms_to_smsboxes thread-id */
 static long sms_dequeue_thread;
 
+/* wait at most this long for a box event before re-trying held messages */
+#define BOXC_DISPATCH_RECHECK 5.0
+
+/* default for smsbox-batch-delay, in milliseconds */
+#define BOXC_BATCH_DELAY 1
+
+/*
+ * Messages the dispatcher holds back until a box for their route is
+ * available, one FIFO per smsbox-id plus one for "any smsbox". Only
+ * the sms_to_smsboxes thread touches these.
+ */
+typedef struct {
+    Octstr *boxc_id;	/* NULL for any smsbox */
+    List *msgs;
+} BoxcRoute;
+
+static Dict *pending_by_id;
+static BoxcRoute *pending_any;
+static List *pending_routes;
+
+/* number of messages held in pending_routes */
+static Counter *pending_sms;
+/* bumped on every event that may let held messages through */
+static Counter *dispatch_events;
+static volatile int dispatcher_waiting;
+/* bumped when smsbox-route rules are reloaded */
+static volatile long routes_generation;
+
 
 typedef struct _boxc {
     Connection	*conn;
@@ -132,9 +165,9 @@ typedef struct _boxc {
     int               load;
     time_t        connect_time;
     Octstr        *client_ip;
-    List            *incoming;
-    List            *retry;   	/* If sending fails */
-    List            *outgoing;
+    gw_mpmcqueue_t  *incoming;
+    gw_mpmcqueue_t  *retry;   	/* If sending fails */
+    gw_mpmcqueue_t  *outgoing;
     Dict           *sent;
     Semaphore *pending;
     volatile sig_atomic_t alive;
@@ -142,6 +175,7 @@ typedef struct _boxc {
     /* used to mark connection usable or still waiting for ident. msg */
     volatile int routable;
     long          http_port; /* smsbox sendsms-port for admin panel */
+    volatile int  binary;   /* box unpacks binary messages */
 } Boxc;
 
 
@@ -151,6 +185,7 @@ static int send_msg(Boxc *boxconn, Msg *pmsg);
 static void boxc_sent_push(Boxc*, Msg*);
 static void boxc_sent_pop(Boxc*, Msg*, Msg**);
 static void boxc_gwlist_destroy(List *list);
+static void boxc_dispatch_wakeup(void);
 
 
 /*-------------------------------------------------
@@ -331,7 +366,7 @@ static void boxc_receiver(void *arg)
             if (conn->routable == 0) {
                 conn->routable = 1;
                 /* wakeup the dequeue thread */
-                gwthread_wakeup(sms_dequeue_thread);
+                boxc_dispatch_wakeup();
             }
 
         } else {
@@ -346,11 +381,13 @@ static void boxc_receiver(void *arg)
                     Msg *orig;
                     boxc_sent_pop(conn, msg, &orig);
                     if (orig != NULL) /* retry this message */
-                        gwlist_append(conn->retry, orig);
+                        gw_mpmcqueue_produce(conn->retry, orig);
                 } else {
                     boxc_sent_pop(conn, msg, NULL);
                     store_save(msg);
                 }
+                /* box has room again, held back messages may go now */
+                boxc_dispatch_wakeup();
                 debug("bb.boxc", 0, "boxc_receiver: got ack");
             }
             /* if this is an identification message from an smsbox instance */
@@ -418,7 +455,18 @@ static void boxc_receiver(void *arg)
 
                 conn->routable = 1;
                 /* wakeup the dequeue thread */
-                gwthread_wakeup(sms_dequeue_thread);
+                boxc_dispatch_wakeup();
+            }
+            /* the box can unpack binary messages, tell it we can, too */
+            else if (msg_codec_feature_version(msg) >= MSG_BINARY_VERSION) {
+                if (!conn->binary) {
+                    Msg *reply = msg_codec_feature();
+                    debug("bb.boxc", 0, "boxc_receiver: box <%s> unpacks binary messages",
+                          octstr_get_cstr(conn->client_ip));
+                    send_msg(conn, reply);
+                    msg_destroy(reply);
+                    conn->binary = 1;
+                }
             }
             else
                 warning(0, "boxc_receiver: unknown msg received from <%s>, "
@@ -437,7 +485,7 @@ static int send_msg(Boxc *boxconn, Msg *pmsg)
 {
     Octstr *pack;
 
-    pack = msg_pack(pmsg);
+    pack = boxconn->binary ? msg_pack_binary(pmsg) : msg_pack(pmsg);
 
     if (pack == NULL)
         return -1;
@@ -471,9 +519,35 @@ static void boxc_sent_push(Boxc *conn, Msg *m)
 
     uuid_unparse(m->sms.id, id);
     os = octstr_create(id);
-    dict_put(conn->sent, os, msg_duplicate(m));
+    dict_put_nocopy(conn->sent, os, msg_duplicate(m));
     semaphore_down(conn->pending);
-    octstr_destroy(os);
+}
+
+
+/*
+ * An smsbox with several links to us may ack a message on another link
+ * than it got the message on. Look for it in the sent dicts of the other
+ * connections.
+ */
+static Msg *boxc_sent_remove_other(Boxc *conn, Octstr *id)
+{
+    Boxc *bc;
+    Msg *msg = NULL;
+    long i;
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    for (i = 0; msg == NULL && i < gwlist_len(smsbox_list); i++) {
+        bc = gwlist_get(smsbox_list, i);
+        if (bc == conn || bc->sent == NULL)
+            continue;
+        if ((msg = dict_remove(bc->sent, id)) != NULL) {
+            /* still under the lock, so bc can not go away */
+            semaphore_up(bc->pending);
+        }
+    }
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    return msg;
 }
 
 
@@ -496,13 +570,16 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
     uuid_unparse((msg_type(m) == sms ? m->sms.id : m->ack.id), id);
     os = octstr_create(id);
     msg = dict_remove(conn->sent, os);
+    if (msg != NULL)
+        semaphore_up(conn->pending);
+    else
+        msg = boxc_sent_remove_other(conn, os);
     octstr_destroy(os);
     if (!msg) {
         error(0, "BOXC: Got ack for nonexistend message!");
         msg_dump(m, 0);
         return;
     }
-    semaphore_up(conn->pending);
     if (orig == NULL)
         msg_destroy(msg);
     else
@@ -521,13 +598,17 @@ static void boxc_sender(void *arg)
 
         /*
          * Make sure there's no data left in the outgoing connection before
-         * doing the potentially blocking gwlist_consume()s
+         * doing the potentially blocking gwlist_consume()s. A batching
+         * connection sends on its own, block only while the box does not
+         * keep up with reading.
          */
-        conn_flush(conn->conn);
+        if (smsbox_batch_size == 0 ||
+            conn_outbuf_len(conn->conn) >= smsbox_batch_size)
+            conn_flush(conn->conn);
 
         gwlist_consume(suspended);	/* block here if suspended */
 
-        if ((msg = gwlist_consume(conn->incoming)) == NULL) {
+        if ((msg = gw_mpmcqueue_consume(conn->incoming)) == NULL) {
             /* tell sms/wapbox to die */
             msg = msg_create(admin);
             msg->admin.command = restart ? cmd_restart : cmd_shutdown;
@@ -540,11 +621,14 @@ static void boxc_sender(void *arg)
             msg_destroy(msg);
             continue;
         }
+        /* a queue below the limit may accept held back messages again */
+        if (max_incoming_sms_qlength > 0 && dispatcher_waiting)
+            boxc_dispatch_wakeup();
         boxc_sent_push(conn, msg);
         if (!conn->alive || send_msg(conn, msg) == -1) {
             /* we got message here */
             boxc_sent_pop(conn, msg, NULL);
-            gwlist_produce(conn->retry, msg);
+            gw_mpmcqueue_produce(conn->retry, msg);
             break;
         }
         msg_destroy(msg);
@@ -578,6 +662,7 @@ static Boxc *boxc_create(int fd, Octstr *ip, int ssl)
     boxc->connect_time = time(NULL);
     boxc->boxc_id = NULL;
     boxc->routable = 0;
+    boxc->binary = 0;
     return boxc;
 }
 
@@ -651,8 +736,12 @@ static void run_smsbox(void *arg)
 
     gwlist_add_producer(flow_threads);
     newconn = arg;
-    newconn->incoming = gwlist_create();
-    gwlist_add_producer(newconn->incoming);
+    if (smsbox_batch_size > 0) {
+        conn_set_output_buffering(newconn->conn, smsbox_batch_size);
+        conn_set_output_delay(newconn->conn, smsbox_batch_delay);
+    }
+    newconn->incoming = gw_mpmcqueue_create(BOXC_QUEUE_SIZE);
+    gw_mpmcqueue_add_producer(newconn->incoming);
     newconn->retry = incoming_sms;
     newconn->outgoing = outgoing_sms;
     newconn->sent = dict_create(smsbox_max_pending, NULL);
@@ -674,9 +763,9 @@ static void run_smsbox(void *arg)
     gwlist_append(smsbox_list, newconn);
     gw_rwlock_unlock(smsbox_list_rwlock);
 
-    gwlist_add_producer(newconn->outgoing);
+    gw_mpmcqueue_add_producer(newconn->outgoing);
     boxc_receiver(newconn);
-    gwlist_remove_producer(newconn->outgoing);
+    gw_mpmcqueue_remove_producer(newconn->outgoing);
 
     /* remove us from smsbox routing list */
     gw_rwlock_wrlock(smsbox_list_rwlock);
@@ -697,8 +786,8 @@ static void run_smsbox(void *arg)
      * check if we in the shutdown phase and sms dequeueing thread
      *   has removed the producer already
      */
-    if (gwlist_producer_count(newconn->incoming) > 0)
-        gwlist_remove_producer(newconn->incoming);
+    if (gw_mpmcqueue_producer_count(newconn->incoming) > 0)
+        gw_mpmcqueue_remove_producer(newconn->incoming);
 
     /* check if we are still waiting for ack's and semaphore locked */
     if (dict_key_count(newconn->sent) >= smsbox_max_pending)
@@ -710,27 +799,27 @@ static void run_smsbox(void *arg)
     keys = dict_keys(newconn->sent);
     while((key = gwlist_extract_first(keys)) != NULL) {
         msg = dict_remove(newconn->sent, key);
-        gwlist_produce(incoming_sms, msg);
+        gw_mpmcqueue_produce(incoming_sms, msg);
         octstr_destroy(key);
     }
     gw_assert(gwlist_len(keys) == 0);
     gwlist_destroy(keys, octstr_destroy_item);
 
     /* clear our send queue */
-    while((msg = gwlist_extract_first(newconn->incoming)) != NULL) {
-        gwlist_produce(incoming_sms, msg);
+    while((msg = gw_mpmcqueue_extract_first(newconn->incoming)) != NULL) {
+        gw_mpmcqueue_produce(incoming_sms, msg);
     }
 
 cleanup:
-    gw_assert(gwlist_len(newconn->incoming) == 0);
-    gwlist_destroy(newconn->incoming, NULL);
+    gw_assert(gw_mpmcqueue_len(newconn->incoming) == 0);
+    gw_mpmcqueue_destroy(newconn->incoming, NULL);
     gw_assert(dict_key_count(newconn->sent) == 0);
     dict_destroy(newconn->sent);
     semaphore_destroy(newconn->pending);
     boxc_destroy(newconn);
 
     /* wakeup the dequeueing thread */
-    gwthread_wakeup(sms_dequeue_thread);
+    boxc_dispatch_wakeup();
 
     gwlist_remove_producer(flow_threads);
 }
@@ -749,7 +838,7 @@ cleanup:
 
 
 static void wait_for_connections(int fd, void (*function) (void *arg),
-    	    	    	    	 List *waited, int ssl)
+    	    	    	    	 gw_mpmcqueue_t *waited, int ssl)
 {
     int ret;
     int timeout = 10; /* 10 sec. */
@@ -765,7 +854,7 @@ static void wait_for_connections(int fd, void (*function) (void *arg),
          *           Otherwise we wait here for ever!
          */
         if (bb_status == BB_SHUTDOWN) {
-            ret = gwlist_wait_until_nonempty(waited);
+            ret = gw_mpmcqueue_wait_until_nonempty(waited);
             if (ret == -1 || !timeout)
                 break;
             else
@@ -815,7 +904,7 @@ static void smsboxc_run(void *arg)
     gwlist_remove_producer(smsbox_list);
 
     /* continue avalanche */
-    gwlist_remove_producer(outgoing_sms);
+    gw_mpmcqueue_remove_producer(outgoing_sms);
 
     /* all connections do the same, so that all must remove() before it
      * is completely over
@@ -986,6 +1075,7 @@ static void init_smsbox_routes(Cfg *cfg, int reload)
 int smsbox_start(Cfg *cfg)
 {
     CfgGroup *grp;
+    long val;
 
     if (smsbox_running) return -1;
 
@@ -1010,6 +1100,18 @@ int smsbox_start(Cfg *cfg)
         info(0, "BOXC: 'smsbox-max-pending' not set, using default (%ld).", smsbox_max_pending);
     }
 
+    if (cfg_get_integer(&smsbox_batch_size, grp, octstr_imm("smsbox-batch-size")) == -1 ||
+        smsbox_batch_size < 0)
+        smsbox_batch_size = 0;
+    if (cfg_get_integer(&val, grp, octstr_imm("smsbox-batch-delay")) == -1)
+        val = BOXC_BATCH_DELAY;
+    if (val <= 0)
+        panic(0, "BOXC: 'smsbox-batch-delay' must be positive.");
+    smsbox_batch_delay = val / 1000.0;
+    if (smsbox_batch_size > 0)
+        info(0, "BOXC: Batching writes to smsboxes up to %ld octets or %ld ms.",
+             smsbox_batch_size, val);
+
     box_allow_ip = cfg_get(grp, octstr_imm("box-allow-ip"));
     if (box_allow_ip == NULL)
         box_allow_ip = octstr_create("");
@@ -1023,6 +1125,10 @@ int smsbox_start(Cfg *cfg)
     smsbox_list_rwlock = gw_rwlock_create();
     if (!boxid)
         boxid = counter_create();
+    if (!pending_sms)
+        pending_sms = counter_create();
+    if (!dispatch_events)
+        dispatch_events = counter_create();
 
     /* the smsbox routing specific inits */
     smsbox_by_id = dict_create(10, (void(*)(void *)) boxc_gwlist_destroy);
@@ -1034,7 +1140,7 @@ int smsbox_start(Cfg *cfg)
     /* load the defined smsbox routing rules */
     init_smsbox_routes(cfg, 0);
 
-    gwlist_add_producer(outgoing_sms);
+    gw_mpmcqueue_add_producer(outgoing_sms);
     gwlist_add_producer(smsbox_list);
 
     smsbox_running = 1;
@@ -1063,8 +1169,12 @@ int smsbox_restart(Cfg *cfg)
     octstr_destroy(smsbox_by_default);
     smsbox_by_default = NULL;
     init_smsbox_routes(cfg, 1);
+    routes_generation++;
     gw_rwlock_unlock(smsbox_list_rwlock);
 
+    /* let the dispatcher re-sort held messages by the new rules */
+    boxc_dispatch_wakeup();
+
     return 0;
 }
 
@@ -1127,7 +1237,7 @@ Octstr *boxc_status(int status_type)
                     "\t\t<ssl>%s</ssl>\n\t</box>",
                     (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : ""),
 		            octstr_get_cstr(bi->client_ip),
-		            gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+		            gw_mpmcqueue_len(bi->incoming) + dict_key_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "yes" : "no"
@@ -1144,7 +1254,7 @@ Octstr *boxc_status(int status_type)
                     (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : ""),
                     octstr_get_cstr(bi->client_ip),
                     bi->http_port,
-                    gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+                    gw_mpmcqueue_len(bi->incoming) + dict_key_count(bi->sent),
                     t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "true" : "false"
@@ -1155,7 +1265,7 @@ Octstr *boxc_status(int status_type)
             else
                 octstr_format_append(tmp, "%ssmsbox:%s, IP %s (%ld queued), (on-line %ldd %ldh %ldm %lds) %s %s",
                     ws, (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : "(none)"),
-                    octstr_get_cstr(bi->client_ip), gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+                    octstr_get_cstr(bi->client_ip), gw_mpmcqueue_len(bi->incoming) + dict_key_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "using SSL" : "",
@@ -1193,94 +1303,89 @@ void boxc_cleanup(void)
     box_deny_ip = NULL;
     counter_destroy(boxid);
     boxid = NULL;
+    counter_destroy(pending_sms);
+    pending_sms = NULL;
+    counter_destroy(dispatch_events);
+    dispatch_events = NULL;
     octstr_destroy(smsbox_interface);
     smsbox_interface = NULL;
 }
 
 
 /*
- * Route the incoming message to one of the following input queues:
- *   a specific smsbox conn
- *   a random smsbox conn if no shortcut routing and msg->sms.boxc_id match
- *
- * BEWARE: All logic inside here should be fast, hence speed processing
- * optimized, because every single MO message passes this function and we
- * have to ensure that no unnecessary overhead is done.
+ * Find the smsbox-id this message has to go to, or NULL if any smsbox
+ * will do. Caller holds smsbox_list_rwlock.
  */
-int route_incoming_to_boxc(Msg *msg)
+static Octstr *route_boxc_id(Msg *msg)
+{
+    Octstr *s, *r, *rs, *os;
+
+    /*
+     * Do we have a specific smsbox-id route to pass this msg to?
+     */
+    if (octstr_len(msg->sms.boxc_id) > 0)
+        return msg->sms.boxc_id;
+
+    /*
+     * Check if we have a "smsbox-route" for this msg.
+     * Where the shortcode route has a higher priority then the smsc-id rule.
+     * Highest priority has the combined <shortcode>:<smsc-id> route.
+     */
+    os = octstr_format("%s:%s",
+                       octstr_get_cstr(msg->sms.receiver),
+                       octstr_get_cstr(msg->sms.smsc_id));
+    s = (msg->sms.smsc_id ? dict_get(smsbox_by_smsc, msg->sms.smsc_id) : NULL);
+    r = (msg->sms.receiver ? dict_get(smsbox_by_receiver, msg->sms.receiver) : NULL);
+    rs = (os ? dict_get(smsbox_by_smsc_receiver, os) : NULL);
+    octstr_destroy(os);
+
+    if (rs)
+        return rs;
+    else if (r)
+        return r;
+    else if (s)
+        return s;
+
+    return smsbox_by_default;
+}
+
+
+/*
+ * Queue the message to an smsbox connection serving boxc_id (any smsbox
+ * without an id if NULL). Caller holds smsbox_list_rwlock.
+ * @return 1 if queued; 0 if no box is available for the route right now;
+ *         -1 if all candidate boxes are over the incoming queue limit.
+ */
+static int route_to_boxc(Msg *msg, Octstr *boxc_id, int quiet)
 {
     Boxc *bc = NULL;
-    Octstr *s, *r, *rs, *boxc_id = NULL;
+    List *boxc_id_list;
     long len, b, i;
     int full_found = 0;
 
-    gw_assert(msg_type(msg) == sms);
-
-    /* msg_dump(msg, 0); */
-
     /* Check we have at least one smsbox connected! */
-    gw_rwlock_rdlock(smsbox_list_rwlock);
     if (gwlist_len(smsbox_list) == 0) {
-        gw_rwlock_unlock(smsbox_list_rwlock);
-    	warning(0, "smsbox_list empty!");
-        if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-            gwlist_produce(incoming_sms, msg);
-            return 0;
-        } else {
-            return -1;
-        }
-    }
-
-    /*
-     * Do we have a specific smsbox-id route to pass this msg to?
-     */
-    if (octstr_len(msg->sms.boxc_id) > 0) {
-        boxc_id = msg->sms.boxc_id;
-    } else {
-        /*
-         * Check if we have a "smsbox-route" for this msg.
-         * Where the shortcode route has a higher priority then the smsc-id rule.
-         * Highest priority has the combined <shortcode>:<smsc-id> route.
-         */
-        Octstr *os = octstr_format("%s:%s",
-                                   octstr_get_cstr(msg->sms.receiver),
-                                   octstr_get_cstr(msg->sms.smsc_id));
-        s = (msg->sms.smsc_id ? dict_get(smsbox_by_smsc, msg->sms.smsc_id) : NULL);
-        r = (msg->sms.receiver ? dict_get(smsbox_by_receiver, msg->sms.receiver) : NULL);
-        rs = (os ? dict_get(smsbox_by_smsc_receiver, os) : NULL);
-        octstr_destroy(os);
-
-        if (rs)
-            boxc_id = rs;
-        else if (r)
-            boxc_id = r;
-        else if (s)
-            boxc_id = s;
-        else if (smsbox_by_default)
-            boxc_id = smsbox_by_default;
+        if (!quiet)
+            warning(0, "smsbox_list empty!");
+        return 0;
     }
 
     /* We have a specific smsbox-id to use */
     if (boxc_id != NULL) {
 
-        List *boxc_id_list = dict_get(smsbox_by_id, boxc_id);
+        boxc_id_list = dict_get(smsbox_by_id, boxc_id);
         if (gwlist_len(boxc_id_list) == 0) {
             /*
              * something is wrong, this was the smsbox connection we used
              * for sending, so it seems this smsbox is gone
              */
-            warning(0, "Could not route message to smsbox id <%s>, smsbox is gone!",
-                    octstr_get_cstr(boxc_id));
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-                gwlist_produce(incoming_sms, msg);
-                return 0;
-            } else {
-                return -1;
-            }
+            if (!quiet)
+                warning(0, "Could not route message to smsbox id <%s>, smsbox is gone!",
+                        octstr_get_cstr(boxc_id));
+            return 0;
         }
-        
-        /* 
+
+        /*
          * Take random smsbox from list, as long as it has space we will use it,
          * otherwise check the next one.
          */
@@ -1291,7 +1396,7 @@ int route_incoming_to_boxc(Msg *msg)
             bc = gwlist_get(boxc_id_list, (i+b) % len);
 
             if (bc != NULL && max_incoming_sms_qlength > 0 &&
-                    gwlist_len(bc->incoming) > max_incoming_sms_qlength) {
+                    gw_mpmcqueue_len(bc->incoming) > max_incoming_sms_qlength) {
                 bc = NULL;
             }
 
@@ -1300,26 +1405,16 @@ int route_incoming_to_boxc(Msg *msg)
             }
         }
 
-        if (bc != NULL) {
-            bc->load++;
-            gwlist_produce(bc->incoming, msg);
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            return 1; /* we are done */
-        }
-        else {
-            /*
-             * we have routing defined, but no smsbox connected at the moment.
-             * put msg into global incoming queue and wait until smsbox with
-             * such boxc_id connected.
-             */
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-                gwlist_produce(incoming_sms, msg);
-                return 0;
-            } else {
-                return -1;
-            }
-        }
+        /*
+         * we have routing defined, but no smsbox with room connected at the
+         * moment, wait until smsbox with such boxc_id is ready.
+         */
+        if (bc == NULL)
+            return 0;
+
+        bc->load++;
+        gw_mpmcqueue_produce(bc->incoming, msg);
+        return 1; /* we are done */
     }
 
     /*
@@ -1338,7 +1433,7 @@ int route_incoming_to_boxc(Msg *msg)
             bc = NULL;
 
         if (bc != NULL && max_incoming_sms_qlength > 0 &&
-            gwlist_len(bc->incoming) > max_incoming_sms_qlength) {
+            gw_mpmcqueue_len(bc->incoming) > max_incoming_sms_qlength) {
             full_found = 1;
             bc = NULL;
         }
@@ -1350,88 +1445,264 @@ int route_incoming_to_boxc(Msg *msg)
 
     if (bc != NULL) {
         bc->load++;
-        gwlist_produce(bc->incoming, msg);
+        gw_mpmcqueue_produce(bc->incoming, msg);
+        return 1;
     }
 
-    gw_rwlock_unlock(smsbox_list_rwlock);
+    if (full_found)
+        return -1;
 
-    if (bc == NULL && full_found == 0) {
+    if (!quiet)
         warning(0, "smsbox_list empty!");
-        if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-            gwlist_produce(incoming_sms, msg);
-               return 0;
-         } else {
-             return -1;
-         }
-    } else if (bc == NULL && full_found == 1) {
-        return -1;
+    return 0;
+}
+
+
+long boxc_incoming_queued(void)
+{
+    return gw_mpmcqueue_len(incoming_sms) + (pending_sms ? counter_value(pending_sms) : 0);
+}
+
+
+/*
+ * Route the incoming message to one of the following input queues:
+ *   a specific smsbox conn
+ *   a random smsbox conn if no shortcut routing and msg->sms.boxc_id match
+ * If no box is available it goes to the global incoming queue, from where
+ * the dispatcher hands it over as soon as a matching box is ready.
+ *
+ * BEWARE: All logic inside here should be fast, hence speed processing
+ * optimized, because every single MO message passes this function and we
+ * have to ensure that no unnecessary overhead is done.
+ */
+int route_incoming_to_boxc(Msg *msg)
+{
+    int ret;
+
+    gw_assert(msg_type(msg) == sms);
+
+    /* msg_dump(msg, 0); */
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    ret = route_to_boxc(msg, route_boxc_id(msg), 0);
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    if (ret != 0)
+        return ret;
+
+    if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > boxc_incoming_queued()) {
+        gw_mpmcqueue_produce(incoming_sms, msg);
+        boxc_dispatch_wakeup();
+        return 0;
     }
 
-    return 1;
+    return -1;
+}
+
+
+/*
+ * Tell the dispatcher something changed that may let held back messages
+ * through: a box connected or identified, acked, or new messages arrived.
+ */
+static void boxc_dispatch_wakeup(void)
+{
+    if (dispatch_events == NULL)
+        return;
+
+    counter_increase(dispatch_events);
+    if (dispatcher_waiting)
+        gwthread_wakeup(sms_dequeue_thread);
+}
+
+
+static BoxcRoute *boxc_route_create(Octstr *boxc_id)
+{
+    BoxcRoute *route;
+
+    route = gw_malloc(sizeof(*route));
+    route->boxc_id = octstr_duplicate(boxc_id);
+    route->msgs = gwlist_create();
+
+    return route;
+}
+
+
+static void boxc_route_destroy(BoxcRoute *route)
+{
+    if (route == NULL)
+        return;
+
+    octstr_destroy(route->boxc_id);
+    gwlist_destroy(route->msgs, NULL);
+    gw_free(route);
+}
+
+
+/* hold msg back in the queue of its route */
+static void pending_add(Msg *msg)
+{
+    BoxcRoute *route;
+    Octstr *boxc_id;
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    boxc_id = route_boxc_id(msg);
+    if (boxc_id == NULL) {
+        route = pending_any;
+    } else if ((route = dict_get(pending_by_id, boxc_id)) == NULL) {
+        route = boxc_route_create(boxc_id);
+        dict_put(pending_by_id, boxc_id, route);
+        gwlist_append(pending_routes, route);
+    }
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    gwlist_append(route->msgs, msg);
+    counter_increase(pending_sms);
+}
+
+
+/*
+ * Hand held back messages over to the boxes, in order per route. A route
+ * stops at its first message no box can take, the rest would fail too.
+ */
+static void pending_flush(void)
+{
+    BoxcRoute *route;
+    Msg *msg;
+    long l;
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    for (l = 0; l < gwlist_len(pending_routes); l++) {
+        route = gwlist_get(pending_routes, l);
+        while (gwlist_len(route->msgs) > 0) {
+            msg = gwlist_get(route->msgs, 0);
+            if (route_to_boxc(msg, route->boxc_id, 1) != 1)
+                break;
+            gwlist_delete(route->msgs, 0, 1);
+            counter_decrease(pending_sms);
+        }
+    }
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    /* forget drained smsbox-id routes */
+    for (l = gwlist_len(pending_routes) - 1; l >= 0; l--) {
+        route = gwlist_get(pending_routes, l);
+        if (route == pending_any || gwlist_len(route->msgs) > 0)
+            continue;
+        dict_remove(pending_by_id, route->boxc_id);
+        gwlist_delete(pending_routes, l, 1);
+        boxc_route_destroy(route);
+    }
+}
+
+
+/* take all held back messages out again, oldest route first */
+static List *pending_extract_all(void)
+{
+    List *msgs = gwlist_create();
+    BoxcRoute *route;
+    Msg *msg;
+
+    while ((route = gwlist_extract_first(pending_routes)) != NULL) {
+        while ((msg = gwlist_extract_first(route->msgs)) != NULL) {
+            gwlist_append(msgs, msg);
+            counter_decrease(pending_sms);
+        }
+        if (route != pending_any) {
+            dict_remove(pending_by_id, route->boxc_id);
+            boxc_route_destroy(route);
+        }
+    }
+    gwlist_append(pending_routes, pending_any);
+
+    return msgs;
 }
 
 
 static void sms_to_smsboxes(void *arg)
 {
-    Msg *newmsg, *startmsg, *msg;
-    long i, len;
-    int ret = -1;
+    Msg *msg;
+    List *msgs;
+    long i, len, generation;
+    unsigned long events;
     Boxc *boxc;
 
     gwlist_add_producer(flow_threads);
 
-    newmsg = startmsg = msg = NULL;
+    pending_by_id = dict_create(10, NULL);
+    pending_any = boxc_route_create(NULL);
+    pending_routes = gwlist_create();
+    gwlist_append(pending_routes, pending_any);
+    generation = routes_generation;
 
     while (bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
-        if (newmsg == startmsg) {
-            /* check if we are in shutdown phase */
-            if (gwlist_producer_count(smsbox_list) == 0)
-                break;
-
-            if (ret == 0 || ret == -1) {
-                /* debug("", 0, "time to sleep"); */
-                gwthread_sleep(60.0);
-                /* debug("", 0, "wake up list len %ld", gwlist_len(incoming_sms)); */
-                /* shutdown ? */
-                if (gwlist_producer_count(smsbox_list) == 0 && gwlist_len(smsbox_list) == 0)
+        if (counter_value(pending_sms) == 0) {
+            /* nothing held back, block until a message has no box */
+            if ((msg = gw_mpmcqueue_consume(incoming_sms)) == NULL) {
+                /* SMSCs not started yet or gone, check if we are going down */
+                if (gwlist_producer_count(smsbox_list) == 0)
                     break;
+                dispatcher_waiting = 1;
+                gwthread_sleep(BOXC_DISPATCH_RECHECK);
+                dispatcher_waiting = 0;
+                continue;
             }
-            startmsg = msg = gwlist_consume(incoming_sms);
-            /* debug("", 0, "gwlist_consume done 1"); */
-            newmsg = NULL;
+            gw_assert(msg_type(msg) == sms);
+            pending_add(msg);
         }
-        else {
-            newmsg = msg = gwlist_consume(incoming_sms);
 
-            /* Back at the first message? */
-            if (newmsg == startmsg) {
-                gwlist_insert(incoming_sms, 0, msg);
-                continue;
-            }
+        events = counter_value(dispatch_events);
+
+        while ((msg = gw_mpmcqueue_extract_first(incoming_sms)) != NULL) {
+            gw_assert(msg_type(msg) == sms);
+            pending_add(msg);
         }
 
-        if (msg == NULL)
-            break;
+        /* smsbox-route rules were reloaded, sort messages again */
+        if (generation != routes_generation) {
+            generation = routes_generation;
+            msgs = pending_extract_all();
+            while ((msg = gwlist_extract_first(msgs)) != NULL)
+                pending_add(msg);
+            gwlist_destroy(msgs, NULL);
+        }
 
-        gw_assert(msg_type(msg) == sms);
+        pending_flush();
 
-        /* debug("bb.sms", 0, "sms_boxc_router: handling message (%p vs %p)",
-	          msg, startmsg); */
+        if (counter_value(pending_sms) == 0)
+            continue;
 
-        ret = route_incoming_to_boxc(msg);
-        if (ret == 1)
-            startmsg = newmsg = NULL;
-        else if (ret == -1) {
-            gwlist_produce(incoming_sms, msg);
-        }
+        /* check if we are in shutdown phase */
+        if (gwlist_producer_count(smsbox_list) == 0)
+            break;
+
+        /*
+         * Wait for a box to connect, ack or drain its queue. Anything that
+         * happened since we looked makes us go round again at once.
+         */
+        dispatcher_waiting = 1;
+        if (counter_value(dispatch_events) == events && gw_mpmcqueue_len(incoming_sms) == 0)
+            gwthread_sleep(BOXC_DISPATCH_RECHECK);
+        dispatcher_waiting = 0;
     }
 
+    /* give back what we still hold, so it is not lost from the queue */
+    msgs = pending_extract_all();
+    while ((msg = gwlist_extract_first(msgs)) != NULL)
+        gw_mpmcqueue_produce(incoming_sms, msg);
+    gwlist_destroy(msgs, NULL);
+    gwlist_destroy(pending_routes, NULL);
+    boxc_route_destroy(pending_any);
+    dict_destroy(pending_by_id);
+    pending_routes = NULL;
+    pending_any = NULL;
+    pending_by_id = NULL;
+
     gw_rwlock_rdlock(smsbox_list_rwlock);
     len = gwlist_len(smsbox_list);
     for (i=0; i < len; i++) {
         boxc = gwlist_get(smsbox_list, i);
-        gwlist_remove_producer(boxc->incoming);
+        gw_mpmcqueue_remove_producer(boxc->incoming);
     }
     gw_rwlock_unlock(smsbox_list_rwlock);
 
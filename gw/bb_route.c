@@ -0,0 +1,556 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * bb_route.c - compiled routing table for outgoing messages
+ *
+ * See bb_route.h for the overall idea. The prefix lists are kept in a
+ * character trie, each node has one bit mask per directive, where a set
+ * bit says that the prefix ending at this node is configured for the
+ * connection with that index. Walking the trie along the receiver number
+ * and or-ing the masks of all visited nodes gives the same result as
+ * calling does_prefix_match() on every connection.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-regex.h"
+#include "sms.h"
+#include "smscconn.h"
+#include "smscconn_p.h"
+#include "bb_route.h"
+
+typedef struct RouteNode RouteNode;
+struct RouteNode {
+    unsigned char c;
+    RouteNode *child;       /* first child */
+    RouteNode *sibling;     /* next child of our parent */
+    RouteMask *allowed;     /* NULL as long as no prefix ends here */
+    RouteMask *denied;
+    RouteMask *preferred;
+};
+
+/* value for the smsc-id dictionary */
+typedef struct {
+    RouteMask *allowed;
+    RouteMask *denied;
+    RouteMask *preferred;
+} RouteIds;
+
+struct RouteTable {
+    long len;
+    long words;
+    SMSCConn **conns;
+    RouteNode *root;
+    Dict *ids;
+    /* connections having the corresponding directive set at all */
+    RouteMask *has_allowed_id;
+    RouteMask *has_denied_id;
+    RouteMask *has_allowed_prefix;
+    RouteMask *has_denied_prefix;
+    /* connections that have to be checked by smscconn_usable() */
+    RouteMask *regex;
+};
+
+typedef struct {
+    RouteMask *usable;
+    List *msgs;
+} RouteGroup;
+
+struct RouteGroups {
+    Mutex *lock;
+    Dict *groups;           /* RouteGroup by the bytes of its mask */
+    volatile long len;      /* parked messages in all groups */
+};
+
+
+static RouteMask *mask_create(long words)
+{
+    RouteMask *mask;
+
+    mask = gw_malloc(sizeof(*mask) * words);
+    memset(mask, 0, sizeof(*mask) * words);
+
+    return mask;
+}
+
+static void mask_set(RouteMask *mask, long i)
+{
+    mask[i / ROUTE_MASK_BITS] |= 1UL << (i % ROUTE_MASK_BITS);
+}
+
+static void mask_or(RouteMask *dst, const RouteMask *src, long words)
+{
+    long i;
+
+    if (src == NULL)
+        return;
+    for (i = 0; i < words; i++)
+        dst[i] |= src[i];
+}
+
+
+static RouteNode *node_create(unsigned char c)
+{
+    RouteNode *node;
+
+    node = gw_malloc(sizeof(*node));
+    memset(node, 0, sizeof(*node));
+    node->c = c;
+
+    return node;
+}
+
+static void node_destroy(RouteNode *node)
+{
+    RouteNode *next;
+
+    while (node != NULL) {
+        node_destroy(node->child);
+        next = node->sibling;
+        gw_free(node->allowed);
+        gw_free(node->denied);
+        gw_free(node->preferred);
+        gw_free(node);
+        node = next;
+    }
+}
+
+static RouteNode *node_child(RouteNode *node, unsigned char c, int create)
+{
+    RouteNode *child;
+
+    for (child = node->child; child != NULL; child = child->sibling) {
+        if (child->c == c)
+            return child;
+    }
+    if (!create)
+        return NULL;
+
+    child = node_create(c);
+    child->sibling = node->child;
+    node->child = child;
+
+    return child;
+}
+
+/*
+ * Add all prefixes of a ';' separated list to the trie. This follows
+ * does_prefix_match(): empty entries are skipped, except a leading one,
+ * which matches any number.
+ */
+static void add_prefixes(RouteTable *table, Octstr *prefixes, long index,
+                         size_t which)
+{
+    RouteNode *node;
+    RouteMask **mask;
+    long i, len;
+    int start;
+
+    if (prefixes == NULL)
+        return;
+
+    len = octstr_len(prefixes);
+    for (i = 0, start = 1; i < len; start = 0) {
+        if (!start && octstr_get_char(prefixes, i) == ';') {
+            i++;
+            continue;
+        }
+        node = table->root;
+        for (; i < len && octstr_get_char(prefixes, i) != ';'; i++)
+            node = node_child(node, octstr_get_char(prefixes, i), 1);
+
+        mask = (RouteMask **) ((char *) node + which);
+        if (*mask == NULL)
+            *mask = mask_create(table->words);
+        mask_set(*mask, index);
+    }
+}
+
+static RouteIds *ids_get(RouteTable *table, Octstr *id)
+{
+    RouteIds *ids;
+
+    if ((ids = dict_get(table->ids, id)) == NULL) {
+        ids = gw_malloc(sizeof(*ids));
+        ids->allowed = mask_create(table->words);
+        ids->denied = mask_create(table->words);
+        ids->preferred = mask_create(table->words);
+        dict_put(table->ids, id, ids);
+    }
+
+    return ids;
+}
+
+static void ids_destroy(void *p)
+{
+    RouteIds *ids = p;
+
+    if (ids == NULL)
+        return;
+    gw_free(ids->allowed);
+    gw_free(ids->denied);
+    gw_free(ids->preferred);
+    gw_free(ids);
+}
+
+static void add_ids(RouteTable *table, List *list, long index, size_t which)
+{
+    RouteIds *ids;
+    long i;
+
+    for (i = 0; i < gwlist_len(list); i++) {
+        ids = ids_get(table, gwlist_get(list, i));
+        mask_set(*(RouteMask **) ((char *) ids + which), index);
+    }
+}
+
+
+RouteTable *route_table_create(List *smsc_list)
+{
+    RouteTable *table;
+    SMSCConn *conn;
+    long i;
+
+    table = gw_malloc(sizeof(*table));
+    table->len = gwlist_len(smsc_list);
+    table->words = ROUTE_MASK_WORDS(table->len > 0 ? table->len : 1);
+    table->conns = gw_malloc(sizeof(table->conns[0]) * (table->len > 0 ? table->len : 1));
+    table->root = node_create('\0');
+    table->ids = dict_create(64, ids_destroy);
+    table->has_allowed_id = mask_create(table->words);
+    table->has_denied_id = mask_create(table->words);
+    table->has_allowed_prefix = mask_create(table->words);
+    table->has_denied_prefix = mask_create(table->words);
+    table->regex = mask_create(table->words);
+
+    for (i = 0; i < table->len; i++) {
+        conn = gwlist_get(smsc_list, i);
+        table->conns[i] = conn;
+
+        if (conn->allowed_smsc_id_regex || conn->denied_smsc_id_regex ||
+                conn->allowed_prefix_regex || conn->denied_prefix_regex ||
+                conn->preferred_prefix_regex) {
+            mask_set(table->regex, i);
+            continue;
+        }
+
+        if (conn->allowed_smsc_id)
+            mask_set(table->has_allowed_id, i);
+        if (conn->denied_smsc_id)
+            mask_set(table->has_denied_id, i);
+        if (conn->allowed_prefix)
+            mask_set(table->has_allowed_prefix, i);
+        if (conn->denied_prefix)
+            mask_set(table->has_denied_prefix, i);
+
+        add_ids(table, conn->allowed_smsc_id, i, offsetof(RouteIds, allowed));
+        add_ids(table, conn->denied_smsc_id, i, offsetof(RouteIds, denied));
+        add_ids(table, conn->preferred_smsc_id, i, offsetof(RouteIds, preferred));
+        add_prefixes(table, conn->allowed_prefix, i, offsetof(RouteNode, allowed));
+        add_prefixes(table, conn->denied_prefix, i, offsetof(RouteNode, denied));
+        add_prefixes(table, conn->preferred_prefix, i, offsetof(RouteNode, preferred));
+    }
+
+    debug("bb.sms", 0, "Routing table compiled for %ld SMSC connections.", table->len);
+
+    return table;
+}
+
+
+void route_table_destroy(RouteTable *table)
+{
+    if (table == NULL)
+        return;
+
+    node_destroy(table->root);
+    dict_destroy(table->ids);
+    gw_free(table->has_allowed_id);
+    gw_free(table->has_denied_id);
+    gw_free(table->has_allowed_prefix);
+    gw_free(table->has_denied_prefix);
+    gw_free(table->regex);
+    gw_free(table->conns);
+    gw_free(table);
+}
+
+
+long route_table_len(RouteTable *table)
+{
+    return table ? table->len : 0;
+}
+
+
+void route_table_match(RouteTable *table, Msg *msg, RouteMask *usable,
+                       RouteMask *preferred)
+{
+    RouteMask *allowed_hit, *denied_hit, *preferred_hit;
+    RouteMask aid, did, pid, a, d, u;
+    RouteIds *ids = NULL;
+    RouteNode *node;
+    long i, len;
+    int ret;
+
+    gw_assert(table != NULL);
+    gw_assert(msg != NULL && msg_type(msg) == sms);
+
+    allowed_hit = mask_create(table->words * 3);
+    denied_hit = allowed_hit + table->words;
+    preferred_hit = denied_hit + table->words;
+
+    /* collect all prefixes that match the receiver */
+    node = table->root;
+    len = octstr_len(msg->sms.receiver);
+    for (i = 0; node != NULL; i++) {
+        mask_or(allowed_hit, node->allowed, table->words);
+        mask_or(denied_hit, node->denied, table->words);
+        mask_or(preferred_hit, node->preferred, table->words);
+        if (i >= len)
+            break;
+        node = node_child(node, octstr_get_char(msg->sms.receiver, i), 0);
+    }
+
+    if (msg->sms.smsc_id != NULL)
+        ids = dict_get(table->ids, msg->sms.smsc_id);
+
+    for (i = 0; i < table->words; i++) {
+        aid = ids ? ids->allowed[i] : 0;
+        did = ids ? ids->denied[i] : 0;
+        pid = ids ? ids->preferred[i] : 0;
+        a = table->has_allowed_prefix[i];
+        d = table->has_denied_prefix[i];
+
+        u = ~table->regex[i];
+        if (i == table->words - 1 && table->len % ROUTE_MASK_BITS)
+            u &= (1UL << (table->len % ROUTE_MASK_BITS)) - 1;
+
+        /* allowed-smsc-id, or denied-smsc-id if no allowed-smsc-id */
+        u &= ~(table->has_allowed_id[i] & ~aid);
+        u &= ~(table->has_denied_id[i] & ~table->has_allowed_id[i] & did);
+
+        /* allowed-prefix and denied-prefix */
+        u &= ~(a & ~d & ~allowed_hit[i]);
+        u &= ~(d & ~a & denied_hit[i]);
+        u &= ~(a & d & ~allowed_hit[i] & denied_hit[i]);
+
+        usable[i] = u;
+        preferred[i] = u & (pid | preferred_hit[i]);
+    }
+    gw_free(allowed_hit);
+
+    /* regex based connections are evaluated the old way */
+    for (i = 0; i < table->len; i++) {
+        if (!ROUTE_MASK_ISSET(table->regex, i))
+            continue;
+        if ((ret = smscconn_usable(table->conns[i], msg)) == -1)
+            continue;
+        mask_set(usable, i);
+        if (ret == 1)
+            mask_set(preferred, i);
+    }
+}
+
+
+
+void route_list_match(List *conns, Msg *msg, RouteMask *usable,
+                      RouteMask *preferred)
+{
+    long i, len, words;
+    int ret;
+
+    len = gwlist_len(conns);
+    words = ROUTE_MASK_WORDS(len);
+    memset(usable, 0, sizeof(*usable) * words);
+    memset(preferred, 0, sizeof(*preferred) * words);
+    for (i = 0; i < len; i++) {
+        if ((ret = smscconn_usable(gwlist_get(conns, i), msg)) == -1)
+            continue;
+        mask_set(usable, i);
+        if (ret == 1)
+            mask_set(preferred, i);
+    }
+}
+
+static void group_destroy(void *p)
+{
+    RouteGroup *group = p;
+
+    gwlist_destroy(group->msgs, msg_destroy_item);
+    gw_free(group->usable);
+    gw_free(group);
+}
+
+
+static int msg_is_expired(void *item, void *pattern)
+{
+    Msg *msg = item;
+
+    return msg->sms.validity != SMS_PARAM_UNDEFINED &&
+           *(time_t *) pattern > msg->sms.validity;
+}
+
+
+RouteGroups *route_groups_create(void)
+{
+    RouteGroups *groups;
+
+    groups = gw_malloc(sizeof(*groups));
+    groups->lock = mutex_create();
+    groups->groups = dict_create(64, group_destroy);
+    groups->len = 0;
+
+    return groups;
+}
+
+
+void route_groups_destroy(RouteGroups *groups)
+{
+    if (groups == NULL)
+        return;
+    dict_destroy(groups->groups);
+    mutex_destroy(groups->lock);
+    gw_free(groups);
+}
+
+
+void route_groups_park(RouteGroups *groups, Msg *msg, RouteMask *usable,
+                       long words)
+{
+    RouteGroup *group;
+    Octstr *key;
+
+    key = octstr_create_from_data((char *) usable, words * sizeof(*usable));
+    mutex_lock(groups->lock);
+    if ((group = dict_get(groups->groups, key)) == NULL) {
+        group = gw_malloc(sizeof(*group));
+        group->usable = gw_malloc(words * sizeof(*usable));
+        memcpy(group->usable, usable, words * sizeof(*usable));
+        group->msgs = gwlist_create();
+        dict_put_nocopy(groups->groups, key, group);
+        key = NULL;
+    }
+    gwlist_append(group->msgs, msg);
+    groups->len++;
+    mutex_unlock(groups->lock);
+    octstr_destroy(key);
+}
+
+
+void route_groups_take(RouteGroups *groups, List *ready, long len,
+                       int (*active)(long index, void *data), void *data,
+                       time_t now)
+{
+    RouteGroup *group;
+    List *keys, *expired;
+    Octstr *key;
+    Msg *msg;
+    long i, taken;
+
+    taken = gwlist_len(ready);
+    mutex_lock(groups->lock);
+    keys = dict_keys(groups->groups);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        group = dict_get(groups->groups, key);
+        for (i = 0; i < len; i++) {
+            if (ROUTE_MASK_ISSET(group->usable, i) && active(i, data))
+                break;
+        }
+        if (i < len) {
+            dict_remove(groups->groups, key);
+            while ((msg = gwlist_extract_first(group->msgs)) != NULL)
+                gwlist_append(ready, msg);
+            group_destroy(group);
+        } else if ((expired = gwlist_extract_matching(group->msgs, &now, msg_is_expired)) != NULL) {
+            while ((msg = gwlist_extract_first(expired)) != NULL)
+                gwlist_append(ready, msg);
+            gwlist_destroy(expired, NULL);
+        }
+        octstr_destroy(key);
+    }
+    groups->len -= gwlist_len(ready) - taken;
+    mutex_unlock(groups->lock);
+    gwlist_destroy(keys, NULL);
+}
+
+
+void route_groups_flush(RouteGroups *groups, List *msgs)
+{
+    RouteGroup *group;
+    List *keys;
+    Octstr *key;
+    Msg *msg;
+
+    mutex_lock(groups->lock);
+    keys = dict_keys(groups->groups);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        group = dict_remove(groups->groups, key);
+        while ((msg = gwlist_extract_first(group->msgs)) != NULL)
+            gwlist_append(msgs, msg);
+        group_destroy(group);
+        octstr_destroy(key);
+    }
+    groups->len = 0;
+    mutex_unlock(groups->lock);
+    gwlist_destroy(keys, NULL);
+}
+
+
+long route_groups_len(RouteGroups *groups)
+{
+    return groups->len;
+}
@@ -0,0 +1,156 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * bb_route.h - compiled routing table for outgoing messages
+ *
+ * The routing table is built from the list of SMSC connections whenever
+ * that list changes. It compiles the static routing directives of all
+ * connections (allowed-/denied-/preferred-prefix and -smsc-id) into one
+ * character trie and one smsc-id dictionary, so that the set of candidate
+ * connections for a message is found with a single walk over its receiver
+ * number, instead of evaluating every connection on its own.
+ *
+ * Connections using any of the *-regex routing directives are still
+ * evaluated with smscconn_usable().
+ */
+
+#ifndef BB_ROUTE_H
+#define BB_ROUTE_H
+
+#include "gwlib/gwlib.h"
+#include "msg.h"
+
+typedef struct RouteTable RouteTable;
+
+/*
+ * Bit masks over the connection indexes of the table, i.e. the position
+ * of the connection inside the list the table has been created from.
+ */
+typedef unsigned long RouteMask;
+
+#define ROUTE_MASK_BITS (sizeof(RouteMask) * 8)
+#define ROUTE_MASK_WORDS(n) (((n) + ROUTE_MASK_BITS - 1) / ROUTE_MASK_BITS)
+#define ROUTE_MASK_ISSET(mask, i) \
+    (((mask)[(i) / ROUTE_MASK_BITS] >> ((i) % ROUTE_MASK_BITS)) & 1UL)
+
+/*
+ * Compile the routing table for the SMSCConns in smsc_list. The caller
+ * has to make sure the list is not modified while doing so, and that
+ * the table is rebuilt (or destroyed) before any of the connections
+ * is destroyed.
+ */
+RouteTable *route_table_create(List *smsc_list);
+
+void route_table_destroy(RouteTable *table);
+
+/* Number of connections covered by the table. */
+long route_table_len(RouteTable *table);
+
+/*
+ * Compute the routing masks for msg. Both masks have to be arrays of
+ * ROUTE_MASK_WORDS(route_table_len(table)) elements. A set bit in
+ * `usable' means that smscconn_usable() would not have returned -1 for
+ * this connection because of its routing configuration, a set bit in
+ * `preferred' that it would have returned 1. The current connection
+ * status is not taken into account, except for connections routed by
+ * regex.
+ */
+void route_table_match(RouteTable *table, Msg *msg, RouteMask *usable,
+                       RouteMask *preferred);
+
+/*
+ * The same as route_table_match() for the connections in list `conns',
+ * without a table, by calling smscconn_usable() for each of them.
+ */
+void route_list_match(List *conns, Msg *msg, RouteMask *usable,
+                      RouteMask *preferred);
+
+/*
+ * Queues of messages per route group, i.e. per set of candidate
+ * connections as given by the `usable' mask of route_table_match(), for
+ * messages that found none of their candidates active. The masks refer
+ * to the positions in the list the table has been created from, so all
+ * groups have to be flushed whenever the table is rebuilt.
+ */
+typedef struct RouteGroups RouteGroups;
+
+RouteGroups *route_groups_create(void);
+
+/* Destroy the groups and any message still parked in them. */
+void route_groups_destroy(RouteGroups *groups);
+
+/* Park msg in the group of the `words' elements long mask usable. */
+void route_groups_park(RouteGroups *groups, Msg *msg, RouteMask *usable,
+                       long words);
+
+/*
+ * Append to `ready' the messages of all groups that have a connection
+ * for which active() returns true, and the messages of the other groups
+ * that have expired at time `now'. `len' is the number of connections
+ * the masks cover.
+ */
+void route_groups_take(RouteGroups *groups, List *ready, long len,
+                       int (*active)(long index, void *data), void *data,
+                       time_t now);
+
+/* Append the messages of all groups to msgs, and forget the groups. */
+void route_groups_flush(RouteGroups *groups, List *msgs);
+
+/* Number of messages parked in all groups. */
+long route_groups_len(RouteGroups *groups);
+
+#endif
@@ -84,10 +84,11 @@
 #include "msg.h"
 #include "sms.h"
 #include "bearerbox.h"
-#include "numhash.h"
+#include "numfilter.h"
 #include "smscconn.h"
 #include "dlr.h"
 #include "load.h"
+#include "bb_route.h"
 
 #include "bb_smscconn_cb.h"    /* callback functions for connections */
 #include "smscconn_p.h"        /* to access counters */
@@ -97,8 +98,8 @@
 /* passed from bearerbox core */
 
 extern volatile sig_atomic_t bb_status;
-extern List *incoming_sms;
-extern List *outgoing_sms;
+extern gw_mpmcqueue_t *incoming_sms;
+extern gw_mpmcqueue_t *outgoing_sms;
 
 extern Counter *incoming_sms_counter;
 extern Counter *outgoing_sms_counter;
@@ -127,30 +128,77 @@ extern Octstr *cfg_filename;
 static volatile sig_atomic_t smsc_running;
 static List *smsc_list;
 static RWLock smsc_list_lock;
+/* NULL while it is rebuilt, swapped in without the write lock */
+static RouteTable *smsc_routes;
+
+/* smsc2_rout() keeps the routing masks on the stack up to this many
+ * connections, and allocates them beyond */
+#define SMSC2_ROUT_STACK_CONNS 1024
 static Cfg *cfg_reloaded;
 static List *smsc_groups;
 static Octstr *unified_prefix;
 
+/*
+ * All white/black-lists of the core group are compiled into one filter,
+ * with one list per directive, in the order they are checked. The odd
+ * ones are regex lists, the second pair of each four are black-lists.
+ */
+static struct {
+    char *directive;    /* configuration directive */
+    char *name;         /* list name for the log */
+    char *reason;       /* failure reason for rejected MT */
+    char *alog;         /* access log text for rejected MO */
+} white_black_lists[] = {
+    { "white-list-sender", "white-list-sender", "sender not in white-list", "not white-listed SMS" },
+    { "white-list-sender-regex", "white-list-sender", "sender not in white-list", "not white-regex-listed SMS" },
+    { "black-list-sender", "black-list-sender", "sender in black-list", "black-listed SMS" },
+    { "black-list-sender-regex", "black-list-sender", "sender in black-list", "black-regex-listed SMS" },
+    { "white-list-receiver", "white-list-receiver", "receiver not in white-list", "not white-listed SMS" },
+    { "white-list-receiver-regex", "white-list-receiver", "receiver not in white-list", "not white-regex-listed SMS" },
+    { "black-list-receiver", "black-list-receiver", "receiver in black-list", "black-listed SMS" },
+    { "black-list-receiver-regex", "black-list-receiver", "receiver in black-list", "black-regex-listed SMS" },
+};
+
+#define WHITE_BLACK_LISTS 8
+#define SENDER_LISTS 0x0fUL
+#define RECEIVER_LISTS 0xf0UL
+#define IS_WHITE_LIST(i) (((i) & 2) == 0)
+
 static RWLock white_black_list_lock;
-static Octstr *black_list_sender_url;
-static Octstr *white_list_sender_url;
-static Octstr *black_list_receiver_url;
-static Octstr *white_list_receiver_url;
-static Numhash *black_list_sender;
-static Numhash *white_list_sender;
-static Numhash *black_list_receiver;
-static Numhash *white_list_receiver;
-
-static regex_t *white_list_sender_regex;
-static regex_t *black_list_sender_regex;
-static regex_t *white_list_receiver_regex;
-static regex_t *black_list_receiver_regex;
+static Octstr *white_black_list_cfg[WHITE_BLACK_LISTS]; /* URL or regex */
+static NumberFilter *white_black_list;
 
 static long router_thread = -1;
 
+/*
+ * Messages for which all candidate connections are down are not put back
+ * into outgoing_sms, where they would keep the router cycling and sleeping
+ * in front of the traffic for healthy connections. They are parked in one
+ * queue per route group instead, i.e. per set of candidate connections,
+ * and handed back to routing by the dispatcher thread as soon as any
+ * connection of the group is active again. The sets are masks over the
+ * positions in smsc_list, so all groups go back into outgoing_sms
+ * whenever the routing table is rebuilt.
+ */
+static RouteGroups *route_groups;
+static long route_groups_thread = -1;
+
 /* message resend */
 static long sms_resend_frequency;
 static long sms_resend_retry;
+static long sms_resend_backoff;
+static long sms_resend_max_frequency;
+
+/*
+ * Messages waiting to be resent are held in a timing wheel until they
+ * are due, instead of circling through outgoing_sms.
+ */
+static gw_timerwheel_t *resend_wheel;
+static long resend_thread = -1;
+
+/* first delay and cap, in ms, for messages that found all queues full */
+#define QFULL_RESEND_DELAY 10
+#define QFULL_RESEND_MAX_DELAY 1000
 
 /*
  * Counter for catenated SMS messages. The counter that can be put into
@@ -176,6 +224,58 @@ static void concat_handling_cleanup(void);
 static int concat_handling_check_and_handle(Msg **msg, Octstr *smscid);
 static void concat_handling_clear_old_parts(int force);
 
+
+/*
+ * Compile the configured white/black-lists into a new filter. Return
+ * NULL if one of the number lists could not be loaded.
+ */
+static NumberFilter *white_black_list_create(void)
+{
+    NumberFilter *filter;
+    regex_t *regex;
+    int i, type;
+
+    filter = number_filter_create();
+    for (i = 0; i < WHITE_BLACK_LISTS; i++) {
+        if (white_black_list_cfg[i] == NULL)
+            continue;
+        type = IS_WHITE_LIST(i) ? NUMFILTER_WHITE : NUMFILTER_BLACK;
+        if (i & 1) {
+            if ((regex = gw_regex_comp(white_black_list_cfg[i], REG_EXTENDED)) == NULL)
+                panic(0, "Could not compile pattern '%s'",
+                      octstr_get_cstr(white_black_list_cfg[i]));
+            number_filter_add_regex(filter, i, type, regex);
+        } else if (number_filter_add_url(filter, i, type, white_black_list_cfg[i]) == -1) {
+            error(0, "Could not get %s at URL <%s>", white_black_lists[i].directive,
+                  octstr_get_cstr(white_black_list_cfg[i]));
+            number_filter_destroy(filter);
+            return NULL;
+        }
+    }
+    number_filter_compile(filter);
+    return filter;
+}
+
+
+/*
+ * Return the first white/black-list that rejects the sender or receiver
+ * of msg, or -1 if it passes all of them.
+ */
+static int white_black_list_check(Msg *msg)
+{
+    unsigned long rejected = 0;
+
+    gw_rwlock_rdlock(&white_black_list_lock);
+    if (white_black_list != NULL) {
+        rejected = number_filter_check(white_black_list, msg->sms.sender, SENDER_LISTS);
+        if (rejected == 0)
+            rejected = number_filter_check(white_black_list, msg->sms.receiver, RECEIVER_LISTS);
+    }
+    gw_rwlock_unlock(&white_black_list_lock);
+
+    return rejected != 0 ? number_filter_first(rejected) : -1;
+}
+
 /*---------------------------------------------------------------------------
  * CALLBACK FUNCTIONS
  *
@@ -185,7 +285,7 @@ static void concat_handling_clear_old_parts(int force);
 void bb_smscconn_ready(SMSCConn *conn)
 {
     gwlist_add_producer(flow_threads);
-    gwlist_add_producer(incoming_sms);
+    gw_mpmcqueue_add_producer(incoming_sms);
 }
 
 
@@ -193,6 +293,8 @@ void bb_smscconn_connected(SMSCConn *conn)
 {
     if (router_thread >= 0)
         gwthread_wakeup(router_thread);
+    if (route_groups_thread >= 0)
+        gwthread_wakeup(route_groups_thread);
 }
 
 
@@ -201,11 +303,55 @@ void bb_smscconn_killed(void)
     /* NOTE: after status has been set to SMSCCONN_DEAD, bearerbox
      *   is free to release/delete 'conn'
      */
-    gwlist_remove_producer(incoming_sms);
+    gw_mpmcqueue_remove_producer(incoming_sms);
     gwlist_remove_producer(flow_threads);
 }
 
 
+/*
+ * Milliseconds to wait before the `attempt'th retry of a message that
+ * failed for `reason'. Temporary failures wait sms-resend-freq seconds,
+ * sms-resend-backoff times longer for every earlier retry, at most
+ * sms-resend-max-freq. A full queue is retried soon and then backed off
+ * the same way while the queues stay full.
+ */
+static long resend_delay(long reason, long attempt)
+{
+    long delay, factor, max_delay;
+
+    if (reason == SMSCCONN_FAILED_QFULL) {
+        delay = QFULL_RESEND_DELAY;
+        factor = 2;
+        max_delay = QFULL_RESEND_MAX_DELAY;
+    } else {
+        delay = sms_resend_frequency * 1000;
+        factor = sms_resend_backoff;
+        max_delay = sms_resend_max_frequency * 1000;
+    }
+    while (--attempt > 0 && factor > 1 && delay < max_delay)
+        delay *= factor;
+    return delay < max_delay ? delay : max_delay;
+}
+
+
+/*
+ * Route msg again after `delay' ms. Once the resend scheduler has gone
+ * at shutdown, msg goes where the scheduler left the others.
+ */
+static void resend_later(Msg *msg, long delay)
+{
+    switch (gw_timerwheel_add(resend_wheel, msg, delay)) {
+    case 1:
+        if (resend_thread >= 0)
+            gwthread_wakeup(resend_thread);
+        break;
+    case -1:
+        gw_mpmcqueue_produce(outgoing_sms, msg);
+        break;
+    }
+}
+
+
 static void handle_split(SMSCConn *conn, Msg *msg, long reason, Octstr *reply)
 {
     struct split_parts *split = msg->sms.split_parts;
@@ -235,8 +381,10 @@ static void handle_split(SMSCConn *conn, Msg *msg, long reason, Octstr *reply)
             }
             msg->sms.resend_try = (msg->sms.resend_try > 0 ? msg->sms.resend_try + 1 : 1);
             time(&msg->sms.resend_time);
+            resend_later(msg, resend_delay(reason, msg->sms.resend_try));
+            return;
         }
-        gwlist_produce(outgoing_sms, msg);
+        gw_mpmcqueue_produce(outgoing_sms, msg);
         return;
     case SMSCCONN_FAILED_DISCARDED:
     case SMSCCONN_FAILED_REJECTED:
@@ -353,12 +501,14 @@ void bb_smscconn_send_failed(SMSCConn *conn, Msg *sms, int reason, Octstr *reply
            }
            sms->sms.resend_try = (sms->sms.resend_try > 0 ? sms->sms.resend_try + 1 : 1);
            time(&sms->sms.resend_time);
+           resend_later(sms, resend_delay(reason, sms->sms.resend_try));
+           break;
        }
-       gwlist_produce(outgoing_sms, sms);
+       gw_mpmcqueue_produce(outgoing_sms, sms);
        break;
        
     case SMSCCONN_FAILED_SHUTDOWN:
-        gwlist_produce(outgoing_sms, sms);
+        gw_mpmcqueue_produce(outgoing_sms, sms);
         break;
 
     default:
@@ -477,7 +627,7 @@ static long bb_smscconn_receive_internal(SMSCConn *conn, Msg *sms)
 long bb_smscconn_receive(SMSCConn *conn, Msg *sms)
 {
     char *uf;
-    int ret;
+    int ret, list;
 
     /*
      * first check whether msgdata data is NULL and set it to empty
@@ -503,87 +653,18 @@ long bb_smscconn_receive(SMSCConn *conn, Msg *sms)
     if (sms->sms.sms_type != report_mo) {
         sms->sms.sms_type = mo;
 
-        gw_rwlock_rdlock(&white_black_list_lock);
-        if (white_list_sender &&
-                numhash_find_number(white_list_sender, sms->sms.sender) < 1) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is not in white-list-sender, message discarded",
-                 octstr_get_cstr(sms->sms.sender));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - not white-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
+        if ((list = white_black_list_check(sms)) >= 0) {
+            Octstr *alog;
 
-        if (white_list_sender_regex &&
-                gw_regex_match_pre(white_list_sender_regex, sms->sms.sender) == 0) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is not in white-list-sender, message discarded",
-                 octstr_get_cstr(sms->sms.sender));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - not white-regex-listed SMS");
+            info(0, "Number <%s> is %s %s, message discarded",
+                 octstr_get_cstr((1UL << list) & SENDER_LISTS ? sms->sms.sender : sms->sms.receiver),
+                 IS_WHITE_LIST(list) ? "not in" : "in", white_black_lists[list].name);
+            alog = octstr_format("REJECTED Receive SMS - %s", white_black_lists[list].alog);
+            bb_alog_sms(conn, sms, octstr_get_cstr(alog));
+            octstr_destroy(alog);
             msg_destroy(sms);
             return SMSCCONN_FAILED_REJECTED;
         }
-
-        if (black_list_sender &&
-                numhash_find_number(black_list_sender, sms->sms.sender) == 1) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is in black-list-sender, message discarded",
-                 octstr_get_cstr(sms->sms.sender));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - black-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-
-        if (black_list_sender_regex &&
-                gw_regex_match_pre(black_list_sender_regex, sms->sms.sender) != 0) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is in black-list-sender, message discarded",
-                 octstr_get_cstr(sms->sms.sender));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - black-regex-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-
-        if (white_list_receiver &&
-                numhash_find_number(white_list_receiver, sms->sms.receiver) < 1) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is not in white-list-receiver, message discarded",
-                 octstr_get_cstr(sms->sms.receiver));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - not white-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-
-        if (white_list_receiver_regex &&
-                gw_regex_match_pre(white_list_receiver_regex, sms->sms.receiver) == 0) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is not in white-list-receiver, message discarded",
-                 octstr_get_cstr(sms->sms.receiver));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - not white-regex-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-
-        if (black_list_receiver &&
-                numhash_find_number(black_list_receiver, sms->sms.receiver) == 1) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is in black-list-receiver, message discarded",
-                 octstr_get_cstr(sms->sms.receiver));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - black-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-
-        if (black_list_receiver_regex &&
-                gw_regex_match_pre(black_list_receiver_regex, sms->sms.receiver) != 0) {
-            gw_rwlock_unlock(&white_black_list_lock);
-            info(0, "Number <%s> is in black-list-receiver, message discarded",
-                 octstr_get_cstr(sms->sms.receiver));
-            bb_alog_sms(conn, sms, "REJECTED Receive SMS - black-regex-listed SMS");
-            msg_destroy(sms);
-            return SMSCCONN_FAILED_REJECTED;
-        }
-        gw_rwlock_unlock(&white_black_list_lock);
     }
 
     /* write to store (if enabled) */
@@ -649,32 +730,19 @@ int bb_reload_smsc_groups()
  */
 static void sms_router(void *arg)
 {
-    Msg *msg, *startmsg, *newmsg;
+    Msg *msg;
     long ret;
+    double wait;
     time_t concat_mo_check;
 
     gwlist_add_producer(flow_threads);
     gwthread_wakeup(MAIN_THREAD_ID);
 
-    startmsg = newmsg = NULL;
-    ret = SMSCCONN_SUCCESS;
     concat_mo_check = time(NULL);
 
     while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
-	if (newmsg == startmsg) {
-            if (ret == SMSCCONN_QUEUED || ret == SMSCCONN_FAILED_QFULL) {
-                /* sleep: sms_resend_frequency / 2 , so we reduce amount of msgs to send */
-                double sleep_time = (sms_resend_frequency / 2 > 1 ? sms_resend_frequency / 2 : sms_resend_frequency);
-                debug("bb.sms", 0, "sms_router: time to sleep %.2f secs.", sleep_time);
-                gwthread_sleep(sleep_time);
-                debug("bb.sms", 0, "sms_router: gwlist_len = %ld", gwlist_len(outgoing_sms));
-            }
-            startmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
-            newmsg = NULL;
-        } else {
-            newmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
-        }
+        msg = gw_mpmcqueue_timed_consume(outgoing_sms, concatenated_mo_timeout);
 
         if (difftime(time(NULL), concat_mo_check) > concatenated_mo_timeout) {
             concat_mo_check = time(NULL);
@@ -682,20 +750,23 @@ static void sms_router(void *arg)
         }
 
         /* shutdown or timeout */
-        if (msg == NULL) {
-            newmsg = startmsg = NULL;
+        if (msg == NULL)
             continue;
-        }
 
-        debug("bb.sms", 0, "sms_router: handling message (%p vs %p)",
-                  msg, startmsg);
+        debug("bb.sms", 0, "sms_router: handling message (%p)", msg);
 
-        /* handle delayed msgs */
-        if (msg->sms.resend_try > 0 && difftime(time(NULL), msg->sms.resend_time) < sms_resend_frequency &&
-            bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        /*
+         * Delayed msgs come back from the resend scheduler when due, with
+         * resend_time cleared, as the wheel has timed them on its monotonic
+         * clock. One that started waiting elsewhere, e.g. before a restart
+         * and now comes from the store, only has the wall clock time it
+         * failed at, and goes to the wheel for the rest of its delay.
+         */
+        if (msg->sms.resend_try > 0 && msg->sms.resend_time != 0 &&
+            (wait = resend_delay(SMSCCONN_FAILED_TEMPORARILY, msg->sms.resend_try) / 1000 -
+                    difftime(time(NULL), msg->sms.resend_time)) > 0) {
             debug("bb.sms", 0, "re-queing SMS not-yet-to-be resent");
-            gwlist_produce(outgoing_sms, msg);
-            ret = SMSCCONN_QUEUED;
+            resend_later(msg, wait * 1000);
             continue;
         }
 
@@ -703,23 +774,21 @@ static void sms_router(void *arg)
         switch(ret) {
         case SMSCCONN_SUCCESS:
             debug("bb.sms", 0, "Message routed successfully.");
-            newmsg = startmsg = NULL;
             break;
         case SMSCCONN_QUEUED:
-            debug("bb.sms", 0, "Routing failed, re-queued.");
+            /* parked in its route group, it does not come back here */
+            debug("bb.sms", 0, "Routing failed, parked.");
             break;
         case SMSCCONN_FAILED_DISCARDED:
             msg_destroy(msg);
-            newmsg = startmsg = NULL;
             break;
         case SMSCCONN_FAILED_QFULL:
             debug("bb.sms", 0, "Routing failed, re-queuing.");
-            gwlist_produce(outgoing_sms, msg);
+            resend_later(msg, resend_delay(ret, ++msg->qfull_tries));
             break;
         case SMSCCONN_FAILED_EXPIRED:
             debug("bb.sms", 0, "Routing failed, expired.");
             msg_destroy(msg);
-            newmsg = startmsg = NULL;
             break;
         default:
             break;
@@ -729,6 +798,133 @@ static void sms_router(void *arg)
 }
 
 
+/*
+ * Hand the messages waiting to be resent back to routing when they are
+ * due. At shutdown the rest goes back to outgoing_sms, like any other
+ * message not sent yet.
+ */
+static void resend_scheduler(void *arg)
+{
+    List *due;
+    Msg *msg;
+    long wait;
+
+    gwlist_add_producer(flow_threads);
+    due = gwlist_create();
+
+    while (bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        wait = gw_timerwheel_expire(resend_wheel, due);
+        while ((msg = gwlist_extract_first(due)) != NULL) {
+            /* due, do not let the router check it again */
+            msg->sms.resend_time = 0;
+            gw_mpmcqueue_produce(outgoing_sms, msg);
+        }
+        gwthread_sleep(wait < 0 ? sms_resend_frequency : wait / 1000.0);
+    }
+
+    gw_timerwheel_close(resend_wheel, due);
+    while ((msg = gwlist_extract_first(due)) != NULL)
+        gw_mpmcqueue_produce(outgoing_sms, msg);
+    gwlist_destroy(due, NULL);
+    gwlist_remove_producer(flow_threads);
+}
+
+
+/*
+ * Move the messages of all route groups back into outgoing_sms.
+ * NOTE: Caller must hold the write lock on smsc_list_lock!
+ */
+static void route_groups_requeue(void)
+{
+    List *msgs;
+    Msg *msg;
+
+    msgs = gwlist_create();
+    route_groups_flush(route_groups, msgs);
+    while ((msg = gwlist_extract_first(msgs)) != NULL)
+        gw_mpmcqueue_produce(outgoing_sms, msg);
+    gwlist_destroy(msgs, NULL);
+}
+
+
+/* NOTE: Caller must hold the read lock on smsc_list_lock! */
+static int route_group_member_active(long index, void *data)
+{
+    StatusInfo stat;
+
+    smscconn_info(gwlist_get(smsc_list, index), &stat);
+    return stat.status == SMSCCONN_ACTIVE && stat.killed == SMSCCONN_ALIVE;
+}
+
+
+/*
+ * Route again the parked messages of all groups that have an active
+ * connection, and the expired messages of the other groups so that
+ * they get reported.
+ */
+static void route_groups_dispatch(void)
+{
+    List *ready;
+    Msg *msg;
+
+    ready = gwlist_create();
+
+    gw_rwlock_rdlock(&smsc_list_lock);
+    route_groups_take(route_groups, ready, gwlist_len(smsc_list),
+                      route_group_member_active, NULL, time(NULL));
+    gw_rwlock_unlock(&smsc_list_lock);
+
+    if (gwlist_len(ready) > 0)
+        debug("bb.sms", 0, "Dispatching %ld parked messages.", gwlist_len(ready));
+
+    while ((msg = gwlist_extract_first(ready)) != NULL) {
+        switch (smsc2_rout(msg, 1)) {
+        case SMSCCONN_FAILED_QFULL:
+            gw_mpmcqueue_produce(outgoing_sms, msg);
+            break;
+        case SMSCCONN_FAILED_DISCARDED:
+        case SMSCCONN_FAILED_EXPIRED:
+            msg_destroy(msg);
+            break;
+        default:
+            break;
+        }
+    }
+    gwlist_destroy(ready, NULL);
+}
+
+
+/*
+ * Hand parked messages back to routing whenever a connection comes up,
+ * and every sms-resend-freq seconds in case we missed a status change.
+ */
+static void route_groups_dispatcher(void *arg)
+{
+    gwlist_add_producer(flow_threads);
+
+    while (bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        gwthread_sleep(sms_resend_frequency);
+        if (route_groups_len(route_groups) > 0 && bb_status != BB_SHUTDOWN && bb_status != BB_DEAD)
+            route_groups_dispatch();
+    }
+    gwlist_remove_producer(flow_threads);
+}
+
+
+/* Number of messages parked in the route groups or waiting to be resent. */
+long smsc2_queued(void)
+{
+    return (route_groups != NULL ? route_groups_len(route_groups) : 0) +
+           smsc2_resend_queued();
+}
+
+
+long smsc2_resend_queued(void)
+{
+    return resend_wheel != NULL ? gw_timerwheel_len(resend_wheel) : 0;
+}
+
+
 #define OCTSTR(os)  octstr_imm(#os)
 
 static int cmp_conn_grp_checksum(void *a, void *b)
@@ -798,6 +994,42 @@ static int cmp_conn_grp_id(void *a, void *b)
 }
 
 
+/*
+ * Drop the routing table after smsc_list or the routing configuration
+ * of any of its connections has been changed. Parked messages go back
+ * into outgoing_sms to be routed with the new table. Until it has been
+ * built, smsc2_rout() asks each connection.
+ * NOTE: Caller must hold the write lock on smsc_list_lock!
+ */
+static void smsc2_drop_routes(void)
+{
+    route_groups_requeue();
+    route_table_destroy(smsc_routes);
+    smsc_routes = NULL;
+}
+
+
+/*
+ * Compile the routing table for smsc_list, if it has been dropped. Only
+ * the read lock is held meanwhile, so routing goes on. Two writers may
+ * compile a table for the same list, the one of the later is thrown away.
+ * NOTE: Caller must not hold smsc_list_lock!
+ */
+static void smsc2_build_routes(void)
+{
+    RouteTable *table, *none = NULL;
+
+    gw_rwlock_rdlock(&smsc_list_lock);
+    if (smsc_list != NULL && __atomic_load_n(&smsc_routes, __ATOMIC_ACQUIRE) == NULL) {
+        table = route_table_create(smsc_list);
+        if (!__atomic_compare_exchange_n(&smsc_routes, &none, table, 0,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            route_table_destroy(table);
+    }
+    gw_rwlock_unlock(&smsc_list_lock);
+}
+
+
 /*-------------------------------------------------------------
  * public functions
  *
@@ -821,70 +1053,34 @@ int smsc2_start(Cfg *cfg)
     /* create smsc list and rwlock for it */
     smsc_list = gwlist_create();
     gw_rwlock_init_static(&smsc_list_lock);
+    resend_wheel = gw_timerwheel_create();
+    route_groups = route_groups_create();
 
     grp = cfg_get_single_group(cfg, octstr_imm("core"));
     unified_prefix = cfg_get(grp, octstr_imm("unified-prefix"));
 
     gw_rwlock_init_static(&white_black_list_lock);
-    white_list_sender = black_list_sender = NULL;
-    white_list_sender_url = black_list_sender_url = NULL;
-    white_list_sender_url = cfg_get(grp, octstr_imm("white-list-sender"));
-    if (white_list_sender_url != NULL) {
-        if ((white_list_sender = numhash_create(octstr_get_cstr(white_list_sender_url))) == NULL)
-            panic(0, "Could not get white-list-sender at URL <%s>",
-                  octstr_get_cstr(white_list_sender_url));
-    }
-    os = cfg_get(grp, octstr_imm("white-list-sender-regex"));
-    if (os != NULL) {
-        if ((white_list_sender_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-
-    black_list_sender_url = cfg_get(grp, octstr_imm("black-list-sender"));
-    if (black_list_sender_url != NULL) {
-        if ((black_list_sender = numhash_create(octstr_get_cstr(black_list_sender_url))) == NULL)
-            panic(0, "Could not get black-list-sender at URL <%s>",
-                  octstr_get_cstr(black_list_sender_url));
-    }
-    os = cfg_get(grp, octstr_imm("black-list-sender-regex"));
-    if (os != NULL) {
-        if ((black_list_sender_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-
-    white_list_receiver = black_list_receiver = NULL;
-    white_list_receiver_url = black_list_receiver_url = NULL;
-    white_list_receiver_url = cfg_get(grp, octstr_imm("white-list-receiver"));
-    if (white_list_receiver_url != NULL) {
-        if ((white_list_receiver = numhash_create(octstr_get_cstr(white_list_receiver_url))) == NULL)
-            panic(0, "Could not get white-list-receiver at URL <%s>",
-                  octstr_get_cstr(white_list_receiver_url));
-    }
-    if ((os = cfg_get(grp, octstr_imm("white-list-receiver-regex"))) != NULL) {
-        if ((white_list_receiver_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-
-    black_list_receiver_url = cfg_get(grp, octstr_imm("black-list-receiver"));
-    if (black_list_receiver_url != NULL) {
-        if ((black_list_receiver = numhash_create(octstr_get_cstr(black_list_receiver_url))) == NULL)
-            panic(0, "Could not get black-list-receiver at URL <%s>",
-                  octstr_get_cstr(black_list_receiver_url));
-    }
-    if ((os = cfg_get(grp, octstr_imm("black-list-receiver-regex"))) != NULL) {
-        if ((black_list_receiver_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-
+    for (i = 0; i < WHITE_BLACK_LISTS; i++)
+        white_black_list_cfg[i] = cfg_get(grp, octstr_imm(white_black_lists[i].directive));
+    if ((white_black_list = white_black_list_create()) == NULL)
+        panic(0, "Cannot start with white/black-lists failing");
     if (cfg_get_integer(&sms_resend_frequency, grp,
             octstr_imm("sms-resend-freq")) == -1 || sms_resend_frequency <= 0) {
         sms_resend_frequency = 60;
     }
     info(0, "Set SMS resend frequency to %ld seconds.", sms_resend_frequency);
+
+    if (cfg_get_integer(&sms_resend_backoff, grp,
+            octstr_imm("sms-resend-backoff")) == -1 || sms_resend_backoff < 1)
+        sms_resend_backoff = 1;
+    if (cfg_get_integer(&sms_resend_max_frequency, grp,
+            octstr_imm("sms-resend-max-freq")) == -1)
+        sms_resend_max_frequency = 3600;
+    if (sms_resend_max_frequency < sms_resend_frequency)
+        sms_resend_max_frequency = sms_resend_frequency;
+    if (sms_resend_backoff > 1)
+        info(0, "SMS resend delay grows by a factor of %ld up to %ld seconds.",
+             sms_resend_backoff, sms_resend_max_frequency);
             
     if (cfg_get_integer(&sms_resend_retry, grp, octstr_imm("sms-resend-retry")) == -1) {
         sms_resend_retry = -1;
@@ -920,11 +1116,16 @@ int smsc2_start(Cfg *cfg)
         }
     }
     gwlist_remove_producer(smsc_list);
+    smsc2_build_routes();
     
     if ((router_thread = gwthread_create(sms_router, NULL)) == -1)
 	panic(0, "Failed to start a new thread for SMS routing");
+    if ((route_groups_thread = gwthread_create(route_groups_dispatcher, NULL)) == -1)
+        panic(0, "Failed to start a new thread for parked SMS");
+    if ((resend_thread = gwthread_create(resend_scheduler, NULL)) == -1)
+        panic(0, "Failed to start a new thread for SMS resends");
     
-    gwlist_add_producer(incoming_sms);
+    gw_mpmcqueue_add_producer(incoming_sms);
     smsc_running = 1;
     return 0;
 }
@@ -1055,6 +1256,8 @@ int smsc2_restart_smsc(Octstr *id)
         success = 1;
         num++;
     }
+    if (success)
+        smsc2_drop_routes();
 
     gw_rwlock_unlock(&smsc_list_lock);
     
@@ -1062,6 +1265,7 @@ int smsc2_restart_smsc(Octstr *id)
         error(0, "SMSC %s not found", octstr_get_cstr(id));
         return -1;
     }
+    smsc2_build_routes();
     /* wake-up the router */
     if (router_thread >= 0)
         gwthread_wakeup(router_thread);
@@ -1088,12 +1292,15 @@ int smsc2_remove_smsc(Octstr *id)
         success = 1;
     }
     gwlist_remove_producer(smsc_list);
+    if (success)
+        smsc2_drop_routes();
 
     gw_rwlock_unlock(&smsc_list_lock);
     if (success == 0) {
         error(0, "SMSC %s not found", octstr_get_cstr(id));
         return -1;
     }
+    smsc2_build_routes();
     return 0;
 }
 
@@ -1151,72 +1358,33 @@ int smsc2_add_smsc(Octstr *id)
         smscid = NULL;
     }
     gwlist_remove_producer(smsc_list);
+    if (success)
+        smsc2_drop_routes();
     gw_rwlock_unlock(&smsc_list_lock);
     if (success == 0) {
         error(0, "SMSC %s not found", octstr_get_cstr(id));
         return -1;
     }
+    smsc2_build_routes();
     return 0;
 }
 
 int smsc2_reload_lists(void)
 {
-    Numhash *tmp;
-    int rc = 1;
-
-    if (white_list_sender_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(white_list_sender_url));
-        if (white_list_sender == NULL) {
-            error(0, "Unable to reload white_list."),
-            rc = -1;
-        } else {
-        	gw_rwlock_wrlock(&white_black_list_lock);
-        	numhash_destroy(white_list_sender);
-        	white_list_sender = tmp;
-        	gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
+    NumberFilter *filter, *old;
 
-    if (black_list_sender_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(black_list_sender_url));
-        if (black_list_sender == NULL) {
-            error(0, "Unable to reload black_list");
-            rc = -1;
-        } else {
-        	gw_rwlock_wrlock(&white_black_list_lock);
-        	numhash_destroy(black_list_sender);
-        	black_list_sender = tmp;
-        	gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
-
-    if (white_list_receiver_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(white_list_receiver_url));
-        if (white_list_receiver == NULL) {
-            error(0, "Unable to reload white_list."),
-            rc = -1;
-        } else {
-            gw_rwlock_wrlock(&white_black_list_lock);
-            numhash_destroy(white_list_receiver);
-            white_list_receiver = tmp;
-            gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
-
-    if (black_list_receiver_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(black_list_receiver_url));
-        if (black_list_receiver == NULL) {
-            error(0, "Unable to reload black_list");
-            rc = -1;
-        } else {
-            gw_rwlock_wrlock(&white_black_list_lock);
-            numhash_destroy(black_list_receiver);
-            black_list_receiver = tmp;
-            gw_rwlock_unlock(&white_black_list_lock);
-        }
+    /* compile the new lists first, then swap them in at once */
+    if ((filter = white_black_list_create()) == NULL) {
+        error(0, "Unable to reload white/black-lists.");
+        return -1;
     }
+    gw_rwlock_wrlock(&white_black_list_lock);
+    old = white_black_list;
+    white_black_list = filter;
+    gw_rwlock_unlock(&white_black_list_lock);
+    number_filter_destroy(old);
 
-    return rc;
+    return 1;
 }
 
 void smsc2_resume(int is_init)
@@ -1241,6 +1409,8 @@ void smsc2_resume(int is_init)
     
     if (router_thread >= 0)
         gwthread_wakeup(router_thread);
+    if (route_groups_thread >= 0)
+        gwthread_wakeup(route_groups_thread);
 }
 
 
@@ -1283,6 +1453,10 @@ int smsc2_shutdown(void)
     gw_rwlock_unlock(&smsc_list_lock);
     if (router_thread >= 0)
 	gwthread_wakeup(router_thread);
+    if (route_groups_thread >= 0)
+        gwthread_wakeup(route_groups_thread);
+    if (resend_thread >= 0)
+        gwthread_wakeup(resend_thread);
 
     /* start avalanche by calling shutdown */
 
@@ -1290,7 +1464,7 @@ int smsc2_shutdown(void)
      * receive thingies? Is this guaranteed by setting bb_status
      * to shutdown before calling these?
      */
-    gwlist_remove_producer(incoming_sms);
+    gw_mpmcqueue_remove_producer(incoming_sms);
 
     /* shutdown low levele PDU things */
     smpp_pdu_shutdown();
@@ -1316,25 +1490,20 @@ void smsc2_cleanup(void)
     }
     gwlist_destroy(smsc_list, NULL);
     smsc_list = NULL;
+    smsc2_drop_routes();
     gw_rwlock_unlock(&smsc_list_lock);
+    route_groups_destroy(route_groups);
+    route_groups = NULL;
+    gw_timerwheel_destroy(resend_wheel, msg_destroy_item);
+    resend_wheel = NULL;
     gwlist_destroy(smsc_groups, NULL);
     octstr_destroy(unified_prefix);    
-    numhash_destroy(white_list_sender);
-    numhash_destroy(black_list_sender);
-    octstr_destroy(white_list_sender_url);
-    octstr_destroy(black_list_sender_url);
-    if (white_list_sender_regex != NULL)
-        gw_regex_destroy(white_list_sender_regex);
-    if (black_list_sender_regex != NULL)
-        gw_regex_destroy(black_list_sender_regex);
-    numhash_destroy(white_list_receiver);
-    numhash_destroy(black_list_receiver);
-    octstr_destroy(white_list_receiver_url);
-    octstr_destroy(black_list_receiver_url);
-    if (white_list_receiver_regex != NULL)
-        gw_regex_destroy(white_list_receiver_regex);
-    if (black_list_receiver_regex != NULL)
-        gw_regex_destroy(black_list_receiver_regex);
+    number_filter_destroy(white_black_list);
+    white_black_list = NULL;
+    for (i = 0; i < WHITE_BLACK_LISTS; i++) {
+        octstr_destroy(white_black_list_cfg[i]);
+        white_black_list_cfg[i] = NULL;
+    }
     /* destroy msg split counter */
     counter_destroy(split_msg_counter);
     gw_rwlock_destroy(&smsc_list_lock);
@@ -1717,8 +1886,10 @@ int smsc2_graceful_restart(Cfg *cfg)
     }
     gwlist_remove_producer(smsc_list);
     gwlist_destroy(add, NULL);
+    smsc2_drop_routes();
 
     gw_rwlock_unlock(&smsc_list_lock);
+    smsc2_build_routes();
 
     /* wake-up the router */
     if (router_thread >= 0)
@@ -1756,7 +1927,10 @@ long smsc2_rout(Msg *msg, int resend)
     SMSCConn *conn, *best_preferred, *best_ok;
     long bp_load, bo_load;
     int i, s, ret, bad_found, full_found;
-    long max_queue, queue_length;
+    long max_queue, queue_length, len, idx;
+    RouteMask masks[2 * ROUTE_MASK_WORDS(SMSC2_ROUT_STACK_CONNS)];
+    RouteMask *usable, *preferred;
+    RouteTable *routes;
     char *uf;
 
     /* XXX handle ack here? */
@@ -1777,72 +1951,15 @@ long smsc2_rout(Msg *msg, int resend)
     normalize_number(uf, &(msg->sms.receiver));
 
     /* check for white/back-listed sender/receiver */
-    gw_rwlock_rdlock(&white_black_list_lock);
-    if (white_list_sender && numhash_find_number(white_list_sender, msg->sms.sender) < 1) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is not in white-list-sender, message rejected",
-             octstr_get_cstr(msg->sms.sender));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("sender not in white-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (white_list_sender_regex && gw_regex_match_pre(white_list_sender_regex, msg->sms.sender) == 0) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is not in white-list-sender, message rejected",
-             octstr_get_cstr(msg->sms.sender));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("sender not in white-list"));
+    if ((i = white_black_list_check(msg)) >= 0) {
+        info(0, "Number <%s> is %s %s, message rejected",
+             octstr_get_cstr((1UL << i) & SENDER_LISTS ? msg->sms.sender : msg->sms.receiver),
+             IS_WHITE_LIST(i) ? "not in" : "in", white_black_lists[i].name);
+        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED,
+                                octstr_create(white_black_lists[i].reason));
         return SMSCCONN_FAILED_REJECTED;
     }
 
-    if (black_list_sender && numhash_find_number(black_list_sender, msg->sms.sender) == 1) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is in black-list-sender, message rejected",
-             octstr_get_cstr(msg->sms.sender));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("sender in black-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (black_list_sender_regex && gw_regex_match_pre(black_list_sender_regex, msg->sms.sender) != 0) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is in black-list-sender, message rejected",
-             octstr_get_cstr(msg->sms.sender));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("sender in black-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (white_list_receiver && numhash_find_number(white_list_receiver, msg->sms.receiver) < 1) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is not in white-list-receiver, message rejected",
-             octstr_get_cstr(msg->sms.receiver));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("receiver not in white-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (white_list_receiver_regex && gw_regex_match_pre(white_list_receiver_regex, msg->sms.receiver) == 0) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is not in white-list-receiver, message rejected",
-             octstr_get_cstr(msg->sms.receiver));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("receiver not in white-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (black_list_receiver && numhash_find_number(black_list_receiver, msg->sms.receiver) == 1) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is in black-list-receiver, message rejected",
-             octstr_get_cstr(msg->sms.receiver));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("receiver in black-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-
-    if (black_list_receiver_regex && gw_regex_match_pre(black_list_receiver_regex, msg->sms.receiver) != 0) {
-        gw_rwlock_unlock(&white_black_list_lock);
-        info(0, "Number <%s> is in black-list-receiver, message rejected",
-             octstr_get_cstr(msg->sms.receiver));
-        bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_REJECTED, octstr_create("receiver in black-list"));
-        return SMSCCONN_FAILED_REJECTED;
-    }
-    gw_rwlock_unlock(&white_black_list_lock);
-
     /* select in which list to add this
      * start - from random SMSCConn, as they are all 'equal'
      */
@@ -1856,6 +1973,8 @@ long smsc2_rout(Msg *msg, int resend)
     best_preferred = best_ok = NULL;
     bad_found = full_found = 0;
     bp_load = bo_load = queue_length = 0;
+    usable = NULL;
+    len = 0;
 
     if (msg->sms.split_parts == NULL) {
     	/*
@@ -1863,25 +1982,42 @@ long smsc2_rout(Msg *msg, int resend)
     	 * and 80% for new msgs. So we can guarantee that old msgs find
     	 * place in the SMSC's queue.
     	 */
-    	if (gwlist_len(outgoing_sms) > 0) {
+    	if (gw_mpmcqueue_len(outgoing_sms) > 0) {
     		max_queue = (resend ? max_outgoing_sms_qlength :
     		max_outgoing_sms_qlength * 0.8);
     	} else
     		max_queue = max_outgoing_sms_qlength;
 
-    	s = gw_rand() % gwlist_len(smsc_list);
+    	len = gwlist_len(smsc_list);
+    	s = gw_rand() % len;
+
+    	/* get the candidate connections from the compiled routing table,
+    	 * or from each connection while the table is rebuilt */
+    	usable = (len <= SMSC2_ROUT_STACK_CONNS ? masks :
+    	          gw_malloc(sizeof(*usable) * ROUTE_MASK_WORDS(len) * 2));
+    	preferred = usable + ROUTE_MASK_WORDS(len);
+    	if ((routes = __atomic_load_n(&smsc_routes, __ATOMIC_ACQUIRE)) != NULL) {
+    	    gw_assert(route_table_len(routes) == len);
+    	    route_table_match(routes, msg, usable, preferred);
+    	} else
+    	    route_list_match(smsc_list, msg, usable, preferred);
 
     	conn = NULL;
-    	for (i = 0; i < gwlist_len(smsc_list); i++) {
-    		conn = gwlist_get(smsc_list,  (i+s) % gwlist_len(smsc_list));
+    	for (i = 0; i < len; i++) {
+    		idx = (i + s) % len;
+    		if (!ROUTE_MASK_ISSET(usable, idx))
+    			continue;
 
+    		conn = gwlist_get(smsc_list, idx);
     		smscconn_info(conn, &stat);
-    		queue_length += (stat.queued > 0 ? stat.queued : 0);
 
-    		ret = smscconn_usable(conn,msg);
-    		if (ret == -1)
+    		/* dead transmitter or active receiver connections are not feasible */
+    		if (stat.status == SMSCCONN_DEAD || stat.status == SMSCCONN_ACTIVE_RECV ||
+    		    stat.killed != SMSCCONN_ALIVE)
     			continue;
 
+    		ret = ROUTE_MASK_ISSET(preferred, idx);
+
     		/* if we already have a preferred one, skip non-preferred */
     		if (ret != 1 && best_preferred)
     			continue;
@@ -1908,12 +2044,21 @@ long smsc2_rout(Msg *msg, int resend)
     			bo_load = stat.load;
     		}
     	}
-    	queue_length += gwlist_len(outgoing_sms);
-    	if (max_outgoing_sms_qlength > 0 && !resend &&
-    	    queue_length > gwlist_len(smsc_list) * max_outgoing_sms_qlength) {
-    		gw_rwlock_unlock(&smsc_list_lock);
-    		debug("bb.sms", 0, "sum(#queues) limit");
-    		return SMSCCONN_FAILED_QFULL;
+
+    	/* the queue sum over all connections is only needed for the limit */
+    	if (max_outgoing_sms_qlength > 0 && !resend) {
+    		for (i = 0; i < len; i++) {
+    			smscconn_info(gwlist_get(smsc_list, i), &stat);
+    			queue_length += (stat.queued > 0 ? stat.queued : 0);
+    		}
+    		queue_length += gw_mpmcqueue_len(outgoing_sms) + smsc2_queued();
+    		if (queue_length > len * max_outgoing_sms_qlength) {
+    			gw_rwlock_unlock(&smsc_list_lock);
+    			if (usable != masks)
+    				gw_free(usable);
+    			debug("bb.sms", 0, "sum(#queues) limit");
+    			return SMSCCONN_FAILED_QFULL;
+    		}
     	}
     } else {
         struct split_parts *parts = msg->sms.split_parts;
@@ -1927,19 +2072,29 @@ long smsc2_rout(Msg *msg, int resend)
     else if (best_ok)
         ret = smscconn_send(best_ok, msg);
     else if (bad_found) {
-        gw_rwlock_unlock(&smsc_list_lock);
-        if (max_outgoing_sms_qlength < 0 || gwlist_len(outgoing_sms) < max_outgoing_sms_qlength) {
-            gwlist_produce(outgoing_sms, msg);
+        if (max_outgoing_sms_qlength < 0 ||
+            gw_mpmcqueue_len(outgoing_sms) + smsc2_queued() < max_outgoing_sms_qlength) {
+            route_groups_park(route_groups, msg, usable, ROUTE_MASK_WORDS(len));
+            gw_rwlock_unlock(&smsc_list_lock);
+            if (usable != masks)
+                gw_free(usable);
             return SMSCCONN_QUEUED;
         }
+        gw_rwlock_unlock(&smsc_list_lock);
+        if (usable != masks)
+            gw_free(usable);
         debug("bb.sms", 0, "bad_found queue full");
         return SMSCCONN_FAILED_QFULL; /* queue full */
     } else if (full_found) {
         gw_rwlock_unlock(&smsc_list_lock);
+        if (usable != masks)
+            gw_free(usable);
         debug("bb.sms", 0, "full_found queue full");
         return SMSCCONN_FAILED_QFULL;
     } else {
         gw_rwlock_unlock(&smsc_list_lock);
+        if (usable != masks)
+            gw_free(usable);
         if (bb_status == BB_SHUTDOWN) {
             msg_destroy(msg);
             return SMSCCONN_QUEUED;
@@ -1951,6 +2106,8 @@ long smsc2_rout(Msg *msg, int resend)
     }
 
     gw_rwlock_unlock(&smsc_list_lock);
+    if (usable != masks)
+        gw_free(usable);
     /* check the status of sending operation */
     if (ret == -1)
         return smsc2_rout(msg, resend); /* re-try */
@@ -91,6 +91,8 @@ int store_init(Cfg *cfg, const Octstr *type, const Octstr *fname, long dump_freq
         ret = store_file_init(fname, dump_freq);
     } else if (octstr_str_compare(type, "spool") == 0) {
         ret = store_spool_init(fname);
+    } else if (octstr_str_compare(type, "wal") == 0) {
+        ret = store_wal_init(cfg, fname, dump_freq);
 #ifdef HAVE_REDIS
     } else if (octstr_str_compare(type, "redis") == 0) {
         ret = store_redis_init(cfg);
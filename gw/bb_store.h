@@ -115,6 +115,7 @@ extern void (*store_for_each_message)(void(*callback_fn)(Msg*, void*), void *dat
  */
 int store_spool_init(const Octstr *fname);
 int store_file_init(const Octstr *fname, long dump_freq);
+int store_wal_init(Cfg *cfg, const Octstr *dirname, long dump_freq);
 #ifdef HAVE_REDIS
 int store_redis_init(Cfg *cfg);
 #endif
@@ -309,8 +309,7 @@ static int store_to_dict(Msg *msg)
         uuid_unparse(copy->sms.id, id);
         uuid_os = octstr_create(id);
         
-        dict_put(sms_dict, uuid_os, copy);
-        octstr_destroy(uuid_os);
+        dict_put_nocopy(sms_dict, uuid_os, copy);
         last_dict_mod = time(NULL);
     } else if (msg_type(msg) == ack) {
         uuid_unparse(msg->ack.id, id);
@@ -817,6 +817,7 @@ int store_redis_init(Cfg *cfg)
 
     pool = dbpool_create(DBPOOL_REDIS, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * Panic on failure to connect. Should we just try to reconnect?
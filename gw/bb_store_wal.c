@@ -0,0 +1,1015 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * bb_store_wal.c : bearerbox box SMS storage/retrieval module using a
+ *                  segmented write-ahead log
+ *
+ * Messages and acks are appended to the active segment file inside the
+ * store-location directory. A single committer thread writes the pending
+ * records and fdatasync()s them in one go (group commit): with
+ * store-wal-sync-interval = 0 store_save() blocks until its record is on
+ * disk, otherwise savers return at once and the committer syncs every
+ * N milliseconds.
+ *
+ * Segments are rotated at store-wal-segment-size. Instead of re-dumping
+ * the whole store, the oldest sealed segment is unlinked as soon as all
+ * its messages have been acknowledged. The remaining messages of sparse
+ * segments are re-appended to the active segment first. On startup all segments are
+ * parsed in parallel and replayed in order.
+ */
+
+#include "gw-config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "gwlib/gwlib.h"
+#include "msg.h"
+#include "sms.h"
+#include "bearerbox.h"
+#include "bb_store.h"
+
+#define WAL_DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+#define WAL_LOAD_THREADS 4
+
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+#define wal_sync(fd) fdatasync(fd)
+#else
+#define wal_sync(fd) fsync(fd)
+#endif
+
+typedef struct {
+    long id;
+    Octstr *name;
+    int fd;           /* -1 once sealed and synced */
+    Octstr *pending;  /* records not yet handed to the committer */
+    long size;        /* bytes appended, including pending */
+    long records;     /* sms records */
+    long live;        /* sms records still referenced from sms_dict */
+    int sealed;
+    int compact;      /* live records are being copied forward */
+} WalSegment;
+
+typedef struct {
+    Msg *msg;
+    WalSegment *seg;
+} WalEntry;
+
+static Octstr *wal_dir = NULL;
+static long segment_size = WAL_DEFAULT_SEGMENT_SIZE;
+static long sync_interval = 0;
+static long dump_frequency = 0;
+
+/* protects everything below */
+static Mutex *wal_mutex = NULL;
+static pthread_cond_t commit_cond;
+static pthread_cond_t synced_cond;
+
+static Dict *sms_dict = NULL;
+static List *segments = NULL;   /* WalSegment, oldest first */
+static WalSegment *active_seg = NULL;
+static long enqueued_lsn = 0;
+static long synced_lsn = 0;
+static int sync_requested = 0;  /* somebody waits for the next commit */
+static int wal_failed = 0;
+
+static int active = 1;
+static long committer_thread = -1;
+static long compactor_thread = -1;
+static List *loaded = NULL;
+
+
+static void wal_entry_destroy(void *p)
+{
+    WalEntry *entry = p;
+
+    if (entry == NULL)
+        return;
+    msg_destroy(entry->msg);
+    gw_free(entry);
+}
+
+
+/* move the absolute time ts on by msec; a zero ts counts from now */
+static void deadline_add(struct timespec *ts, long msec)
+{
+    struct timeval now;
+
+    if (ts->tv_sec == 0) {
+        gettimeofday(&now, NULL);
+        ts->tv_sec = now.tv_sec;
+        ts->tv_nsec = now.tv_usec * 1000;
+    }
+    ts->tv_sec += msec / 1000;
+    ts->tv_nsec += (msec % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+
+static int deadline_passed(const struct timespec *ts)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec > ts->tv_sec ||
+           (now.tv_sec == ts->tv_sec && now.tv_usec * 1000 >= ts->tv_nsec);
+}
+
+
+/*
+ * Wait on cond with wal_mutex held, keeping the Mutex owner bookkeeping
+ * consistent. A NULL abstime waits without timeout.
+ */
+static void wal_wait(pthread_cond_t *cond, const struct timespec *abstime)
+{
+    wal_mutex->owner = -1;
+    pthread_cleanup_push((void(*)(void*))pthread_mutex_unlock, &wal_mutex->mutex);
+    if (abstime != NULL)
+        pthread_cond_timedwait(cond, &wal_mutex->mutex, abstime);
+    else
+        pthread_cond_wait(cond, &wal_mutex->mutex);
+    pthread_cleanup_pop(0);
+    wal_mutex->owner = gwthread_self();
+}
+
+
+static void sync_dir(void)
+{
+    int fd;
+
+    if ((fd = open(octstr_get_cstr(wal_dir), O_RDONLY)) == -1)
+        return;
+    if (fsync(fd) == -1)
+        error(errno, "Failed to sync store directory `%s'", octstr_get_cstr(wal_dir));
+    close(fd);
+}
+
+
+static WalSegment *segment_create(long id)
+{
+    WalSegment *seg;
+
+    seg = gw_malloc(sizeof(*seg));
+    seg->id = id;
+    seg->name = octstr_format("%S/wal-%016lx.log", wal_dir, id);
+    seg->fd = -1;
+    seg->pending = octstr_create("");
+    seg->size = 0;
+    seg->records = 0;
+    seg->live = 0;
+    seg->sealed = 0;
+    seg->compact = 0;
+
+    return seg;
+}
+
+
+static void segment_destroy(WalSegment *seg)
+{
+    if (seg == NULL)
+        return;
+    if (seg->fd != -1)
+        close(seg->fd);
+    octstr_destroy(seg->name);
+    octstr_destroy(seg->pending);
+    gw_free(seg);
+}
+
+
+/* open a fresh active segment with the given id; wal_mutex held */
+static int segment_open(long id)
+{
+    WalSegment *seg;
+
+    seg = segment_create(id);
+    seg->fd = open(octstr_get_cstr(seg->name), O_WRONLY|O_CREAT|O_APPEND, S_IRUSR|S_IWUSR);
+    if (seg->fd == -1) {
+        error(errno, "Failed to open store segment `%s'", octstr_get_cstr(seg->name));
+        segment_destroy(seg);
+        return -1;
+    }
+    sync_dir();
+
+    if (active_seg != NULL)
+        active_seg->sealed = 1;
+    active_seg = seg;
+    gwlist_append(segments, seg);
+    debug("bb.store", 0, "Opened store segment `%s'", octstr_get_cstr(seg->name));
+
+    return 0;
+}
+
+
+/* append one record to the active segment; wal_mutex held. Returns its LSN. */
+static long append_record(Msg *msg)
+{
+    Octstr *pack;
+    unsigned char buf[4];
+
+    if (active_seg->size >= segment_size && segment_open(active_seg->id + 1) == -1)
+        wal_failed = 1;
+
+    pack = store_msg_pack(msg);
+    encode_network_long(buf, octstr_len(pack));
+    octstr_append_data(active_seg->pending, (char*)buf, 4);
+    octstr_append(active_seg->pending, pack);
+    active_seg->size += octstr_len(pack) + 4;
+    enqueued_lsn += octstr_len(pack) + 4;
+    octstr_destroy(pack);
+
+    return enqueued_lsn;
+}
+
+
+static int read_msg(Msg **msg, Octstr *os, long *off)
+{
+    unsigned char buf[4];
+    long i;
+    Octstr *pack;
+
+    gw_assert(*off >= 0);
+    if (*off + 4 > octstr_len(os))
+        return -1;
+
+    octstr_get_many_chars((char*)buf, os, *off, 4);
+    i = decode_network_long(buf);
+    if (i < 0 || *off + 4 + i > octstr_len(os))
+        return -1;
+    *off += 4;
+
+    pack = octstr_copy(os, *off, i);
+    *off += i;
+    *msg = store_msg_unpack(pack);
+    octstr_destroy(pack);
+
+    if (!*msg)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * Apply a message to sms_dict, accounting it against seg;
+ * wal_mutex held (or single threaded during load).
+ */
+static int store_to_dict(Msg *msg, WalSegment *seg, int replay)
+{
+    WalEntry *entry, *old;
+    Octstr *uuid_os;
+    char id[UUID_STR_LEN + 1];
+
+    if (msg_type(msg) == sms) {
+        entry = gw_malloc(sizeof(*entry));
+        entry->msg = msg_duplicate(msg);
+        entry->seg = seg;
+        seg->records++;
+        seg->live++;
+
+        uuid_unparse(msg->sms.id, id);
+        uuid_os = octstr_create(id);
+        old = dict_remove(sms_dict, uuid_os);
+        if (old != NULL) {
+            old->seg->live--;
+            wal_entry_destroy(old);
+        }
+        dict_put_nocopy(sms_dict, uuid_os, entry);
+    } else if (msg_type(msg) == ack) {
+        uuid_unparse(msg->ack.id, id);
+        uuid_os = octstr_create(id);
+        old = dict_remove(sms_dict, uuid_os);
+        octstr_destroy(uuid_os);
+        if (old == NULL) {
+            /* acks of already compacted messages are expected on replay */
+            if (!replay)
+                warning(0, "bb_store: get ACK of message not found "
+                        "from store, strange?");
+        } else {
+            old->seg->live--;
+            wal_entry_destroy(old);
+        }
+    } else
+        return -1;
+
+    return 0;
+}
+
+
+/* wait until everything enqueued so far is on disk; wal_mutex held */
+static int wait_synced(long lsn)
+{
+    sync_requested = 1;
+    pthread_cond_signal(&commit_cond);
+    while (synced_lsn < lsn && !wal_failed && committer_thread != -1)
+        wal_wait(&synced_cond, NULL);
+
+    return (wal_failed || synced_lsn < lsn) ? -1 : 0;
+}
+
+
+/*
+ * Committer thread: takes all pending records, writes them out and syncs
+ * each touched segment once per round, then wakes up the waiting savers.
+ * In interval mode a round starts every sync_interval ms, savers do not
+ * wake the committer, only those waiting for a sync (store_dump) and
+ * shutdown do.
+ */
+static void wal_committer(void *arg)
+{
+    List *batch = gwlist_create();
+    WalSegment *seg;
+    struct timespec deadline = { 0, 0 };
+    long target, l;
+    int failed;
+
+    mutex_lock(wal_mutex);
+    if (sync_interval > 0)
+        deadline_add(&deadline, sync_interval);
+    while (active || synced_lsn < enqueued_lsn) {
+        if (sync_interval > 0) {
+            while (active && !sync_requested && !deadline_passed(&deadline))
+                wal_wait(&commit_cond, &deadline);
+            /* keep the pace, but do not catch up on rounds missed */
+            deadline_add(&deadline, sync_interval);
+            if (deadline_passed(&deadline)) {
+                deadline.tv_sec = 0;
+                deadline_add(&deadline, sync_interval);
+            }
+        } else if (active && !sync_requested && synced_lsn == enqueued_lsn)
+            wal_wait(&commit_cond, NULL);
+        sync_requested = 0;
+        if (synced_lsn == enqueued_lsn)
+            continue;
+
+        /* grab pending records of every segment, oldest first */
+        target = enqueued_lsn;
+        for (l = 0; l < gwlist_len(segments); l++) {
+            seg = gwlist_get(segments, l);
+            if (octstr_len(seg->pending) == 0)
+                continue;
+            gwlist_append(batch, seg);
+            gwlist_append(batch, seg->pending);
+            seg->pending = octstr_create("");
+        }
+        mutex_unlock(wal_mutex);
+
+        failed = 0;
+        while ((seg = gwlist_extract_first(batch)) != NULL) {
+            Octstr *data = gwlist_extract_first(batch);
+            long pos = 0, n = 0;
+
+            while (!failed && pos < octstr_len(data)) {
+                if ((n = octstr_write_data(data, seg->fd, pos)) == -1)
+                    failed = 1;
+                pos += n;
+            }
+            if (!failed && wal_sync(seg->fd) == -1) {
+                error(errno, "Failed to sync store segment `%s'",
+                      octstr_get_cstr(seg->name));
+                failed = 1;
+            }
+            octstr_destroy(data);
+        }
+
+        mutex_lock(wal_mutex);
+        if (failed) {
+            error(0, "Store write-ahead log failed, refusing further saves.");
+            wal_failed = 1;
+            synced_lsn = enqueued_lsn;
+        } else
+            synced_lsn = target;
+
+        /* sealed segments are complete now, release their descriptors */
+        for (l = 0; l < gwlist_len(segments); l++) {
+            seg = gwlist_get(segments, l);
+            if (seg->sealed && seg->fd != -1 && octstr_len(seg->pending) == 0) {
+                close(seg->fd);
+                seg->fd = -1;
+            }
+        }
+        pthread_cond_broadcast(&synced_cond);
+    }
+    mutex_unlock(wal_mutex);
+
+    gwlist_destroy(batch, NULL);
+}
+
+
+/*
+ * Write the records of msgs to a new sealed segment with the given id,
+ * without holding wal_mutex. Returns the segment, NULL on failure.
+ */
+static WalSegment *segment_write(long id, List *msgs)
+{
+    WalSegment *seg;
+    Octstr *data, *pack;
+    unsigned char buf[4];
+    long l, pos, n;
+
+    data = octstr_create("");
+    for (l = 0; l < gwlist_len(msgs); l++) {
+        pack = store_msg_pack(gwlist_get(msgs, l));
+        encode_network_long(buf, octstr_len(pack));
+        octstr_append_data(data, (char*)buf, 4);
+        octstr_append(data, pack);
+        octstr_destroy(pack);
+    }
+
+    seg = segment_create(id);
+    seg->fd = open(octstr_get_cstr(seg->name), O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+    for (pos = 0, n = 0; seg->fd != -1 && pos < octstr_len(data); pos += n) {
+        if ((n = octstr_write_data(data, seg->fd, pos)) == -1)
+            break;
+    }
+    if (seg->fd == -1 || pos < octstr_len(data) || wal_sync(seg->fd) == -1) {
+        error(errno, "Failed to write store segment `%s'", octstr_get_cstr(seg->name));
+        unlink(octstr_get_cstr(seg->name));
+        segment_destroy(seg);
+        octstr_destroy(data);
+        return NULL;
+    }
+    close(seg->fd);
+    seg->fd = -1;
+    sync_dir();
+
+    seg->size = octstr_len(data);
+    seg->records = gwlist_len(msgs);
+    seg->sealed = 1;
+    octstr_destroy(data);
+
+    return seg;
+}
+
+
+/*
+ * Reclaim space from the sealed segments. A segment without live messages
+ * is unlinked, but only at the head of the log, so an ack can never
+ * outlive the message it refers to on disk. A mostly acknowledged segment
+ * gets its remaining messages copied forward. So does a mostly live one
+ * while the sealed log as a whole is mostly acknowledged, otherwise a
+ * long lived head would keep every segment after it on disk.
+ *
+ * The copies are written without holding wal_mutex, to a segment whose id
+ * is reserved between the compacted ones and a new active segment. So
+ * whatever is saved meanwhile, acks of copied messages included, is
+ * replayed after the copies on load.
+ */
+static void wal_compact(void)
+{
+    static int compacting = 0;
+    WalSegment *seg, *copy;
+    WalEntry *entry;
+    List *keys, *ids, *msgs;
+    Octstr *key;
+    long i, l, live, records, compact, id;
+
+    mutex_lock(wal_mutex);
+    if (compacting) {
+        mutex_unlock(wal_mutex);
+        return;
+    }
+    live = records = 0;
+    for (i = 0; i < gwlist_len(segments); i++) {
+        seg = gwlist_get(segments, i);
+        if (!seg->sealed || seg->fd != -1)
+            break;
+        live += seg->live;
+        records += seg->records;
+    }
+
+    i = compact = 0;
+    while (i < gwlist_len(segments) && (seg = gwlist_get(segments, i))->sealed &&
+           seg->fd == -1) {
+        if (i == 0 && seg->live == 0) {
+            gwlist_delete(segments, 0, 1);
+            debug("bb.store", 0, "Removing store segment `%s'", octstr_get_cstr(seg->name));
+            if (unlink(octstr_get_cstr(seg->name)) == -1 && errno != ENOENT)
+                error(errno, "Failed to remove store segment `%s'",
+                      octstr_get_cstr(seg->name));
+            segment_destroy(seg);
+            continue;
+        }
+        if (seg->live > 0 && (seg->live * 2 <= seg->records || live * 2 <= records)) {
+            debug("bb.store", 0, "Compacting store segment `%s', %ld of %ld messages left",
+                  octstr_get_cstr(seg->name), seg->live, seg->records);
+            seg->compact = 1;
+            compact++;
+        }
+        i++;
+    }
+    if (compact == 0 || wal_failed) {
+        mutex_unlock(wal_mutex);
+        return;
+    }
+
+    /* snapshot the live messages of all segments being compacted */
+    ids = gwlist_create();
+    msgs = gwlist_create();
+    keys = dict_keys(sms_dict);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        entry = dict_get(sms_dict, key);
+        if (entry == NULL || !entry->seg->compact) {
+            octstr_destroy(key);
+            continue;
+        }
+        gwlist_append(ids, key);
+        gwlist_append(msgs, msg_duplicate(entry->msg));
+    }
+    gwlist_destroy(keys, NULL);
+
+    /* reserve the id of the copy, saves go on after it */
+    id = active_seg->id + 1;
+    if (segment_open(id + 1) == -1) {
+        wal_failed = 1;
+        copy = NULL;
+    } else {
+        compacting = 1;
+        mutex_unlock(wal_mutex);
+        copy = segment_write(id, msgs);
+        mutex_lock(wal_mutex);
+        compacting = 0;
+    }
+
+    /* entries still in their compacted segment now live in the copy */
+    for (l = 0; copy != NULL && l < gwlist_len(ids); l++) {
+        entry = dict_get(sms_dict, gwlist_get(ids, l));
+        if (entry == NULL || !entry->seg->compact)
+            continue;
+        entry->seg->live--;
+        entry->seg = copy;
+        copy->live++;
+    }
+    for (l = 0; l < gwlist_len(segments); l++) {
+        seg = gwlist_get(segments, l);
+        seg->compact = 0;
+        if (copy != NULL && seg->id > id) {
+            gwlist_insert(segments, l, copy);
+            copy = NULL;
+        }
+    }
+    mutex_unlock(wal_mutex);
+
+    gwlist_destroy(ids, octstr_destroy_item);
+    gwlist_destroy(msgs, msg_destroy_item);
+}
+
+
+/* compaction thread, runs every store-dump-freq seconds */
+static void wal_compactor(void *arg)
+{
+    while (active) {
+        wal_compact();
+        gwthread_sleep(dump_frequency);
+    }
+}
+
+
+/*------------------------------------------------------*/
+
+static void store_wal_for_each_message(void(*callback_fn)(Msg* msg, void *data), void *data)
+{
+    List *keys;
+    WalEntry *entry;
+    long l;
+
+    if (wal_dir == NULL)
+        return;
+
+    mutex_lock(wal_mutex);
+    keys = dict_keys(sms_dict);
+    for (l = 0; l < gwlist_len(keys); l++) {
+        entry = dict_get(sms_dict, gwlist_get(keys, l));
+        if (entry == NULL)
+            continue;
+        callback_fn(entry->msg, data);
+    }
+    mutex_unlock(wal_mutex);
+
+    gwlist_destroy(keys, octstr_destroy_item);
+}
+
+
+static long store_wal_messages(void)
+{
+    return (sms_dict ? dict_key_count(sms_dict) : -1);
+}
+
+
+static int store_wal_save(Msg *msg)
+{
+    long lsn;
+    int ret;
+
+    if (wal_dir == NULL)
+        return 0;
+
+    /* block here until store not loaded */
+    gwlist_consume(loaded);
+
+    /* always set msg id and timestamp */
+    if (msg_type(msg) == sms && uuid_is_null(msg->sms.id))
+        uuid_generate(msg->sms.id);
+
+    if (msg_type(msg) == sms && msg->sms.time == MSG_PARAM_UNDEFINED)
+        time(&msg->sms.time);
+
+    mutex_lock(wal_mutex);
+    if (wal_failed || store_to_dict(msg, active_seg, 0) == -1) {
+        mutex_unlock(wal_mutex);
+        return -1;
+    }
+    lsn = append_record(msg);
+
+    /* in interval mode the committer picks it up with its next round */
+    ret = (sync_interval > 0 ? 0 : wait_synced(lsn));
+    mutex_unlock(wal_mutex);
+
+    return ret;
+}
+
+
+static int store_wal_save_ack(Msg *msg, ack_status_t status)
+{
+    Msg *mack;
+    int ret;
+
+    /* only sms are handled */
+    if (!msg || msg_type(msg) != sms)
+        return -1;
+
+    if (wal_dir == NULL)
+        return 0;
+
+    mack = msg_create(ack);
+    if (!mack)
+        return -1;
+
+    mack->ack.time = msg->sms.time;
+    uuid_copy(mack->ack.id, msg->sms.id);
+    mack->ack.nack = status;
+
+    ret = store_save(mack);
+    msg_destroy(mack);
+
+    return ret;
+}
+
+
+typedef struct {
+    Mutex *lock;
+    long next;
+    long count;
+    WalSegment **segs;
+    List **records;
+} WalLoadJob;
+
+
+/* parse whole segment files into lists of messages, several at a time */
+static void wal_load_worker(void *arg)
+{
+    WalLoadJob *job = arg;
+    WalSegment *seg;
+    Octstr *data;
+    Msg *msg;
+    List *records;
+    long i, pos;
+
+    for (;;) {
+        mutex_lock(job->lock);
+        i = job->next++;
+        mutex_unlock(job->lock);
+        if (i >= job->count)
+            break;
+
+        seg = job->segs[i];
+        records = gwlist_create();
+        if ((data = octstr_read_file(octstr_get_cstr(seg->name))) == NULL) {
+            error(0, "Cannot read store segment `%s', skipped.", octstr_get_cstr(seg->name));
+            job->records[i] = records;
+            continue;
+        }
+        seg->size = octstr_len(data);
+        pos = 0;
+        while (pos < octstr_len(data)) {
+            if (read_msg(&msg, data, &pos) == -1) {
+                /* an interrupted write leaves a torn tail, nothing follows it */
+                warning(0, "Truncated or corrupt record in store segment `%s' "
+                        "at offset %ld, ignoring rest of segment.",
+                        octstr_get_cstr(seg->name), pos);
+                break;
+            }
+            gwlist_append(records, msg);
+        }
+        octstr_destroy(data);
+        job->records[i] = records;
+    }
+}
+
+
+static int segment_cmp(const void *a, const void *b)
+{
+    const WalSegment *sa = a, *sb = b;
+
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+
+static int store_wal_load(void(*receive_msg)(Msg*))
+{
+    DIR *dir;
+    struct dirent *ent;
+    WalLoadJob job;
+    WalSegment *seg;
+    WalEntry *entry;
+    List *keys;
+    Octstr *key;
+    Msg *msg;
+    long threads[WAL_LOAD_THREADS];
+    long i, n, msgs, id;
+    char tail;
+    int retval = 0;
+
+    if (wal_dir == NULL)
+        return 0;
+
+    mutex_lock(wal_mutex);
+
+    if ((dir = opendir(octstr_get_cstr(wal_dir))) == NULL) {
+        if (errno != ENOENT || mkdir(octstr_get_cstr(wal_dir), S_IRWXU) == -1) {
+            error(errno, "Could not open store directory `%s'", octstr_get_cstr(wal_dir));
+            mutex_unlock(wal_mutex);
+            gwlist_remove_producer(loaded);
+            return -1;
+        }
+        dir = opendir(octstr_get_cstr(wal_dir));
+    }
+    while (dir != NULL && (ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "wal-%lx.lo%c", &id, &tail) != 2 || tail != 'g')
+            continue;
+        seg = segment_create(id);
+        seg->sealed = 1;
+        gwlist_append(segments, seg);
+    }
+    if (dir != NULL)
+        closedir(dir);
+
+    gwlist_sort(segments, segment_cmp);
+
+    /* parse segments in parallel */
+    job.count = gwlist_len(segments);
+    job.next = 0;
+    job.lock = mutex_create();
+    job.segs = gw_malloc(sizeof(WalSegment*) * (job.count + 1));
+    job.records = gw_malloc(sizeof(List*) * (job.count + 1));
+    for (i = 0; i < job.count; i++) {
+        job.segs[i] = gwlist_get(segments, i);
+        job.records[i] = NULL;
+    }
+    if (job.count > 0)
+        info(0, "Loading %ld store segments from `%s'", job.count, octstr_get_cstr(wal_dir));
+    else
+        info(0, "No store segments found in `%s', starting a new log",
+             octstr_get_cstr(wal_dir));
+
+    n = (job.count < WAL_LOAD_THREADS ? job.count : WAL_LOAD_THREADS);
+    for (i = 0; i < n; i++) {
+        if ((threads[i] = gwthread_create(wal_load_worker, &job)) == -1)
+            break;
+    }
+    n = i;
+    if (n == 0)
+        wal_load_worker(&job);
+    for (i = 0; i < n; i++)
+        gwthread_join(threads[i]);
+    mutex_destroy(job.lock);
+
+    /* replay them in log order */
+    msgs = 0;
+    for (i = 0; i < job.count; i++) {
+        seg = job.segs[i];
+        while ((msg = gwlist_extract_first(job.records[i])) != NULL) {
+            if (msg_type(msg) == sms)
+                msgs++;
+            if (store_to_dict(msg, seg, 1) == -1) {
+                warning(0, "Strange message in store segment, discarded, "
+                        "dump follows:");
+                msg_dump(msg, 0);
+            }
+            msg_destroy(msg);
+        }
+        gwlist_destroy(job.records[i], NULL);
+        active_seg = seg;
+    }
+    gw_free(job.segs);
+    gw_free(job.records);
+
+    info(0, "Retrieved %ld messages, non-acknowledged messages: %ld",
+         msgs, dict_key_count(sms_dict));
+
+    /* never append to a possibly torn segment, start a new one */
+    if (segment_open(active_seg != NULL ? active_seg->id + 1 : 1) == -1)
+        retval = -1;
+
+    keys = dict_keys(sms_dict);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        entry = dict_get(sms_dict, key);
+        if (entry != NULL)
+            receive_msg(msg_duplicate(entry->msg));
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+
+    mutex_unlock(wal_mutex);
+
+    /* allow using of store */
+    gwlist_remove_producer(loaded);
+
+    if ((committer_thread = gwthread_create(wal_committer, NULL)) == -1)
+        panic(0, "Failed to create a store committer thread!");
+    if ((compactor_thread = gwthread_create(wal_compactor, NULL)) == -1)
+        panic(0, "Failed to create a store compaction thread!");
+
+    return retval;
+}
+
+
+static int store_wal_dump(void)
+{
+    int retval = 0;
+
+    if (wal_dir == NULL)
+        return 0;
+
+    debug("bb.store", 0, "Syncing %ld messages in store", dict_key_count(sms_dict));
+    mutex_lock(wal_mutex);
+    if (active_seg != NULL)
+        retval = wait_synced(enqueued_lsn);
+    mutex_unlock(wal_mutex);
+    wal_compact();
+
+    return retval;
+}
+
+
+static void store_wal_shutdown(void)
+{
+    WalSegment *seg;
+
+    if (wal_dir == NULL)
+        return;
+
+    mutex_lock(wal_mutex);
+    active = 0;
+    pthread_cond_signal(&commit_cond);
+    mutex_unlock(wal_mutex);
+
+    if (compactor_thread != -1) {
+        gwthread_wakeup(compactor_thread);
+        gwthread_join(compactor_thread);
+    }
+    /* committer flushes whatever is still pending before leaving */
+    if (committer_thread != -1)
+        gwthread_join(committer_thread);
+    committer_thread = compactor_thread = -1;
+
+    while ((seg = gwlist_extract_first(segments)) != NULL)
+        segment_destroy(seg);
+    gwlist_destroy(segments, NULL);
+    dict_destroy(sms_dict);
+    mutex_destroy(wal_mutex);
+    pthread_cond_destroy(&commit_cond);
+    pthread_cond_destroy(&synced_cond);
+    octstr_destroy(wal_dir);
+    gwlist_destroy(loaded, NULL);
+
+    segments = NULL;
+    sms_dict = NULL;
+    active_seg = NULL;
+    wal_mutex = NULL;
+    wal_dir = NULL;
+    loaded = NULL;
+}
+
+
+int store_wal_init(Cfg *cfg, const Octstr *dirname, long dump_freq)
+{
+    CfgGroup *grp;
+    long val;
+
+    /* Initialize function pointers */
+    store_messages = store_wal_messages;
+    store_save = store_wal_save;
+    store_save_ack = store_wal_save_ack;
+    store_load = store_wal_load;
+    store_dump = store_wal_dump;
+    store_shutdown = store_wal_shutdown;
+    store_for_each_message = store_wal_for_each_message;
+
+    if (dirname == NULL)
+        return 0; /* we are done */
+
+    if (octstr_len(dirname) > (FILENAME_MAX-30))
+        panic(0, "Store directory name too long: `%s', failed to init.",
+              octstr_get_cstr(dirname));
+
+    segment_size = WAL_DEFAULT_SEGMENT_SIZE;
+    sync_interval = 0;
+    if (cfg != NULL && (grp = cfg_get_single_group(cfg, octstr_imm("core"))) != NULL) {
+        if (cfg_get_integer(&val, grp, octstr_imm("store-wal-segment-size")) != -1 && val > 0)
+            segment_size = val;
+        if (cfg_get_integer(&val, grp, octstr_imm("store-wal-sync-interval")) != -1 && val >= 0)
+            sync_interval = val;
+    }
+
+    if (dump_freq > 0)
+        dump_frequency = dump_freq;
+    else
+        dump_frequency = BB_STORE_DEFAULT_DUMP_FREQ;
+
+    wal_dir = octstr_duplicate(dirname);
+    sms_dict = dict_create(1024, wal_entry_destroy);
+    segments = gwlist_create();
+    active_seg = NULL;
+    enqueued_lsn = synced_lsn = 0;
+    wal_failed = 0;
+
+    wal_mutex = mutex_create();
+    pthread_cond_init(&commit_cond, NULL);
+    pthread_cond_init(&synced_cond, NULL);
+    active = 1;
+
+    loaded = gwlist_create();
+    gwlist_add_producer(loaded);
+
+    info(0, "Using write-ahead log store in `%s' (segment size %ld, %s)",
+         octstr_get_cstr(wal_dir), segment_size,
+         sync_interval > 0 ? "periodic sync" : "synchronous commit");
+
+    return 0;
+}
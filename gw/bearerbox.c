@@ -73,6 +73,7 @@
 #include <unistd.h>
 
 #include "gwlib/gwlib.h"
+#include "gwlib/dbpool.h"
 #include "msg.h"
 #include "bearerbox.h"
 #include "shared.h"
@@ -81,8 +82,8 @@
 
 /* global variables; included to other modules as needed */
 
-List *incoming_sms;
-List *outgoing_sms;
+gw_mpmcqueue_t *incoming_sms;
+gw_mpmcqueue_t *outgoing_sms;
 
 
 Counter *incoming_sms_counter;
@@ -423,7 +424,7 @@ static Cfg *init_bearerbox(Cfg *cfg)
         log = cfg_get(grp, octstr_imm("store-location"));
         val = cfg_get(grp, octstr_imm("store-type"));
     }
-    if (store_init(cfg, val, log, store_dump_freq, msg_pack, msg_unpack_wrapper) == -1)
+    if (store_init(cfg, val, log, store_dump_freq, msg_pack_binary, msg_unpack_wrapper) == -1)
         panic(0, "Could not start with store init failed.");
     octstr_destroy(val);
     octstr_destroy(log);
@@ -470,8 +471,8 @@ static Cfg *init_bearerbox(Cfg *cfg)
 
     /* if all seems to be OK by the first glimpse, real start-up */
 
-    outgoing_sms = gwlist_create();
-    incoming_sms = gwlist_create();
+    outgoing_sms = gw_mpmcqueue_create(BB_QUEUE_SIZE);
+    incoming_sms = gw_mpmcqueue_create(BB_QUEUE_SIZE);
 
     outgoing_sms_counter = counter_create();
     incoming_sms_counter = counter_create();
@@ -528,6 +529,12 @@ static Cfg *init_bearerbox(Cfg *cfg)
 
     if (cfg_get_integer(&value, grp, octstr_imm("http-timeout")) == 0)
         http_set_client_timeout(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-client-threads")) == 0)
+        http_set_client_threads(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-resolver-threads")) == 0)
+        http_set_resolver_threads(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-client-max-connections")) == 0)
+        http_set_client_max_connections(value);
 #ifndef NO_SMS    
     {
         List *list;
@@ -569,9 +576,9 @@ static void empty_msg_lists(void)
     
 #ifndef NO_SMS
     /* XXX we should record these so that they are not forever lost... */
-    if (gwlist_len(incoming_sms) > 0 || gwlist_len(outgoing_sms) > 0)
+    if (gw_mpmcqueue_len(incoming_sms) > 0 || gw_mpmcqueue_len(outgoing_sms) > 0)
         debug("bb", 0, "Remaining SMS: %ld incoming, %ld outgoing",
-              gwlist_len(incoming_sms), gwlist_len(outgoing_sms));
+              gw_mpmcqueue_len(incoming_sms), gw_mpmcqueue_len(outgoing_sms));
 
     info(0, "Total SMS messages: received %ld, dlr %ld, sent %ld, dlr %ld",
          counter_value(incoming_sms_counter),
@@ -580,8 +587,8 @@ static void empty_msg_lists(void)
          counter_value(outgoing_dlr_counter));
 #endif
 
-    gwlist_destroy(incoming_sms, msg_destroy_item);
-    gwlist_destroy(outgoing_sms, msg_destroy_item);
+    gw_mpmcqueue_destroy(incoming_sms, msg_destroy_item);
+    gw_mpmcqueue_destroy(outgoing_sms, msg_destroy_item);
     
     counter_destroy(incoming_sms_counter);
     counter_destroy(incoming_dlr_counter);
@@ -606,11 +613,11 @@ static void dispatch_into_queue(Msg *msg)
         case mt_push:
         case mt_reply:
         case report_mt:
-            gwlist_append(outgoing_sms, msg);
+            gw_mpmcqueue_produce(outgoing_sms, msg);
             break;
         case mo:
         case report_mo:
-            gwlist_append(incoming_sms, msg);
+            gw_mpmcqueue_produce(incoming_sms, msg);
             break;
         default:
             uuid_unparse(msg->sms.id, id);
@@ -1034,8 +1041,8 @@ Octstr *bb_print_status(int status_type)
     ret = octstr_format(frmt,
         octstr_get_cstr(version),
         s, t/3600/24, t/3600%24, t/60%60, t%60,
-        counter_value(incoming_sms_counter), gwlist_len(incoming_sms),
-        counter_value(outgoing_sms_counter), gwlist_len(outgoing_sms),
+        counter_value(incoming_sms_counter), boxc_incoming_queued(),
+        counter_value(outgoing_sms_counter), gw_mpmcqueue_len(outgoing_sms) + smsc2_queued(),
         store_messages(),
         load_get(incoming_sms_load,0), load_get(incoming_sms_load,1), load_get(incoming_sms_load,2),
         load_get(outgoing_sms_load,0), load_get(outgoing_sms_load,1), load_get(outgoing_sms_load,2),
@@ -1108,7 +1115,7 @@ Octstr *bb_health_status(int *is_healthy)
     smsc2_status_counts(&smsc_total, &smsc_online);
 
     /* Get queue length */
-    sms_queued = gwlist_len(incoming_sms) + gwlist_len(outgoing_sms);
+    sms_queued = boxc_incoming_queued() + gw_mpmcqueue_len(outgoing_sms) + smsc2_queued();
 
     /* Get log queue status */
     log_queue_status(&log_status);
@@ -1220,12 +1227,36 @@ Octstr *bb_health_status(int *is_healthy)
 }
 
 
+/*
+ * Append a histogram from per bucket counts, Prometheus wants them summed up.
+ */
+static void prometheus_histogram(Octstr *out, const char *name, const char *help,
+                                 const long *buckets, double sum)
+{
+    static const double bounds[] = DBPOOL_HISTOGRAM_BOUNDS;
+    long count = 0;
+    int i;
+
+    octstr_format_append(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (i = 0; i < DBPOOL_HISTOGRAM_BUCKETS; i++) {
+        count += buckets[i];
+        if (i < DBPOOL_HISTOGRAM_BUCKETS - 1)
+            octstr_format_append(out, "%s_bucket{le=\"%g\"} %ld\n", name, bounds[i], count);
+        else
+            octstr_format_append(out, "%s_bucket{le=\"+Inf\"} %ld\n", name, count);
+    }
+    octstr_format_append(out, "%s_sum %.6f\n%s_count %ld\n", name, sum, name, count);
+}
+
+
 Octstr *bb_prometheus_metrics(void)
 {
     Octstr *out;
     time_t t;
     int smsc_total, smsc_online;
     LogQueueStatus log_status;
+    HTTPClientPoolStatus pool_status;
+    DBPoolStatus db_status;
 
     out = octstr_create("");
     t = time(NULL) - start_time;
@@ -1236,6 +1267,12 @@ Octstr *bb_prometheus_metrics(void)
     /* Get log queue status */
     log_queue_status(&log_status);
 
+    /* Get HTTP client pool status */
+    http_client_pool_status(&pool_status);
+
+    /* Get database pool status */
+    dbpool_status(&db_status);
+
     /* Counters - monotonically increasing */
     octstr_format_append(out,
         "# HELP kamex_sms_received_total Total SMS messages received\n"
@@ -1272,13 +1309,19 @@ Octstr *bb_prometheus_metrics(void)
         "# HELP kamex_sms_queue_incoming Queued incoming SMS\n"
         "# TYPE kamex_sms_queue_incoming gauge\n"
         "kamex_sms_queue_incoming %ld\n\n",
-        gwlist_len(incoming_sms));
+        boxc_incoming_queued());
 
     octstr_format_append(out,
         "# HELP kamex_sms_queue_outgoing Queued outgoing SMS\n"
         "# TYPE kamex_sms_queue_outgoing gauge\n"
         "kamex_sms_queue_outgoing %ld\n\n",
-        gwlist_len(outgoing_sms));
+        gw_mpmcqueue_len(outgoing_sms) + smsc2_queued());
+
+    octstr_format_append(out,
+        "# HELP kamex_sms_queue_resend Outgoing SMS waiting to be resent\n"
+        "# TYPE kamex_sms_queue_resend gauge\n"
+        "kamex_sms_queue_resend %ld\n\n",
+        smsc2_resend_queued());
 
     octstr_format_append(out,
         "# HELP kamex_store_messages Messages in persistent store\n"
@@ -1345,8 +1388,70 @@ Octstr *bb_prometheus_metrics(void)
     octstr_format_append(out,
         "# HELP kamex_log_dropped_total Log messages dropped\n"
         "# TYPE kamex_log_dropped_total counter\n"
-        "kamex_log_dropped_total %ld\n",
+        "kamex_log_dropped_total %ld\n\n",
         log_status.dropped_total);
 
+    /* HTTP client connection pool metrics */
+    octstr_format_append(out,
+        "# HELP kamex_http_client_pool_hits_total HTTP requests on a reused connection\n"
+        "# TYPE kamex_http_client_pool_hits_total counter\n"
+        "kamex_http_client_pool_hits_total %ld\n\n",
+        pool_status.hits);
+
+    octstr_format_append(out,
+        "# HELP kamex_http_client_pool_misses_total HTTP requests on a new connection\n"
+        "# TYPE kamex_http_client_pool_misses_total counter\n"
+        "kamex_http_client_pool_misses_total %ld\n\n",
+        pool_status.misses);
+
+    octstr_format_append(out,
+        "# HELP kamex_http_client_pool_waits_total HTTP requests that waited for a connection\n"
+        "# TYPE kamex_http_client_pool_waits_total counter\n"
+        "kamex_http_client_pool_waits_total %ld\n\n",
+        pool_status.waits);
+
+    octstr_format_append(out,
+        "# HELP kamex_http_client_connections Open HTTP client connections\n"
+        "# TYPE kamex_http_client_connections gauge\n"
+        "kamex_http_client_connections %ld\n\n",
+        pool_status.open);
+
+    octstr_format_append(out,
+        "# HELP kamex_http_client_waiting HTTP requests waiting for a connection\n"
+        "# TYPE kamex_http_client_waiting gauge\n"
+        "kamex_http_client_waiting %ld\n\n",
+        pool_status.waiting);
+
+    /* Database connection pool metrics */
+    octstr_format_append(out,
+        "# HELP kamex_dbpool_checks_total Database connections checked before use\n"
+        "# TYPE kamex_dbpool_checks_total counter\n"
+        "kamex_dbpool_checks_total %ld\n\n",
+        db_status.checks);
+
+    octstr_format_append(out,
+        "# HELP kamex_dbpool_reconnects_total Database connections replaced\n"
+        "# TYPE kamex_dbpool_reconnects_total counter\n"
+        "kamex_dbpool_reconnects_total %ld\n\n",
+        db_status.reconnects);
+
+    octstr_format_append(out,
+        "# HELP kamex_dbpool_statements_prepared_total Database statements prepared\n"
+        "# TYPE kamex_dbpool_statements_prepared_total counter\n"
+        "kamex_dbpool_statements_prepared_total %ld\n\n",
+        db_status.prepared);
+
+    octstr_format_append(out,
+        "# HELP kamex_dbpool_statements_reused_total Database statements run without preparing again\n"
+        "# TYPE kamex_dbpool_statements_reused_total counter\n"
+        "kamex_dbpool_statements_reused_total %ld\n\n",
+        db_status.reused);
+
+    prometheus_histogram(out, "kamex_dbpool_wait_seconds",
+        "Time waited for a database connection", db_status.wait, db_status.wait_sum);
+    octstr_append_cstr(out, "\n");
+    prometheus_histogram(out, "kamex_dbpool_checkout_seconds",
+        "Time a database connection was in use", db_status.hold, db_status.hold_sum);
+
     return out;
 }
@@ -68,6 +68,13 @@
 /* Default outgoing queue length */
 #define DEFAULT_OUTGOING_SMS_QLENGTH    1000000
 
+/*
+ * Lock-free part of the global and per-box message queues; longer queues
+ * spill over into a locked list, so these are not limits.
+ */
+#define BB_QUEUE_SIZE                   65536
+#define BOXC_QUEUE_SIZE                 1024
+
 /* general bearerbox state */
 
 enum {
@@ -117,10 +124,14 @@ void boxc_cleanup(void);
  * Route the incoming message to one of the following input queues:
  *   a specific smsbox conn
  *   a random smsbox conn if no shortcut routing and msg->sms.boxc_id match.
- * @return -1 if incoming queue full; 0 otherwise.
+ * @return -1 if incoming queue full; 1 if passed to a box; 0 if queued
+ *         until a box for it is available.
  */
 int route_incoming_to_boxc(Msg *msg);
 
+/* Number of incoming SMS still waiting for an smsbox. */
+long boxc_incoming_queued(void);
+
 
 
 
@@ -143,11 +154,21 @@ Octstr *smsc2_status(int status_type);
 /* Get SMSC connection counts for health check */
 void smsc2_status_counts(int *total, int *online);
 
+/*
+ * Number of outgoing SMS parked until one of their SMSCs is active or
+ * waiting to be resent
+ */
+long smsc2_queued(void);
+
+/* Number of outgoing SMS waiting to be resent */
+long smsc2_resend_queued(void);
+
 /* function to route outgoing SMS'es
  *
  * If finds a good one, puts into it and returns SMSCCONN_SUCCESS
- * If finds only bad ones, but acceptable, queues and
- *  returns SMSCCONN_QUEUED  (like all acceptable currently disconnected)
+ * If finds only bad ones, but acceptable, parks it until one of them
+ *  is active and returns SMSCCONN_QUEUED  (like all acceptable currently
+ *  disconnected)
  * if message acceptable but queues full returns SMSCCONN_FAILED_QFULL and
  * message is not destroyed.
  * If cannot find nothing at all, returns SMSCCONN_FAILED_DISCARDED and
@@ -96,6 +96,30 @@
 /* Our callback functions */
 static struct dlr_storage *handles = NULL;
 
+/*
+ * Write-behind buffer. If enabled, dlr_add() only queues the entry and
+ * the writer thread hands queued entries over to the storage in batches,
+ * so that a slow database does not stall the SMSC connection adding them.
+ * Entries stay in the lookaside dict until they are stored and dlr_find()
+ * looks there first. A DLR arriving before its entry is written is
+ * resolved from memory, and the final remove then never hits the storage.
+ */
+struct pending_dlr {
+    struct dlr_entry *entry;
+    Octstr *key;
+    int status;     /* dlr_update() to apply once stored */
+    int removed;    /* 1 = dlr_remove() to apply once stored, 2 = applied */
+};
+
+static List *pending = NULL;        /* queued struct pending_dlr, oldest first */
+static Dict *lookaside = NULL;      /* "smsc ts" -> List of struct pending_dlr */
+static Mutex *pending_lock = NULL;
+static Semaphore *pending_slots = NULL;
+static long batch_size;
+static long writer_thread = -1;
+static int writer_running = 0;
+static int writer_idle = 0;
+
 /*
  * Function to allocate a new struct dlr_entry entry
  * and initialize it to zero
@@ -161,6 +185,23 @@ void dlr_entry_destroy(struct dlr_entry *dlr)
     gw_free(dlr);
 }
 
+/*
+ * Return 1 if a report of type status is the last one for any entry.
+ */
+int dlr_status_final(int status)
+{
+    return !DLR_IS_NOT_FINAL(status);
+}
+
+/*
+ * Return 1 if the entry has to stay in the storage after a report of
+ * type status, i.e. an intermediate one while a final one is requested.
+ */
+int dlr_entry_keep(const struct dlr_entry *dlr, int status)
+{
+    return !dlr_status_final(status) && DLR_IS_SUCCESS_OR_FAIL(dlr->mask);
+}
+
 /*
  * Load all configuration directives that are common for all database
  * types that use the 'dlr-db' group to define which attributes are 
@@ -226,6 +267,297 @@ void dlr_db_fields_destroy(struct dlr_db_fields *fields)
 }
 
 
+static Octstr *pending_key(const Octstr *smsc, const Octstr *ts)
+{
+    return octstr_format("%S %S", smsc, ts);
+}
+
+
+static Octstr *dst_shorten(const Octstr *dst)
+{
+    Octstr *dst_min;
+    long len;
+
+    dst_min = octstr_duplicate(dst);
+    len = octstr_len(dst_min);
+    if (len > MIN_DST_LEN)
+        octstr_delete(dst_min, 0, len - MIN_DST_LEN);
+
+    return dst_min;
+}
+
+
+/*
+ * Return the buffered entry for smsc, ts and (the tail of) dst. Entries
+ * removed already are only returned if there is no other one.
+ * NOTE: pending_lock must be held.
+ */
+static struct pending_dlr *pending_lookup(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    struct pending_dlr *p, *removed = NULL;
+    Octstr *key;
+    List *list;
+    long i, off;
+
+    key = pending_key(smsc, ts);
+    list = dict_get(lookaside, key);
+    octstr_destroy(key);
+
+    for (i = 0; i < gwlist_len(list); i++) {
+        p = gwlist_get(list, i);
+        if (dst != NULL) {
+            /* the same as the storages' LIKE '%dst' */
+            off = octstr_len(p->entry->destination) - octstr_len(dst);
+            if (off < 0 || octstr_search(p->entry->destination, dst, off) != off)
+                continue;
+        }
+        if (!p->removed)
+            return p;
+        if (removed == NULL)
+            removed = p;
+    }
+
+    return removed;
+}
+
+
+/*
+ * Drop the entry from the lookaside dict.
+ * NOTE: pending_lock must be held.
+ */
+static void pending_forget(struct pending_dlr *p)
+{
+    List *list;
+
+    list = dict_get(lookaside, p->key);
+    gwlist_delete_equal(list, p);
+    if (gwlist_len(list) == 0) {
+        dict_remove(lookaside, p->key);
+        gwlist_destroy(list, NULL);
+    }
+}
+
+
+static void pending_destroy(struct pending_dlr *p)
+{
+    dlr_entry_destroy(p->entry);
+    octstr_destroy(p->key);
+    gw_free(p);
+    semaphore_up(pending_slots);
+}
+
+
+static void pending_add(struct dlr_entry *dlr)
+{
+    struct pending_dlr *p;
+    List *list;
+    int wakeup;
+
+    p = gw_malloc(sizeof(*p));
+    p->entry = dlr;
+    p->key = pending_key(dlr->smsc, dlr->timestamp);
+    p->status = 0;
+    p->removed = 0;
+
+    /* blocks while the buffer is full */
+    semaphore_down(pending_slots);
+
+    mutex_lock(pending_lock);
+    if ((list = dict_get(lookaside, p->key)) == NULL) {
+        list = gwlist_create();
+        dict_put(lookaside, p->key, list);
+    }
+    gwlist_append(list, p);
+    gwlist_append(pending, p);
+    wakeup = writer_idle;
+    writer_idle = 0;
+    mutex_unlock(pending_lock);
+
+    if (wakeup)
+        gwthread_wakeup(writer_thread);
+}
+
+
+/*
+ * Return 1 if the entry is still buffered, with a copy of it in *dlr or
+ * NULL if it has been removed. Return 0 if the storage has to be asked.
+ */
+static int pending_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst,
+                       struct dlr_entry **dlr)
+{
+    struct pending_dlr *p;
+
+    mutex_lock(pending_lock);
+    p = pending_lookup(smsc, ts, dst);
+    if (p != NULL)
+        *dlr = (p->removed ? NULL : dlr_entry_duplicate(p->entry));
+    mutex_unlock(pending_lock);
+
+    return p != NULL;
+}
+
+
+/*
+ * Record an update (or the removal if remove is set) for a buffered entry,
+ * the writer applies it once the entry is stored. Return 0 if the entry
+ * is not buffered anymore and the storage has to be changed directly.
+ */
+static int pending_change(const Octstr *smsc, const Octstr *ts, const Octstr *dst,
+                          int status, int remove)
+{
+    struct pending_dlr *p;
+
+    mutex_lock(pending_lock);
+    p = pending_lookup(smsc, ts, dst);
+    if (p != NULL && !p->removed) {
+        if (remove)
+            p->removed = 1;
+        else
+            p->status = status;
+    }
+    mutex_unlock(pending_lock);
+
+    return p != NULL;
+}
+
+
+/*
+ * Apply what dlr_find() did to the entry while it was being stored, then
+ * let go of it. The entry stays visible until then, so a DLR can't slip
+ * past to the storage in between.
+ */
+static void pending_stored(struct pending_dlr *p)
+{
+    struct dlr_entry *dlr = p->entry;
+    Octstr *dst = NULL;
+    int status, remove;
+
+    if (dlr->use_dst && dlr->destination)
+        dst = dst_shorten(dlr->destination);
+
+    mutex_lock(pending_lock);
+    for (;;) {
+        status = p->status;
+        remove = (p->removed == 1);
+        p->status = 0;
+        if (remove)
+            p->removed = 2;
+        else if (status == 0)
+            break;
+        mutex_unlock(pending_lock);
+
+        if (remove)
+            handles->dlr_remove(dlr->smsc, dlr->timestamp, dst);
+        else if (handles->dlr_update != NULL)
+            handles->dlr_update(dlr->smsc, dlr->timestamp, dst, status);
+
+        mutex_lock(pending_lock);
+    }
+    pending_forget(p);
+    mutex_unlock(pending_lock);
+
+    octstr_destroy(dst);
+    pending_destroy(p);
+}
+
+
+static void dlr_writer(void *arg)
+{
+    List *batch, *entries;
+    struct pending_dlr *p;
+    long i;
+
+    batch = gwlist_create();
+    entries = gwlist_create();
+
+    for (;;) {
+        mutex_lock(pending_lock);
+        while (gwlist_len(batch) < batch_size && (p = gwlist_extract_first(pending)) != NULL) {
+            if (p->removed) {
+                /* its DLR came before it was written, nothing to store */
+                pending_forget(p);
+                pending_destroy(p);
+                continue;
+            }
+            gwlist_append(batch, p);
+            gwlist_append(entries, p->entry);
+        }
+        if (gwlist_len(batch) == 0) {
+            if (!writer_running) {
+                mutex_unlock(pending_lock);
+                break;
+            }
+            writer_idle = 1;
+            mutex_unlock(pending_lock);
+            gwthread_sleep(-1);
+            continue;
+        }
+        mutex_unlock(pending_lock);
+
+        debug("dlr.dlr", 0, "DLR[%s]: Storing %ld buffered DLR entries",
+              dlr_type(), gwlist_len(entries));
+
+        if (handles->dlr_add_batch != NULL) {
+            handles->dlr_add_batch(entries);
+        } else {
+            for (i = 0; i < gwlist_len(entries); i++)
+                handles->dlr_add(dlr_entry_duplicate(gwlist_get(entries, i)));
+        }
+
+        while ((p = gwlist_extract_first(batch)) != NULL)
+            pending_stored(p);
+        while (gwlist_extract_first(entries) != NULL)
+            ;
+    }
+
+    gwlist_destroy(batch, NULL);
+    gwlist_destroy(entries, NULL);
+}
+
+
+static void write_behind_init(CfgGroup *grp)
+{
+    long size;
+
+    if (cfg_get_integer(&size, grp, octstr_imm("dlr-write-behind")) == -1 || size <= 0)
+        return;
+    if (cfg_get_integer(&batch_size, grp, octstr_imm("dlr-batch-size")) == -1 || batch_size <= 0)
+        batch_size = 100;
+
+    pending = gwlist_create();
+    lookaside = dict_create(size, NULL);
+    pending_lock = mutex_create();
+    pending_slots = semaphore_create(size);
+    writer_running = 1;
+
+    if ((writer_thread = gwthread_create(dlr_writer, NULL)) == -1)
+        panic(0, "DLR: can't start the write-behind thread");
+
+    info(0, "DLR buffering up to %ld entries, stored in batches of %ld", size, batch_size);
+}
+
+
+static void write_behind_shutdown(void)
+{
+    if (writer_thread == -1)
+        return;
+
+    mutex_lock(pending_lock);
+    writer_running = 0;
+    mutex_unlock(pending_lock);
+    gwthread_wakeup(writer_thread);
+    gwthread_join(writer_thread);
+    writer_thread = -1;
+
+    gwlist_destroy(pending, NULL);
+    dict_destroy(lookaside);
+    mutex_destroy(pending_lock);
+    semaphore_destroy(pending_slots);
+    pending = NULL;
+    lookaside = NULL;
+}
+
+
 /*
  * Initialize specifically dlr storage. If defined storage is unknown
  * then panic.
@@ -287,6 +619,8 @@ void dlr_init(Cfg* cfg)
     /* get info from storage */
     info(0, "DLR using storage type: %s", handles->type);
 
+    write_behind_init(grp);
+
     /* cleanup */
     octstr_destroy(dlr_type);
 }
@@ -296,6 +630,9 @@ void dlr_init(Cfg* cfg)
  */
 void dlr_shutdown()
 {
+    /* stores whatever is still buffered */
+    write_behind_shutdown();
+
     if (handles != NULL && handles->dlr_shutdown != NULL)
         handles->dlr_shutdown();
 }
@@ -305,8 +642,14 @@ void dlr_shutdown()
  */
 long dlr_messages(void)
 {
-    if (handles != NULL && handles->dlr_messages != NULL)
-        return handles->dlr_messages();
+    long msgs;
+
+    if (handles != NULL && handles->dlr_messages != NULL) {
+        msgs = handles->dlr_messages();
+        if (msgs != -1 && pending != NULL)
+            msgs += gwlist_len(pending);
+        return msgs;
+    }
 
     return -1;
 }
@@ -373,8 +716,11 @@ void dlr_add(const Octstr *smsc, const Octstr *ts, Msg *msg, int use_dst)
           dlr_type(), octstr_get_cstr(dlr->smsc), octstr_get_cstr(dlr->timestamp),
           octstr_get_cstr(dlr->source), octstr_get_cstr(dlr->destination), dlr->mask, octstr_get_cstr(dlr->boxc_id));
 	
-    /* call registered function */
-    handles->dlr_add(dlr);
+    /* call registered function, or leave it to the writer */
+    if (pending != NULL)
+        pending_add(dlr);
+    else
+        handles->dlr_add(dlr);
 }
 
 /*
@@ -388,6 +734,7 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
     struct dlr_entry *dlr = NULL;
     Octstr *dst_min = NULL;
     Octstr *dlr_mask;
+    int taken = 0;
     
     if(octstr_len(smsc) == 0) {
 	warning(0, "DLR[%s]: Can't find a dlr without smsc-id", dlr_type());
@@ -398,18 +745,22 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
     if (handles == NULL || handles->dlr_get == NULL)
         return NULL;
 
-    if (use_dst && dst) {
-        dst_min = octstr_duplicate(dst);
-        int len = octstr_len(dst);
+    if (use_dst && dst)
+        dst_min = dst_shorten(dst);
 
-        if (len > MIN_DST_LEN)
-            octstr_delete(dst_min, 0, len - MIN_DST_LEN);
-    }
     debug("dlr.dlr", 0, "DLR[%s]: Looking for DLR smsc=%s, ts=%s, dst=%s, type=%d",
                                  dlr_type(), octstr_get_cstr(smsc), octstr_get_cstr(ts), octstr_get_cstr(dst), typ);
 
-    dlr = handles->dlr_get(smsc, ts, dst_min);
+    if (pending != NULL && pending_get(smsc, ts, dst_min, &dlr)) {
+        /* still buffered, the storage doesn't know it yet */
+    } else if (handles->dlr_take != NULL) {
+        /* fetch and remove or update in one go */
+        dlr = handles->dlr_take(smsc, ts, dst_min, typ);
+        taken = 1;
+    } else
+        dlr = handles->dlr_get(smsc, ts, dst_min);
     if (dlr == NULL)  {
+        octstr_destroy(dst_min);
         warning(0, "DLR[%s]: DLR from SMSC<%s> for DST<%s> not found.",
                 dlr_type(), octstr_get_cstr(smsc), octstr_get_cstr(dst));         
         return NULL;
@@ -464,14 +815,20 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
 #undef O_SET
  
     /* check for end status and if so remove from storage */
-    if (DLR_IS_NOT_FINAL(typ) && DLR_IS_SUCCESS_OR_FAIL(dlr->mask)) {
+    if (taken) {
+        /* dlr_take did it already */
+    } else if (dlr_entry_keep(dlr, typ)) {
         debug("dlr.dlr", 0, "DLR[%s]: DLR not destroyed, still waiting for other delivery report", dlr_type());
         /* update dlr entry status if function defined */
-        if (handles != NULL && handles->dlr_update != NULL){
+        if (pending != NULL && pending_change(smsc, ts, dst_min, typ, 0)) {
+            /* still buffered, updated once stored */
+        } else if (handles != NULL && handles->dlr_update != NULL){
             handles->dlr_update(smsc, ts, dst_min, typ);
         }
     } else {
-        if (handles != NULL && handles->dlr_remove != NULL){
+        if (pending != NULL && pending_change(smsc, ts, dst_min, 0, 1)) {
+            /* still buffered, dropped or removed once stored */
+        } else if (handles != NULL && handles->dlr_remove != NULL){
             /* it's not good for internal storage, but better for all others */
             handles->dlr_remove(smsc, ts, dst_min);
         } else {
@@ -491,6 +848,19 @@ void dlr_flush(void)
     info(0, "Flushing all %ld queued DLR messages in %s storage", dlr_messages(), 
             dlr_type());
  
+    if (pending != NULL) {
+        struct pending_dlr *p;
+        long i;
+
+        /* queued entries are dropped instead of stored */
+        mutex_lock(pending_lock);
+        for (i = 0; i < gwlist_len(pending); i++) {
+            p = gwlist_get(pending, i);
+            p->removed = 2;
+        }
+        mutex_unlock(pending_lock);
+    }
+
     if (handles != NULL && handles->dlr_flush != NULL)
         handles->dlr_flush();
 }
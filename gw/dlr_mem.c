@@ -69,21 +69,174 @@
 #include "dlr_p.h"
 
 /*
- * This is the global list where all messages being sent out are being kept track
- * of his list is looked up once a delivery report comes in
+ * The waiting DLRs are kept in a number of independent shards, each one
+ * being a chained hash table keyed by (smsc, timestamp) and guarded by its
+ * own rwlock. Entries with the same key (e.g. EMI/UCP timestamps without
+ * milliseconds) are kept in insertion order on the same chain and are told
+ * apart by the destination suffix match. Every shard additionally keeps all
+ * of its entries on an age list, so expired entries can be dropped from the
+ * old end without scanning the table.
  */
-static List *dlr_waiting_list;
-static RWLock rwlock;
+#define DLR_MEM_SHARDS 64
+#define DLR_MEM_MIN_BUCKETS 1024
+
+typedef struct DlrMemNode DlrMemNode;
+struct DlrMemNode {
+    struct dlr_entry *dlr;
+    unsigned long hash;
+    time_t added;
+    DlrMemNode *next;       /* hash chain */
+    DlrMemNode *older;      /* age list */
+    DlrMemNode *newer;
+};
+
+typedef struct {
+    RWLock lock;
+    DlrMemNode **tab;
+    unsigned long size;     /* always a power of two */
+    long count;
+    DlrMemNode *oldest;
+    DlrMemNode *newest;
+} DlrMemShard;
+
+static DlrMemShard shards[DLR_MEM_SHARDS];
+
+/* seconds after which a waiting DLR is dropped, 0 means never */
+static long dlr_ttl = 0;
+
+
+static unsigned long dlr_mem_hash(const Octstr *smsc, const Octstr *ts)
+{
+    unsigned long hash;
+
+    hash = octstr_hash_key((Octstr *) smsc);
+    hash = hash * 31 + octstr_hash_key((Octstr *) ts);
+    /* spread the bits, octstr_hash_key() only gives us 31 of them */
+    hash ^= hash >> 15;
+    hash *= 2654435761UL;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+static DlrMemShard *dlr_mem_shard(unsigned long hash)
+{
+    return &shards[hash % DLR_MEM_SHARDS];
+}
+
+static unsigned long dlr_mem_bucket(DlrMemShard *shard, unsigned long hash)
+{
+    return (hash / DLR_MEM_SHARDS) & (shard->size - 1);
+}
+
+static void dlr_mem_shard_init(DlrMemShard *shard)
+{
+    gw_rwlock_init_static(&shard->lock);
+    shard->size = DLR_MEM_MIN_BUCKETS;
+    shard->tab = gw_malloc(sizeof(shard->tab[0]) * shard->size);
+    memset(shard->tab, 0, sizeof(shard->tab[0]) * shard->size);
+    shard->count = 0;
+    shard->oldest = shard->newest = NULL;
+}
+
+/*
+ * Double the number of buckets of the shard. Caller must hold the write lock.
+ */
+static void dlr_mem_shard_grow(DlrMemShard *shard)
+{
+    DlrMemNode **tab, *node, **tail;
+    unsigned long size;
+
+    size = shard->size * 2;
+    tab = gw_malloc(sizeof(tab[0]) * size);
+    memset(tab, 0, sizeof(tab[0]) * size);
+    shard->size = size;
+
+    /*
+     * Walk the age list instead of the old buckets, this way entries with
+     * equal keys stay in insertion order on their new chain.
+     */
+    for (node = shard->oldest; node != NULL; node = node->newer) {
+        node->next = NULL;
+        for (tail = &tab[dlr_mem_bucket(shard, node->hash)]; *tail != NULL; tail = &(*tail)->next)
+            ;
+        *tail = node;
+    }
+
+    gw_free(shard->tab);
+    shard->tab = tab;
+}
 
 /*
- * Destroy dlr_waiting_list.
+ * Unlink node from both the hash chain and the age list and destroy it.
+ * Caller must hold the write lock.
+ */
+static void dlr_mem_node_remove(DlrMemShard *shard, DlrMemNode *node)
+{
+    DlrMemNode **p;
+
+    for (p = &shard->tab[dlr_mem_bucket(shard, node->hash)]; *p != node; p = &(*p)->next)
+        gw_assert(*p != NULL);
+    *p = node->next;
+
+    if (node->older != NULL)
+        node->older->newer = node->newer;
+    else
+        shard->oldest = node->newer;
+    if (node->newer != NULL)
+        node->newer->older = node->older;
+    else
+        shard->newest = node->older;
+
+    shard->count--;
+    dlr_entry_destroy(node->dlr);
+    gw_free(node);
+}
+
+static int dlr_mem_node_expired(DlrMemNode *node, time_t now)
+{
+    return dlr_ttl > 0 && difftime(now, node->added) >= dlr_ttl;
+}
+
+/*
+ * Drop expired entries from the old end of the age list.
+ * Caller must hold the write lock.
+ */
+static void dlr_mem_shard_expire(DlrMemShard *shard, time_t now)
+{
+    while (shard->oldest != NULL && dlr_mem_node_expired(shard->oldest, now)) {
+        debug("dlr.mem", 0, "DLR[internal]: expiring entry smsc=%s, ts=%s, dst=%s",
+              octstr_get_cstr(shard->oldest->dlr->smsc),
+              octstr_get_cstr(shard->oldest->dlr->timestamp),
+              octstr_get_cstr(shard->oldest->dlr->destination));
+        dlr_mem_node_remove(shard, shard->oldest);
+    }
+}
+
+/*
+ * Destroy all shards.
  */
 static void dlr_mem_shutdown()
 {
-    gw_rwlock_wrlock(&rwlock);
-    gwlist_destroy(dlr_waiting_list, (gwlist_item_destructor_t *)dlr_entry_destroy);
-    gw_rwlock_unlock(&rwlock);
-    gw_rwlock_destroy(&rwlock);
+    DlrMemShard *shard;
+    DlrMemNode *node, *next;
+    long i;
+
+    for (i = 0; i < DLR_MEM_SHARDS; i++) {
+        shard = &shards[i];
+        gw_rwlock_wrlock(&shard->lock);
+        for (node = shard->oldest; node != NULL; node = next) {
+            next = node->newer;
+            dlr_entry_destroy(node->dlr);
+            gw_free(node);
+        }
+        gw_free(shard->tab);
+        shard->tab = NULL;
+        shard->oldest = shard->newest = NULL;
+        shard->count = 0;
+        gw_rwlock_unlock(&shard->lock);
+        gw_rwlock_destroy(&shard->lock);
+    }
 }
 
 /*
@@ -91,32 +244,67 @@ static void dlr_mem_shutdown()
  */
 static long dlr_mem_messages(void)
 {
-    return gwlist_len(dlr_waiting_list);
+    long i, ret = 0;
+
+    for (i = 0; i < DLR_MEM_SHARDS; i++) {
+        gw_rwlock_rdlock(&shards[i].lock);
+        ret += shards[i].count;
+        gw_rwlock_unlock(&shards[i].lock);
+    }
+
+    return ret;
 }
 
 static void dlr_mem_flush(void)
 {
+    DlrMemShard *shard;
     long i;
-    long len;
-
-    gw_rwlock_wrlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i = 0; i < len; i++) {
-        struct dlr_entry *dlr = gwlist_get(dlr_waiting_list, 0);
-        gwlist_delete(dlr_waiting_list, 0, 1);
-        dlr_entry_destroy(dlr);
+
+    for (i = 0; i < DLR_MEM_SHARDS; i++) {
+        shard = &shards[i];
+        gw_rwlock_wrlock(&shard->lock);
+        while (shard->oldest != NULL)
+            dlr_mem_node_remove(shard, shard->oldest);
+        gw_rwlock_unlock(&shard->lock);
     }
-    gw_rwlock_unlock(&rwlock);
 }
 
 /*
- * add struct dlr_entry to list
+ * add struct dlr_entry to its shard
  */
 static void dlr_mem_add(struct dlr_entry *dlr)
 {
-    gw_rwlock_wrlock(&rwlock);
-    gwlist_append(dlr_waiting_list,dlr);
-    gw_rwlock_unlock(&rwlock);
+    DlrMemShard *shard;
+    DlrMemNode *node, **tail;
+
+    node = gw_malloc(sizeof(*node));
+    node->dlr = dlr;
+    node->hash = dlr_mem_hash(dlr->smsc, dlr->timestamp);
+    node->added = time(NULL);
+    node->next = NULL;
+
+    shard = dlr_mem_shard(node->hash);
+    gw_rwlock_wrlock(&shard->lock);
+
+    dlr_mem_shard_expire(shard, node->added);
+    if (shard->count >= shard->size)
+        dlr_mem_shard_grow(shard);
+
+    /* append, so the oldest entry for a key is found first */
+    for (tail = &shard->tab[dlr_mem_bucket(shard, node->hash)]; *tail != NULL; tail = &(*tail)->next)
+        ;
+    *tail = node;
+
+    node->older = shard->newest;
+    node->newer = NULL;
+    if (shard->newest != NULL)
+        shard->newest->newer = node;
+    else
+        shard->oldest = node;
+    shard->newest = node;
+    shard->count++;
+
+    gw_rwlock_unlock(&shard->lock);
 }
 
 /*
@@ -142,28 +330,74 @@ static int dlr_mem_entry_match(struct dlr_entry *dlr, const Octstr *smsc, const
     return 1;
 }
 
+/*
+ * Find the first matching, not yet expired node in the shard.
+ * Caller must hold at least the read lock.
+ */
+static DlrMemNode *dlr_mem_find(DlrMemShard *shard, unsigned long hash, const Octstr *smsc,
+                                const Octstr *ts, const Octstr *dst)
+{
+    DlrMemNode *node;
+    time_t now = time(NULL);
+
+    for (node = shard->tab[dlr_mem_bucket(shard, hash)]; node != NULL; node = node->next) {
+        if (node->hash == hash && !dlr_mem_node_expired(node, now) &&
+            dlr_mem_entry_match(node->dlr, smsc, ts, dst) == 0)
+            return node;
+    }
+
+    return NULL;
+}
+
 /*
  * Find matching entry and return copy of it, otherwise NULL
  */
 static struct dlr_entry *dlr_mem_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    long i;
-    long len;
-    struct dlr_entry *dlr = NULL, *ret = NULL;
+    DlrMemShard *shard;
+    DlrMemNode *node;
+    struct dlr_entry *ret = NULL;
+    unsigned long hash;
+
+    hash = dlr_mem_hash(smsc, ts);
+    shard = dlr_mem_shard(hash);
+
+    gw_rwlock_rdlock(&shard->lock);
+    if ((node = dlr_mem_find(shard, hash, smsc, ts, dst)) != NULL)
+        ret = dlr_entry_duplicate(node->dlr);
+    gw_rwlock_unlock(&shard->lock);
+
+    /* we couldnt find a matching entry */
+    return ret;
+}
+
+/*
+ * Find matching entry and remove it, unless it still waits for a final
+ * report, in which case a copy is returned like dlr_mem_get() does.
+ */
+static struct dlr_entry *dlr_mem_take(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    DlrMemShard *shard;
+    DlrMemNode *node;
+    struct dlr_entry *ret = NULL;
+    unsigned long hash;
 
-    gw_rwlock_rdlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i=0; i < len; i++) {
-        dlr = gwlist_get(dlr_waiting_list, i);
+    hash = dlr_mem_hash(smsc, ts);
+    shard = dlr_mem_shard(hash);
 
-        if (dlr_mem_entry_match(dlr, smsc, ts, dst) == 0) {
-            ret = dlr_entry_duplicate(dlr);
-            break;
+    gw_rwlock_wrlock(&shard->lock);
+    if ((node = dlr_mem_find(shard, hash, smsc, ts, dst)) != NULL) {
+        if (dlr_entry_keep(node->dlr, status)) {
+            ret = dlr_entry_duplicate(node->dlr);
+        } else {
+            /* hand the entry itself over instead of copying it */
+            ret = node->dlr;
+            node->dlr = NULL;
+            dlr_mem_node_remove(shard, node);
         }
     }
-    gw_rwlock_unlock(&rwlock);
+    gw_rwlock_unlock(&shard->lock);
 
-    /* we couldnt find a matching entry */
     return ret;
 }
 
@@ -172,28 +406,24 @@ static struct dlr_entry *dlr_mem_get(const Octstr *smsc, const Octstr *ts, const
  */
 static void dlr_mem_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    long i;
-    long len;
-    struct dlr_entry *dlr = NULL;
-
-    gw_rwlock_wrlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i=0; i < len; i++) {
-        dlr = gwlist_get(dlr_waiting_list, i);
-
-        if (dlr_mem_entry_match(dlr, smsc, ts, dst) == 0) {
-            gwlist_delete(dlr_waiting_list, i, 1);
-            dlr_entry_destroy(dlr);
-            break;
-        }
-    }
-    gw_rwlock_unlock(&rwlock);
+    DlrMemShard *shard;
+    DlrMemNode *node;
+    unsigned long hash;
+
+    hash = dlr_mem_hash(smsc, ts);
+    shard = dlr_mem_shard(hash);
+
+    gw_rwlock_wrlock(&shard->lock);
+    if ((node = dlr_mem_find(shard, hash, smsc, ts, dst)) != NULL)
+        dlr_mem_node_remove(shard, node);
+    gw_rwlock_unlock(&shard->lock);
 }
 
 static struct dlr_storage  handles = {
     .type = "internal",
     .dlr_add = dlr_mem_add,
     .dlr_get = dlr_mem_get,
+    .dlr_take = dlr_mem_take,
     .dlr_remove = dlr_mem_remove,
     .dlr_shutdown = dlr_mem_shutdown,
     .dlr_messages = dlr_mem_messages,
@@ -201,12 +431,25 @@ static struct dlr_storage  handles = {
 };
 
 /*
- * Initialize dlr_waiting_list and return out storage handles.
+ * Initialize the shards and return out storage handles.
+ * The internal storage doesn't need a 'dlr-db' group, but if there is
+ * one, its 'ttl' is honoured so that memory usage stays bounded.
  */
 struct dlr_storage *dlr_init_mem(Cfg *cfg)
 {
-    dlr_waiting_list = gwlist_create();
-    gw_rwlock_init_static(&rwlock);
+    CfgGroup *grp;
+    long i;
+
+    for (i = 0; i < DLR_MEM_SHARDS; i++)
+        dlr_mem_shard_init(&shards[i]);
+
+    dlr_ttl = 0;
+    if (cfg != NULL && (grp = cfg_get_single_group(cfg, octstr_imm("dlr-db"))) != NULL) {
+        if (cfg_get_integer(&dlr_ttl, grp, octstr_imm("ttl")) == -1 || dlr_ttl < 0)
+            dlr_ttl = 0;
+    }
+    if (dlr_ttl > 0)
+        info(0, "DLR[internal]: waiting entries expire after %ld seconds.", dlr_ttl);
 
     return &handles;
 }
@@ -381,6 +381,7 @@ struct dlr_storage *dlr_init_mssql(Cfg *cfg)
 
     pool = dbpool_create(DBPOOL_MSSQL, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     if (dbpool_conn_count(pool) == 0)
         panic(0, "DLR: MSSQL: Could not establish mssql connection(s).");
@@ -82,35 +82,108 @@ static DBPool *pool = NULL;
  */
 static struct dlr_db_fields *fields = NULL;
 
+/*
+ * Our statements, built once from the table and field names, so that
+ * every connection prepares them once. Those with index 1 also match
+ * the destination number.
+ */
+static struct {
+    Octstr *messages;
+    Octstr *add;
+    Octstr *add_batch; /* MYSQL_BATCH_ROWS rows */
+    Octstr *get[2];
+    Octstr *remove[2];
+    Octstr *update[2];
+    Octstr *flush;
+} queries;
+
+/*
+ * Rows per INSERT, keeps us well below the limit of 65535 placeholders.
+ */
+#define MYSQL_BATCH_ROWS 1000
+
+
+static Octstr *dlr_mysql_batch_sql(long rows)
+{
+    Octstr *sql;
+    long i;
+
+    sql = octstr_format("INSERT INTO `%S` (`%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`) VALUES ",
+                        fields->table, fields->field_smsc, fields->field_ts,
+                        fields->field_src, fields->field_dst, fields->field_serv,
+                        fields->field_url, fields->field_mask, fields->field_boxc,
+                        fields->field_status);
+    for (i = 0; i < rows; i++)
+        octstr_append_cstr(sql, i > 0 ? ", (?, ?, ?, ?, ?, ?, ?, ?, 0)" : "(?, ?, ?, ?, ?, ?, ?, ?, 0)");
+
+    return sql;
+}
+
+
+static void dlr_mysql_queries_create(void)
+{
+    Octstr *like;
+    int i;
+
+    queries.messages = octstr_format("SELECT count(*) FROM `%S`", fields->table);
+    queries.add = dlr_mysql_batch_sql(1);
+    queries.add_batch = dlr_mysql_batch_sql(MYSQL_BATCH_ROWS);
+    queries.flush = octstr_format("DELETE FROM `%S`", fields->table);
+
+    for (i = 0; i < 2; i++) {
+        like = (i ? octstr_format("AND `%S` LIKE CONCAT('%%', ?)", fields->field_dst) : octstr_create(""));
+        queries.get[i] = octstr_format("SELECT `%S`, `%S`, `%S`, `%S`, `%S`, `%S` FROM `%S` WHERE `%S`=? AND `%S`=? %S LIMIT 1",
+                                       fields->field_mask, fields->field_serv,
+                                       fields->field_url, fields->field_src,
+                                       fields->field_dst, fields->field_boxc,
+                                       fields->table, fields->field_smsc,
+                                       fields->field_ts, like);
+        queries.remove[i] = octstr_format("DELETE FROM `%S` WHERE `%S`=? AND `%S`=? %S LIMIT 1",
+                                          fields->table, fields->field_smsc,
+                                          fields->field_ts, like);
+        queries.update[i] = octstr_format("UPDATE `%S` SET `%S`=? WHERE `%S`=? AND `%S`=? %S LIMIT 1",
+                                          fields->table, fields->field_status,
+                                          fields->field_smsc, fields->field_ts,
+                                          like);
+        octstr_destroy(like);
+    }
+}
+
+
+static void dlr_mysql_queries_destroy(void)
+{
+    int i;
+
+    octstr_destroy(queries.messages);
+    octstr_destroy(queries.add);
+    octstr_destroy(queries.add_batch);
+    octstr_destroy(queries.flush);
+    for (i = 0; i < 2; i++) {
+        octstr_destroy(queries.get[i]);
+        octstr_destroy(queries.remove[i]);
+        octstr_destroy(queries.update[i]);
+    }
+    memset(&queries, 0, sizeof(queries));
+}
+
 
 static void dlr_mysql_shutdown()
 {
     dbpool_destroy(pool);
+    dlr_mysql_queries_destroy();
     dlr_db_fields_destroy(fields);
 }
 
-static void dlr_mysql_add(struct dlr_entry *entry)
+/*
+ * Insert a single entry on an already consumed connection, also used
+ * when a batch fails to find the entry that made it fail.
+ */
+static int mysql_add(DBPoolConn *pconn, struct dlr_entry *entry)
 {
-    Octstr *sql, *os_mask;
-    DBPoolConn *pconn;
+    Octstr *os_mask;
     List *binds = gwlist_create();
     int res;
 
-    debug("dlr.mysql", 0, "adding DLR entry into database");
-
-    pconn = dbpool_conn_consume(pool);
-    /* just for sure */
-    if (pconn == NULL) {
-        dlr_entry_destroy(entry);
-        return;
-    }
-
-    sql = octstr_format("INSERT INTO `%S` (`%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`) VALUES "
-                        "(?, ?, ?, ?, ?, ?, ?, ?, 0)",
-                        fields->table, fields->field_smsc, fields->field_ts,
-                        fields->field_src, fields->field_dst, fields->field_serv,
-                        fields->field_url, fields->field_mask, fields->field_boxc,
-                        fields->field_status);
     os_mask = octstr_format("%d", entry->mask);
     gwlist_append(binds, entry->smsc);
     gwlist_append(binds, entry->timestamp);
@@ -122,43 +195,105 @@ static void dlr_mysql_add(struct dlr_entry *entry)
     gwlist_append(binds, entry->boxc_id);
 
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.add));
 #endif
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.add, binds)) == -1)
         error(0, "DLR: MYSQL: Error while adding dlr entry for DST<%s>", octstr_get_cstr(entry->destination));
     else if (!res)
         warning(0, "DLR: MYSQL: No dlr inserted for DST<%s>", octstr_get_cstr(entry->destination));
 
-    dbpool_conn_produce(pconn);
-    octstr_destroy(sql);
     gwlist_destroy(binds, NULL);
     octstr_destroy(os_mask);
+
+    return res;
+}
+
+static void dlr_mysql_add(struct dlr_entry *entry)
+{
+    DBPoolConn *pconn;
+
+    debug("dlr.mysql", 0, "adding DLR entry into database");
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL) {
+        dlr_entry_destroy(entry);
+        return;
+    }
+
+    mysql_add(pconn, entry);
+    dbpool_conn_produce(pconn);
     dlr_entry_destroy(entry);
 }
 
-static struct dlr_entry* dlr_mysql_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+static void dlr_mysql_add_batch(List *entries)
 {
-    Octstr *sql, *like;
+    Octstr *sql, *os_mask;
     DBPoolConn *pconn;
-    List *result = NULL, *row;
-    struct dlr_entry *res = NULL;
-    List *binds = gwlist_create();
+    List *binds, *masks;
+    struct dlr_entry *entry;
+    long i, j, n, rows;
+    int res;
+
+    n = gwlist_len(entries);
+    debug("dlr.mysql", 0, "adding %ld DLR entries into database", n);
 
     pconn = dbpool_conn_consume(pool);
-    if (pconn == NULL) /* should not happens, but sure is sure */
-        return NULL;
+    /* just for sure */
+    if (pconn == NULL)
+        return;
 
-    if (dst)
-        like = octstr_format("AND `%S` LIKE CONCAT('%%', ?)", fields->field_dst);
-    else
-        like = octstr_imm("");
+    binds = gwlist_create();
+    masks = gwlist_create();
+    for (i = 0; i < n; i += rows) {
+        rows = (n - i > MYSQL_BATCH_ROWS ? MYSQL_BATCH_ROWS : n - i);
+        /* only the last, shorter chunk needs its own statement */
+        sql = (rows == MYSQL_BATCH_ROWS ? queries.add_batch : dlr_mysql_batch_sql(rows));
+        for (j = i; j < i + rows; j++) {
+            entry = gwlist_get(entries, j);
+            os_mask = octstr_format("%d", entry->mask);
+            gwlist_append(binds, entry->smsc);
+            gwlist_append(binds, entry->timestamp);
+            gwlist_append(binds, entry->source);
+            gwlist_append(binds, entry->destination);
+            gwlist_append(binds, entry->service);
+            gwlist_append(binds, entry->url);
+            gwlist_append(binds, os_mask);
+            gwlist_append(binds, entry->boxc_id);
+            gwlist_append(masks, os_mask);
+        }
+#if defined(DLR_TRACE)
+        debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+#endif
+        if ((res = dbpool_conn_update(pconn, sql, binds)) == -1 || res < rows) {
+            /* one bad entry fails them all, so that only this one is lost */
+            warning(0, "DLR: MYSQL: %d of %ld dlr entries inserted, adding them one by one", res < 0 ? 0 : res, rows);
+            for (j = i; j < i + rows; j++)
+                mysql_add(pconn, gwlist_get(entries, j));
+        }
 
-    sql = octstr_format("SELECT `%S`, `%S`, `%S`, `%S`, `%S`, `%S` FROM `%S` WHERE `%S`=? AND `%S`=? %S LIMIT 1",
-                        fields->field_mask, fields->field_serv,
-                        fields->field_url, fields->field_src,
-                        fields->field_dst, fields->field_boxc,
-                        fields->table, fields->field_smsc,
-                        fields->field_ts, like);
+        if (sql != queries.add_batch)
+            octstr_destroy(sql);
+        while (gwlist_extract_first(binds) != NULL)
+            ;
+        while ((os_mask = gwlist_extract_first(masks)) != NULL)
+            octstr_destroy(os_mask);
+    }
+
+    dbpool_conn_produce(pconn);
+    gwlist_destroy(binds, NULL);
+    gwlist_destroy(masks, NULL);
+}
+
+/*
+ * The get, remove and update operations on an already consumed connection,
+ * so that dlr_mysql_take() can do them all with a single checkout.
+ */
+static struct dlr_entry* mysql_get(DBPoolConn *pconn, const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    List *result = NULL, *row;
+    struct dlr_entry *res = NULL;
+    List *binds = gwlist_create();
 
     gwlist_append(binds, (Octstr *)smsc);
     gwlist_append(binds, (Octstr *)ts);
@@ -166,20 +301,14 @@ static struct dlr_entry* dlr_mysql_get(const Octstr *smsc, const Octstr *ts, con
         gwlist_append(binds, (Octstr *)dst);
 
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.get[dst != NULL]));
 #endif
 
-    if (dbpool_conn_select(pconn, sql, binds, &result) != 0) {
-        octstr_destroy(sql);
-        octstr_destroy(like);
+    if (dbpool_conn_select(pconn, queries.get[dst != NULL], binds, &result) != 0) {
         gwlist_destroy(binds, NULL);
-        dbpool_conn_produce(pconn);
         return NULL;
     }
-    octstr_destroy(sql);
-    octstr_destroy(like);
     gwlist_destroy(binds, NULL);
-    dbpool_conn_produce(pconn);
 
 #define LO2CSTR(r, i) octstr_get_cstr(gwlist_get(r, i))
 
@@ -203,73 +332,38 @@ static struct dlr_entry* dlr_mysql_get(const Octstr *smsc, const Octstr *ts, con
     return res;
 }
 
-static void dlr_mysql_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+static void mysql_remove(DBPoolConn *pconn, const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    Octstr *sql, *like;
-    DBPoolConn *pconn;
     List *binds = gwlist_create();
     int res;
 
     debug("dlr.mysql", 0, "removing DLR from database");
 
-    pconn = dbpool_conn_consume(pool);
-    /* just for sure */
-    if (pconn == NULL)
-        return;
-
-    if (dst)
-        like = octstr_format("AND `%S` LIKE CONCAT('%%', ?)", fields->field_dst);
-    else
-        like = octstr_imm("");
-
-    sql = octstr_format("DELETE FROM `%S` WHERE `%S`=? AND `%S`=? %S LIMIT 1",
-                        fields->table, fields->field_smsc,
-                        fields->field_ts, like);
-
     gwlist_append(binds, (Octstr *)smsc);
     gwlist_append(binds, (Octstr *)ts);
     if (dst)
         gwlist_append(binds, (Octstr *)dst);
 
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.remove[dst != NULL]));
 #endif
 
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.remove[dst != NULL], binds)) == -1)
         error(0, "DLR: MYSQL: Error while removing dlr entry for DST<%s>", octstr_get_cstr(dst));
     else if (!res)
         warning(0, "DLR: MYSQL: No dlr deleted for DST<%s>", octstr_get_cstr(dst));
 
-    dbpool_conn_produce(pconn);
     gwlist_destroy(binds, NULL);
-    octstr_destroy(sql);
-    octstr_destroy(like);
 }
 
-static void dlr_mysql_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+static void mysql_update(DBPoolConn *pconn, const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
 {
-    Octstr *sql, *os_status, *like;
-    DBPoolConn *pconn;
+    Octstr *os_status;
     List *binds = gwlist_create();
     int res;
 
     debug("dlr.mysql", 0, "updating DLR status in database");
 
-    pconn = dbpool_conn_consume(pool);
-    /* just for sure */
-    if (pconn == NULL)
-        return;
-
-    if (dst)
-        like = octstr_format("AND `%S` LIKE CONCAT('%%', ?)", fields->field_dst);
-    else
-        like = octstr_imm("");
-
-    sql = octstr_format("UPDATE `%S` SET `%S`=? WHERE `%S`=? AND `%S`=? %S LIMIT 1",
-                        fields->table, fields->field_status,
-                        fields->field_smsc, fields->field_ts,
-                        like);
-
     os_status = octstr_format("%d", status);
     gwlist_append(binds, (Octstr *)os_status);
     gwlist_append(binds, (Octstr *)smsc);
@@ -278,24 +372,86 @@ static void dlr_mysql_update(const Octstr *smsc, const Octstr *ts, const Octstr
         gwlist_append(binds, (Octstr *)dst);
 
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.update[dst != NULL]));
 #endif
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.update[dst != NULL], binds)) == -1)
         error(0, "DLR: MYSQL: Error while updating dlr entry for DST<%s>", octstr_get_cstr(dst));
     else if (!res)
        warning(0, "DLR: MYSQL: No dlr found to update for DST<%s>, (status %d)", octstr_get_cstr(dst), status);
 
-    dbpool_conn_produce(pconn);
     gwlist_destroy(binds, NULL);
     octstr_destroy(os_status);
-    octstr_destroy(sql);
-    octstr_destroy(like);
+}
+
+static struct dlr_entry* dlr_mysql_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    DBPoolConn *pconn;
+    struct dlr_entry *res;
+
+    pconn = dbpool_conn_consume(pool);
+    if (pconn == NULL) /* should not happens, but sure is sure */
+        return NULL;
+
+    res = mysql_get(pconn, smsc, ts, dst);
+    dbpool_conn_produce(pconn);
+
+    return res;
+}
+
+/*
+ * MySQL has no RETURNING clause, so this still takes two statements,
+ * but over one connection checkout instead of two.
+ */
+static struct dlr_entry* dlr_mysql_take(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    DBPoolConn *pconn;
+    struct dlr_entry *res;
+
+    pconn = dbpool_conn_consume(pool);
+    if (pconn == NULL) /* should not happens, but sure is sure */
+        return NULL;
+
+    res = mysql_get(pconn, smsc, ts, dst);
+    if (res != NULL) {
+        if (dlr_entry_keep(res, status))
+            mysql_update(pconn, smsc, ts, dst, status);
+        else
+            mysql_remove(pconn, smsc, ts, dst);
+    }
+    dbpool_conn_produce(pconn);
+
+    return res;
+}
+
+static void dlr_mysql_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    DBPoolConn *pconn;
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    mysql_remove(pconn, smsc, ts, dst);
+    dbpool_conn_produce(pconn);
+}
+
+static void dlr_mysql_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    DBPoolConn *pconn;
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    mysql_update(pconn, smsc, ts, dst, status);
+    dbpool_conn_produce(pconn);
 }
 
 static long dlr_mysql_messages(void)
 {
     List *result, *row;
-    Octstr *sql;
     DBPoolConn *conn;
     long msgs = -1;
 
@@ -303,18 +459,15 @@ static long dlr_mysql_messages(void)
     if (conn == NULL)
         return -1;
 
-    sql = octstr_format("SELECT count(*) FROM `%S`", fields->table);
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.messages));
 #endif
 
-    if (dbpool_conn_select(conn, sql, NULL, &result) != 0) {
-        octstr_destroy(sql);
+    if (dbpool_conn_select(conn, queries.messages, NULL, &result) != 0) {
         dbpool_conn_produce(conn);
         return -1;
     }
     dbpool_conn_produce(conn);
-    octstr_destroy(sql);
 
     if (gwlist_len(result) > 0) {
         row = gwlist_extract_first(result);
@@ -328,7 +481,6 @@ static long dlr_mysql_messages(void)
 
 static void dlr_mysql_flush(void)
 {
-    Octstr *sql;
     DBPoolConn *pconn;
     int rows;
 
@@ -337,23 +489,23 @@ static void dlr_mysql_flush(void)
     if (pconn == NULL)
         return;
 
-    sql = octstr_format("DELETE FROM `%S`", fields->table);
 #if defined(DLR_TRACE)
-    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(queries.flush));
 #endif
-    rows = dbpool_conn_update(pconn, sql, NULL);
+    rows = dbpool_conn_update(pconn, queries.flush, NULL);
     if (rows == -1)
         error(0, "DLR: MYSQL: Error while flushing dlr entries from database");
     else
         debug("dlr.mysql", 0, "Flushing %d DLR entries from database", rows);
     dbpool_conn_produce(pconn);
-    octstr_destroy(sql);
 }
 
 static struct dlr_storage handles = {
     .type = "mysql",
     .dlr_add = dlr_mysql_add,
+    .dlr_add_batch = dlr_mysql_add_batch,
     .dlr_get = dlr_mysql_get,
+    .dlr_take = dlr_mysql_take,
     .dlr_update = dlr_mysql_update,
     .dlr_remove = dlr_mysql_remove,
     .dlr_shutdown = dlr_mysql_shutdown,
@@ -383,6 +535,7 @@ struct dlr_storage *dlr_init_mysql(Cfg *cfg)
 
     fields = dlr_db_fields_create(grp);
     gw_assert(fields != NULL);
+    dlr_mysql_queries_create();
 
     /*
      * Escaping special quotes for field/table names
@@ -451,6 +604,7 @@ found:
 
     pool = dbpool_create(DBPOOL_MYSQL, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * XXX should a failing connect throw panic?!
@@ -415,6 +415,7 @@ struct dlr_storage *dlr_init_oracle(Cfg *cfg)
 
     pool = dbpool_create(DBPOOL_ORACLE, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     if (dbpool_conn_count(pool) == 0)
         panic(0, "DLR: ORACLE: Couldnot establish oracle connection(s).");
@@ -102,6 +102,16 @@ void dlr_entry_destroy(struct dlr_entry *dlr);
  */
 struct dlr_entry *dlr_entry_duplicate(const struct dlr_entry *dlr);
 
+/*
+ * Return 1 if a report of type status is the last one for any entry
+ */
+int dlr_status_final(int status);
+
+/*
+ * Return 1 if dlr entry stays in storage after a report of type status
+ */
+int dlr_entry_keep(const struct dlr_entry *dlr, int status);
+
 /* 
  * Callback functions to handle specific dlr storage type 
  */
@@ -115,11 +125,24 @@ struct dlr_storage {
      * NOTE: this function is responsible to destroy struct dlr_entry
      */
     void (*dlr_add) (struct dlr_entry *entry);
+    /*
+     * Add several dlr entries into storage at once. Optional, used by
+     * the write-behind buffer instead of dlr_add if defined.
+     * NOTE: entries stay owned by the caller
+     */
+    void (*dlr_add_batch) (List *entries);
     /*
      * Find and return struct dlr_entry. If entry not found return NULL.
      * NOTE: Caller will destroy struct dlr_entry
      */
     struct dlr_entry* (*dlr_get) (const Octstr *smsc, const Octstr *ts, const Octstr *dst);
+    /*
+     * Find, return and remove matching dlr entry in one operation, or
+     * only update its status field if dlr_entry_keep() says so. Optional,
+     * used by dlr_find() instead of dlr_get and dlr_remove/dlr_update.
+     * NOTE: Caller will destroy struct dlr_entry
+     */
+    struct dlr_entry* (*dlr_take) (const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status);
     /*
      * Remove matching dlr entry from storage
      */
@@ -162,6 +162,42 @@ static void dlr_pgsql_add(struct dlr_entry *entry)
 }
 
 
+static void dlr_pgsql_add_batch(List *entries)
+{
+    Octstr *sql;
+    struct dlr_entry *entry;
+    long i, n;
+    int res;
+
+    n = gwlist_len(entries);
+    sql = octstr_format("INSERT INTO \"%s\" (\"%s\", \"%s\", \"%s\", \"%s\", \"%s\", \"%s\", \"%s\", \"%s\", \"%s\") VALUES ",
+                        octstr_get_cstr(fields->table), octstr_get_cstr(fields->field_smsc),
+                        octstr_get_cstr(fields->field_ts),
+                        octstr_get_cstr(fields->field_src), octstr_get_cstr(fields->field_dst),
+                        octstr_get_cstr(fields->field_serv), octstr_get_cstr(fields->field_url),
+                        octstr_get_cstr(fields->field_mask), octstr_get_cstr(fields->field_boxc),
+                        octstr_get_cstr(fields->field_status));
+    for (i = 0; i < n; i++) {
+        entry = gwlist_get(entries, i);
+        octstr_format_append(sql, "%s('%s', '%s', '%s', '%s', '%s', '%s', '%d', '%s', '%d')",
+                             (i > 0 ? ", " : ""),
+                             octstr_get_cstr(entry->smsc), octstr_get_cstr(entry->timestamp), octstr_get_cstr(entry->source),
+                             octstr_get_cstr(entry->destination), octstr_get_cstr(entry->service), octstr_get_cstr(entry->url),
+                             entry->mask, octstr_get_cstr(entry->boxc_id), 0);
+    }
+    octstr_append_char(sql, ';');
+
+    /* one bad entry fails them all, so that only this one is lost */
+    if ((res = pgsql_update(sql)) == -1 || res < n) {
+       warning(0, "DLR: PGSQL: %d of %ld dlr entries inserted, adding them one by one", res < 0 ? 0 : res, n);
+       for (i = 0; i < n; i++)
+           dlr_pgsql_add(dlr_entry_duplicate(gwlist_get(entries, i)));
+    }
+
+    octstr_destroy(sql);
+}
+
+
 static struct dlr_entry *dlr_pgsql_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
     struct dlr_entry *res = NULL;
@@ -218,6 +254,73 @@ static struct dlr_entry *dlr_pgsql_get(const Octstr *smsc, const Octstr *ts, con
 }
 
 
+/*
+ * Fetch the entry and delete or update it in the same statement.
+ */
+static struct dlr_entry *dlr_pgsql_take(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    struct dlr_entry *res = NULL;
+    Octstr *sql, *like, *change;
+    List *result, *row;
+
+    if (dst)
+        like = octstr_format("AND \"%S\" LIKE '%%%S'", fields->field_dst, dst);
+    else
+        like = octstr_imm("");
+
+    if (dlr_status_final(status))
+        change = octstr_format("DELETE FROM \"%S\"", fields->table);
+    else
+        change = octstr_format("UPDATE \"%S\" SET \"%S\"=%d", fields->table,
+                               fields->field_status, status);
+
+    sql = octstr_format("%S WHERE oid = (SELECT oid FROM \"%S\" WHERE "
+          "\"%S\"='%S' AND \"%S\"='%S' %S LIMIT 1) RETURNING \"%S\", \"%S\", "
+          "\"%S\", \"%S\", \"%S\", \"%S\", oid;",
+          change, fields->table, fields->field_smsc, smsc, fields->field_ts, ts,
+          like, fields->field_mask, fields->field_serv, fields->field_url,
+          fields->field_src, fields->field_dst, fields->field_boxc);
+
+    result = pgsql_select(sql);
+    octstr_destroy(sql);
+    octstr_destroy(change);
+    octstr_destroy(like);
+
+    if (result == NULL || gwlist_len(result) < 1) {
+        debug("dlr.pgsql", 0, "no rows found");
+        gwlist_destroy(result, NULL);
+        return NULL;
+    }
+
+    row = gwlist_get(result, 0);
+
+    res = dlr_entry_create();
+    gw_assert(res != NULL);
+    res->mask        = atoi(octstr_get_cstr(gwlist_get(row, 0)));
+    res->service     = octstr_duplicate(gwlist_get(row, 1));
+    res->url         = octstr_duplicate(gwlist_get(row, 2));
+    res->source      = octstr_duplicate(gwlist_get(row, 3));
+    res->destination = octstr_duplicate(gwlist_get(row, 4));
+    res->boxc_id     = octstr_duplicate(gwlist_get(row, 5));
+    res->smsc        = octstr_duplicate(smsc);
+
+    /* updated, but nobody waits for a final report */
+    if (!dlr_status_final(status) && !dlr_entry_keep(res, status)) {
+        sql = octstr_format("DELETE FROM \"%S\" WHERE oid = %S;", fields->table,
+                            gwlist_get(row, 6));
+        if (!pgsql_update(sql))
+            warning(0, "DLR: PGSQL: No dlr deleted for DST<%s>", octstr_get_cstr(dst));
+        octstr_destroy(sql);
+    }
+
+    while((row = gwlist_extract_first(result)))
+        gwlist_destroy(row, octstr_destroy_item);
+    gwlist_destroy(result, NULL);
+
+    return res;
+}
+
+
 static void dlr_pgsql_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
     Octstr *sql, *like;
@@ -301,7 +404,9 @@ static void dlr_pgsql_flush(void)
 static struct dlr_storage handles = {
     .type = "pgsql",
     .dlr_add = dlr_pgsql_add,
+    .dlr_add_batch = dlr_pgsql_add_batch,
     .dlr_get = dlr_pgsql_get,
+    .dlr_take = dlr_pgsql_take,
     .dlr_update = dlr_pgsql_update,
     .dlr_remove = dlr_pgsql_remove,
     .dlr_shutdown = dlr_pgsql_shutdown,
@@ -401,6 +506,7 @@ found:
 
     pool = dbpool_create(DBPOOL_PGSQL, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * XXX should a failing connect throw panic?!
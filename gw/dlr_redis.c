@@ -100,22 +100,10 @@ static void dlr_redis_shutdown()
     dlr_db_fields_destroy(fields);
 }
 
-static void dlr_redis_add(struct dlr_entry *entry)
+static Octstr *dlr_redis_key(const struct dlr_entry *entry)
 {
-    Octstr *key, *sql, *os;
-    DBPoolConn *pconn;
-    List *binds;
-    int res, len;
-
-    debug("dlr.redis", 0, "Adding DLR into keystore");
-
-    pconn = dbpool_conn_consume(pool);
-    /* just for sure */
-    if (pconn == NULL) {
-        error(0, "DLR: REDIS: No connection available - dropping DLR");
-        dlr_entry_destroy(entry);
-        return;
-    }
+    Octstr *key;
+    int len;
 
     if (entry->use_dst && entry->destination) {
         Octstr *dst_min;
@@ -138,6 +126,28 @@ static void dlr_redis_add(struct dlr_entry *entry)
                 entry->timestamp);
     }
 
+    return key;
+}
+
+static void dlr_redis_add(struct dlr_entry *entry)
+{
+    Octstr *key, *sql, *os;
+    DBPoolConn *pconn;
+    List *binds;
+    int res;
+
+    debug("dlr.redis", 0, "Adding DLR into keystore");
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL) {
+        error(0, "DLR: REDIS: No connection available - dropping DLR");
+        dlr_entry_destroy(entry);
+        return;
+    }
+
+    key = dlr_redis_key(entry);
+
 #ifdef REDIS_PRECHECK
     binds = gwlist_create();
     sql = octstr_format("HSETNX %S %S ?", key, fields->field_smsc);
@@ -358,6 +368,103 @@ static void dlr_redis_remove(const Octstr *smsc, const Octstr *ts, const Octstr
     gwlist_destroy(binds, NULL);
 }
 
+/*
+ * Fetch the entry and delete it, or update its status, in one round trip.
+ * KEYS[1] is the entry, ARGV[1..6] the fields we fetch, ARGV[7] the status
+ * field with its new value in ARGV[8], and ARGV[9] is "1" for a final one.
+ */
+#define REDIS_TAKE_SCRIPT \
+    "local r = redis.call('HMGET', KEYS[1], ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5], ARGV[6]) " \
+    "if r[1] then " \
+    "if ARGV[9] == '1' then redis.call('DEL', KEYS[1]) " \
+    "else redis.call('HSET', KEYS[1], ARGV[7], ARGV[8]) end " \
+    "end " \
+    "return r"
+
+static struct dlr_entry *dlr_redis_take(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    Octstr *key, *sql, *os_status;
+    DBPoolConn *pconn;
+    List *binds = gwlist_create();
+    List *result = NULL, *row;
+    struct dlr_entry *res = NULL;
+    int final = dlr_status_final(status);
+
+    pconn = dbpool_conn_consume(pool);
+    if (pconn == NULL) {
+        error(0, "DLR: REDIS: No connection available");
+        gwlist_destroy(binds, NULL);
+        return NULL;
+    }
+
+    /* If the destination address is not NULL, then
+     * it has been shortened by the abstractive layer. */
+    if (dst)
+        key = octstr_format("%S:%S:%S:%S", fields->table,
+                (Octstr*) smsc, (Octstr*) ts, (Octstr*) dst);
+    else
+        key = octstr_format("%S:%S:%S", fields->table,
+                (Octstr*) smsc, (Octstr*) ts);
+
+    os_status = octstr_format("%d", status);
+    sql = octstr_create("");
+    gwlist_append(binds, octstr_imm("EVAL"));
+    gwlist_append(binds, octstr_imm(REDIS_TAKE_SCRIPT));
+    gwlist_append(binds, octstr_imm("1"));
+    gwlist_append(binds, key);
+    gwlist_append(binds, fields->field_mask);
+    gwlist_append(binds, fields->field_serv);
+    gwlist_append(binds, fields->field_url);
+    gwlist_append(binds, fields->field_src);
+    gwlist_append(binds, fields->field_dst);
+    gwlist_append(binds, fields->field_boxc);
+    gwlist_append(binds, fields->field_status);
+    gwlist_append(binds, os_status);
+    gwlist_append(binds, octstr_imm(final ? "1" : "0"));
+
+    if (dbpool_conn_select(pconn, sql, binds, &result) != 0) {
+        error(0, "DLR: REDIS: Failed to fetch DLR for %s", octstr_get_cstr(key));
+        octstr_destroy(sql);
+        octstr_destroy(key);
+        octstr_destroy(os_status);
+        gwlist_destroy(binds, NULL);
+        dbpool_conn_produce(pconn);
+        return NULL;
+    }
+
+    dbpool_conn_produce(pconn);
+    octstr_destroy(sql);
+    octstr_destroy(key);
+    octstr_destroy(os_status);
+    gwlist_destroy(binds, NULL);
+
+    if (gwlist_len(result) > 0) {
+        row = gwlist_extract_first(result);
+
+        /* a missing key gives us an array of (nil) values, see above */
+        if (octstr_len(gwlist_get(row, 0)) > 0) {
+            res = dlr_entry_create();
+            gw_assert(res != NULL);
+            res->mask = atoi(octstr_get_cstr(gwlist_get(row, 0)));
+            get_octstr_value(&res->service, row, 1);
+            get_octstr_value(&res->url, row, 2);
+            octstr_url_decode(res->url);
+            get_octstr_value(&res->source, row, 3);
+            get_octstr_value(&res->destination, row, 4);
+            get_octstr_value(&res->boxc_id, row, 5);
+            res->smsc = octstr_duplicate(smsc);
+        }
+        gwlist_destroy(row, octstr_destroy_item);
+    }
+    gwlist_destroy(result, NULL);
+
+    /* updated, but nobody waits for a final report */
+    if (res != NULL && !final && !dlr_entry_keep(res, status))
+        dlr_redis_remove(smsc, ts, dst);
+
+    return res;
+}
+
 static void dlr_redis_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
 {
     Octstr *key, *sql, *os_status;
@@ -461,6 +568,7 @@ static struct dlr_storage handles = {
     .type = "redis",
     .dlr_add = dlr_redis_add,
     .dlr_get = dlr_redis_get,
+    .dlr_take = dlr_redis_take,
     .dlr_update = dlr_redis_update,
     .dlr_remove = dlr_redis_remove,
     .dlr_shutdown = dlr_redis_shutdown,
@@ -562,6 +670,7 @@ found:
 
     pool = dbpool_create(DBPOOL_REDIS, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     /*
      * Panic on failure to connect. Should we just try to reconnect?
@@ -70,6 +70,7 @@
 
 
 #ifdef HAVE_SQLITE3
+#include <sqlite3.h>
 
 /*
  * Our connection pool to sqlite3.
@@ -82,10 +83,122 @@ static DBPool *pool = NULL;
 static struct dlr_db_fields *fields = NULL;
 
 
+/*
+ * Our statements, built once from the table and field names, so that
+ * every connection prepares them once. Those with index 1 also match
+ * the destination number.
+ */
+static struct {
+    Octstr *messages;
+    Octstr *add;
+    Octstr *add_batch; /* SQLITE3_BATCH_ROWS rows */
+    Octstr *remove[2];
+    Octstr *remove_rowid;
+    Octstr *get[2];
+    Octstr *take_final[2];
+    Octstr *take[2];
+    Octstr *update[2];
+    Octstr *flush;
+} queries;
+
+/*
+ * Rows per INSERT, keeps us below SQLite's default limit of 999 binds.
+ */
+#define SQLITE3_BATCH_ROWS 100
+
+
+static Octstr *dlr_sqlite3_batch_sql(long rows)
+{
+    Octstr *sql;
+    long i;
+
+    sql = octstr_format("INSERT INTO %S (%S, %S, %S, %S, %S, %S, %S, %S, %S) VALUES ",
+                        fields->table, fields->field_smsc, fields->field_ts,
+                        fields->field_src, fields->field_dst, fields->field_serv,
+                        fields->field_url, fields->field_mask, fields->field_boxc,
+                        fields->field_status);
+    for (i = 0; i < rows; i++)
+        octstr_append_cstr(sql, i > 0 ? ", (?, ?, ?, ?, ?, ?, ?, ?, 0)" : "(?, ?, ?, ?, ?, ?, ?, ?, 0)");
+
+    return sql;
+}
+
+
+static void dlr_sqlite3_queries_create(void)
+{
+    Octstr *like;
+    int i;
+
+    queries.messages = octstr_format("SELECT count(*) FROM %S", fields->table);
+    queries.add = octstr_format("INSERT INTO %S (%S, %S, %S, %S, %S, %S, %S, %S, %S) VALUES "
+                                "(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, 0)",
+                                fields->table, fields->field_smsc, fields->field_ts,
+                                fields->field_src, fields->field_dst, fields->field_serv,
+                                fields->field_url, fields->field_mask, fields->field_boxc,
+                                fields->field_status);
+    queries.add_batch = dlr_sqlite3_batch_sql(SQLITE3_BATCH_ROWS);
+    queries.remove_rowid = octstr_format("DELETE FROM %S WHERE ROWID=?1", fields->table);
+    queries.flush = octstr_format("DELETE FROM %S", fields->table);
+
+    for (i = 0; i < 2; i++) {
+        like = (i ? octstr_format("AND %S LIKE '%%' || ?3", fields->field_dst) : octstr_create(""));
+        queries.remove[i] = octstr_format("DELETE FROM %S WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1)",
+                                          fields->table, fields->table,
+                                          fields->field_smsc, fields->field_ts, like);
+        queries.get[i] = octstr_format("SELECT %S, %S, %S, %S, %S, %S FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1",
+                                       fields->field_mask, fields->field_serv,
+                                       fields->field_url, fields->field_src,
+                                       fields->field_dst, fields->field_boxc,
+                                       fields->table, fields->field_smsc,
+                                       fields->field_ts, like);
+        queries.take_final[i] = octstr_format("DELETE FROM %S WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1) "
+                                              "RETURNING %S, %S, %S, %S, %S, %S, ROWID",
+                                              fields->table, fields->table,
+                                              fields->field_smsc, fields->field_ts, like,
+                                              fields->field_mask, fields->field_serv,
+                                              fields->field_url, fields->field_src,
+                                              fields->field_dst, fields->field_boxc);
+        queries.take[i] = octstr_format("UPDATE %S SET %S=?%d WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1) "
+                                        "RETURNING %S, %S, %S, %S, %S, %S, ROWID",
+                                        fields->table, fields->field_status, i ? 4 : 3,
+                                        fields->table, fields->field_smsc, fields->field_ts, like,
+                                        fields->field_mask, fields->field_serv,
+                                        fields->field_url, fields->field_src,
+                                        fields->field_dst, fields->field_boxc);
+        octstr_destroy(like);
+
+        like = (i ? octstr_format("AND %S LIKE '%%' || ?4", fields->field_dst) : octstr_create(""));
+        queries.update[i] = octstr_format("UPDATE %S SET %S=?1 WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?2 AND %S=?3 %S LIMIT 1)",
+                                          fields->table, fields->field_status, fields->table,
+                                          fields->field_smsc, fields->field_ts, like);
+        octstr_destroy(like);
+    }
+}
+
+
+static void dlr_sqlite3_queries_destroy(void)
+{
+    int i;
+
+    octstr_destroy(queries.messages);
+    octstr_destroy(queries.add);
+    octstr_destroy(queries.add_batch);
+    octstr_destroy(queries.remove_rowid);
+    octstr_destroy(queries.flush);
+    for (i = 0; i < 2; i++) {
+        octstr_destroy(queries.remove[i]);
+        octstr_destroy(queries.get[i]);
+        octstr_destroy(queries.take_final[i]);
+        octstr_destroy(queries.take[i]);
+        octstr_destroy(queries.update[i]);
+    }
+    memset(&queries, 0, sizeof(queries));
+}
+
+
 static long dlr_messages_sqlite3()
 {
     List *result, *row;
-    Octstr *sql;
     DBPoolConn *conn;
     long msgs = -1;
 
@@ -93,18 +206,15 @@ static long dlr_messages_sqlite3()
     if (conn == NULL)
         return -1;
 
-    sql = octstr_format("SELECT count(*) FROM %S", fields->table);
 #if defined(DLR_TRACE)
-    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.messages));
 #endif
 
-    if (dbpool_conn_select(conn, sql, NULL, &result) != 0) {
-        octstr_destroy(sql);
+    if (dbpool_conn_select(conn, queries.messages, NULL, &result) != 0) {
         dbpool_conn_produce(conn);
         return -1;
     }
     dbpool_conn_produce(conn);
-    octstr_destroy(sql);
 
     if (gwlist_len(result) > 0) {
         row = gwlist_extract_first(result);
@@ -119,31 +229,20 @@ static long dlr_messages_sqlite3()
 static void dlr_shutdown_sqlite3()
 {
     dbpool_destroy(pool);
+    dlr_sqlite3_queries_destroy();
     dlr_db_fields_destroy(fields);
 }
 
-static void dlr_add_sqlite3(struct dlr_entry *entry)
+/*
+ * Insert a single entry on an already consumed connection, also used
+ * when a batch fails to find the entry that made it fail.
+ */
+static int dlr_sqlite3_insert(DBPoolConn *pconn, struct dlr_entry *entry)
 {
-    Octstr *sql, *os_mask;
-    DBPoolConn *pconn;
+    Octstr *os_mask;
     List *binds = gwlist_create();
     int res;
 
-    debug("dlr.sqlite3", 0, "adding DLR entry into database");
-
-    pconn = dbpool_conn_consume(pool);
-    /* just for sure */
-    if (pconn == NULL) {
-        dlr_entry_destroy(entry);
-        return;
-    }
-
-    sql = octstr_format("INSERT INTO %S (%S, %S, %S, %S, %S, %S, %S, %S, %S) VALUES "
-                        "(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, 0)",
-                        fields->table, fields->field_smsc, fields->field_ts,
-                        fields->field_src, fields->field_dst, fields->field_serv, 
-                        fields->field_url, fields->field_mask, fields->field_boxc,
-                        fields->field_status);
     os_mask = octstr_format("%d", entry->mask);
     
     gwlist_append(binds, entry->smsc);         /* ?1 */
@@ -155,23 +254,105 @@ static void dlr_add_sqlite3(struct dlr_entry *entry)
     gwlist_append(binds, os_mask);             /* ?7 */
     gwlist_append(binds, entry->boxc_id);      /* ?8 */
 #if defined(DLR_TRACE)
-    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.add));
 #endif
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.add, binds)) == -1)
         error(0, "DLR: SQLite3: Error while adding dlr entry for DST<%s>", octstr_get_cstr(entry->destination));
     else if (!res)
         warning(0, "DLR: SQLite3: No dlr inserted for DST<%s>", octstr_get_cstr(entry->destination));
 
-    dbpool_conn_produce(pconn);
-    octstr_destroy(sql);
     gwlist_destroy(binds, NULL);
     octstr_destroy(os_mask);
+
+    return res;
+}
+
+static void dlr_add_sqlite3(struct dlr_entry *entry)
+{
+    DBPoolConn *pconn;
+
+    debug("dlr.sqlite3", 0, "adding DLR entry into database");
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL) {
+        dlr_entry_destroy(entry);
+        return;
+    }
+
+    dlr_sqlite3_insert(pconn, entry);
+    dbpool_conn_produce(pconn);
     dlr_entry_destroy(entry);
 }
 
+static void dlr_add_batch_sqlite3(List *entries)
+{
+    Octstr *sql, *os_mask;
+    DBPoolConn *pconn;
+    List *binds, *masks;
+    struct dlr_entry *entry;
+    long i, j, n, rows;
+    int res;
+
+    n = gwlist_len(entries);
+    debug("dlr.sqlite3", 0, "adding %ld DLR entries into database", n);
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    /* one commit for all the rows */
+    if (n > SQLITE3_BATCH_ROWS)
+        dbpool_conn_update(pconn, octstr_imm("BEGIN"), NULL);
+
+    binds = gwlist_create();
+    masks = gwlist_create();
+    for (i = 0; i < n; i += rows) {
+        rows = (n - i > SQLITE3_BATCH_ROWS ? SQLITE3_BATCH_ROWS : n - i);
+        /* only the last, shorter chunk needs its own statement */
+        sql = (rows == SQLITE3_BATCH_ROWS ? queries.add_batch : dlr_sqlite3_batch_sql(rows));
+        for (j = i; j < i + rows; j++) {
+            entry = gwlist_get(entries, j);
+            os_mask = octstr_format("%d", entry->mask);
+            gwlist_append(binds, entry->smsc);
+            gwlist_append(binds, entry->timestamp);
+            gwlist_append(binds, entry->source);
+            gwlist_append(binds, entry->destination);
+            gwlist_append(binds, entry->service);
+            gwlist_append(binds, entry->url);
+            gwlist_append(binds, os_mask);
+            gwlist_append(binds, entry->boxc_id);
+            gwlist_append(masks, os_mask);
+        }
+#if defined(DLR_TRACE)
+        debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+#endif
+        if ((res = dbpool_conn_update(pconn, sql, binds)) == -1 || res < rows) {
+            /* one bad entry fails them all, so that only this one is lost */
+            warning(0, "DLR: SQLite3: %d of %ld dlr entries inserted, adding them one by one", res < 0 ? 0 : res, rows);
+            for (j = i; j < i + rows; j++)
+                dlr_sqlite3_insert(pconn, gwlist_get(entries, j));
+        }
+
+        if (sql != queries.add_batch)
+            octstr_destroy(sql);
+        while (gwlist_extract_first(binds) != NULL)
+            ;
+        while ((os_mask = gwlist_extract_first(masks)) != NULL)
+            octstr_destroy(os_mask);
+    }
+
+    if (n > SQLITE3_BATCH_ROWS)
+        dbpool_conn_update(pconn, octstr_imm("COMMIT"), NULL);
+
+    dbpool_conn_produce(pconn);
+    gwlist_destroy(binds, NULL);
+    gwlist_destroy(masks, NULL);
+}
+
 static void dlr_remove_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    Octstr *sql, *like;
     DBPoolConn *pconn;
     List *binds = gwlist_create();
     int res;
@@ -182,38 +363,26 @@ static void dlr_remove_sqlite3(const Octstr *smsc, const Octstr *ts, const Octst
     if (pconn == NULL)
         return;
     
-    if (dst)
-        like = octstr_format("AND %S LIKE '%?3'", fields->field_dst);
-    else
-        like = octstr_imm("");
-
-    sql = octstr_format("DELETE FROM %S WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1)",
-                        fields->table, fields->table,
-                        fields->field_smsc, fields->field_ts, like);
-
     gwlist_append(binds, (Octstr *)smsc);      /* ?1 */
     gwlist_append(binds, (Octstr *)ts);        /* ?2 */
     if (dst)
         gwlist_append(binds, (Octstr *)dst);   /* ?3 */
 
 #if defined(DLR_TRACE)
-    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.remove[dst != NULL]));
 #endif
 
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.remove[dst != NULL], binds)) == -1)
         error(0, "DLR: SQLite3: Error while removing dlr entry for DST<%s>", octstr_get_cstr(dst));
     else if (!res)
         warning(0, "DLR: SQLite3: No dlr deleted for DST<%s>", octstr_get_cstr(dst));
 
     dbpool_conn_produce(pconn);
     gwlist_destroy(binds, NULL);
-    octstr_destroy(sql);
-    octstr_destroy(like);
 }
 
 static struct dlr_entry* dlr_get_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    Octstr *sql, *like;
     DBPoolConn *pconn;
     List *result = NULL, *row;
     struct dlr_entry *res = NULL;
@@ -223,35 +392,89 @@ static struct dlr_entry* dlr_get_sqlite3(const Octstr *smsc, const Octstr *ts, c
     if (pconn == NULL) /* should not happens, but sure is sure */
         return NULL;
 
+    gwlist_append(binds, (Octstr *)smsc);      /* ?1 */
+    gwlist_append(binds, (Octstr *)ts);        /* ?2 */
     if (dst)
-        like = octstr_format("AND %S LIKE '%?3'", fields->field_dst);
-    else
-        like = octstr_imm("");
+        gwlist_append(binds, (Octstr *)dst);   /* ?3 */
+
+#if defined(DLR_TRACE)
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.get[dst != NULL]));
+#endif
+    if (dbpool_conn_select(pconn, queries.get[dst != NULL], binds, &result) != 0) {
+        gwlist_destroy(binds, NULL);
+        dbpool_conn_produce(pconn);
+        return NULL;
+    }
+    gwlist_destroy(binds, NULL);
+    dbpool_conn_produce(pconn);
 
-    sql = octstr_format("SELECT %S, %S, %S, %S, %S, %S FROM %S WHERE %S=?1 AND %S=?2 %S LIMIT 1",
-                        fields->field_mask, fields->field_serv,
-                        fields->field_url, fields->field_src,
-                        fields->field_dst, fields->field_boxc,
-                        fields->table, fields->field_smsc,
-                        fields->field_ts, like);
+#define LO2CSTR(r, i) octstr_get_cstr(gwlist_get(r, i))
+
+    if (gwlist_len(result) > 0) {
+        row = gwlist_extract_first(result);
+        res = dlr_entry_create();
+        gw_assert(res != NULL);
+        res->mask = atoi(LO2CSTR(row,0));
+        res->service = octstr_create(LO2CSTR(row, 1));
+        res->url = octstr_create(LO2CSTR(row,2));
+        res->source = octstr_create(LO2CSTR(row, 3));
+        res->destination = octstr_create(LO2CSTR(row, 4));
+        res->boxc_id = octstr_create(LO2CSTR(row, 5));
+        gwlist_destroy(row, octstr_destroy_item);
+        res->smsc = octstr_duplicate(smsc);
+    }
+    gwlist_destroy(result, NULL);
+
+#undef LO2CSTR
+
+    return res;
+}
+
+#if SQLITE_VERSION_NUMBER >= 3035000
+/*
+ * Fetch the entry and delete or update it with the same statement using
+ * RETURNING. Only an intermediate report for an entry that doesn't wait
+ * for a final one takes a second statement to delete it.
+ */
+static struct dlr_entry* dlr_take_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    Octstr *sql, *os_status = NULL;
+    DBPoolConn *pconn;
+    List *result = NULL, *row;
+    struct dlr_entry *res = NULL;
+    List *binds = gwlist_create();
+
+    pconn = dbpool_conn_consume(pool);
+    if (pconn == NULL) { /* should not happens, but sure is sure */
+        gwlist_destroy(binds, NULL);
+        return NULL;
+    }
+
+    if (dlr_status_final(status))
+        sql = queries.take_final[dst != NULL];
+    else {
+        os_status = octstr_format("%d", status);
+        sql = queries.take[dst != NULL];
+    }
 
     gwlist_append(binds, (Octstr *)smsc);      /* ?1 */
     gwlist_append(binds, (Octstr *)ts);        /* ?2 */
     if (dst)
         gwlist_append(binds, (Octstr *)dst);   /* ?3 */
+    if (os_status)
+        gwlist_append(binds, os_status);       /* ?3 or ?4 */
 
 #if defined(DLR_TRACE)
     debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
 #endif
     if (dbpool_conn_select(pconn, sql, binds, &result) != 0) {
-        octstr_destroy(sql);
         dbpool_conn_produce(pconn);
+        octstr_destroy(os_status);
+        gwlist_destroy(binds, NULL);
         return NULL;
     }
-    octstr_destroy(sql);
-    octstr_destroy(like);
+    octstr_destroy(os_status);
     gwlist_destroy(binds, NULL);
-    dbpool_conn_produce(pconn);
 
 #define LO2CSTR(r, i) octstr_get_cstr(gwlist_get(r, i))
 
@@ -265,19 +488,33 @@ static struct dlr_entry* dlr_get_sqlite3(const Octstr *smsc, const Octstr *ts, c
         res->source = octstr_create(LO2CSTR(row, 3));
         res->destination = octstr_create(LO2CSTR(row, 4));
         res->boxc_id = octstr_create(LO2CSTR(row, 5));
-        gwlist_destroy(row, octstr_destroy_item);
         res->smsc = octstr_duplicate(smsc);
+
+        /* updated, but nobody waits for a final report */
+        if (!dlr_status_final(status) && !dlr_entry_keep(res, status)) {
+            binds = gwlist_create();
+            gwlist_append(binds, gwlist_get(row, 6));
+#if defined(DLR_TRACE)
+            debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.remove_rowid));
+#endif
+            if (dbpool_conn_update(pconn, queries.remove_rowid, binds) == -1)
+                error(0, "DLR: SQLite3: Error while removing dlr entry for DST<%s>", octstr_get_cstr(dst));
+            gwlist_destroy(binds, NULL);
+        }
+        gwlist_destroy(row, octstr_destroy_item);
     }
     gwlist_destroy(result, NULL);
+    dbpool_conn_produce(pconn);
 
 #undef LO2CSTR
 
     return res;
 }
+#endif
 
 static void dlr_update_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
 {
-    Octstr *sql, *os_status, *like;
+    Octstr *os_status;
     DBPoolConn *pconn;
     List *binds = gwlist_create();
     int res;
@@ -289,15 +526,6 @@ static void dlr_update_sqlite3(const Octstr *smsc, const Octstr *ts, const Octst
     if (pconn == NULL)
         return;
 
-    if (dst)
-        like = octstr_format("AND %S LIKE '%?4'", fields->field_dst);
-    else
-        like = octstr_imm("");
-
-    sql = octstr_format("UPDATE %S SET %S=?1 WHERE ROWID IN (SELECT ROWID FROM %S WHERE %S=?2 AND %S=?3 %S LIMIT 1)",
-                        fields->table, fields->field_status, fields->table,
-                        fields->field_smsc, fields->field_ts, like);
-
     os_status = octstr_format("%d", status);
     gwlist_append(binds, (Octstr *)os_status); /* ?1 */
     gwlist_append(binds, (Octstr *)smsc);      /* ?2 */
@@ -306,9 +534,9 @@ static void dlr_update_sqlite3(const Octstr *smsc, const Octstr *ts, const Octst
         gwlist_append(binds, (Octstr *)dst);   /* ?4 */
     
 #if defined(DLR_TRACE)
-    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.update[dst != NULL]));
 #endif
-    if ((res = dbpool_conn_update(pconn, sql, binds)) == -1)
+    if ((res = dbpool_conn_update(pconn, queries.update[dst != NULL], binds)) == -1)
         error(0, "DLR: SQLite3: Error while updating dlr entry for DST<%s>", octstr_get_cstr(dst));
     else if (!res)
         warning(0, "DLR: SQLite3: No dlr found to update for DST<%s> (status: %d)", octstr_get_cstr(dst), status);
@@ -316,13 +544,10 @@ static void dlr_update_sqlite3(const Octstr *smsc, const Octstr *ts, const Octst
     dbpool_conn_produce(pconn);
     gwlist_destroy(binds, NULL);
     octstr_destroy(os_status);
-    octstr_destroy(sql);
-    octstr_destroy(like);
 }
 
 static void dlr_flush_sqlite3 (void)
 {
-    Octstr *sql;
     DBPoolConn *pconn;
     int rows;
 
@@ -331,17 +556,15 @@ static void dlr_flush_sqlite3 (void)
     if (pconn == NULL)
         return;
 
-    sql = octstr_format("DELETE FROM %S", fields->table);
 #if defined(DLR_TRACE)
-    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(queries.flush));
 #endif
-    rows = dbpool_conn_update(pconn, sql, NULL);
+    rows = dbpool_conn_update(pconn, queries.flush, NULL);
     if (rows == -1)
         error(0, "DLR: SQLite3: Error while flushing dlr entries from database");
     else
         debug("dlr.sqlite3", 0, "Flushing %d DLR entries from database", rows);
     dbpool_conn_produce(pconn);
-    octstr_destroy(sql);
 }
 
 static struct dlr_storage handles = {
@@ -349,7 +572,11 @@ static struct dlr_storage handles = {
     .dlr_messages = dlr_messages_sqlite3,
     .dlr_shutdown = dlr_shutdown_sqlite3,
     .dlr_add = dlr_add_sqlite3,
+    .dlr_add_batch = dlr_add_batch_sqlite3,
     .dlr_get = dlr_get_sqlite3,
+#if SQLITE_VERSION_NUMBER >= 3035000
+    .dlr_take = dlr_take_sqlite3,
+#endif
     .dlr_remove = dlr_remove_sqlite3,
     .dlr_update = dlr_update_sqlite3,
     .dlr_flush = dlr_flush_sqlite3
@@ -373,6 +600,7 @@ struct dlr_storage *dlr_init_sqlite3(Cfg *cfg)
     /* initialize database fields */
     fields = dlr_db_fields_create(grp);
     gw_assert(fields != NULL);
+    dlr_sqlite3_queries_create();
 
     grplist = cfg_get_multi_group(cfg, octstr_imm("sqlite3-connection"));
     found = 0;
@@ -408,6 +636,7 @@ struct dlr_storage *dlr_init_sqlite3(Cfg *cfg)
 
     pool = dbpool_create(DBPOOL_SQLITE3, db_conf, pool_size);
     gw_assert(pool != NULL);
+    dbpool_configure(pool, grp);
 
     if (dbpool_conn_count(pool) == 0)
         panic(0, "DLR: SQLite3: Could not establish sqlite3 connection(s).");
@@ -65,6 +65,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 
@@ -85,6 +86,9 @@ static int parse_uuid(uuid_t id, Octstr *packed, int *off);
 
 static char *type_as_str(Msg *msg);
 
+static Msg *msg_unpack_binary(Octstr *os, const char *file, long line,
+                              const char *func);
+
 
 /**********************************************************************
  * Implementations of the exported functions.
@@ -98,6 +102,8 @@ Msg *msg_create_real(enum msg_type type, const char *file, long line,
     msg = gw_malloc_trace(sizeof(Msg), file, line, func);
 
     msg->type = type;
+    msg->link = -1;
+    msg->qfull_tries = 0;
 #define INTEGER(name) p->name = MSG_PARAM_UNDEFINED;
 #define OCTSTR(name) p->name = NULL;
 #define UUID(name) uuid_generate(p->name);
@@ -209,6 +215,10 @@ Msg *msg_unpack_real(Octstr *os, const char *file, long line, const char *func)
     int off;
     long i;
 
+    if (octstr_len(os) >= 4 &&
+        octstr_ncompare(os, octstr_imm(MSG_BINARY_MAGIC), 3) == 0)
+        return msg_unpack_binary(os, file, line, func);
+
     msg = msg_create_real(0, file, line, func);
     if (msg == NULL)
         goto error;
@@ -259,6 +269,272 @@ inline Msg *msg_unpack_wrapper(Octstr *os)
 }
 
 
+/**********************************************************************
+ * Binary codec.
+ *
+ * All integers are big endian. A packed message is
+ *
+ *   header   "KBM" version(1)  type(4)  nint(2)  nuuid(2)  nstr(4)
+ *   nint     integer fields, 8 octets each
+ *   nuuid    UUID fields, 16 raw octets each
+ *   nstr     string table entries: offset(4) length(4), length
+ *            0xffffffff for a NULL field, offset relative to the
+ *            start of the string data
+ *            string data
+ *
+ * Fields of each kind are in msg-decl.h order. New fields may only be
+ * added at the end of a message type: a decoder reads the fields it
+ * knows and skips the rest, fields missing in the input stay undefined.
+ */
+
+#define BINARY_HEADER_LEN 16
+#define BINARY_NULL 0xffffffffUL
+/* packets up to this size are built on the stack */
+#define BINARY_STACK_LEN 1024
+
+static void put_uint(unsigned char *p, unsigned long long value, int len)
+{
+    while (len-- > 0) {
+        p[len] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static unsigned long long get_uint(const unsigned char *p, int len)
+{
+    unsigned long long value = 0;
+
+    while (len-- > 0)
+        value = (value << 8) | *p++;
+    return value;
+}
+
+
+Octstr *msg_pack_binary(Msg *msg)
+{
+    unsigned char stack[BINARY_STACK_LEN], *buf, *w;
+    Octstr *os;
+    long nint = 0, nuuid = 0, nstr = 0, nbytes = 0, off = 0, total;
+
+#define INTEGER(name) nint++;
+#define OCTSTR(name) nstr++; nbytes += octstr_len(p->name);
+#define UUID(name) nuuid++;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        panic(0, "Internal error: unknown message type: %d",
+              msg->type);
+    }
+
+    /* build the packet in one go, so that the Octstr is allocated once */
+    total = BINARY_HEADER_LEN + 8 * nint + 16 * nuuid + 8 * nstr + nbytes;
+    buf = (total <= BINARY_STACK_LEN) ? stack : gw_malloc(total);
+
+    memcpy(buf, MSG_BINARY_MAGIC, 3);
+    buf[3] = MSG_BINARY_VERSION;
+    put_uint(buf + 4, msg->type, 4);
+    put_uint(buf + 8, nint, 2);
+    put_uint(buf + 10, nuuid, 2);
+    put_uint(buf + 12, nstr, 4);
+    w = buf + BINARY_HEADER_LEN;
+
+    /* integers, UUIDs, the string table and the strings, in this order */
+#define INTEGER(name) put_uint(w, (unsigned long long) p->name, 8); w += 8;
+#define OCTSTR(name)
+#define UUID(name)
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+#define INTEGER(name)
+#define OCTSTR(name)
+#define UUID(name) memcpy(w, p->name, 16); w += 16;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+#define INTEGER(name)
+#define OCTSTR(name) \
+    put_uint(w, off, 4); \
+    put_uint(w + 4, p->name != NULL ? octstr_len(p->name) : BINARY_NULL, 4); \
+    w += 8; \
+    off += octstr_len(p->name);
+#define UUID(name)
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+#define INTEGER(name)
+#define OCTSTR(name) \
+    if (p->name != NULL) { \
+        memcpy(w, octstr_get_cstr(p->name), octstr_len(p->name)); \
+        w += octstr_len(p->name); \
+    }
+#define UUID(name)
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+    gw_assert(w == buf + total);
+    os = octstr_create_from_data((char *) buf, total);
+    if (buf != stack)
+        gw_free(buf);
+
+    return os;
+}
+
+
+static Msg *msg_unpack_binary(Octstr *os, const char *file, long line,
+                              const char *func)
+{
+    const unsigned char *data, *ints, *uuids, *table;
+    unsigned long long offset, len;
+    long type, nint, nuuid, nstr, strings, total, i;
+    Msg *msg = NULL;
+
+    data = (const unsigned char *) octstr_get_cstr(os);
+    total = octstr_len(os);
+    if (total < BINARY_HEADER_LEN)
+        goto error;
+    if (data[3] != MSG_BINARY_VERSION) {
+        error(0, "Msg packet has unsupported binary version %d.", data[3]);
+        return NULL;
+    }
+    type = get_uint(data + 4, 4);
+    nint = get_uint(data + 8, 2);
+    nuuid = get_uint(data + 10, 2);
+    nstr = get_uint(data + 12, 4);
+    ints = data + BINARY_HEADER_LEN;
+    uuids = ints + 8 * nint;
+    table = uuids + 16 * nuuid;
+    strings = BINARY_HEADER_LEN + 8 * nint + 16 * nuuid + 8 * (long long) nstr;
+    if (nstr > total || strings > total)
+        goto error;
+
+    msg = msg_create_real(0, file, line, func);
+    msg->type = type;
+
+#define INTEGER(name) \
+    p->name = (i < nint) ? (long) get_uint(ints + 8 * i, 8) : MSG_PARAM_UNDEFINED; i++;
+#define OCTSTR(name)
+#define UUID(name)
+#define VOID(name) p->name = NULL;
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; i = 0; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        error(0, "Internal error: unknown message type: %d",
+              msg->type);
+        msg->type = 0;
+        msg_destroy(msg);
+        return NULL;
+    }
+
+#define INTEGER(name)
+#define OCTSTR(name)
+#define UUID(name) \
+    if (i < nuuid) memcpy(p->name, uuids + 16 * i, 16); \
+    else uuid_clear(p->name); \
+    i++;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; i = 0; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+    /* NULL all strings first, so that msg_destroy works on errors */
+#define INTEGER(name)
+#define OCTSTR(name) p->name = NULL;
+#define UUID(name)
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+#define INTEGER(name)
+#define OCTSTR(name) \
+    if (i < nstr) { \
+        offset = get_uint(table + 8 * i, 4); \
+        len = get_uint(table + 8 * i + 4, 4); \
+        if (len != BINARY_NULL) { \
+            if (offset + len > (unsigned long long) (total - strings)) \
+                goto error; \
+            p->name = octstr_create_from_data_trace((char *) data + strings + offset, \
+                                                    len, file, line, func); \
+        } \
+    } \
+    i++;
+#define UUID(name)
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; (void) p; i = 0; stmt } break;
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+    return msg;
+
+error:
+    msg_destroy(msg);
+    error(0, "Msg packet was invalid.");
+    return NULL;
+}
+
+
+Msg *msg_codec_feature(void)
+{
+    Msg *msg;
+
+    msg = msg_create(admin);
+    msg->admin.command = cmd_feature;
+    msg->admin.boxc_id = octstr_create(MSG_FEATURE_CODEC);
+    msg->admin.http_port = MSG_BINARY_VERSION;
+    return msg;
+}
+
+
+int msg_codec_feature_version(Msg *msg)
+{
+    if (msg_type(msg) != admin || msg->admin.command != cmd_feature ||
+        octstr_str_compare(msg->admin.boxc_id, MSG_FEATURE_CODEC) != 0)
+        return -1;
+    return msg->admin.http_port;
+}
+
+
 /**********************************************************************
  * Implementations of private functions.
  */
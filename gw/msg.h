@@ -78,6 +78,12 @@ enum msg_type {
 
 typedef struct {
 	enum msg_type type;
+	/* link to the bearerbox the message was read from, or an ack has
+	 * to go back on, -1 if none. Local to the box, it is not packed. */
+	long link;
+	/* routing attempts in a row that found all queues full, local to
+	 * bearerbox and not packed either */
+	long qfull_tries;
 
 	#define INTEGER(name) long name;
 	#define OCTSTR(name) Octstr *name;
@@ -184,4 +190,29 @@ Msg *msg_unpack_real(Octstr *os, const char *file, long line, const char *func);
     gw_claim_area(msg_unpack_real((os), __FILE__, __LINE__, __func__))
 Msg *msg_unpack_wrapper(Octstr *os);
 
+/*
+ * Pack an Msg with the binary codec: a fixed layout header with all
+ * integer and UUID fields, followed by an offset table for the strings.
+ * It is faster to pack and unpack, and integers keep all 64 bits.
+ * msg_unpack() recognises both formats by the leading magic, so only
+ * the writer has to know which one the reader understands.
+ */
+#define MSG_BINARY_MAGIC "KBM"
+#define MSG_BINARY_VERSION 1
+Octstr *msg_pack_binary(Msg *msg);
+
+/*
+ * Boxes tell each other that they can unpack binary messages with an
+ * admin cmd_feature message carrying MSG_FEATURE_CODEC in boxc_id and
+ * the binary version in http_port. Boxes that do not know the feature
+ * ignore the message and keep getting the old format.
+ *
+ * msg_codec_feature() creates such a message; msg_codec_feature_version()
+ * returns the version announced in `msg', or -1 if it is no codec
+ * announcement.
+ */
+#define MSG_FEATURE_CODEC "msg-codec"
+Msg *msg_codec_feature(void);
+int msg_codec_feature_version(Msg *msg);
+
 #endif
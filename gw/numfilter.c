@@ -0,0 +1,948 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+/*
+ * numfilter.c - compiled white/black-list matcher for phone numbers
+ *
+ * See numfilter.h for the interface.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gwlib/gwlib.h"
+#include "numfilter.h"
+
+/* exact numbers are compared on their last KEY_DIGITS digits */
+#define KEY_DIGITS 19
+/* longest number we look at, longer ones are not numbers */
+#define MAX_DIGITS 64
+
+#define EMPTY_KEY (~0ULL)
+
+/*
+ * A compiled number list file is a header, the exact numbers to add and
+ * to remove as keys in Eytzinger order, then the prefixes to add and to
+ * remove as lines of digits in sorted order. A full list has nothing to
+ * remove. A delta file holds the changes to the full list it was made
+ * against, whose id it records.
+ */
+#define NUMLIST_MAGIC "KXNUMLS\001"
+#define NUMLIST_BYTE_ORDER 0x01020304
+#define NUMLIST_DELTA 1
+
+enum {
+    NUMLIST_KEYS,
+    NUMLIST_REMOVED_KEYS,
+    NUMLIST_PREFIXES,           /* in octets, as are the removed ones */
+    NUMLIST_REMOVED_PREFIXES,
+    NUMLIST_SECTIONS
+};
+
+struct numlist_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t flags;
+    uint64_t id;                /* of a full list, from its contents */
+    uint64_t base;              /* id of the full list of a delta */
+    uint64_t size[NUMLIST_SECTIONS];
+};
+
+/* a compiled number list file mapped for one list, and its delta */
+struct mapped_list {
+    struct numlist_header *map;
+    size_t map_size;
+    const unsigned long long *keys;
+    unsigned long count;
+    struct numlist_header *delta;
+    size_t delta_size;
+    const unsigned long long *removed;
+    unsigned long removed_count;
+};
+
+struct prefix_node {
+    long child[10];         /* 0 is "none", the root is never a child */
+    unsigned char lists;    /* lists that have this prefix */
+};
+
+struct NumberFilter {
+    unsigned long used;     /* lists that have been configured */
+    unsigned long white;    /* lists that are white-lists */
+    unsigned long regexes;  /* lists that are a regex */
+    regex_t *regex[NUMFILTER_MAX_LISTS];
+    unsigned long mapped;   /* lists that are a compiled list file */
+    struct mapped_list files[NUMFILTER_MAX_LISTS];
+
+    /* exact numbers while adding, compiled into the table */
+    unsigned long long *keys;
+    unsigned char *key_lists;
+    long num_keys;
+    long keys_size;
+
+    /* open addressing table of the exact numbers */
+    unsigned long long *table;
+    unsigned char *table_lists;
+    unsigned long table_mask;
+    int table_shift;
+    long numbers;
+
+    /* digit trie of the prefixes */
+    struct prefix_node *nodes;
+    long num_nodes;
+    long nodes_size;
+    long prefixes;
+
+    int compiled;
+};
+
+
+/*
+ * Copy the significant digits of the `len' octets at `s' into `digits'
+ * and return their number. Blanks, '-' and a leading '+' are skipped, as
+ * are leading zeros. If `prefix' is not NULL, a '*' after the digits makes
+ * it a prefix and anything after that is ignored, as is anything after a
+ * ':'. Otherwise all of `s' must be part of the number. Return -1 if `s'
+ * is not a number.
+ */
+static int significant_digits(const char *s, long len, char *digits, int *prefix)
+{
+    long i;
+    int n = 0, seen = 0;
+
+    if (prefix != NULL)
+        *prefix = 0;
+    for (i = 0; i < len; i++) {
+        if (isdigit((unsigned char) s[i])) {
+            seen = 1;
+            if (n == 0 && s[i] == '0')
+                continue;
+            if (n == MAX_DIGITS)
+                return -1;
+            digits[n++] = s[i];
+        } else if (s[i] == ' ' || s[i] == '-' || s[i] == '\t' ||
+                   (s[i] == '+' && !seen && n == 0))
+            continue;
+        else if (prefix != NULL && s[i] == '*') {
+            *prefix = 1;
+            break;
+        } else if (prefix != NULL && (s[i] == ':' || s[i] == '\r'))
+            break;
+        else if (prefix == NULL)
+            return -1;
+        else
+            break;
+    }
+    return seen ? n : -1;
+}
+
+
+static unsigned long long digits_key(const char *digits, int n)
+{
+    unsigned long long key = 0;
+    int i;
+
+    for (i = (n > KEY_DIGITS ? n - KEY_DIGITS : 0); i < n; i++)
+        key = key * 10 + (digits[i] - '0');
+    return key;
+}
+
+
+static unsigned long key_slot(NumberFilter *filter, unsigned long long key)
+{
+    return (unsigned long) ((key * 0x9E3779B97F4A7C15ULL) >> filter->table_shift);
+}
+
+
+static void add_key(NumberFilter *filter, int list, unsigned long long key)
+{
+    if (filter->num_keys == filter->keys_size) {
+        filter->keys_size = filter->keys_size ? filter->keys_size * 2 : 1024;
+        filter->keys = gw_realloc(filter->keys, filter->keys_size * sizeof(*filter->keys));
+        filter->key_lists = gw_realloc(filter->key_lists, filter->keys_size);
+    }
+    filter->keys[filter->num_keys] = key;
+    filter->key_lists[filter->num_keys++] = 1 << list;
+}
+
+
+static long new_node(NumberFilter *filter)
+{
+    if (filter->num_nodes == filter->nodes_size) {
+        filter->nodes_size *= 2;
+        filter->nodes = gw_realloc(filter->nodes, filter->nodes_size * sizeof(*filter->nodes));
+    }
+    memset(&filter->nodes[filter->num_nodes], 0, sizeof(*filter->nodes));
+    return filter->num_nodes++;
+}
+
+
+static void add_prefix(NumberFilter *filter, int list, const char *digits, int n)
+{
+    long node = 0, next;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ((next = filter->nodes[node].child[digits[i] - '0']) == 0) {
+            next = new_node(filter);
+            filter->nodes[node].child[digits[i] - '0'] = next;
+        }
+        node = next;
+    }
+    if (filter->nodes[node].lists == 0)
+        filter->prefixes++;
+    filter->nodes[node].lists |= 1 << list;
+}
+
+
+static void use_list(NumberFilter *filter, int list, enum numfilter_type type)
+{
+    gw_assert(list >= 0 && list < NUMFILTER_MAX_LISTS);
+    gw_assert(!filter->compiled);
+
+    filter->used |= 1UL << list;
+    if (type == NUMFILTER_WHITE)
+        filter->white |= 1UL << list;
+    else
+        filter->white &= ~(1UL << list);
+}
+
+
+static void remove_prefix(NumberFilter *filter, int list, const char *digits, int n)
+{
+    long node = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        if ((node = filter->nodes[node].child[digits[i] - '0']) == 0)
+            return;
+    if (filter->nodes[node].lists & (1 << list)) {
+        filter->nodes[node].lists &= ~(1 << list);
+        if (filter->nodes[node].lists == 0)
+            filter->prefixes--;
+    }
+}
+
+
+/*
+ * Append the prefixes below `node', whose digits are in `digits', to
+ * `os', one per line and in sorted order.
+ */
+static void dump_prefixes(NumberFilter *filter, long node, char *digits, int n,
+                          Octstr *os)
+{
+    int i;
+
+    if (filter->nodes[node].lists != 0) {
+        octstr_append_data(os, digits, n);
+        octstr_append_char(os, '\n');
+    }
+    for (i = 0; i < 10; i++) {
+        if (filter->nodes[node].child[i] != 0) {
+            digits[n] = '0' + i;
+            dump_prefixes(filter, filter->nodes[node].child[i], digits, n + 1, os);
+        }
+    }
+}
+
+
+/*
+ * Lay out the `count' sorted keys at `sorted' in Eytzinger order, the
+ * implicit binary tree with the children of position k at 2k and 2k + 1,
+ * and return the index of the next key. The top levels of the tree share
+ * a few cache lines and pages, which a binary search of a large sorted
+ * array does not.
+ */
+static unsigned long eytzinger_fill(const unsigned long long *sorted,
+                                    unsigned long long *keys, unsigned long i,
+                                    unsigned long k, unsigned long count)
+{
+    if (k <= count) {
+        i = eytzinger_fill(sorted, keys, i, 2 * k, count);
+        keys[k - 1] = sorted[i++];
+        i = eytzinger_fill(sorted, keys, i, 2 * k + 1, count);
+    }
+    return i;
+}
+
+
+/* The reverse of eytzinger_fill(). */
+static unsigned long eytzinger_sort(const unsigned long long *keys,
+                                    unsigned long long *sorted, unsigned long i,
+                                    unsigned long k, unsigned long count)
+{
+    if (k <= count) {
+        i = eytzinger_sort(keys, sorted, i, 2 * k, count);
+        sorted[i++] = keys[k - 1];
+        i = eytzinger_sort(keys, sorted, i, 2 * k + 1, count);
+    }
+    return i;
+}
+
+
+static int eytzinger_find(const unsigned long long *keys, unsigned long count,
+                          unsigned long long key)
+{
+    unsigned long k = 1;
+
+    while (k <= count) {
+        /* the 16 descendants four levels down share two cache lines */
+        __builtin_prefetch(keys + 16 * k - 1);
+        k = 2 * k + (keys[k - 1] < key);
+    }
+    /* undo the right turns after the last left turn, and that one */
+    k >>= __builtin_ffsl((long) ~k);
+    return k != 0 && keys[k - 1] == key;
+}
+
+
+static int compare_keys(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/*
+ * Map the compiled number list file `path' and check its header. Return
+ * NULL if it cannot be used, the reason is logged.
+ */
+static struct numlist_header *map_list(const char *path, size_t *size)
+{
+    struct numlist_header *h;
+    struct stat st;
+    void *map;
+    uint64_t keys;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        error(errno, "Cannot open number list <%s>", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(*h)) {
+        error(0, "Number list <%s> is too short", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error(errno, "Cannot map number list <%s>", path);
+        return NULL;
+    }
+    h = map;
+    *size = st.st_size;
+
+    keys = h->size[NUMLIST_KEYS] + h->size[NUMLIST_REMOVED_KEYS];
+    if (memcmp(h->magic, NUMLIST_MAGIC, sizeof(h->magic)) != 0 ||
+        h->byte_order != NUMLIST_BYTE_ORDER ||
+        h->size[NUMLIST_KEYS] > *size / 8 || h->size[NUMLIST_REMOVED_KEYS] > *size / 8 ||
+        h->size[NUMLIST_PREFIXES] > *size || h->size[NUMLIST_REMOVED_PREFIXES] > *size ||
+        sizeof(*h) + keys * 8 + h->size[NUMLIST_PREFIXES] +
+        h->size[NUMLIST_REMOVED_PREFIXES] != *size) {
+        error(0, "Number list <%s> is corrupted or from another platform", path);
+        munmap(map, *size);
+        return NULL;
+    }
+    return h;
+}
+
+
+static const char *list_section(struct numlist_header *h, int section)
+{
+    const char *p = (const char *) (h + 1);
+    int i;
+
+    for (i = 0; i < section; i++)
+        p += (i < NUMLIST_PREFIXES ? 8 : 1) * h->size[i];
+    return p;
+}
+
+
+/* Add or remove the prefixes of a section of a mapped list file. */
+static void map_prefixes(NumberFilter *filter, int list, struct numlist_header *h,
+                         int section)
+{
+    const char *p, *end, *eol;
+
+    p = list_section(h, section);
+    end = p + h->size[section];
+    for (; p < end; p = eol + 1) {
+        if ((eol = memchr(p, '\n', end - p)) == NULL)
+            eol = end;
+        if (eol - p >= MAX_DIGITS)
+            continue;
+        if (section == NUMLIST_PREFIXES)
+            add_prefix(filter, list, p, eol - p);
+        else
+            remove_prefix(filter, list, p, eol - p);
+    }
+}
+
+
+/*
+ * Use the compiled number list file `path' for `list', with the changes
+ * of `path'.delta if there is one. The keys stay in the mapped file, only
+ * the prefixes and the numbers added by the delta are copied.
+ */
+static int add_file(NumberFilter *filter, int list, enum numfilter_type type,
+                    const char *path)
+{
+    struct mapped_list *file = &filter->files[list];
+    struct numlist_header *h, *d;
+    const unsigned long long *keys;
+    struct stat st;
+    Octstr *delta;
+    unsigned long i;
+
+    gw_assert(file->map == NULL);
+
+    if ((h = map_list(path, &file->map_size)) == NULL)
+        return -1;
+    if (h->flags & NUMLIST_DELTA) {
+        error(0, "Number list <%s> is a delta, not a full list", path);
+        munmap(h, file->map_size);
+        return -1;
+    }
+    madvise(h, file->map_size, MADV_RANDOM);
+
+    use_list(filter, list, type);
+    filter->mapped |= 1UL << list;
+    file->map = h;
+    file->keys = (const unsigned long long *) list_section(h, NUMLIST_KEYS);
+    file->count = h->size[NUMLIST_KEYS];
+    map_prefixes(filter, list, h, NUMLIST_PREFIXES);
+
+    delta = octstr_format("%s.delta", path);
+    if (stat(octstr_get_cstr(delta), &st) == 0 &&
+        (d = map_list(octstr_get_cstr(delta), &file->delta_size)) != NULL) {
+        if (!(d->flags & NUMLIST_DELTA) || d->base != h->id) {
+            warning(0, "Number list delta <%s> was not made for <%s>, ignored",
+                    octstr_get_cstr(delta), path);
+            munmap(d, file->delta_size);
+        } else {
+            file->delta = d;
+            keys = (const unsigned long long *) list_section(d, NUMLIST_KEYS);
+            for (i = 0; i < d->size[NUMLIST_KEYS]; i++)
+                add_key(filter, list, keys[i]);
+            file->removed = (const unsigned long long *) list_section(d, NUMLIST_REMOVED_KEYS);
+            file->removed_count = d->size[NUMLIST_REMOVED_KEYS];
+            map_prefixes(filter, list, d, NUMLIST_PREFIXES);
+            map_prefixes(filter, list, d, NUMLIST_REMOVED_PREFIXES);
+        }
+    }
+    octstr_destroy(delta);
+
+    info(0, "Mapped <%s> with %lu numbers%s", path, file->count,
+         file->delta != NULL ? " and its delta" : "");
+    return 0;
+}
+
+
+/* Add the number list in `body', one entry per line. */
+static long add_lines(NumberFilter *filter, int list, enum numfilter_type type,
+                      Octstr *body)
+{
+    char *data, *ptr;
+    long lines = 0;
+
+    use_list(filter, list, type);
+    data = octstr_get_cstr(body);
+    while (*data != '\0') {
+        if ((ptr = strchr(data, '\n')) != NULL)
+            *ptr = '\0';
+        while (*data != '\0' && isspace((unsigned char) *data))
+            data++;
+        if (*data != '#' && *data != '\0') {
+            if (number_filter_add_number(filter, list, type, data) == 0)
+                lines++;
+            else
+                warning(0, "Corrupted line '%s'", data);
+        }
+        if (ptr == NULL)
+            break;
+        data = ptr + 1;
+    }
+    return lines;
+}
+
+
+/* Write `size' octets to `f', return -1 if that fails. */
+static int write_data(FILE *f, const void *data, size_t size)
+{
+    return size == 0 || fwrite(data, size, 1, f) == 1 ? 0 : -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * Public functions
+ */
+
+NumberFilter *number_filter_create(void)
+{
+    NumberFilter *filter;
+
+    filter = gw_malloc(sizeof(*filter));
+    memset(filter, 0, sizeof(*filter));
+    filter->nodes_size = 64;
+    filter->nodes = gw_malloc(filter->nodes_size * sizeof(*filter->nodes));
+    new_node(filter);
+    return filter;
+}
+
+
+void number_filter_destroy(NumberFilter *filter)
+{
+    int i;
+
+    if (filter == NULL)
+        return;
+    for (i = 0; i < NUMFILTER_MAX_LISTS; i++) {
+        if (filter->regex[i] != NULL)
+            gw_regex_destroy(filter->regex[i]);
+        if (filter->files[i].map != NULL)
+            munmap(filter->files[i].map, filter->files[i].map_size);
+        if (filter->files[i].delta != NULL)
+            munmap(filter->files[i].delta, filter->files[i].delta_size);
+    }
+    gw_free(filter->keys);
+    gw_free(filter->key_lists);
+    gw_free(filter->table);
+    gw_free(filter->table_lists);
+    gw_free(filter->nodes);
+    gw_free(filter);
+}
+
+
+int number_filter_add_number(NumberFilter *filter, int list,
+                             enum numfilter_type type, const char *line)
+{
+    char digits[MAX_DIGITS];
+    int n, prefix;
+
+    use_list(filter, list, type);
+    gw_assert(!(filter->regexes & (1UL << list)));
+
+    n = significant_digits(line, strlen(line), digits, &prefix);
+    if (n < 0 || (n == 0 && prefix))
+        return -1;
+    if (prefix)
+        add_prefix(filter, list, digits, n);
+    else
+        add_key(filter, list, digits_key(digits, n));
+    return 0;
+}
+
+
+int number_filter_add_url(NumberFilter *filter, int list,
+                          enum numfilter_type type, Octstr *url)
+{
+    List *request_headers, *reply_headers;
+    Octstr *final_url, *reply_body, *type_os, *charset, *path;
+    char magic[sizeof(NUMLIST_MAGIC) - 1];
+    long lines;
+    int status, fd, ret;
+
+    if (octstr_case_search(url, octstr_imm("http://"), 0) != 0 &&
+        octstr_case_search(url, octstr_imm("https://"), 0) != 0) {
+        /* a local file, compiled or text */
+        if (octstr_case_search(url, octstr_imm("file://"), 0) == 0)
+            path = octstr_copy(url, 7, octstr_len(url));
+        else
+            path = octstr_duplicate(url);
+        if ((fd = open(octstr_get_cstr(path), O_RDONLY)) == -1) {
+            error(errno, "Cannot load number list from <%s>!", octstr_get_cstr(url));
+            octstr_destroy(path);
+            return -1;
+        }
+        ret = read(fd, magic, sizeof(magic));
+        close(fd);
+        if (ret == sizeof(magic) && memcmp(magic, NUMLIST_MAGIC, sizeof(magic)) == 0) {
+            ret = add_file(filter, list, type, octstr_get_cstr(path));
+        } else if ((reply_body = octstr_read_file(octstr_get_cstr(path))) == NULL) {
+            ret = -1;
+        } else {
+            lines = add_lines(filter, list, type, reply_body);
+            octstr_destroy(reply_body);
+            info(0, "Read from <%s> total of %ld numbers", octstr_get_cstr(url), lines);
+            ret = 0;
+        }
+        octstr_destroy(path);
+        return ret;
+    }
+
+    request_headers = http_create_empty_headers();
+    status = http_get_real(HTTP_METHOD_GET, url, request_headers, &final_url,
+                           &reply_headers, &reply_body);
+    octstr_destroy(final_url);
+    http_destroy_headers(request_headers);
+
+    if (status != HTTP_OK) {
+        http_destroy_headers(reply_headers);
+        octstr_destroy(reply_body);
+        error(0, "Cannot load number list from <%s>!", octstr_get_cstr(url));
+        return -1;
+    }
+    http_header_get_content_type(reply_headers, &type_os, &charset);
+    octstr_destroy(charset);
+    http_destroy_headers(reply_headers);
+
+    if (octstr_str_compare(type_os, "text/plain") != 0) {
+        error(0, "Strange content type <%s> for number list <%s> - expecting "
+              "'text/plain', operation fails", octstr_get_cstr(type_os),
+              octstr_get_cstr(url));
+        octstr_destroy(type_os);
+        octstr_destroy(reply_body);
+        return -1;
+    }
+    octstr_destroy(type_os);
+
+    lines = add_lines(filter, list, type, reply_body);
+    octstr_destroy(reply_body);
+
+    info(0, "Read from <%s> total of %ld numbers", octstr_get_cstr(url), lines);
+    return 0;
+}
+
+
+void number_filter_add_regex(NumberFilter *filter, int list,
+                             enum numfilter_type type, regex_t *regex)
+{
+    use_list(filter, list, type);
+    gw_assert(filter->regex[list] == NULL && filter->files[list].map == NULL);
+
+    filter->regexes |= 1UL << list;
+    filter->regex[list] = regex;
+}
+
+
+void number_filter_compile(NumberFilter *filter)
+{
+    unsigned long size, slot;
+    long i;
+
+    gw_assert(!filter->compiled);
+
+    /* keep the load factor of the table below 3/4 */
+    size = 16;
+    filter->table_shift = 60;
+    while (size < (unsigned long) filter->num_keys + filter->num_keys / 3 + 1) {
+        size *= 2;
+        filter->table_shift--;
+    }
+    filter->table_mask = size - 1;
+    filter->table = gw_malloc(size * sizeof(*filter->table));
+    filter->table_lists = gw_malloc(size);
+    for (slot = 0; slot < size; slot++)
+        filter->table[slot] = EMPTY_KEY;
+    memset(filter->table_lists, 0, size);
+
+    for (i = 0; i < filter->num_keys; i++) {
+        slot = key_slot(filter, filter->keys[i]);
+        while (filter->table[slot] != EMPTY_KEY && filter->table[slot] != filter->keys[i])
+            slot = (slot + 1) & filter->table_mask;
+        if (filter->table[slot] == EMPTY_KEY) {
+            filter->table[slot] = filter->keys[i];
+            filter->numbers++;
+        }
+        filter->table_lists[slot] |= filter->key_lists[i];
+    }
+    gw_free(filter->keys);
+    gw_free(filter->key_lists);
+    filter->keys = NULL;
+    filter->key_lists = NULL;
+    filter->num_keys = filter->keys_size = 0;
+
+    filter->compiled = 1;
+}
+
+
+unsigned long number_filter_lists(NumberFilter *filter)
+{
+    return filter == NULL ? 0 : filter->used;
+}
+
+
+unsigned long number_filter_check(NumberFilter *filter, Octstr *number,
+                                  unsigned long lists)
+{
+    char digits[MAX_DIGITS];
+    struct mapped_list *file;
+    unsigned long found = 0, slot, mapped;
+    unsigned long long key;
+    long node;
+    int i, n;
+
+    gw_assert(filter->compiled);
+
+    lists &= filter->used;
+    if (lists == 0)
+        return 0;
+
+    if (number != NULL && (lists & ~filter->regexes) &&
+        (n = significant_digits(octstr_get_cstr(number), octstr_len(number),
+                                digits, NULL)) > 0) {
+        key = digits_key(digits, n);
+        slot = key_slot(filter, key);
+        while (filter->table[slot] != EMPTY_KEY) {
+            if (filter->table[slot] == key) {
+                found |= filter->table_lists[slot];
+                break;
+            }
+            slot = (slot + 1) & filter->table_mask;
+        }
+        for (mapped = lists & filter->mapped; mapped != 0; mapped &= mapped - 1) {
+            file = &filter->files[__builtin_ctzl(mapped)];
+            if (eytzinger_find(file->keys, file->count, key) &&
+                !eytzinger_find(file->removed, file->removed_count, key))
+                found |= mapped & -mapped;
+        }
+        for (i = 0, node = 0; i < n; i++) {
+            if ((node = filter->nodes[node].child[digits[i] - '0']) == 0)
+                break;
+            found |= filter->nodes[node].lists;
+        }
+    }
+
+    if (number != NULL) {
+        for (i = 0; i < NUMFILTER_MAX_LISTS; i++)
+            if ((lists & filter->regexes & (1UL << i)) &&
+                gw_regex_match_pre(filter->regex[i], number) == 1)
+                found |= 1UL << i;
+    }
+
+    /* white-lists reject what they do not hold, black-lists what they do */
+    return (found ^ filter->white) & lists;
+}
+
+
+int number_filter_first(unsigned long lists)
+{
+    gw_assert(lists != 0);
+    return __builtin_ctzl(lists);
+}
+
+
+long number_filter_size(NumberFilter *filter, long *prefixes)
+{
+    long numbers;
+    int i;
+
+    if (prefixes != NULL)
+        *prefixes = filter->prefixes;
+    numbers = filter->compiled ? filter->numbers : filter->num_keys;
+    for (i = 0; i < NUMFILTER_MAX_LISTS; i++)
+        numbers += filter->files[i].count - filter->files[i].removed_count;
+    return numbers;
+}
+
+
+int number_filter_write(NumberFilter *filter, Octstr *path, Octstr *base)
+{
+    struct numlist_header h, *b = NULL;
+    unsigned long long *keys, *old = NULL, *removed = NULL, *layout = NULL;
+    unsigned long count, old_count, added, dropped, i, j;
+    Octstr *prefixes, *added_prefixes, *removed_prefixes, *os, *tmp;
+    List *lines, *old_lines = NULL;
+    long added_lines, removed_lines;
+    char digits[MAX_DIGITS];
+    size_t base_size = 0;
+    FILE *f;
+    int cmp, ret = -1;
+
+    gw_assert(!filter->compiled);
+
+    /* the sorted numbers and prefixes of all lists */
+    keys = gw_malloc((filter->num_keys + 1) * sizeof(*keys));
+    memcpy(keys, filter->keys, filter->num_keys * sizeof(*keys));
+    qsort(keys, filter->num_keys, sizeof(*keys), compare_keys);
+    for (i = count = 0; i < (unsigned long) filter->num_keys; i++)
+        if (count == 0 || keys[count - 1] != keys[i])
+            keys[count++] = keys[i];
+    prefixes = octstr_create("");
+    dump_prefixes(filter, 0, digits, 0, prefixes);
+    lines = octstr_split(prefixes, octstr_imm("\n"));
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, NUMLIST_MAGIC, sizeof(h.magic));
+    h.byte_order = NUMLIST_BYTE_ORDER;
+    added = count;
+    dropped = 0;
+    added_prefixes = prefixes;
+    removed_prefixes = octstr_create("");
+    added_lines = gwlist_len(lines);
+    removed_lines = 0;
+
+    if (base == NULL) {
+        /* a full list, identified by its contents */
+        h.id = 14695981039346656037ULL;
+        for (i = 0; i < count; i++)
+            h.id = (h.id ^ keys[i]) * 1099511628211ULL;
+        h.id ^= octstr_hash_key(prefixes);
+    } else {
+        /* the differences against the full list `base' */
+        if ((b = map_list(octstr_get_cstr(base), &base_size)) == NULL)
+            goto out;
+        if (b->flags & NUMLIST_DELTA) {
+            error(0, "Number list <%s> is a delta, not a full list",
+                  octstr_get_cstr(base));
+            goto out;
+        }
+        h.flags = NUMLIST_DELTA;
+        h.base = b->id;
+
+        old_count = b->size[NUMLIST_KEYS];
+        old = gw_malloc((old_count + 1) * sizeof(*old));
+        eytzinger_sort((const unsigned long long *) list_section(b, NUMLIST_KEYS),
+                       old, 0, 1, old_count);
+        removed = gw_malloc((old_count + 1) * sizeof(*removed));
+        added = 0;
+        for (i = j = 0; i < count || j < old_count; ) {
+            if (j == old_count || (i < count && keys[i] < old[j]))
+                keys[added++] = keys[i++];
+            else if (i == count || old[j] < keys[i])
+                removed[dropped++] = old[j++];
+            else
+                i++, j++;
+        }
+
+        os = octstr_create_from_data(list_section(b, NUMLIST_PREFIXES),
+                                     b->size[NUMLIST_PREFIXES]);
+        old_lines = octstr_split(os, octstr_imm("\n"));
+        octstr_destroy(os);
+        added_prefixes = octstr_create("");
+        added_lines = 0;
+        for (i = j = 0; i < (unsigned long) gwlist_len(lines) ||
+                        j < (unsigned long) gwlist_len(old_lines); ) {
+            if (j == (unsigned long) gwlist_len(old_lines))
+                cmp = -1;
+            else if (i == (unsigned long) gwlist_len(lines))
+                cmp = 1;
+            else
+                cmp = octstr_compare(gwlist_get(lines, i), gwlist_get(old_lines, j));
+            if (cmp < 0) {
+                octstr_format_append(added_prefixes, "%S\n", gwlist_get(lines, i++));
+                added_lines++;
+            } else if (cmp > 0) {
+                octstr_format_append(removed_prefixes, "%S\n", gwlist_get(old_lines, j++));
+                removed_lines++;
+            } else
+                i++, j++;
+        }
+    }
+
+    h.size[NUMLIST_KEYS] = added;
+    h.size[NUMLIST_REMOVED_KEYS] = dropped;
+    h.size[NUMLIST_PREFIXES] = octstr_len(added_prefixes);
+    h.size[NUMLIST_REMOVED_PREFIXES] = octstr_len(removed_prefixes);
+
+    /*
+     * Write a new file and rename it over the old one, so that processes
+     * which still map the old file keep using it unchanged.
+     */
+    layout = gw_malloc(((added > dropped ? added : dropped) + 1) * sizeof(*layout));
+    tmp = octstr_format("%S.tmp", path);
+    if ((f = fopen(octstr_get_cstr(tmp), "w")) == NULL) {
+        error(errno, "Cannot create number list <%s>", octstr_get_cstr(tmp));
+    } else if (write_data(f, &h, sizeof(h)) == -1 ||
+               (eytzinger_fill(keys, layout, 0, 1, added),
+                write_data(f, layout, added * sizeof(*layout))) == -1 ||
+               (eytzinger_fill(removed, layout, 0, 1, dropped),
+                write_data(f, layout, dropped * sizeof(*layout))) == -1 ||
+               write_data(f, octstr_get_cstr(added_prefixes),
+                          octstr_len(added_prefixes)) == -1 ||
+               write_data(f, octstr_get_cstr(removed_prefixes),
+                          octstr_len(removed_prefixes)) == -1 ||
+               fflush(f) != 0 || fsync(fileno(f)) == -1) {
+        error(errno, "Cannot write number list <%s>", octstr_get_cstr(tmp));
+        fclose(f);
+        unlink(octstr_get_cstr(tmp));
+    } else if (fclose(f) != 0 ||
+               rename(octstr_get_cstr(tmp), octstr_get_cstr(path)) == -1) {
+        error(errno, "Cannot write number list <%s>", octstr_get_cstr(path));
+        unlink(octstr_get_cstr(tmp));
+    } else {
+        info(0, "Wrote %s <%s>: %lu numbers and %ld prefixes added, "
+             "%lu numbers and %ld prefixes removed",
+             base != NULL ? "delta" : "number list", octstr_get_cstr(path),
+             added, added_lines, dropped, removed_lines);
+        ret = 0;
+    }
+    octstr_destroy(tmp);
+
+out:
+    if (b != NULL)
+        munmap(b, base_size);
+    gw_free(keys);
+    gw_free(old);
+    gw_free(removed);
+    gw_free(layout);
+    if (added_prefixes != prefixes)
+        octstr_destroy(added_prefixes);
+    octstr_destroy(prefixes);
+    octstr_destroy(removed_prefixes);
+    gwlist_destroy(lines, octstr_destroy_item);
+    gwlist_destroy(old_lines, octstr_destroy_item);
+    return ret;
+}
@@ -0,0 +1,154 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+/*
+ * numfilter.h - compiled white/black-list matcher for phone numbers
+ *
+ * A NumberFilter holds up to NUMFILTER_MAX_LISTS white- or black-lists
+ * and answers, with one lookup per number, which of them reject it. All
+ * number lists of a filter are compiled into one open addressing table
+ * for exact numbers and one digit trie for prefixes, so the cost of a
+ * check does not depend on the size or count of the lists. Lists given
+ * as a regular expression are kept aside and only evaluated when asked.
+ *
+ * Numbers are compared on their significant digits: a leading '+',
+ * leading zeros, blanks and '-' are ignored, as with numhash. Exact
+ * numbers are compared on their last 19 digits, prefixes on all digits.
+ *
+ * A filter is immutable after number_filter_compile(), so it can be used
+ * from several threads and reloaded by compiling a new one and swapping
+ * the pointer.
+ *
+ * Large lists can be compiled into a number list file beforehand, see
+ * number_filter_write() and the mknumlist utility. Such a file is mapped
+ * read-only rather than parsed, so loading it takes no time and memory
+ * of its own and its pages are shared by all processes that use it. The
+ * changes since it was compiled can be kept in a small delta file next
+ * to it, so that the large file needs to be rebuilt only now and then.
+ */
+
+#ifndef NUMFILTER_H
+#define NUMFILTER_H
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-regex.h"
+
+#define NUMFILTER_MAX_LISTS 8
+
+typedef struct NumberFilter NumberFilter;
+
+enum numfilter_type {
+    NUMFILTER_WHITE,    /* rejects the numbers not in the list */
+    NUMFILTER_BLACK     /* rejects the numbers in the list */
+};
+
+NumberFilter *number_filter_create(void);
+void number_filter_destroy(NumberFilter *filter);
+
+/*
+ * Add one entry to number list `list'. The syntax is the same as for a
+ * line of a numhash file: the number may contain blanks, '+' and '-' and
+ * is ended by ':' or the end of the line, everything after it is a
+ * comment. A number ending in '*' is a prefix, matching all numbers that
+ * start with it. Return -1 if the line holds no number.
+ */
+int number_filter_add_number(NumberFilter *filter, int list,
+                             enum numfilter_type type, const char *line);
+
+/*
+ * Load number list `list' from `url', one entry per line. A `url' that is
+ * not HTTP is a local file, which may be a compiled number list; then
+ * `url'.delta is applied to it, if it exists and was made for it. Return
+ * -1 if the list could not be fetched, the error is logged.
+ */
+int number_filter_add_url(NumberFilter *filter, int list,
+                          enum numfilter_type type, Octstr *url);
+
+/*
+ * Use `regex' for list `list', which must not hold numbers. The filter
+ * takes over the compiled expression.
+ */
+void number_filter_add_regex(NumberFilter *filter, int list,
+                             enum numfilter_type type, regex_t *regex);
+
+/* Build the lookup tables. No entries may be added afterwards. */
+void number_filter_compile(NumberFilter *filter);
+
+/* Bit mask of the lists that have any entries or a regex. */
+unsigned long number_filter_lists(NumberFilter *filter);
+
+/*
+ * Return the bit mask of those lists out of `lists' that reject `number',
+ * which may be NULL. Bit n stands for list n.
+ */
+unsigned long number_filter_check(NumberFilter *filter, Octstr *number,
+                                  unsigned long lists);
+
+/* Number of the first list in a non-empty bit mask. */
+int number_filter_first(unsigned long lists);
+
+/* Number of exact numbers and of prefixes in the filter. */
+long number_filter_size(NumberFilter *filter, long *prefixes);
+
+/*
+ * Write the numbers and prefixes added to all lists of the filter, which
+ * must not be compiled, into the compiled number list file `path'. If
+ * `base' is not NULL, write the delta from the compiled list `base'
+ * instead. The file is replaced atomically, so a running gateway can
+ * reload it. Return -1 on error, which is logged.
+ */
+int number_filter_write(NumberFilter *filter, Octstr *path, Octstr *base);
+
+#endif
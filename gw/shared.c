@@ -74,9 +74,85 @@ volatile enum program_status program_status = starting_up;
  * Communication with the bearerbox.
  */
 
-/* this is a static connection if only *one* boxc connection is 
- * established from a foobarbox to bearerbox. */
-static Connection *bb_conn;
+/* these are the static connections if a foobarbox establishes its
+ * boxc links to bearerbox via connect_to_bearerbox(). */
+typedef struct {
+    Connection *conn;
+    /* set once the bearerbox told us it can unpack binary messages */
+    volatile int binary;
+} BearerboxLink;
+
+static BearerboxLink *bb_links = NULL;
+static long bb_link_count = 0;
+static unsigned long bb_link_next = 0;
+
+
+/* write batching for connections to the bearerbox, see set_bearerbox_batching() */
+static long bb_batch_size = 0;
+static double bb_batch_delay = 0;
+
+/* default for bearerbox-batch-delay, in milliseconds */
+#define BB_BATCH_DELAY 1
+
+
+void set_bearerbox_batching(long size, double delay)
+{
+    bb_batch_size = size > 0 ? size : 0;
+    bb_batch_delay = delay;
+}
+
+
+void config_bearerbox_batching(CfgGroup *grp)
+{
+    long size, delay;
+
+    if (cfg_get_integer(&size, grp, octstr_imm("bearerbox-batch-size")) == -1 ||
+        size <= 0)
+        return;
+    if (cfg_get_integer(&delay, grp, octstr_imm("bearerbox-batch-delay")) == -1)
+        delay = BB_BATCH_DELAY;
+    if (delay <= 0)
+        panic(0, "'bearerbox-batch-delay' must be positive.");
+    info(0, "Batching writes to bearerbox up to %ld octets or %ld ms.",
+         size, delay);
+    set_bearerbox_batching(size, delay / 1000.0);
+}
+
+
+static Octstr *pack_for_bearerbox(Connection *conn, Msg *msg)
+{
+    long i;
+
+    for (i = 0; i < bb_link_count; i++) {
+        if (bb_links[i].conn == conn) {
+            if (bb_links[i].binary)
+                return msg_pack_binary(msg);
+            break;
+        }
+    }
+    return msg_pack(msg);
+}
+
+
+/*
+ * Messages to the same receiver always take the same link, so that
+ * their order is kept. Acks go back on the link their message came in,
+ * where the bearerbox waits for them. Everything else goes round robin.
+ */
+static Connection *link_for_msg(Msg *msg)
+{
+    unsigned long i;
+
+    if (bb_link_count == 1)
+        return bb_links[0].conn;
+    if (msg_type(msg) == ack && msg->link >= 0 && msg->link < bb_link_count)
+        i = msg->link;
+    else if (msg_type(msg) == sms && msg->sms.receiver != NULL)
+        i = octstr_hash_key(msg->sms.receiver);
+    else
+        i = __atomic_fetch_add(&bb_link_next, 1, __ATOMIC_RELAXED);
+    return bb_links[i % bb_link_count].conn;
+}
 
 
 Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *our_host)
@@ -93,6 +169,11 @@ Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *o
     if (conn == NULL)
         return NULL;
 
+    if (bb_batch_size > 0) {
+        conn_set_output_buffering(conn, bb_batch_size);
+        conn_set_output_delay(conn, bb_batch_delay);
+    }
+
     if (ssl)
         info(0, "Connected to bearerbox at %s port %d using SSL.",
 	         octstr_get_cstr(host), port);
@@ -106,9 +187,35 @@ Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *o
 
 void connect_to_bearerbox(Octstr *host, int port, int ssl, Octstr *our_host)
 {
-    bb_conn = connect_to_bearerbox_real(host, port, ssl, our_host);
-    if (bb_conn == NULL)
-        panic(0, "Couldn't connect to the bearerbox.");
+    connect_to_bearerbox_links(host, port, ssl, our_host, 1);
+}
+
+
+void connect_to_bearerbox_links(Octstr *host, int port, int ssl,
+                                Octstr *our_host, long links)
+{
+    long i;
+
+    gw_assert(bb_links == NULL && links > 0);
+
+    bb_links = gw_malloc(links * sizeof(*bb_links));
+    for (i = 0; i < links; i++) {
+        bb_links[i].conn = connect_to_bearerbox_real(host, port, ssl, our_host);
+        if (bb_links[i].conn == NULL)
+            panic(0, "Couldn't connect to the bearerbox.");
+        bb_links[i].binary = 0;
+    }
+    bb_link_count = links;
+
+    /* a bearerbox that knows the binary codec answers in kind */
+    for (i = 0; i < links; i++)
+        write_to_bearerbox_link(i, msg_codec_feature());
+}
+
+
+long bearerbox_links(void)
+{
+    return bb_link_count;
 }
 
 
@@ -120,8 +227,13 @@ void close_connection_to_bearerbox_real(Connection *conn)
 
 void close_connection_to_bearerbox(void)
 {
-    close_connection_to_bearerbox_real(bb_conn);
-    bb_conn = NULL;
+    long i;
+
+    for (i = 0; i < bb_link_count; i++)
+        close_connection_to_bearerbox_real(bb_links[i].conn);
+    bb_link_count = 0;
+    gw_free(bb_links);
+    bb_links = NULL;
 }
 
 
@@ -129,7 +241,7 @@ void write_to_bearerbox_real(Connection *conn, Msg *pmsg)
 {
     Octstr *pack;
 
-    pack = msg_pack(pmsg);
+    pack = pack_for_bearerbox(conn, pmsg);
     if (conn_write_withlen(conn, pack) == -1)
     	error(0, "Couldn't write Msg to bearerbox.");
 
@@ -140,7 +252,14 @@ void write_to_bearerbox_real(Connection *conn, Msg *pmsg)
 
 void write_to_bearerbox(Msg *pmsg)
 {
-    write_to_bearerbox_real(bb_conn, pmsg);
+    write_to_bearerbox_real(link_for_msg(pmsg), pmsg);
+}
+
+
+void write_to_bearerbox_link(long link, Msg *pmsg)
+{
+    gw_assert(link >= 0 && link < bb_link_count);
+    write_to_bearerbox_real(bb_links[link].conn, pmsg);
 }
 
 
@@ -149,7 +268,7 @@ int deliver_to_bearerbox_real(Connection *conn, Msg *msg)
      
     Octstr *pack;
     
-    pack = msg_pack(msg);
+    pack = pack_for_bearerbox(conn, msg);
     if (conn_write_withlen(conn, pack) == -1) {
     	error(0, "Couldn't deliver Msg to bearerbox.");
         octstr_destroy(pack);
@@ -164,7 +283,7 @@ int deliver_to_bearerbox_real(Connection *conn, Msg *msg)
 
 int deliver_to_bearerbox(Msg *msg)
 {
-    return deliver_to_bearerbox_real(bb_conn, msg);
+    return deliver_to_bearerbox_real(link_for_msg(msg), msg);
 }
                                            
 
@@ -218,7 +337,24 @@ int read_from_bearerbox_real(Connection *conn, Msg **msg, double seconds)
 
 int read_from_bearerbox(Msg **msg, double seconds)
 {
-    return read_from_bearerbox_real(bb_conn, msg, seconds);
+    return read_from_bearerbox_link(0, msg, seconds);
+}
+
+
+int read_from_bearerbox_link(long link, Msg **msg, double seconds)
+{
+    int ret;
+
+    gw_assert(link >= 0 && link < bb_link_count);
+    ret = read_from_bearerbox_real(bb_links[link].conn, msg, seconds);
+    if (ret == 0)
+        (*msg)->link = link;
+    if (ret == 0 && !bb_links[link].binary &&
+        msg_codec_feature_version(*msg) >= MSG_BINARY_VERSION) {
+        debug("gw.shared", 0, "Bearerbox unpacks binary messages, using them.");
+        bb_links[link].binary = 1;
+    }
+    return ret;
 }
 
 
@@ -89,6 +89,36 @@ extern volatile enum program_status {
 Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *our_host);
 void connect_to_bearerbox(Octstr *host, int port, int ssl, Octstr *our_host);
 
+/*
+ * Open `links' parallel connections to the bearerbox instead of one.
+ * write_to_bearerbox() and deliver_to_bearerbox() spread the messages
+ * over them, keeping messages to the same receiver on the same link.
+ * Each link has to be read with read_from_bearerbox_link(), and every
+ * link has to identify itself, see write_to_bearerbox_link().
+ */
+void connect_to_bearerbox_links(Octstr *host, int port, int ssl,
+                                Octstr *our_host, long links);
+
+/*
+ * Return the number of open links to the bearerbox.
+ */
+long bearerbox_links(void);
+
+
+/*
+ * Coalesce the writes to bearerbox connections opened afterwards into
+ * batches of up to `size' octets, sent at the latest `delay' seconds
+ * after the first message of a batch. A size of 0 writes each message
+ * right away. The framing does not change, any bearerbox reads it.
+ */
+void set_bearerbox_batching(long size, double delay);
+
+/*
+ * Set the batching from 'bearerbox-batch-size' and 'bearerbox-batch-delay'
+ * (milliseconds) in the given box configuration group.
+ */
+void config_bearerbox_batching(CfgGroup *grp);
+
 
 /*
  * Close connection to the bearerbox.
@@ -105,6 +135,7 @@ void close_connection_to_bearerbox(void);
  */
 int read_from_bearerbox_real(Connection *conn, Msg **msg, double seconds);
 int read_from_bearerbox(Msg **msg, double seconds);
+int read_from_bearerbox_link(long link, Msg **msg, double seconds);
 
 
 /*
@@ -112,6 +143,7 @@ int read_from_bearerbox(Msg **msg, double seconds);
  */
 void write_to_bearerbox_real(Connection *conn, Msg *pmsg);
 void write_to_bearerbox(Msg *msg);
+void write_to_bearerbox_link(long link, Msg *msg);
 
 
 /*
@@ -93,6 +93,11 @@
 #define HTTP_RETRY_DELAY    10 /* in sec. */
 #define HTTP_MAX_PENDING    512 /* max requests handled in parallel */
 
+/* lock-free part of the inbound request queue, not a limit */
+#define SMSBOX_QUEUE_SIZE   4096
+#define SMSBOX_MAX_LINKS    64 /* max bearerbox-links */
+#define SENDSMS_DEFAULT_THREADS 1 /* sendsms HTTP worker threads */
+
 /* Timer item structure for HTTP retrying */
 typedef struct TimerItem {
     Timer *timer;
@@ -105,7 +110,10 @@ volatile sig_atomic_t restart = 0;
 static Cfg *cfg;
 static long bb_port;
 static int bb_ssl = 0;
+/* parallel connections to bearerbox */
+static long bb_links = 1;
 static long sendsms_port = 0;
+static long sendsms_threads = SENDSMS_DEFAULT_THREADS;
 static Octstr *sendsms_interface = NULL;
 static Octstr *smsbox_id = NULL;
 static Octstr *sendsms_url = NULL;
@@ -123,15 +131,22 @@ static Octstr *reply_couldnotrepresent = NULL;
 static Octstr *reply_requestfailed = NULL;
 static Octstr *reply_emptymessage = NULL;
 static int mo_recode = 0;
-static Numhash *white_list;
-static Numhash *black_list;
-static regex_t *white_list_regex = NULL;
-static regex_t *black_list_regex = NULL;
+static NumberFilter *number_filter;
+
+/* Log texts for the receivers rejected by each list of a number filter */
+static char *number_list_rejects[URLTRANS_NUMBER_LISTS] = {
+    "not in white-list", "not in white-list-regex",
+    "in black-list", "in black-list-regex"
+};
+static char *global_number_list_rejects[URLTRANS_NUMBER_LISTS] = {
+    "not in global white-list", "not in global white-list-regex",
+    "in global black-list", "in global black-list-regex"
+};
 static long max_http_retries = HTTP_MAX_RETRIES;
 static long http_queue_delay = HTTP_RETRY_DELAY;
 static Octstr *ppg_service_name = NULL;
 
-static List *smsbox_requests = NULL;      /* the inbound request queue */
+static gw_mpmcqueue_t *smsbox_requests = NULL;/* the inbound request queue */
 static List *smsbox_http_requests = NULL; /* the outbound HTTP request queue */
 
 /* Timerset for the HTTP retry mechanism. */
@@ -162,12 +177,27 @@ static List *sendsms_reply_hdrs = NULL;
 static void identify_to_bearerbox(void)
 {
     Msg *msg;
+    long i;
 
-    msg = msg_create(admin);
-    msg->admin.command = cmd_identify;
-    msg->admin.boxc_id = octstr_duplicate(smsbox_id);
-    msg->admin.http_port = sendsms_port;
-    write_to_bearerbox(msg);
+    for (i = 0; i < bearerbox_links(); i++) {
+        msg = msg_create(admin);
+        msg->admin.command = cmd_identify;
+        msg->admin.boxc_id = octstr_duplicate(smsbox_id);
+        msg->admin.http_port = sendsms_port;
+        write_to_bearerbox_link(i, msg);
+    }
+}
+
+/*
+ * Send our heartbeat on every link, bearerbox keeps the load per link.
+ */
+static void heartbeat_to_bearerbox(Msg *msg)
+{
+    long i;
+
+    for (i = 1; i < bearerbox_links(); i++)
+        write_to_bearerbox_link(i, msg_duplicate(msg));
+    write_to_bearerbox_link(0, msg);
 }
 
 /*
@@ -227,21 +257,23 @@ static void delayed_http_reply(Msg *msg)
 
 /*
  * Read an Msg from the bearerbox and send it to the proper receiver
- * via a List. At the moment all messages are sent to the smsbox_requests
- * List.
+ * via a queue. At the moment all messages are sent to the smsbox_requests
+ * queue. There is one of these for each link to bearerbox, the one for
+ * the first link runs in the main thread.
  */
-static void read_messages_from_bearerbox(void)
+static void read_messages_from_bearerbox(void *arg)
 {
     time_t start, t;
     int secs;
     int total = 0;
     int ret;
+    long link = (long) arg;
     Msg *msg;
 
     start = t = time(NULL);
     while (program_status != shutting_down) {
         /* block infinite for reading messages */
-        ret = read_from_bearerbox(&msg, INFINITE_TIME);
+        ret = read_from_bearerbox_link(link, &msg, INFINITE_TIME);
         if (ret == -1) {
             if (program_status != shutting_down) {
                 error(0, "Bearerbox is gone, restarting");
@@ -271,7 +303,7 @@ static void read_messages_from_bearerbox(void)
 	    if (total == 0)
 		start = time(NULL);
 	    total++;
-	    gwlist_produce(smsbox_requests, msg);
+	    gw_mpmcqueue_produce(smsbox_requests, msg);
 	} else if (msg_type(msg) == ack) {
 	    if (!immediate_sendsms_reply)
 		delayed_http_reply(msg);
@@ -284,6 +316,10 @@ static void read_messages_from_bearerbox(void)
     secs = difftime(time(NULL), start);
     info(0, "Received (and handled?) %d requests in %d seconds "
     	 "(%.2f per second)", total, secs, (float)total / secs);
+
+    /* whoever stops first, the main thread has to notice */
+    if (link != 0)
+        gwthread_wakeup(MAIN_THREAD_ID);
 }
 
 
@@ -1780,7 +1816,7 @@ static void obey_request_thread(void *arg)
     Octstr *p;
     int ret, dreport=0;
 
-    while ((msg = gwlist_consume(smsbox_requests)) != NULL) {
+    while ((msg = gw_mpmcqueue_consume(smsbox_requests)) != NULL) {
 
     	if (msg->sms.sms_type == report_mo)
     	    dreport = 1;
@@ -1810,6 +1846,7 @@ static void obey_request_thread(void *arg)
              * Send NACK to bearerbox, otherwise message remains in store file.
              */
             mack = msg_create(ack);
+            mack->link = msg->link;
             mack->ack.nack = ack_failed;
             mack->ack.time = msg->sms.time;
             uuid_copy(mack->ack.id, msg->sms.id);
@@ -1821,6 +1858,7 @@ static void obey_request_thread(void *arg)
 
     	/* create ack message to be sent afterwards */
     	mack = msg_create(ack);
+    	mack->link = msg->link;
     	mack->ack.nack = ack_success;
     	mack->ack.time = msg->sms.time;
     	uuid_copy(mack->ack.id, msg->sms.id);
@@ -1951,13 +1989,18 @@ error:
 
 typedef const struct pam_message pam_message_type;
 
-static const char *PAM_username;
-static const char *PAM_password;
+/* Credentials of one authentication, passed as PAM appdata so that
+ * concurrent sendsms threads don't share them. */
+struct PAM_credentials {
+    const char *username;
+    const char *password;
+};
 
 static int PAM_conv (int num_msg, pam_message_type **msg,
 		     struct pam_response **resp,
 		     void *appdata_ptr)
 {
+    struct PAM_credentials *cred = appdata_ptr;
     int count = 0, replies = 0;
     struct pam_response *repl = NULL;
     int size = sizeof(struct pam_response);
@@ -1972,14 +2015,14 @@ static int PAM_conv (int num_msg, pam_message_type **msg,
 	case PAM_PROMPT_ECHO_ON:
 	    GET_MEM;
 	    repl[replies].resp_retcode = PAM_SUCCESS;
-	    repl[replies++].resp = COPY_STRING(PAM_username);
+	    repl[replies++].resp = COPY_STRING(cred->username);
 	    /* PAM frees resp */
 	    break;
 
 	case PAM_PROMPT_ECHO_OFF:
 	    GET_MEM;
 	    repl[replies].resp_retcode = PAM_SUCCESS;
-	    repl[replies++].resp = COPY_STRING(PAM_password);
+	    repl[replies++].resp = COPY_STRING(cred->password);
 	    /* PAM frees resp */
 	    break;
 
@@ -2000,21 +2043,19 @@ static int PAM_conv (int num_msg, pam_message_type **msg,
     return PAM_SUCCESS;
 }
 
-static struct pam_conv PAM_conversation = {
-    &PAM_conv,
-    NULL
-};
-
-
 static int authenticate(const char *login, const char *passwd)
 {
     pam_handle_t *pamh;
     int pam_error;
+    struct PAM_credentials cred;
+    struct pam_conv conversation;
     
-    PAM_username = login;
-    PAM_password = passwd;
+    cred.username = login;
+    cred.password = passwd;
+    conversation.conv = &PAM_conv;
+    conversation.appdata_ptr = &cred;
     
-    pam_error = pam_start("kannel", login, &PAM_conversation, &pamh);
+    pam_error = pam_start("kannel", login, &conversation, &pamh);
     if (pam_error != PAM_SUCCESS ||
         (pam_error = pam_authenticate(pamh, 0)) != PAM_SUCCESS) {
 	pam_end(pamh, pam_error);
@@ -2096,7 +2137,8 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
     List *failed_id = NULL;
     List *allowed = NULL;
     List *denied = NULL;
-    int no_recv, ret = 0, i;
+    unsigned long rejected, global_rejected;
+    int no_recv, ret = 0, i, j;
 
     /*
      * Multi-cast messages with several receivers in 'to' are handled
@@ -2149,76 +2191,27 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
          * First of all fill the two lists systematically by the rules,
          * then we will revise the lists.
          */
-        if (urltrans_white_list(t) &&
-            numhash_find_number(urltrans_white_list(t), receiv) < 1) {
-            info(0, "Number <%s> is not in white-list, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-
-        if (urltrans_white_list_regex(t) &&
-                gw_regex_match_pre(urltrans_white_list_regex(t), receiv) == 0) {
-            info(0, "Number <%s> is not in white-list-regex, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-        
-        if (urltrans_black_list(t) &&
-            numhash_find_number(urltrans_black_list(t), receiv) == 1) {
-            info(0, "Number <%s> is in black-list, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-
-        if (urltrans_black_list_regex(t) &&
-                gw_regex_match_pre(urltrans_black_list_regex(t), receiv) == 1) {
-            info(0, "Number <%s> is in black-list-regex, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-
-        if (white_list &&
-            numhash_find_number(white_list, receiv) < 1) {
-            info(0, "Number <%s> is not in global white-list, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-
-        if (white_list_regex &&
-            gw_regex_match_pre(white_list_regex, receiv) == 0) {
-            info(0, "Number <%s> is not in global white-list-regex, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
-        }
-
-        if (black_list &&
-            numhash_find_number(black_list, receiv) == 1) {
-            info(0, "Number <%s> is in global black-list, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
+        rejected = (urltrans_number_filter(t) ?
+                    number_filter_check(urltrans_number_filter(t), receiv, ~0UL) : 0);
+        global_rejected = (number_filter ?
+                           number_filter_check(number_filter, receiv, ~0UL) : 0);
+        for (j = 0; j < URLTRANS_NUMBER_LISTS; j++) {
+            if (rejected & (1UL << j)) {
+                info(0, "Number <%s> is %s, message discarded",
+                     octstr_get_cstr(receiv), number_list_rejects[j]);
+                gwlist_append_unique(denied, receiv, octstr_item_match);
+            } else {
+                gwlist_append_unique(allowed, receiv, octstr_item_match);
+            }
         }
-
-        if (black_list_regex &&
-            gw_regex_match_pre(black_list_regex, receiv) == 1) {
-            info(0, "Number <%s> is in global black-list-regex, message discarded",
-                 octstr_get_cstr(receiv));
-            gwlist_append_unique(denied, receiv, octstr_item_match);
-        } else {
-            gwlist_append_unique(allowed, receiv, octstr_item_match);
+        for (j = 0; j < URLTRANS_NUMBER_LISTS; j++) {
+            if (global_rejected & (1UL << j)) {
+                info(0, "Number <%s> is %s, message discarded",
+                     octstr_get_cstr(receiv), global_number_list_rejects[j]);
+                gwlist_append_unique(denied, receiv, octstr_item_match);
+            } else {
+                gwlist_append_unique(allowed, receiv, octstr_item_match);
+            }
         }
 
         /* Have allowed for receiver */
@@ -2972,6 +2965,10 @@ error:
 }
 
 
+/*
+ * Serve sendsms HTTP requests.  sendsms-threads of these share the port;
+ * all state of a request is local to the thread handling it.
+ */
 static void sendsms_thread(void *arg)
  {
     HTTPClient *client;
@@ -3179,6 +3176,11 @@ static Cfg *init_smsbox(Cfg *cfg)
     if (cfg_get_bool(&ssl, grp, octstr_imm("bearerbox-port-ssl")) != -1)
         bb_ssl = ssl;
 #endif /* HAVE_LIBSSL */
+    config_bearerbox_batching(grp);
+    if (cfg_get_integer(&bb_links, grp, octstr_imm("bearerbox-links")) == -1)
+        bb_links = 1;
+    if (bb_links < 1 || bb_links > SMSBOX_MAX_LINKS)
+        panic(0, "'bearerbox-links' must be between 1 and %d.", SMSBOX_MAX_LINKS);
 
     cfg_get_bool(&mo_recode, grp, octstr_imm("mo-recode"));
     if(mo_recode < 0)
@@ -3200,35 +3202,15 @@ static Cfg *init_smsbox(Cfg *cfg)
     if (reply_emptymessage == NULL)
 	reply_emptymessage = octstr_create("<Empty reply from service provider>");
 
-    {   
-	Octstr *os;
-	os = cfg_get(grp, octstr_imm("white-list"));
-	if (os != NULL) {
-	    white_list = numhash_create(octstr_get_cstr(os));
-	    octstr_destroy(os);
-	}
-
-	os = cfg_get(grp, octstr_imm("white-list-regex"));
-	if (os != NULL) {
-        if ((white_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-                        panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-	}
-
-	os = cfg_get(grp, octstr_imm("black-list"));
-	if (os != NULL) {
-	    black_list = numhash_create(octstr_get_cstr(os));
-	    octstr_destroy(os);
-	}
-	os = cfg_get(grp, octstr_imm("black-list-regex"));
-	if (os != NULL) {
-        if ((black_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-                        panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
-        octstr_destroy(os);
-	}
-    }
+    number_filter = urltrans_number_filter_create(grp);
 
     cfg_get_integer(&sendsms_port, grp, octstr_imm("sendsms-port"));
+
+    if (cfg_get_integer(&sendsms_threads, grp, octstr_imm("sendsms-threads")) == -1)
+        sendsms_threads = SENDSMS_DEFAULT_THREADS;
+    else if (sendsms_threads < 1)
+        panic(0, "Invalid sendsms-threads value %ld, must be at least 1.",
+              sendsms_threads);
     
     /* check if want to bind to a specific interface */
     sendsms_interface = cfg_get(grp, octstr_imm("sendsms-interface"));    
@@ -3319,8 +3301,12 @@ static Cfg *init_smsbox(Cfg *cfg)
             else
                 panic(0, "Failed to open HTTP socket");
         } else {
-            info(0, "Set up send sms service at port %ld", sendsms_port);
-            gwthread_create(sendsms_thread, NULL);
+            long i;
+
+            info(0, "Set up send sms service at port %ld with %ld thread(s)",
+                 sendsms_port, sendsms_threads);
+            for (i = 0; i < sendsms_threads; i++)
+                gwthread_create(sendsms_thread, NULL);
         }
     }
 
@@ -3331,6 +3317,12 @@ static Cfg *init_smsbox(Cfg *cfg)
 
     if (cfg_get_integer(&value, grp, octstr_imm("http-timeout")) == 0)
        http_set_client_timeout(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-client-threads")) == 0)
+       http_set_client_threads(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-resolver-threads")) == 0)
+       http_set_resolver_threads(value);
+    if (cfg_get_integer(&value, grp, octstr_imm("http-client-max-connections")) == 0)
+       http_set_client_max_connections(value);
 
     /*
      * Reading the name we are using for ppg services from ppg core group
@@ -3398,6 +3390,7 @@ int main(int argc, char **argv)
 {
     int cf_index;
     int i;
+    long link, link_threads[SMSBOX_MAX_LINKS];
     Octstr *filename;
     double heartbeat_freq = DEFAULT_HEARTBEAT;
 
@@ -3471,10 +3464,10 @@ int main(int argc, char **argv)
 
 
     caller = http_caller_create();
-    smsbox_requests = gwlist_create();
+    smsbox_requests = gw_mpmcqueue_create(SMSBOX_QUEUE_SIZE);
     smsbox_http_requests = gwlist_create();
     timerset = gw_timerset_create();
-    gwlist_add_producer(smsbox_requests);
+    gw_mpmcqueue_add_producer(smsbox_requests);
     gwlist_add_producer(smsbox_http_requests);
     num_outstanding_requests = counter_create();
     catenated_sms_counter = counter_create();
@@ -3482,35 +3475,51 @@ int main(int argc, char **argv)
     gwthread_create(url_result_thread, NULL);
     gwthread_create(http_queue_thread, NULL);
 
-    connect_to_bearerbox(bb_host, bb_port, bb_ssl, NULL /* bb_our_host */);
+    connect_to_bearerbox_links(bb_host, bb_port, bb_ssl, NULL /* bb_our_host */,
+                               bb_links);
 	/* XXX add our_host if required */
 
-    if (0 > heartbeat_start(write_to_bearerbox, heartbeat_freq,
+    if (0 > heartbeat_start(heartbeat_to_bearerbox, heartbeat_freq,
 				       outstanding_requests)) {
         info(0, GW_NAME "Could not start heartbeat.");
     }
 
     identify_to_bearerbox();
-    read_messages_from_bearerbox();
+    for (link = 1; link < bb_links; link++)
+        link_threads[link] = gwthread_create(read_messages_from_bearerbox, (void *) link);
+    read_messages_from_bearerbox((void *) 0);
+    for (link = 1; link < bb_links; link++) {
+        if (link_threads[link] != -1)
+            gwthread_wakeup(link_threads[link]);
+    }
+    gwthread_join_every(read_messages_from_bearerbox);
 
     info(0, GW_NAME " smsbox terminating.");
 
     heartbeat_stop(ALL_HEARTBEATS);
     http_close_all_ports();
     gwthread_join_every(sendsms_thread);
-    gwlist_remove_producer(smsbox_requests);
+    gw_mpmcqueue_remove_producer(smsbox_requests);
     gwlist_remove_producer(smsbox_http_requests);
     gwthread_join_every(obey_request_thread);
     http_caller_signal_shutdown(caller);
     gwthread_join_every(url_result_thread);
     gwthread_join_every(http_queue_thread);
 
+    {
+        HTTPClientPoolStatus pool_status;
+
+        http_client_pool_status(&pool_status);
+        info(0, "HTTP client pool: %ld reused, %ld opened, %ld waited for a connection.",
+             pool_status.hits, pool_status.misses, pool_status.waits);
+    }
+
     close_connection_to_bearerbox();
     alog_close();
     urltrans_destroy(translations);
-    gw_assert(gwlist_len(smsbox_requests) == 0);
+    gw_assert(gw_mpmcqueue_len(smsbox_requests) == 0);
     gw_assert(gwlist_len(smsbox_http_requests) == 0);
-    gwlist_destroy(smsbox_requests, NULL);
+    gw_mpmcqueue_destroy(smsbox_requests, NULL);
     gwlist_destroy(smsbox_http_requests, NULL);
     http_caller_destroy(caller);
     gw_timerset_destroy(timerset);
@@ -3527,10 +3536,7 @@ int main(int argc, char **argv)
     octstr_destroy(reply_couldnotrepresent);
     octstr_destroy(sendsms_interface);    
     octstr_destroy(ppg_service_name);    
-    numhash_destroy(black_list);
-    numhash_destroy(white_list);
-    if (white_list_regex != NULL) gw_regex_destroy(white_list_regex);
-    if (black_list_regex != NULL) gw_regex_destroy(black_list_regex);
+    number_filter_destroy(number_filter);
     semaphore_destroy(max_pending_requests);
     cfg_destroy(cfg);
 
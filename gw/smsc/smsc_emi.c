@@ -1006,19 +1006,24 @@ static int emi2_do_send(SMSCConn *conn, Connection *server)
 {
     struct emimsg *emimsg;
     Msg *msg;
-    double delay = 0;
 
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
-    
     /* Send messages if there's room in the sending window */
     while (emi2_can_send(conn) &&
            (msg = gw_prioqueue_remove(PRIVDATA(conn)->outgoing_queue)) != NULL) {
-        int nexttrn = emi2_next_trn(conn);
+        int nexttrn;
+
+        /* obey throughput speed limit, if any */
+        if (conn->throughput_limit != NULL) {
+            while (!PRIVDATA(conn)->shutdown &&
+                   !gw_ratelimit_wait(conn->throughput_limit))
+                ;
+            if (PRIVDATA(conn)->shutdown) {
+                gw_prioqueue_insert(PRIVDATA(conn)->outgoing_queue, msg);
+                break;
+            }
+        }
 
-        if (conn->throughput > 0)
-            gwthread_sleep(delay);
+        nexttrn = emi2_next_trn(conn);
 
         /* convert the generic Kannel message into an EMI type message */
         emimsg = msg_to_emimsg(msg, nexttrn, PRIVDATA(conn));
@@ -1594,6 +1599,9 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
         }
     }
 
+    /* cut short a throughput limit sleep */
+    if (privdata->host)
+        gwthread_wakeup(privdata->sender_thread);
     if (privdata->rport > 0)
         gwthread_wakeup(privdata->receiver_thread);
     return 0;
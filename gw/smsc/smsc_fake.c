@@ -266,11 +266,6 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
     PrivData *privdata = conn->data;
     Octstr *line;
     Msg	*msg;
-    double delay = 0;
-
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
 
     while (1) {
         while (!conn->is_stopped && !privdata->shutdown &&
@@ -290,6 +285,17 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 
         while ((msg = gwlist_extract_first(privdata->outgoing_queue)) != NULL) {
 
+            /* obey throughput speed limit, if any */
+            if (conn->throughput_limit != NULL) {
+                while (!privdata->shutdown &&
+                       !gw_ratelimit_wait(conn->throughput_limit))
+                    ;
+                if (privdata->shutdown) {
+                    gwlist_insert(privdata->outgoing_queue, 0, msg);
+                    break;
+                }
+            }
+
             /* pass msg to fakesmsc daemon */            
             if (sms_to_client(client, msg) == 1) {
                 Msg *copy = msg_duplicate(msg);
@@ -333,11 +339,6 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 		            SMSCCONN_FAILED_REJECTED, octstr_create("REJECTED"));
                 goto error;
             }
-
-            /* obey throughput speed limit, if any */
-            if (conn->throughput > 0) {
-                gwthread_sleep(delay);
-            }
         }
         if (privdata->shutdown) {
             debug("bb.sms", 0, "smsc_fake shutting down, closing client socket");
@@ -243,15 +243,10 @@ static void httpsmsc_sender(void *arg)
     SMSCConn *conn = arg;
     ConnData *conndata = conn->data;
     Msg *msg;
-    double delay = 0;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
 
-    if (conn->throughput) {
-        delay = 1.0 / conn->throughput;
-    }
-
     while (conndata->shutdown == 0) {
         /* check if we can send ; otherwise block on semaphore */
         if (conndata->max_pending_sends)
@@ -268,8 +263,16 @@ static void httpsmsc_sender(void *arg)
             break;
 
         /* obey throughput speed limit, if any */
-        if (conn->throughput > 0) {
-            gwthread_sleep(delay);
+        if (conn->throughput_limit != NULL) {
+            while (conndata->shutdown == 0 &&
+                   !gw_ratelimit_wait(conn->throughput_limit))
+                ;
+            if (conndata->shutdown) {
+                gwlist_insert(conndata->msg_to_send, 0, msg);
+                if (conndata->max_pending_sends)
+                    semaphore_up(conndata->max_pending_sends);
+                break;
+            }
         }
         counter_increase(conndata->open_sends);
         if (conndata->callbacks->send_sms(conn, msg) == -1) {
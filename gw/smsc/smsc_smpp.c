@@ -1263,13 +1263,12 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
 
     while (*pending_submits < smpp->max_pending_submits) {
         /* check our throughput */
-        if (smpp->conn->throughput > 0 && load_get(smpp->load, 0) >= smpp->conn->throughput) {
+        if (smpp->conn->throughput_limit != NULL && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
+            !gw_ratelimit_take(smpp->conn->throughput_limit)) {
             debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit exceeded (%.02f,%.02f)",
                   octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
             break;
         }
-        debug("bb.sms.smpp", 0, "SMPP[%s]: throughput (%.02f,%.02f)",
-              octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
 
         /* Get next message, quit if none to be sent */
         msg = gw_prioqueue_remove(smpp->msgs_to_send);
@@ -1286,9 +1285,8 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         if (send_pdu(conn, smpp, pdu) == 0) {
             struct smpp_msg *smpp_msg = smpp_msg_create(msg);
             os = octstr_format("%ld", pdu->u.submit_sm.sequence_number);
-            dict_put(smpp->sent_msgs, os, smpp_msg);
+            dict_put_nocopy(smpp->sent_msgs, os, smpp_msg);
             smpp_pdu_destroy(pdu);
-            octstr_destroy(os);
             ++(*pending_submits);
             load_increase(smpp->load);
         }
@@ -2409,9 +2407,11 @@ static void io_thread(void *arg)
                     smpp->throttling_err_time > 0 && pending_submits < smpp->max_pending_submits) {
                     time_t tr_timeout = smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME - now;
                     timeout = timeout > tr_timeout ? tr_timeout : timeout;
-                } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 && smpp->conn->throughput > 0 &&
+                } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
+                           smpp->conn->throughput_limit != NULL &&
                            smpp->max_pending_submits > pending_submits) {
-                    double t = 1.0 / smpp->conn->throughput;
+                    /* poll() counts in milliseconds, don't wake up before the next token */
+                    double t = gw_ratelimit_delay(smpp->conn->throughput_limit) + 0.001;
                     timeout = t < timeout ? t : timeout;
                 }
                 /* sleep a while */
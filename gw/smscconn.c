@@ -341,6 +341,12 @@ SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
         octstr_destroy(tmp);
         info(0, "Set throughput to %.3f for smsc id <%s>", conn->throughput, octstr_get_cstr(conn->id));
     }
+    if (conn->throughput > 0) {
+        long burst;
+        if (cfg_get_integer(&burst, grp, octstr_imm("throughput-burst")) == -1 || burst < 1)
+            burst = 1;
+        conn->throughput_limit = gw_ratelimit_create(conn->throughput, burst);
+    }
     /* Sets the admin_id. Equals to connection id if empty */
     GET_OPTIONAL_VAL(conn->admin_id, "smsc-admin-id");
     if (conn->admin_id == NULL)
@@ -473,6 +479,7 @@ int smscconn_destroy(SMSCConn *conn)
     load_destroy(conn->incoming_dlr_load);
     load_destroy(conn->outgoing_sms_load);
     load_destroy(conn->outgoing_dlr_load);
+    gw_ratelimit_destroy(conn->throughput_limit);
 
     octstr_destroy(conn->name);
     octstr_destroy(conn->id);
@@ -201,6 +201,7 @@ struct smscconn {
     int alt_dcs; /* use alternate DCS 0xFX */
 
     double throughput;     /* message thoughput per sec. to be delivered to SMSC */
+    gw_ratelimit_t *throughput_limit; /* enforces throughput, NULL if unlimited */
 
     /* Stores rerouting information for this specific smsc-id */
     int reroute;                /* simply turn MO into MT and process internally */
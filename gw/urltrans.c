@@ -120,8 +120,7 @@ struct URLTranslation {
     Octstr *denied_prefix;	/* ...denied prefixes */
     Octstr *allowed_recv_prefix; /* Prefixes (of receiver) allowed in this translation, or... */
     Octstr *denied_recv_prefix;	/* ...denied prefixes */
-    Numhash *white_list;	/* To numbers allowed, or ... */
-    Numhash *black_list; /* ...denied numbers */
+    NumberFilter *number_filter; /* white and black number lists */
 
     int assume_plain_text; /* for type: octet-stream */
     int accept_x_kannel_headers; /* do we accept special headers in reply */
@@ -135,14 +134,29 @@ struct URLTranslation {
     long dlr_mask;       /* DLR event mask */
 
     regex_t *keyword_regex;       /* the compiled regular expression for the keyword*/
+    List *keywords;     /* lowercase keyword and aliases, if these are plain
+                           strings matched via the keyword trie instead of
+                           keyword_regex */
+    long index;         /* position in URLTranslationList->list */
     regex_t *accepted_smsc_regex;
     regex_t *accepted_account_regex;
     regex_t *allowed_prefix_regex;
     regex_t *denied_prefix_regex;
     regex_t *allowed_receiver_prefix_regex;
     regex_t *denied_receiver_prefix_regex;
-    regex_t *white_list_regex;
-    regex_t *black_list_regex;
+};
+
+
+/*
+ * Case-insensitive trie of the plain keywords and aliases. The translations
+ * of a keyword are attached to the node its last character leads to.
+ */
+typedef struct KeywordNode KeywordNode;
+struct KeywordNode {
+    unsigned char c;
+    KeywordNode *child;     /* first child */
+    KeywordNode *sibling;   /* next child of our parent */
+    List *translations;     /* NULL as long as no keyword ends here */
 };
 
 
@@ -153,6 +167,8 @@ struct URLTranslationList {
     List *list;
     List *defaults; /* List of default sms-services */
     Dict *names;	/* Dict of lowercase Octstr names */
+    KeywordNode *keywords;  /* trie of plain keywords in list */
+    List *regex_list;       /* translations in list with a keyword_regex */
 };
 
 
@@ -182,6 +198,65 @@ static void destroy_keyword_list(void *list)
 }
 
 
+static KeywordNode *keyword_node_create(unsigned char c)
+{
+    KeywordNode *node;
+
+    node = gw_malloc(sizeof(*node));
+    memset(node, 0, sizeof(*node));
+    node->c = c;
+
+    return node;
+}
+
+static void keyword_node_destroy(KeywordNode *node)
+{
+    KeywordNode *next;
+
+    while (node != NULL) {
+        keyword_node_destroy(node->child);
+        next = node->sibling;
+        gwlist_destroy(node->translations, NULL);
+        gw_free(node);
+        node = next;
+    }
+}
+
+static KeywordNode *keyword_node_child(KeywordNode *node, unsigned char c,
+                                       int create)
+{
+    KeywordNode *child;
+
+    for (child = node->child; child != NULL; child = child->sibling) {
+        if (child->c == c)
+            return child;
+    }
+    if (!create)
+        return NULL;
+
+    child = keyword_node_create(c);
+    child->sibling = node->child;
+    node->child = child;
+
+    return child;
+}
+
+/* Keywords are stored in lowercase, see create_onetrans(). */
+static void keyword_add(KeywordNode *root, Octstr *keyword, URLTranslation *t)
+{
+    KeywordNode *node;
+    long i;
+
+    node = root;
+    for (i = 0; i < octstr_len(keyword); i++)
+        node = keyword_node_child(node, octstr_get_char(keyword, i), 1);
+
+    if (node->translations == NULL)
+        node->translations = gwlist_create();
+    gwlist_append(node->translations, t);
+}
+
+
 URLTranslationList *urltrans_create(void) 
 {
     URLTranslationList *trans;
@@ -190,6 +265,8 @@ URLTranslationList *urltrans_create(void)
     trans->list = gwlist_create();
     trans->defaults = gwlist_create();
     trans->names = dict_create(1024, destroy_keyword_list);
+    trans->keywords = keyword_node_create(0);
+    trans->regex_list = gwlist_create();
     return trans;
 }
 
@@ -199,6 +276,8 @@ void urltrans_destroy(URLTranslationList *trans)
     gwlist_destroy(trans->list, destroy_onetrans);
     gwlist_destroy(trans->defaults, destroy_onetrans);
     dict_destroy(trans->names);
+    keyword_node_destroy(trans->keywords);
+    gwlist_destroy(trans->regex_list, NULL);
     gw_free(trans);
 }
 
@@ -212,10 +291,20 @@ int urltrans_add_one(URLTranslationList *trans, CfgGroup *grp)
     if (ot == NULL)
 	return -1;
 
-    if (ot->type != TRANSTYPE_SENDSMS && ot->keyword_regex == NULL)
+    if (ot->type != TRANSTYPE_SENDSMS && ot->keyword_regex == NULL &&
+        ot->keywords == NULL)
         gwlist_append(trans->defaults, ot);
-    else 
+    else {
+        ot->index = gwlist_len(trans->list);
         gwlist_append(trans->list, ot);
+        if (ot->keywords != NULL) {
+            long i;
+
+            for (i = 0; i < gwlist_len(ot->keywords); i++)
+                keyword_add(trans->keywords, gwlist_get(ot->keywords, i), ot);
+        } else if (ot->keyword_regex != NULL)
+            gwlist_append(trans->regex_list, ot);
+    }
     
     list2 = dict_get(trans->names, ot->name);
     if (list2 == NULL) {
@@ -968,24 +1057,43 @@ Octstr *urltrans_denied_recv_prefix(URLTranslation *t)
     return t->denied_recv_prefix;
 }
 
-Numhash *urltrans_white_list(URLTranslation *t)
-{
-    return t->white_list;
-}
-
-regex_t *urltrans_white_list_regex(URLTranslation *t)
-{
-    return t->white_list_regex;
-}
-
-Numhash *urltrans_black_list(URLTranslation *t)
+NumberFilter *urltrans_number_filter(URLTranslation *t)
 {
-    return t->black_list;
+    return t->number_filter;
 }
 
-regex_t *urltrans_black_list_regex(URLTranslation *t)
+NumberFilter *urltrans_number_filter_create(CfgGroup *grp)
 {
-    return t->black_list_regex;
+    static char *directives[URLTRANS_NUMBER_LISTS] = {
+        "white-list", "white-list-regex", "black-list", "black-list-regex"
+    };
+    NumberFilter *filter;
+    regex_t *regex;
+    Octstr *os;
+    int i, type;
+
+    filter = number_filter_create();
+    for (i = 0; i < URLTRANS_NUMBER_LISTS; i++) {
+        if ((os = cfg_get(grp, octstr_imm(directives[i]))) == NULL)
+            continue;
+        type = (i == URLTRANS_BLACK_LIST || i == URLTRANS_BLACK_LIST_REGEX ?
+                NUMFILTER_BLACK : NUMFILTER_WHITE);
+        if (i == URLTRANS_WHITE_LIST_REGEX || i == URLTRANS_BLACK_LIST_REGEX) {
+            if ((regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
+                panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+            number_filter_add_regex(filter, i, type, regex);
+        } else {
+            /* a list that cannot be loaded is not used */
+            number_filter_add_url(filter, i, type, os);
+        }
+        octstr_destroy(os);
+    }
+    if (number_filter_lists(filter) == 0) {
+        number_filter_destroy(filter);
+        return NULL;
+    }
+    number_filter_compile(filter);
+    return filter;
 }
 
 int urltrans_assume_plain_text(URLTranslation *t) 
@@ -1034,6 +1142,26 @@ int urltrans_max_priority(URLTranslation *t)
  */
 
 
+/*
+ * Return 1 if `keyword' has no meaning in a regex other than the literal
+ * text, and can be matched case-insensitively byte by byte.
+ */
+static int keyword_is_plain(Octstr *keyword)
+{
+    long i;
+    int c;
+
+    if (octstr_len(keyword) == 0)
+        return 0;
+    for (i = 0; i < octstr_len(keyword); i++) {
+        c = octstr_get_char(keyword, i);
+        if (c < 0x20 || c >= 0x7f || strchr(".[]()*+?{}|^$\\", c) != NULL)
+            return 0;
+    }
+    return 1;
+}
+
+
 /*
  * Create one URLTranslation. Return NULL for failure, pointer to it for OK.
  */
@@ -1050,8 +1178,6 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
     Octstr *denied_prefix_regex;
     Octstr *allowed_receiver_prefix_regex;
     Octstr *denied_receiver_prefix_regex;
-    Octstr *white_list_regex;
-    Octstr *black_list_regex;
     Octstr *keyword_regex;
     Octstr *os, *tmp;
     
@@ -1146,15 +1272,17 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 	    octstr_destroy(tmp);
 	} else if (tmp != NULL) {
 	    Octstr *aliases;
+	    long i;
+	    int plain;
 	    
 	    /* convert to regex */
 	    regex_flag |= REG_ICASE;
 	    keyword_regex = octstr_format("^[ ]*(%S", tmp);
-	    octstr_destroy(tmp);
+	    ot->keywords = gwlist_create();
+	    gwlist_append(ot->keywords, tmp);
 
 	    aliases = cfg_get(grp, octstr_imm("aliases"));
 	    if (aliases != NULL) {
-	        long i;
 	        List *l;
 
 	        l = octstr_split(aliases, octstr_imm(";"));
@@ -1164,13 +1292,36 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 	            os = gwlist_get(l, i);
 	            octstr_format_append(keyword_regex, "|%S", os);
 	        }
-	        gwlist_destroy(l, octstr_destroy_item);
+	        while ((os = gwlist_extract_first(l)) != NULL)
+	            gwlist_append(ot->keywords, os);
+	        gwlist_destroy(l, NULL);
 	    }
 	    
 	    octstr_append_cstr(keyword_regex, ")[ ]*");
+
+	    /*
+	     * The regex matches if the message starts with one of the words,
+	     * ignoring case. Plain words are looked up in the keyword trie
+	     * instead, so that MO messages don't have to run thousands of
+	     * regexes. Anything that could be a regex construct keeps using
+	     * the regex.
+	     */
+	    plain = 1;
+	    for (i = 0; plain && i < gwlist_len(ot->keywords); i++)
+	        plain = keyword_is_plain(gwlist_get(ot->keywords, i));
+	    if (plain) {
+	        for (i = 0; i < gwlist_len(ot->keywords); i++) {
+	            os = gwlist_get(ot->keywords, i);
+	            octstr_convert_range(os, 0, octstr_len(os), tolower);
+	        }
+	    } else {
+	        gwlist_destroy(ot->keywords, octstr_destroy_item);
+	        ot->keywords = NULL;
+	    }
 	}
 
-        if (keyword_regex != NULL && (ot->keyword_regex = gw_regex_comp(keyword_regex, regex_flag)) == NULL) {
+        if (keyword_regex != NULL && ot->keywords == NULL &&
+            (ot->keyword_regex = gw_regex_comp(keyword_regex, regex_flag)) == NULL) {
             error(0, "Could not compile pattern '%s'", octstr_get_cstr(keyword_regex));
             octstr_destroy(keyword_regex);
             goto error;
@@ -1289,29 +1440,7 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
         octstr_destroy(denied_prefix_regex);
     }
     
-    os = cfg_get(grp, octstr_imm("white-list"));
-    if (os != NULL) {
-        ot->white_list = numhash_create(octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-    white_list_regex = cfg_get(grp, octstr_imm("white-list-regex"));
-    if (white_list_regex != NULL) {
-        if ((ot->white_list_regex = gw_regex_comp(white_list_regex, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(white_list_regex));
-        octstr_destroy(white_list_regex);
-    }
-
-    os = cfg_get(grp, octstr_imm("black-list"));
-    if (os != NULL) {
-        ot->black_list = numhash_create(octstr_get_cstr(os));
-        octstr_destroy(os);
-    }
-    black_list_regex = cfg_get(grp, octstr_imm("black-list-regex"));
-    if (black_list_regex != NULL) {
-        if ((ot->black_list_regex = gw_regex_comp(black_list_regex, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(black_list_regex));
-        octstr_destroy(black_list_regex);
-    }
+    ot->number_filter = urltrans_number_filter_create(grp);
 
     if (cfg_get_integer(&ot->max_messages, grp, octstr_imm("max-messages")) == -1)
         ot->max_messages = 1;
@@ -1398,17 +1527,15 @@ static void destroy_onetrans(void *p)
 	octstr_destroy(ot->denied_prefix);
 	octstr_destroy(ot->allowed_recv_prefix);
 	octstr_destroy(ot->denied_recv_prefix);
-	numhash_destroy(ot->white_list);
-	numhash_destroy(ot->black_list);
+	number_filter_destroy(ot->number_filter);
         if (ot->keyword_regex != NULL) gw_regex_destroy(ot->keyword_regex);
+        gwlist_destroy(ot->keywords, octstr_destroy_item);
         if (ot->accepted_smsc_regex != NULL) gw_regex_destroy(ot->accepted_smsc_regex);
         if (ot->accepted_account_regex != NULL) gw_regex_destroy(ot->accepted_account_regex);
         if (ot->allowed_prefix_regex != NULL) gw_regex_destroy(ot->allowed_prefix_regex);
         if (ot->denied_prefix_regex != NULL) gw_regex_destroy(ot->denied_prefix_regex);
         if (ot->allowed_receiver_prefix_regex != NULL) gw_regex_destroy(ot->allowed_receiver_prefix_regex);
         if (ot->denied_receiver_prefix_regex != NULL) gw_regex_destroy(ot->denied_receiver_prefix_regex);
-        if (ot->white_list_regex != NULL) gw_regex_destroy(ot->white_list_regex);
-        if (ot->black_list_regex != NULL) gw_regex_destroy(ot->black_list_regex);
 	gw_free(ot);
     }
 }
@@ -1497,21 +1624,8 @@ static int check_allowed_translation(URLTranslation *t,
         gw_regex_match_pre(t->denied_receiver_prefix_regex, receiver) == 0)
         return NOT_ALLOWED;
 
-    if (t->white_list && numhash_find_number(t->white_list, sender) < 1) {
-        return NOT_ALLOWED;
-    }
-
-    if (t->white_list_regex && gw_regex_match_pre(t->white_list_regex, sender) == 0) {
-        return NOT_ALLOWED;
-    }   
-
-    if (t->black_list && numhash_find_number(t->black_list, sender) == 1) {
-        return NOT_ALLOWED;
-    }
-
-    if (t->black_list_regex && gw_regex_match_pre(t->black_list_regex, sender) == 1) {
+    if (t->number_filter && number_filter_check(t->number_filter, sender, ~0UL) != 0)
         return NOT_ALLOWED;
-    }   
 
     /* Have allowed and denied */
     if (t->denied_prefix && t->allowed_prefix && does_prefix_match(t->allowed_prefix, sender) != 1 &&
@@ -1527,39 +1641,79 @@ static int check_allowed_translation(URLTranslation *t,
 };
 
     
-/* get_matching_translations - iterate over all translations in trans. 
- * for each translation check whether 
- * the translation's keyword has already been interpreted as a regexp. 
- * if not, compile it now,
- * otherwise retrieve compilation result from dictionary.
+static int compare_index(const void *a, const void *b)
+{
+    const URLTranslation *ta = a, *tb = b;
+
+    return (ta->index > tb->index) - (ta->index < tb->index);
+}
+
+/* get_matching_translations - find all translations in trans whose
+ * keyword matches the start of the message.
+ *
+ * Plain keywords are looked up by walking the keyword trie along the
+ * message, every node passed on the way holds keywords that are a prefix
+ * of it. This is what the keyword regex "^[ ]*(keyword|aliases)[ ]*" does
+ * as well. Only the translations with a real regex are tried one by one.
  *
- * the translations where the word matches the translation's pattern 
- * are returned in a list
+ * The translations where the message matches the translation's keyword
+ * are returned in a list, in configuration order.
  * 
  */
 static List *get_matching_translations(URLTranslationList *trans, Octstr *msg) 
 {
     List *list;
     long i;
-    URLTranslation *t;
+    URLTranslation *t, *prev;
+    KeywordNode *node;
+    const unsigned char *p;
 
     gw_assert(trans != NULL && msg != NULL);
 
     list = gwlist_create();
-    for (i = 0; i < gwlist_len(trans->list); ++i) {
-        t = gwlist_get(trans->list, i);
-        
-        if (t->keyword_regex == NULL)
-            continue;
 
+    p = (const unsigned char *) octstr_get_cstr(msg);
+    while (*p == ' ')
+        p++;
+    for (node = trans->keywords; *p != '\0'; p++) {
+        node = keyword_node_child(node, tolower(*p), 0);
+        if (node == NULL)
+            break;
+        if (node->translations != NULL) {
+            for (i = 0; i < gwlist_len(node->translations); i++)
+                gwlist_append(list, gwlist_get(node->translations, i));
+        }
+    }
+
+    for (i = 0; i < gwlist_len(trans->regex_list); ++i) {
+        t = gwlist_get(trans->regex_list, i);
+        
         if (gw_regex_match_pre(t->keyword_regex, msg) == 1) {
-            debug("", 0, "match found: %s", octstr_get_cstr(t->name));
             gwlist_append(list, t);
-        } else {
-            debug("", 0, "no match found: %s", octstr_get_cstr(t->name));
         }
     }
 
+    /* keep configuration order, and drop duplicates from aliases
+     * that are prefixes of each other */
+    if (gwlist_len(list) > 1) {
+        gwlist_sort(list, compare_index);
+        prev = NULL;
+        for (i = 0; i < gwlist_len(list); ) {
+            t = gwlist_get(list, i);
+            if (t == prev) {
+                gwlist_delete(list, i, 1);
+            } else {
+                prev = t;
+                i++;
+            }
+        }
+    }
+
+    for (i = 0; i < gwlist_len(list); i++) {
+        t = gwlist_get(list, i);
+        debug("", 0, "match found: %s", octstr_get_cstr(t->name));
+    }
+
     return list;
 }
 
@@ -83,7 +83,7 @@
 
 #include "gwlib/gwlib.h"
 #include "msg.h"
-#include "numhash.h"
+#include "numfilter.h"
 #include "gwlib/gw-regex.h"
 
 /*
@@ -337,11 +337,26 @@ Octstr *urltrans_denied_recv_prefix(URLTranslation *t);
 regex_t *urltrans_allowed_prefix_regex(URLTranslation *t);
 regex_t *urltrans_denied_prefix_regex(URLTranslation *t);
 
-/* Return white and black to number list */
-Numhash *urltrans_white_list(URLTranslation *t);
-Numhash *urltrans_black_list(URLTranslation *t);
-regex_t *urltrans_white_list_regex(URLTranslation *t);
-regex_t *urltrans_black_list_regex(URLTranslation *t);
+/*
+ * Lists of the number filter of a translation, from the white-list,
+ * white-list-regex, black-list and black-list-regex directives.
+ */
+enum {
+    URLTRANS_WHITE_LIST,
+    URLTRANS_WHITE_LIST_REGEX,
+    URLTRANS_BLACK_LIST,
+    URLTRANS_BLACK_LIST_REGEX,
+    URLTRANS_NUMBER_LISTS
+};
+
+/* Return white and black to number lists, NULL if there are none */
+NumberFilter *urltrans_number_filter(URLTranslation *t);
+
+/*
+ * Compile the white and black number lists of a configuration group
+ * into a filter with the lists above. Return NULL if there are none.
+ */
+NumberFilter *urltrans_number_filter_create(CfgGroup *grp);
 
 /* Return value of true (!0) or false (0) variables */
 int urltrans_assume_plain_text(URLTranslation *t);
@@ -129,6 +129,14 @@ struct Connection
      * Set it to 0 to get an unbuffered connection. */
     unsigned int output_buffering;
 
+    /* Send buffered data at the latest this many seconds after it was
+     * queued, 0 to keep it until the buffer fills or is flushed. */
+    double output_delay;
+    int flush_scheduled;  /* is on the flush queue */
+
+    /* Protected by flush_lock */
+    double flush_at;
+
     /* Protected by inlock */
     Octstr *inbuf;
     long inbufpos;    /* start of unread data in inbuf */
@@ -156,6 +164,17 @@ struct Connection
 static void unlocked_register_pollin(Connection *conn, int onoff);
 static void unlocked_register_pollout(Connection *conn, int onoff);
 
+/*
+ * Connections with delayed output waiting for the flusher thread, in
+ * the order of their deadlines. A Connection is on the queue at most
+ * once. Take flush_lock before the outlock of a Connection, never the
+ * other way round.
+ */
+static Mutex *flush_lock = NULL;
+static List *flush_queue = NULL;
+static long flusher_thread = -1;
+static volatile sig_atomic_t flusher_running = 0;
+
 /* There are a number of functions that play with POLLIN and POLLOUT flags.
  * The general rule is that we always want to poll for POLLIN except when
  * we have detected eof (which may be reported as eternal POLLIN), and
@@ -306,6 +325,75 @@ static int unlocked_try_write(Connection *conn)
     return 0;
 }
 
+/* Must be called with the outlock held.  Return 1 if the caller has to
+ * put the connection on the flush queue after releasing the lock. */
+static int unlocked_need_flush(Connection *conn)
+{
+    if (conn->output_delay <= 0 || conn->flush_scheduled ||
+        unlocked_outbuf_len(conn) == 0)
+        return 0;
+    conn->flush_scheduled = 1;
+    return 1;
+}
+
+/* Must be called with flush_lock held.  Return the queue position. */
+static long queue_flush(Connection *conn, double now)
+{
+    Connection *other;
+    long i;
+
+    conn->flush_at = now + conn->output_delay;
+    /* mostly all delays are the same and this appends */
+    for (i = gwlist_len(flush_queue); i > 0; i--) {
+        other = gwlist_get(flush_queue, i - 1);
+        if (other->flush_at <= conn->flush_at)
+            break;
+    }
+    gwlist_insert(flush_queue, i, conn);
+    return i;
+}
+
+/* Must be called without the outlock held. */
+static void schedule_flush(Connection *conn)
+{
+    mutex_lock(flush_lock);
+    /* the flusher sleeps until the first deadline only */
+    if (queue_flush(conn, date_monotonic_now()) == 0)
+        gwthread_wakeup(flusher_thread);
+    mutex_unlock(flush_lock);
+}
+
+static void flusher(void *arg)
+{
+    Connection *conn;
+    double now, sleep;
+
+    while (flusher_running) {
+        mutex_lock(flush_lock);
+        now = date_monotonic_now();
+        sleep = -1;
+        while (gwlist_len(flush_queue) > 0) {
+            conn = gwlist_get(flush_queue, 0);
+            if (conn->flush_at > now) {
+                sleep = conn->flush_at - now;
+                break;
+            }
+            gwlist_delete(flush_queue, 0, 1);
+            lock_out(conn);
+            unlocked_write(conn);
+            /* a slow peer took only part of it, try the rest later
+             * rather than wait for the next write on this connection */
+            if (unlocked_outbuf_len(conn) > 0 && !conn->io_error)
+                queue_flush(conn, now);
+            else
+                conn->flush_scheduled = 0;
+            unlock_out(conn);
+        }
+        mutex_unlock(flush_lock);
+        gwthread_sleep_micro(sleep);
+    }
+}
+
 /* Read whatever data is currently available, up to an internal maximum. */
 static void unlocked_read(Connection *conn)
 {
@@ -585,6 +673,9 @@ Connection *conn_wrap_fd(int fd, int ssl)
     conn->read_eof = 0;
     conn->io_error = 0;
     conn->output_buffering = DEFAULT_OUTPUT_BUFFERING;
+    conn->output_delay = 0;
+    conn->flush_scheduled = 0;
+    conn->flush_at = 0;
 
     conn->registered = NULL;
     conn->callback = NULL;
@@ -632,7 +723,13 @@ void conn_destroy(Connection *conn)
         return;
 
     /* No locking done here.  conn_destroy should not be called
-     * if any thread might still be interested in the connection. */
+     * if any thread might still be interested in the connection.
+     * The flusher thread is, so take it off the flush queue. */
+    if (flusher_thread != -1) {
+        mutex_lock(flush_lock);
+        gwlist_delete_equal(flush_queue, conn);
+        mutex_unlock(flush_lock);
+    }
 
     if (conn->registered) {
         fdset_unregister(conn->registered, conn->fd);
@@ -642,7 +739,8 @@ void conn_destroy(Connection *conn)
     }
 
     if (conn->fd >= 0) {
-        /* Try to flush any remaining data */
+        /* Try to flush any remaining data, buffered or not */
+        conn->output_buffering = 0;
         unlocked_try_write(conn);
 
 #ifdef HAVE_LIBSSL
@@ -735,6 +833,32 @@ void conn_set_output_buffering(Connection *conn, unsigned int size)
     unlock_out(conn);
 }
 
+void conn_set_output_delay(Connection *conn, double seconds)
+{
+    int schedule;
+
+    gw_assert(conn != NULL);
+    gw_assert(!conn->claimed);
+
+    if (seconds > 0) {
+        mutex_lock(flush_lock);
+        if (flusher_thread == -1) {
+            flusher_running = 1;
+            flusher_thread = gwthread_create(flusher, NULL);
+            if (flusher_thread == -1)
+                panic(0, "conn_set_output_delay: cannot start flusher thread");
+        }
+        mutex_unlock(flush_lock);
+    }
+
+    lock_out(conn);
+    conn->output_delay = seconds > 0 ? seconds : 0;
+    schedule = unlocked_need_flush(conn);
+    unlock_out(conn);
+    if (schedule)
+        schedule_flush(conn);
+}
+
 static void poll_callback(int fd, int revents, void *data)
 {
     Connection *conn;
@@ -1050,31 +1174,37 @@ int conn_flush(Connection *conn)
 
 int conn_write(Connection *conn, Octstr *data)
 {
-    int ret;
+    int ret, schedule;
 
     lock_out(conn);
     octstr_append(conn->outbuf, data);
     ret = unlocked_try_write(conn);
+    schedule = unlocked_need_flush(conn);
     unlock_out(conn);
+    if (schedule)
+        schedule_flush(conn);
 
     return ret;
 }
 
 int conn_write_data(Connection *conn, unsigned char *data, long length)
 {
-    int ret;
+    int ret, schedule;
 
     lock_out(conn);
     octstr_append_data(conn->outbuf, data, length);
     ret = unlocked_try_write(conn);
+    schedule = unlocked_need_flush(conn);
     unlock_out(conn);
+    if (schedule)
+        schedule_flush(conn);
 
     return ret;
 }
 
 int conn_write_withlen(Connection *conn, Octstr *data)
 {
-    int ret;
+    int ret, schedule;
     unsigned char lengthbuf[4];
 
     encode_network_long(lengthbuf, octstr_len(data));
@@ -1082,7 +1212,10 @@ int conn_write_withlen(Connection *conn, Octstr *data)
     octstr_append_data(conn->outbuf, lengthbuf, 4);
     octstr_append(conn->outbuf, data);
     ret = unlocked_try_write(conn);
+    schedule = unlocked_need_flush(conn);
     unlock_out(conn);
+    if (schedule)
+        schedule_flush(conn);
 
     return ret;
 }
@@ -1250,6 +1383,26 @@ Octstr *conn_read_packet(Connection *conn, int startmark, int endmark)
     return result;
 }
 
+void conn_init(void)
+{
+    flush_lock = mutex_create();
+    flush_queue = gwlist_create();
+}
+
+void conn_shutdown(void)
+{
+    if (flusher_thread != -1) {
+        flusher_running = 0;
+        gwthread_wakeup(flusher_thread);
+        gwthread_join(flusher_thread);
+        flusher_thread = -1;
+    }
+    gwlist_destroy(flush_queue, NULL);
+    flush_queue = NULL;
+    mutex_destroy(flush_lock);
+    flush_lock = NULL;
+}
+
 #ifdef HAVE_LIBSSL
 X509 *conn_get_peer_certificate(Connection *conn) 
 {
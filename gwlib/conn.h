@@ -200,6 +200,14 @@ int conn_error(Connection *conn);
  * at the top of this file for more information. */
 void conn_set_output_buffering(Connection *conn, unsigned int size);
 
+/* Send buffered data at the latest `seconds' after it was queued, even
+ * if the output buffer did not fill up.  Together with output buffering
+ * this coalesces the writes of a busy connection into fewer system calls
+ * and still bounds the delay of each message.  The flush is done by a
+ * gwlib thread, so the connection must not be claimed.  Set it to 0 to
+ * keep the data until the buffer fills or is flushed. */
+void conn_set_output_delay(Connection *conn, double seconds);
+
 /* Register this connection with an FDSet.  This will make it unnecessary
  * to call conn_wait.  Instead, the callback function will be called when
  * there is new data available, or when all data queued for output is
@@ -286,6 +294,11 @@ Octstr *conn_read_withlen(Connection *conn);
   */
 Octstr *conn_read_packet(Connection *conn, int startmark, int endmark);
 
+/* Initialize and shut down the module, called by gwlib_init and
+ * gwlib_shutdown. */
+void conn_init(void);
+void conn_shutdown(void);
+
 #ifdef HAVE_LIBSSL
 
 #include <openssl/x509.h>
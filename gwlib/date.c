@@ -341,3 +341,12 @@ long date_universal_now(void)
 {
     return (long) time(NULL);
 }
+
+
+double date_monotonic_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -122,3 +122,9 @@ Octstr* date_create_iso(time_t unixtime);
  * Return the current date and time as a unix time value.
  */
 long date_universal_now(void);
+
+/*
+ * Return seconds, with fractions, of a clock that does not jump with the
+ * date and time. Only differences of its values mean anything.
+ */
+double date_monotonic_now(void);
@@ -71,6 +71,23 @@
 #include "dbpool.h"
 #include "dbpool_p.h"
 
+/*
+ * Counters over all pools, see dbpool_status().
+ */
+static struct {
+    long checks;
+    long reconnects;
+    long prepared;
+    long reused;
+    long wait[DBPOOL_HISTOGRAM_BUCKETS];
+    long wait_usec;
+    long hold[DBPOOL_HISTOGRAM_BUCKETS];
+    long hold_usec;
+} stats;
+
+#define STATS_ADD(p, n) __atomic_add_fetch((p), (n), __ATOMIC_RELAXED)
+#define STATS_GET(p)    __atomic_load_n((p), __ATOMIC_RELAXED)
+
 #ifdef HAVE_DBPOOL
 
 #include "dbpool_mysql.c"
@@ -81,11 +98,30 @@
 #include "dbpool_redis.c"
 #include "dbpool_cass.c"
 
+/*
+ * Prepared statements kept per connection. Further ones, e.g. of
+ * queries built with varying text, are prepared for a single use.
+ */
+#define DBPOOL_MAX_STATEMENTS 64
+
+static void histogram_add(long *buckets, long *usec, double secs)
+{
+    static const double bounds[] = DBPOOL_HISTOGRAM_BOUNDS;
+    int i;
+
+    for (i = 0; i < DBPOOL_HISTOGRAM_BUCKETS - 1 && secs > bounds[i]; i++)
+        ;
+    STATS_ADD(&buckets[i], 1);
+    STATS_ADD(usec, (long) (secs * 1e6));
+}
+
 
 static void dbpool_conn_destroy(DBPoolConn *conn)
 {
     gw_assert(conn != NULL);
 
+    /* statements go first, some databases refuse to close otherwise */
+    dict_destroy(conn->statements);
     if (conn->conn != NULL)
         conn->pool->db_ops->close(conn->conn);
 
@@ -112,6 +148,8 @@ DBPool *dbpool_create(enum db_type db_type, DBConf *conf, unsigned int connectio
     p->curr_size = 0;
     p->conf = conf;
     p->db_type = db_type;
+    p->max_idle = 30;
+    p->max_lifetime = 0;
 
     switch(db_type) {
 #ifdef HAVE_MSSQL
@@ -198,6 +236,11 @@ unsigned int dbpool_increase(DBPool *p, unsigned int count)
 
             pc->conn = conn;
             pc->pool = p;
+            pc->created = pc->used = date_monotonic_now();
+            pc->failed = 0;
+            pc->statements = NULL;
+            if (p->db_ops->prepare != NULL)
+                pc->statements = dict_create(DBPOOL_MAX_STATEMENTS, p->db_ops->finalize);
 
             p->curr_size++;
             opened++;
@@ -246,6 +289,22 @@ unsigned int dbpool_decrease(DBPool *p, unsigned int c)
 }
 
 
+void dbpool_configure(DBPool *p, CfgGroup *grp)
+{
+    long n;
+
+    gw_assert(p != NULL);
+
+    if (grp == NULL)
+        return;
+
+    if (cfg_get_integer(&n, grp, octstr_imm("max-idle")) != -1 && n >= 0)
+        p->max_idle = n;
+    if (cfg_get_integer(&n, grp, octstr_imm("max-lifetime")) != -1 && n >= 0)
+        p->max_lifetime = n;
+}
+
+
 long dbpool_conn_count(DBPool *p)
 {
     gw_assert(p != NULL && p->pool != NULL);
@@ -254,9 +313,37 @@ long dbpool_conn_count(DBPool *p)
 }
 
 
+/*
+ * Return 1 if the connection can't be handed out: it is older than
+ * max-lifetime, or it failed or idled too long and the check says so.
+ */
+static int dbpool_conn_stale(DBPool *p, DBPoolConn *pc, double now)
+{
+    if (pc->conn == NULL)
+        return 1;
+
+    if (p->max_lifetime > 0 && now - pc->created >= p->max_lifetime) {
+        debug("dbpool", 0, "DBPool connection reached max-lifetime, reconnecting...");
+        return 1;
+    }
+
+    /* no need to ask the database about a connection in use a moment ago */
+    if (p->db_ops->check == NULL || (!pc->failed && now - pc->used < p->max_idle))
+        return 0;
+
+    STATS_ADD(&stats.checks, 1);
+    if (p->db_ops->check(pc->conn) != 0)
+        return 1;
+
+    pc->failed = 0;
+    return 0;
+}
+
+
 DBPoolConn *dbpool_conn_consume(DBPool *p)
 {
     DBPoolConn *pc;
+    double start, now;
 
     gw_assert(p != NULL && p->pool != NULL);
     
@@ -264,6 +351,8 @@ DBPoolConn *dbpool_conn_consume(DBPool *p)
     if (p->max_size < 1)
         return NULL;
 
+    now = start = date_monotonic_now();
+
     /* check if we have any connection */
     while (p->curr_size < 1) {
         debug("dbpool", 0, "DBPool has no connections, reconnecting up to maximum...");
@@ -275,12 +364,8 @@ DBPoolConn *dbpool_conn_consume(DBPool *p)
 
     /* garantee that you deliver a valid connection to the caller */
     while ((pc = gwlist_consume(p->pool)) != NULL) {
-
-        /* 
-         * XXX check that the connection is still existing.
-         * Is this a performance bottle-neck?!
-         */
-        if (!pc->conn || (p->db_ops->check && p->db_ops->check(pc->conn) != 0)) {
+        now = date_monotonic_now();
+        if (dbpool_conn_stale(p, pc, now)) {
             /* something was wrong, reinitialize the connection */
             /* lock dbpool for update */
             gwlist_lock(p->pool);
@@ -288,6 +373,9 @@ DBPoolConn *dbpool_conn_consume(DBPool *p)
             p->curr_size--;
             /* unlock dbpool for update */
             gwlist_unlock(p->pool);
+            STATS_ADD(&stats.reconnects, 1);
+            /* replace it right away, retired ones shouldn't shrink the pool */
+            dbpool_increase(p, 1);
             /*
              * maybe not needed, just try to get next connection, but it
              * can be dangeros if all connections where broken, then we will
@@ -306,14 +394,27 @@ DBPoolConn *dbpool_conn_consume(DBPool *p)
         }
     }
 
-    return (pc->conn != NULL ? pc : NULL);
+    /* pool is being destroyed */
+    if (pc == NULL)
+        return NULL;
+
+    histogram_add(stats.wait, &stats.wait_usec, now - start);
+    pc->used = now;
+
+    return pc;
 }
 
 
 void dbpool_conn_produce(DBPoolConn *pc)
 {
+    double now;
+
     gw_assert(pc != NULL && pc->conn != NULL && pc->pool != NULL && pc->pool->pool != NULL);
 
+    now = date_monotonic_now();
+    histogram_add(stats.hold, &stats.hold_usec, now - pc->used);
+    pc->used = now;
+
     gwlist_produce(pc->pool->pool, pc);
 }
 
@@ -338,6 +439,7 @@ unsigned int dbpool_check(DBPool *p)
         DBPoolConn *pconn;
 
         pconn = gwlist_get(p->pool, i);
+        STATS_ADD(&stats.checks, 1);
         if (p->db_ops->check(pconn->conn) != 0) {
             /* something was wrong, reinitialize the connection */
             gwlist_delete(p->pool, i, 1);
@@ -347,6 +449,7 @@ unsigned int dbpool_check(DBPool *p)
             len--;
             i--;
         } else {
+            pconn->failed = 0;
             n++;
         }
     }
@@ -361,27 +464,137 @@ unsigned int dbpool_check(DBPool *p)
 }
 
 
+/*
+ * Look up the prepared statement for sql or prepare it. A new statement
+ * is kept with the connection, unless keep_all is false and the
+ * connection holds DBPOOL_MAX_STATEMENTS already; then *once is set and
+ * the caller has to finalize it after use.
+ */
+static void *dbpool_conn_prepare(DBPoolConn *conn, const Octstr *sql, int keep_all, int *once)
+{
+    void *stmt;
+
+    *once = 0;
+    if ((stmt = dict_get(conn->statements, (Octstr*) sql)) != NULL) {
+        STATS_ADD(&stats.reused, 1);
+        return stmt;
+    }
+
+    if ((stmt = conn->pool->db_ops->prepare(conn->conn, sql)) == NULL)
+        return NULL;
+    STATS_ADD(&stats.prepared, 1);
+
+    if (!keep_all && dict_key_count(conn->statements) >= DBPOOL_MAX_STATEMENTS)
+        *once = 1;
+    else
+        dict_put(conn->statements, (Octstr*) sql, stmt);
+
+    return stmt;
+}
+
+
+/*
+ * A query failed. Have the connection checked before its next use,
+ * unless the driver can tell that the connection itself is fine.
+ */
+static void dbpool_conn_error(DBPoolConn *conn)
+{
+    struct db_ops *ops = conn->pool->db_ops;
+
+    if (ops->broken == NULL || ops->broken(conn->conn))
+        conn->failed = 1;
+}
+
+
 int dbpool_conn_select(DBPoolConn *conn, const Octstr *sql, List *binds, List **result)
 {
+    struct db_ops *ops;
+    void *stmt;
+    int ret, once;
+
     if (sql == NULL || conn == NULL)
         return -1;
 
-    if (conn->pool->db_ops->select == NULL)
+    ops = conn->pool->db_ops;
+    if (conn->statements != NULL) {
+        if ((stmt = dbpool_conn_prepare(conn, sql, 0, &once)) == NULL)
+            ret = -1;
+        else {
+            ret = ops->select_prepared(conn->conn, stmt, binds, result);
+            if (once)
+                ops->finalize(stmt);
+        }
+    } else if (ops->select == NULL)
         return -1; /* may be panic here ??? */
+    else
+        ret = ops->select(conn->conn, sql, binds, result);
+
+    if (ret == -1)
+        dbpool_conn_error(conn);
 
-    return conn->pool->db_ops->select(conn->conn, sql, binds, result);
+    return ret;
 }
 
 
 int dbpool_conn_update(DBPoolConn *conn, const Octstr *sql, List *binds)
 {
+    struct db_ops *ops;
+    void *stmt;
+    int ret, once;
+
     if (sql == NULL || conn == NULL)
         return -1;
 
-    if (conn->pool->db_ops->update == NULL)
+    ops = conn->pool->db_ops;
+    if (conn->statements != NULL) {
+        if ((stmt = dbpool_conn_prepare(conn, sql, 0, &once)) == NULL)
+            ret = -1;
+        else {
+            ret = ops->update_prepared(conn->conn, stmt, binds);
+            if (once)
+                ops->finalize(stmt);
+        }
+    } else if (ops->update == NULL)
         return -1; /* may be panic here ??? */
+    else
+        ret = ops->update(conn->conn, sql, binds);
+
+    if (ret == -1)
+        dbpool_conn_error(conn);
+
+    return ret;
+}
+
+
+void *dbpool_conn_statement(DBPoolConn *conn, const Octstr *sql)
+{
+    void *stmt;
+    int once;
+
+    if (sql == NULL || conn == NULL || conn->statements == NULL)
+        return NULL;
 
-    return conn->pool->db_ops->update(conn->conn, sql, binds);
+    if ((stmt = dbpool_conn_prepare(conn, sql, 1, &once)) == NULL)
+        conn->failed = 1;
+
+    return stmt;
 }
 
 #endif /* HAVE_DBPOOL */
+
+
+void dbpool_status(DBPoolStatus *status)
+{
+    int i;
+
+    status->checks = STATS_GET(&stats.checks);
+    status->reconnects = STATS_GET(&stats.reconnects);
+    status->prepared = STATS_GET(&stats.prepared);
+    status->reused = STATS_GET(&stats.reused);
+    for (i = 0; i < DBPOOL_HISTOGRAM_BUCKETS; i++) {
+        status->wait[i] = STATS_GET(&stats.wait[i]);
+        status->hold[i] = STATS_GET(&stats.hold[i]);
+    }
+    status->wait_sum = STATS_GET(&stats.wait_usec) / 1e6;
+    status->hold_sum = STATS_GET(&stats.hold_usec) / 1e6;
+}
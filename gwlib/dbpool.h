@@ -93,6 +93,10 @@ typedef struct DBPool DBPool;
  typedef struct {
     void *conn; /* the pointer holding the database specific connection */
     DBPool *pool; /* pointer of the pool where this connection belongs to */
+    double created; /* when the connection was opened */
+    double used; /* when it was last handed out or given back */
+    int failed; /* an operation failed, check the connection before reuse */
+    Dict *statements; /* prepared statements by sql text, if supported */
 }  DBPoolConn;
 
 typedef struct {
@@ -204,6 +208,16 @@ unsigned int dbpool_increase(DBPool *p, unsigned int conn);
  */
 unsigned int dbpool_decrease(DBPool *p, unsigned int conn);
 
+/*
+ * Read 'max-idle' and 'max-lifetime' from the *-connection group grp.
+ * Connections are checked by the database specific check function (e.g.
+ * a ping) only before they are handed out after an operation on them
+ * failed, or after they were idle for max-idle seconds or more (default
+ * 30, 0 checks at every checkout). Connections older than max-lifetime
+ * seconds are closed and opened again (default 0, keep them forever).
+ */
+void dbpool_configure(DBPool *p, CfgGroup *grp);
+
 /*
  * Return the number of connections that are currently queued in the pool.
  */
@@ -228,6 +242,39 @@ void dbpool_conn_produce(DBPoolConn *conn);
 int dbpool_conn_select(DBPoolConn *conn, const Octstr *sql, List *binds, List **result);
 int dbpool_conn_update(DBPoolConn *conn, const Octstr *sql, List *binds);
 
+/*
+ * Returns the database specific prepared statement for sql, for callers
+ * working with the raw connection, or NULL if the database does not
+ * support them or preparing failed. It is prepared on first use and kept
+ * with the connection until that is closed, so it must not be released
+ * by the caller, only reset after each execution. dbpool_conn_select()
+ * and dbpool_conn_update() use the same statements.
+ */
+void *dbpool_conn_statement(DBPoolConn *conn, const Octstr *sql);
+
+/*
+ * Upper bounds in seconds of the histogram buckets below, the last
+ * bucket takes all that is slower.
+ */
+#define DBPOOL_HISTOGRAM_BOUNDS { 0.0001, 0.001, 0.01, 0.1, 1.0, 10.0 }
+#define DBPOOL_HISTOGRAM_BUCKETS 7
+
+/*
+ * Counters over all pools of the process, for monitoring and sizing.
+ */
+typedef struct {
+    long checks;            /* connection checks done on checkout */
+    long reconnects;        /* connections replaced, broken or too old */
+    long prepared;          /* statements prepared */
+    long reused;            /* executions of an already prepared statement */
+    long wait[DBPOOL_HISTOGRAM_BUCKETS];    /* checkouts by time waited */
+    double wait_sum;
+    long hold[DBPOOL_HISTOGRAM_BUCKETS];    /* checkouts by time held */
+    double hold_sum;
+} DBPoolStatus;
+
+void dbpool_status(DBPoolStatus *status);
+
 /*
  * Perfoms a check of all connections within the pool and tries to
  * re-establish the same ammount of connections if there are broken
@@ -166,27 +166,52 @@ static int mysql_check_conn(void *conn)
 }
 
 
-static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
+static void *mysql_prepare_stmt(void *conn, const Octstr *sql)
 {
     MYSQL_STMT *stmt;
-    MYSQL_RES *result;
-    MYSQL_BIND *bind = NULL;
-    long i, binds_len;
-    int ret;
-
-    *res = NULL;
 
     /* allocate statement handle */
     stmt = mysql_stmt_init((MYSQL*) conn);
     if (stmt == NULL) {
         error(0, "MYSQL: mysql_stmt_init(), out of memory.");
-        return -1;
+        return NULL;
     }
     if (mysql_stmt_prepare(stmt, octstr_get_cstr(sql), octstr_len(sql))) {
-        error(0, "MYSQL: Unable to prepare statement: %s", mysql_stmt_error(stmt));
+        error(0, "MYSQL: Unable to prepare statement: `%s'", mysql_stmt_error(stmt));
         mysql_stmt_close(stmt);
-        return -1;
+        return NULL;
     }
+
+    return stmt;
+}
+
+
+static void mysql_finalize_stmt(void *stmt)
+{
+    mysql_stmt_close(stmt);
+}
+
+
+/*
+ * Make the statement ready for the next execution.
+ */
+static void mysql_reset_stmt(MYSQL_STMT *stmt)
+{
+    mysql_stmt_free_result(stmt);
+    mysql_stmt_reset(stmt);
+}
+
+
+static int mysql_select_stmt(void *conn, void *thestmt, List *binds, List **res)
+{
+    MYSQL_STMT *stmt = thestmt;
+    MYSQL_RES *result;
+    MYSQL_BIND *bind = NULL;
+    long i, binds_len;
+    int ret;
+
+    *res = NULL;
+
     /* bind params if any */
     binds_len = gwlist_len(binds);
     if (binds_len > 0) {
@@ -203,7 +228,7 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
         if (mysql_stmt_bind_param(stmt, bind)) {
           error(0, "MYSQL: mysql_stmt_bind_param() failed: `%s'", mysql_stmt_error(stmt));
           gw_free(bind);
-          mysql_stmt_close(stmt);
+          mysql_reset_stmt(stmt);
           return -1;
         }
     }
@@ -212,7 +237,7 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
     if (mysql_stmt_execute(stmt)) {
         error(0, "MYSQL: mysql_stmt_execute() failed: `%s'", mysql_stmt_error(stmt));
         gw_free(bind);
-        mysql_stmt_close(stmt);
+        mysql_reset_stmt(stmt);
         return -1;
     }
     gw_free(bind);
@@ -230,9 +255,9 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
 
     /* Fetch result set meta information */
     result = mysql_stmt_result_metadata(stmt);
-    if (res == NULL) {
+    if (result == NULL) {
         error(0, "MYSQL: mysql_stmt_result_metadata() failed: `%s'", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
+        mysql_reset_stmt(stmt);
         return -1;
     }
     /* Get total columns in the query */
@@ -269,7 +294,7 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
     if (mysql_stmt_bind_result(stmt, bind)) {
         error(0, "MYSQL: mysql_stmt_bind_result() failed: `%s'", mysql_stmt_error(stmt));
         DESTROY_BIND(bind, binds_len);
-        mysql_stmt_close(stmt);
+        mysql_reset_stmt(stmt);
         return -1;
     }
 
@@ -314,7 +339,7 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
     if (ret != MYSQL_NO_DATA) {
         List *row;
         error(0, "MYSQL: mysql_stmt_bind_result() failed: `%s'", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
+        mysql_reset_stmt(stmt);
         while((row = gwlist_extract_first(*res)) != NULL)
             gwlist_destroy(row, octstr_destroy_item);
         gwlist_destroy(*res, NULL);
@@ -322,30 +347,19 @@ static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
         return -1;
     }
 
-    mysql_stmt_close(stmt);
+    mysql_reset_stmt(stmt);
 
     return 0;
 }
 
 
-static int mysql_update(void *conn, const Octstr *sql, List *binds)
+static int mysql_update_stmt(void *conn, void *thestmt, List *binds)
 {
-    MYSQL_STMT *stmt;
+    MYSQL_STMT *stmt = thestmt;
     MYSQL_BIND *bind = NULL;
     long i, binds_len;
     int ret;
 
-    /* allocate statement handle */
-    stmt = mysql_stmt_init((MYSQL*) conn);
-    if (stmt == NULL) {
-        error(0, "MYSQL: mysql_stmt_init(), out of memory.");
-        return -1;
-    }
-    if (mysql_stmt_prepare(stmt, octstr_get_cstr(sql), octstr_len(sql))) {
-        error(0, "MYSQL: Unable to prepare statement: `%s'", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        return -1;
-    }
     /* bind params if any */
     binds_len = gwlist_len(binds);
     if (binds_len > 0) {
@@ -362,7 +376,7 @@ static int mysql_update(void *conn, const Octstr *sql, List *binds)
         if (mysql_stmt_bind_param(stmt, bind)) {
           error(0, "MYSQL: mysql_stmt_bind_param() failed: `%s'", mysql_stmt_error(stmt));
           gw_free(bind);
-          mysql_stmt_close(stmt);
+          mysql_reset_stmt(stmt);
           return -1;
         }
     }
@@ -379,13 +393,42 @@ retry:
         else {
             error(0, "MYSQL: mysql_stmt_execute() failed: %d: `%s'", ret, mysql_stmt_error(stmt));
             gw_free(bind);
-            mysql_stmt_close(stmt);
+            mysql_reset_stmt(stmt);
             return -1;
         }
     }
     gw_free(bind);
 
     ret = mysql_stmt_affected_rows(stmt);
+    mysql_reset_stmt(stmt);
+
+    return ret;
+}
+
+
+static int mysql_select(void *conn, const Octstr *sql, List *binds, List **res)
+{
+    MYSQL_STMT *stmt;
+    int ret;
+
+    *res = NULL;
+    if ((stmt = mysql_prepare_stmt(conn, sql)) == NULL)
+        return -1;
+    ret = mysql_select_stmt(conn, stmt, binds, res);
+    mysql_stmt_close(stmt);
+
+    return ret;
+}
+
+
+static int mysql_update(void *conn, const Octstr *sql, List *binds)
+{
+    MYSQL_STMT *stmt;
+    int ret;
+
+    if ((stmt = mysql_prepare_stmt(conn, sql)) == NULL)
+        return -1;
+    ret = mysql_update_stmt(conn, stmt, binds);
     mysql_stmt_close(stmt);
 
     return ret;
@@ -412,7 +455,11 @@ static struct db_ops mysql_ops = {
     .check = mysql_check_conn,
     .select = mysql_select,
     .update = mysql_update,
-    .conf_destroy = mysql_conf_destroy
+    .conf_destroy = mysql_conf_destroy,
+    .prepare = mysql_prepare_stmt,
+    .finalize = mysql_finalize_stmt,
+    .select_prepared = mysql_select_stmt,
+    .update_prepared = mysql_update_stmt
 };
 
 #endif /* HAVE_MYSQL */
@@ -104,6 +104,31 @@ struct db_ops {
      * @return #rows processed ; -1 if a error occurs
      */
     int (*update) (void *conn, const Octstr *sql, List *binds);
+    /*
+     * Prepare sql once for repeated execution on the given connection.
+     * If defined, dbpool keeps the prepared statements of each connection
+     * keyed by their sql text and runs select/update through them.
+     * NOTE: this function and the three below are optional
+     * @return database specific statement ; NULL if an error occurs
+     */
+    void* (*prepare) (void *conn, const Octstr *sql);
+    /*
+     * Release a statement returned by prepare.
+     */
+    void (*finalize) (void *stmt);
+    /*
+     * Same as select and update, but executing a prepared statement.
+     * The statement has to be ready for the next execution afterwards.
+     */
+    int (*select_prepared) (void *conn, void *stmt, List *binds, List **result);
+    int (*update_prepared) (void *conn, void *stmt, List *binds);
+    /*
+     * Tell whether the last -1 of select/update came from a lost
+     * connection, and not from a query that simply had no usual result.
+     * NOTE: this function is optional, without it every -1 counts as lost
+     * @return 1 if the connection is broken ; 0 otherwise
+     */
+    int (*broken) (void *conn);
 };
 
 struct DBPool
@@ -114,6 +139,8 @@ struct DBPool
     DBConf *conf; /* the database type specific configuration block */
     struct db_ops *db_ops; /* the database operations callbacks */
     enum db_type db_type; /* the type of database */
+    long max_idle; /* check connections idle for that many seconds */
+    long max_lifetime; /* replace connections that old, 0 = never */
 };
 
 
@@ -515,12 +515,20 @@ static void redis_conf_destroy(DBConf *db_conf)
 }
 
 
+static int redis_broken(void *conn)
+{
+    /* hiredis sets err on I/O and protocol errors only */
+    return ((redisContext*) conn)->err != 0;
+}
+
+
 static struct db_ops redis_ops = {
     .open = redis_open_conn,
     .close = redis_close_conn,
     .check = redis_check_conn,
     .select = redis_select,
     .update = redis_update,
+    .broken = redis_broken,
     .conf_destroy = redis_conf_destroy
 };
 
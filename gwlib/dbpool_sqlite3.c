@@ -133,18 +133,12 @@ static void sqlite3_conf_destroy(DBConf *db_conf)
     gw_free(db_conf);
 }
 
-static int sqlite3_select(void *theconn, const Octstr *sql, List *binds, List **res)
+static void *sqlite3_prepare_stmt(void *theconn, const Octstr *sql)
 {
     sqlite3 *db = theconn;
     sqlite3_stmt *stmt;
     const char *rem;
-    List *row;
     int status;
-    int columns;
-    int i;
-    int binds_len = (binds ? gwlist_len(binds) : 0);
-
-    *res = NULL;
 
     /* prepare statement */
 #if SQLITE_VERSION_NUMBER >= 3003009    
@@ -154,20 +148,67 @@ static int sqlite3_select(void *theconn, const Octstr *sql, List *binds, List **
 #endif
     if (SQLITE_OK != status) {
         error(0, "SQLite3: %s", sqlite3_errmsg(db));
-        return -1;
+        return NULL;
     }
 
-    /* bind variables */
+    return stmt;
+}
+
+
+static void sqlite3_finalize_stmt(void *stmt)
+{
+    sqlite3_finalize(stmt);
+}
+
+
+/*
+ * Make the statement ready for the next execution. Bindings are static,
+ * so they have to be cleared before the values they point to go away.
+ */
+static void sqlite3_reset_stmt(sqlite3_stmt *stmt)
+{
+    sqlite3_reset(stmt);
+#if SQLITE_VERSION_NUMBER >= 3003009
+    sqlite3_clear_bindings(stmt);
+#endif
+}
+
+
+static int sqlite3_bind_stmt(sqlite3 *db, sqlite3_stmt *stmt, List *binds)
+{
+    int i, status;
+    int binds_len = (binds ? gwlist_len(binds) : 0);
+
     for (i = 0; i < binds_len; i++) {
         Octstr *bind = gwlist_get(binds, i);
         status = sqlite3_bind_text(stmt, i + 1, octstr_get_cstr(bind), octstr_len(bind), SQLITE_STATIC);
         if (SQLITE_OK != status) {
             error(0, "SQLite3: %s", sqlite3_errmsg(db));
-            sqlite3_finalize(stmt);
             return -1;
         }
     }
 
+    return 0;
+}
+
+
+static int sqlite3_select_stmt(void *theconn, void *thestmt, List *binds, List **res)
+{
+    sqlite3 *db = theconn;
+    sqlite3_stmt *stmt = thestmt;
+    List *row;
+    int status;
+    int columns;
+    int i;
+
+    *res = NULL;
+
+    /* bind variables */
+    if (sqlite3_bind_stmt(db, stmt, binds) == -1) {
+        sqlite3_reset_stmt(stmt);
+        return -1;
+    }
+
     /* execute our statement */
     *res = gwlist_create();
     while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
@@ -192,53 +233,33 @@ static int sqlite3_select(void *theconn, const Octstr *sql, List *binds, List **
             gwlist_destroy(row, octstr_destroy_item);
         gwlist_destroy(*res, NULL);
         *res = NULL;
-        sqlite3_finalize(stmt);
+        sqlite3_reset_stmt(stmt);
         return -1;
     }
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset_stmt(stmt);
 
     return 0;
 }
 
 
-static int sqlite3_update(void *theconn, const Octstr *sql, List *binds)
+static int sqlite3_update_stmt(void *theconn, void *thestmt, List *binds)
 {
     sqlite3 *db = theconn;
-    sqlite3_stmt *stmt;
-    const char *rem;
+    sqlite3_stmt *stmt = thestmt;
     int status;
     int rows;
-    int i;
-    int binds_len = (binds ? gwlist_len(binds) : 0);
-
-    /* prepare statement */
-#if SQLITE_VERSION_NUMBER >= 3003009    
-    status = sqlite3_prepare_v2(db, octstr_get_cstr(sql), octstr_len(sql) + 1, &stmt, &rem);
-#else
-    status = sqlite3_prepare(db, octstr_get_cstr(sql), octstr_len(sql) + 1, &stmt, &rem);
-#endif    
-    if (SQLITE_OK != status) {
-        error(0, "SQLite3: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    debug("dbpool.sqlite3",0,"sqlite3_prepare done");
 
     /* bind variables */
-    for (i = 0; i < binds_len; i++) {
-        Octstr *bind = gwlist_get(binds, i);
-        status = sqlite3_bind_text(stmt, i + 1, octstr_get_cstr(bind), octstr_len(bind), SQLITE_STATIC);
-        if (SQLITE_OK != status) {
-            error(0, "SQLite3: %s", sqlite3_errmsg(db));
-            sqlite3_finalize(stmt);
-            return -1;
-        }
+    if (sqlite3_bind_stmt(db, stmt, binds) == -1) {
+        sqlite3_reset_stmt(stmt);
+        return -1;
     }
 
     /* execute our statement */
     if ((status = sqlite3_step(stmt)) != SQLITE_DONE) {
         error(0, "SQLite3: %s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
+        sqlite3_reset_stmt(stmt);
         return -1;
     }
     debug("dbpool.sqlite3",0,"sqlite3_step done");
@@ -246,18 +267,54 @@ static int sqlite3_update(void *theconn, const Octstr *sql, List *binds)
     rows = sqlite3_changes(db);
     debug("dbpool.sqlite3",0,"rows processed = %d", rows);
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset_stmt(stmt);
 
     return rows;
 }
 
+
+static int sqlite3_select(void *theconn, const Octstr *sql, List *binds, List **res)
+{
+    sqlite3_stmt *stmt;
+    int ret;
+
+    *res = NULL;
+    if ((stmt = sqlite3_prepare_stmt(theconn, sql)) == NULL)
+        return -1;
+    ret = sqlite3_select_stmt(theconn, stmt, binds, res);
+    sqlite3_finalize(stmt);
+
+    return ret;
+}
+
+
+static int sqlite3_update(void *theconn, const Octstr *sql, List *binds)
+{
+    sqlite3_stmt *stmt;
+    int ret;
+
+    if ((stmt = sqlite3_prepare_stmt(theconn, sql)) == NULL)
+        return -1;
+    ret = sqlite3_update_stmt(theconn, stmt, binds);
+    sqlite3_finalize(stmt);
+
+    return ret;
+}
+
 static struct db_ops sqlite3_ops = {
     .open = sqlite3_open_conn,
     .close = sqlite3_close_conn,
     .check = sqlite3_check_conn,
     .conf_destroy = sqlite3_conf_destroy,
     .select = sqlite3_select,
-    .update = sqlite3_update
+    .update = sqlite3_update,
+#if SQLITE_VERSION_NUMBER >= 3003009
+    /* older statements fail instead of preparing again on schema changes */
+    .prepare = sqlite3_prepare_stmt,
+    .finalize = sqlite3_finalize_stmt,
+#endif
+    .select_prepared = sqlite3_select_stmt,
+    .update_prepared = sqlite3_update_stmt
 };
 
 #endif /* HAVE_SQLITE3 */
@@ -57,8 +57,12 @@
 /*
  * dict.c - lookup data structure using octet strings as keys
  *
- * The Dict is implemented as a simple hash table. In the future, it 
- * might be interesting to use a trie instead.
+ * The Dict is implemented as an open addressing hash table with linear
+ * probing. Items live directly in the table together with the hash of
+ * their key, so a lookup walks one contiguous array and compares keys
+ * only when the stored hash matches. Larger Dicts are split into shards
+ * with a lock each, selected by the low bits of the hash, so threads
+ * working on different keys rarely meet on the same lock.
  *
  * Lars Wirzenius, based on code by Tuomas Luttinen
  */
@@ -68,122 +72,265 @@
 
 
 /*
- * The hash table stores key/value -pairs in a List.
+ * A slot of the table. Empty slots have key == NULL. The layout starts
+ * with key and value, dict_traverse_sorted() hands Item pointers to the
+ * compare function.
  */
 
 typedef struct Item Item;
 struct Item {
     Octstr *key;
     void *value;
+    unsigned long hash;
 };
 
 
-static Item *item_create(Octstr *key, void *value)
+/*
+ * `tab' is an array of `size' slots, `size' is a power of two. `count'
+ * is the number of used slots, the table grows before it gets more than
+ * 3/4 full; deletion shifts the following items back, so there are no
+ * tombstones and a lookup stops at the first empty slot.
+ */
+
+typedef struct {
+    Mutex *lock;
+    Item *tab;
+    unsigned long size;
+    long count;
+} Shard;
+
+
+/*
+ * The dictionary itself. `key_count' is the sum of the shard counts, kept
+ * up to date by the put and remove functions to make dict_key_count()
+ * cheap.
+ */
+
+struct Dict {
+    Shard *shards;
+    unsigned long num_shards;
+    int shard_bits;
+    long key_count;
+    void (*destroy_value)(void *);
+};
+
+/* at most this many shards per Dict */
+#define MAX_SHARD_BITS 4
+
+/* start a new shard with at most this many slots, it grows on demand */
+#define MAX_INITIAL_SLOTS (64 * 1024)
+
+/* smallest table */
+#define MIN_SLOTS 8
+
+
+static unsigned long key_hash(Octstr *key)
 {
-    Item *item;
-    
-    item = gw_malloc(sizeof(*item));
-    item->key = octstr_duplicate(key);
-    item->value = value;
-    return item;
+    unsigned long h;
+
+    /* octstr_hash_key() only gives 31 bits, spread them over the word */
+    h = octstr_hash_key(key) * (unsigned long) 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
 }
 
-static void item_destroy(void *item)
+
+static Shard *shard_of(Dict *dict, unsigned long hash)
 {
-    Item *p;
-    
-    p = item;
-    octstr_destroy(p->key);
-    gw_free(p);
+    return &dict->shards[hash & (dict->num_shards - 1)];
 }
 
 
-static int item_has_key(void *item, void *key)
+static unsigned long home_slot(Dict *dict, Shard *shard, unsigned long hash)
 {
-    return octstr_compare(key, ((Item *) item)->key) == 0;
+    return (hash >> dict->shard_bits) & (shard->size - 1);
 }
 
 
-/*
- * The dictionary itself is a very simple hash table.
- * `tab' is an array of Lists of Items, in which empty Lists may be
- * represented as NULL.  `size' is the number of elements allocated
- * for the array, and `key_count' is the number of Items currently
- * in the table.  `key_count' is kept up to date by the put and remove
- * functions, and is used to make dict_key_count() faster.
- */
+static void lock(Shard *shard)
+{
+    mutex_lock(shard->lock);
+}
 
-struct Dict {
-    List **tab;
-    long size;
-    long key_count;
-    void (*destroy_value)(void *);
-    Mutex *lock;
-};
+
+static void unlock(Shard *shard)
+{
+    mutex_unlock(shard->lock);
+}
 
 
-static void lock(Dict *dict)
+static void lock_all(Dict *dict)
 {
-    mutex_lock(dict->lock);
+    unsigned long i;
+
+    for (i = 0; i < dict->num_shards; ++i)
+        lock(&dict->shards[i]);
 }
 
 
-static void unlock(Dict *dict)
+static void unlock_all(Dict *dict)
 {
-    mutex_unlock(dict->lock);
+    unsigned long i;
+
+    for (i = dict->num_shards; i > 0; --i)
+        unlock(&dict->shards[i - 1]);
 }
 
 
-static long key_to_index(Dict *dict, Octstr *key)
+static Item *table_create(unsigned long size)
 {
-    return octstr_hash_key(key) % dict->size;
+    Item *tab;
+
+    tab = gw_malloc(sizeof(*tab) * size);
+    memset(tab, 0, sizeof(*tab) * size);
+    return tab;
 }
 
-static int handle_null_value(Dict *dict, Octstr *key, void *value)
+
+/*
+ * Return the slot holding key, or the empty slot where it would go.
+ */
+static Item *find_slot(Dict *dict, Shard *shard, Octstr *key, unsigned long hash)
 {
-    if (value == NULL) {
-        value = dict_remove(dict, key);
-	if (dict->destroy_value != NULL)
-	    dict->destroy_value(value);
-        return 1;
+    unsigned long i, mask;
+    Item *p;
+
+    mask = shard->size - 1;
+    for (i = home_slot(dict, shard, hash); ; i = (i + 1) & mask) {
+        p = &shard->tab[i];
+        if (p->key == NULL)
+            return p;
+        if (p->hash == hash && octstr_compare(p->key, key) == 0)
+            return p;
     }
+}
 
-    return 0;
+
+static void grow(Dict *dict, Shard *shard)
+{
+    Item *old, *p;
+    unsigned long old_size, i, j, mask;
+
+    old = shard->tab;
+    old_size = shard->size;
+    shard->size = old_size * 2;
+    shard->tab = table_create(shard->size);
+    mask = shard->size - 1;
+
+    for (i = 0; i < old_size; ++i) {
+        if (old[i].key == NULL)
+            continue;
+        for (j = home_slot(dict, shard, old[i].hash); ; j = (j + 1) & mask) {
+            p = &shard->tab[j];
+            if (p->key == NULL)
+                break;
+        }
+        *p = old[i];
+    }
+    gw_free(old);
 }
 
-static int dict_put_true(Dict *dict, Octstr *key, void *value)
+
+/*
+ * Make room for one more key; the caller looks up the slot afterwards.
+ */
+static void reserve(Dict *dict, Shard *shard)
 {
-    Item *p;
-    long i;
-    int item_unique;
+    if ((unsigned long) (shard->count + 1) * 4 > shard->size * 3)
+        grow(dict, shard);
+}
 
-    item_unique = 0;
-    lock(dict);
-    i = key_to_index(dict, key);
 
-    if (dict->tab[i] == NULL) {
-	dict->tab[i] = gwlist_create();
-	p = NULL;
-    } else {
-	p = gwlist_search(dict->tab[i], key, item_has_key);
+/*
+ * Remove the item in slot p and move the items of the same probe run
+ * that would not be found anymore into the gap.
+ */
+static void delete_slot(Dict *dict, Shard *shard, Item *p)
+{
+    unsigned long i, j, home, mask;
+
+    mask = shard->size - 1;
+    i = p - shard->tab;
+    for (j = (i + 1) & mask; shard->tab[j].key != NULL; j = (j + 1) & mask) {
+        home = home_slot(dict, shard, shard->tab[j].hash);
+        /* may item j move to the gap at i, i.e. is home not in (i, j]? */
+        if ((j > i && (home <= i || home > j)) ||
+            (j < i && (home <= i && home > j))) {
+            shard->tab[i] = shard->tab[j];
+            i = j;
+        }
     }
+    shard->tab[i].key = NULL;
+    shard->tab[i].value = NULL;
+    shard->count--;
+    __atomic_sub_fetch(&dict->key_count, 1, __ATOMIC_RELAXED);
+}
 
-    if (p == NULL) {
-    	p = item_create(key, value);
-	gwlist_append(dict->tab[i], p);
-        dict->key_count++;
+
+static void insert_slot(Dict *dict, Shard *shard, Item *p, Octstr *key,
+                        unsigned long hash, void *value)
+{
+    p->key = key;
+    p->value = value;
+    p->hash = hash;
+    shard->count++;
+    __atomic_add_fetch(&dict->key_count, 1, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Store value under key. `copy' tells whether the Dict stores a copy of
+ * the key or takes over the key itself. Returns 1 if the key was new.
+ * For an existing key `replace' decides whether the old value is
+ * replaced by the new one or the new one is dropped; the dropped value
+ * is destroyed in either case.
+ */
+static int put(Dict *dict, Octstr *key, void *value, int copy, int replace)
+{
+    Shard *shard;
+    unsigned long hash;
+    Item *p;
+    int item_unique;
+
+    hash = key_hash(key);
+    shard = shard_of(dict, hash);
+
+    lock(shard);
+    reserve(dict, shard);
+    p = find_slot(dict, shard, key, hash);
+    if (p->key == NULL) {
+        insert_slot(dict, shard, p, copy ? octstr_duplicate(key) : key, hash, value);
         item_unique = 1;
     } else {
-    	if (dict->destroy_value != NULL)
-    	    dict->destroy_value(value);
+        if (replace) {
+            if (dict->destroy_value != NULL)
+                dict->destroy_value(p->value);
+            p->value = value;
+        } else if (dict->destroy_value != NULL) {
+            dict->destroy_value(value);
+        }
+        if (!copy)
+            octstr_destroy(key);
         item_unique = 0;
     }
-
-    unlock(dict);
+    unlock(shard);
 
     return item_unique;
 }
 
+
+static int handle_null_value(Dict *dict, Octstr *key, void *value)
+{
+    if (value == NULL) {
+        value = dict_remove(dict, key);
+	if (dict->destroy_value != NULL)
+	    dict->destroy_value(value);
+        return 1;
+    }
+
+    return 0;
+}
+
+
 /*
  * And finally, the public functions.
  */
@@ -192,19 +339,30 @@ static int dict_put_true(Dict *dict, Octstr *key, void *value)
 Dict *dict_create(long size_hint, void (*destroy_value)(void *))
 {
     Dict *dict;
-    long i;
+    unsigned long i, size, per_shard;
     
     dict = gw_malloc(sizeof(*dict));
 
-    /*
-     * Hash tables tend to work well until they are fill to about 50%.
-     */
-    dict->size = size_hint * 2;
-
-    dict->tab = gw_malloc(sizeof(dict->tab[0]) * dict->size);
-    for (i = 0; i < dict->size; ++i)
-    	dict->tab[i] = NULL;
-    dict->lock = mutex_create();
+    /* only big Dicts are worth more than one lock */
+    dict->shard_bits = 0;
+    while (dict->shard_bits < MAX_SHARD_BITS &&
+           (512L << dict->shard_bits) < size_hint)
+        dict->shard_bits++;
+    dict->num_shards = 1UL << dict->shard_bits;
+
+    /* keep the expected number of keys below 3/4 of the slots */
+    per_shard = (size_hint > 0 ? size_hint : 1) / dict->num_shards;
+    per_shard = per_shard + per_shard / 3 + 1;
+    for (size = MIN_SLOTS; size < per_shard && size < MAX_INITIAL_SLOTS; size <<= 1)
+        ;
+
+    dict->shards = gw_malloc(sizeof(*dict->shards) * dict->num_shards);
+    for (i = 0; i < dict->num_shards; ++i) {
+        dict->shards[i].lock = mutex_create();
+        dict->shards[i].tab = table_create(size);
+        dict->shards[i].size = size;
+        dict->shards[i].count = 0;
+    }
     dict->destroy_value = destroy_value;
     dict->key_count = 0;
     
@@ -214,154 +372,119 @@ Dict *dict_create(long size_hint, void (*destroy_value)(void *))
 
 void dict_destroy(Dict *dict)
 {
-    long i;
-    Item *p;
+    unsigned long i, j;
+    Shard *shard;
     
     if (dict == NULL)
         return;
 
-    for (i = 0; i < dict->size; ++i) {
-        if (dict->tab[i] == NULL)
-	    continue;
-
-	while ((p = gwlist_extract_first(dict->tab[i])) != NULL) {
+    for (i = 0; i < dict->num_shards; ++i) {
+        shard = &dict->shards[i];
+        for (j = 0; j < shard->size; ++j) {
+            if (shard->tab[j].key == NULL)
+                continue;
 	    if (dict->destroy_value != NULL)
-	    	dict->destroy_value(p->value);
-	    item_destroy(p);
-	}
-	gwlist_destroy(dict->tab[i], NULL);
+	    	dict->destroy_value(shard->tab[j].value);
+            octstr_destroy(shard->tab[j].key);
+        }
+        mutex_destroy(shard->lock);
+        gw_free(shard->tab);
     }
-    mutex_destroy(dict->lock);
-    gw_free(dict->tab);
+    gw_free(dict->shards);
     gw_free(dict);
 }
 
 
 void dict_put(Dict *dict, Octstr *key, void *value)
 {
-    long i;
-    Item *p;
-
-    if (value == NULL) {
-        value = dict_remove(dict, key);
-	if (dict->destroy_value != NULL)
-	    dict->destroy_value(value);
+    if (handle_null_value(dict, key, value))
         return;
-    }
+    put(dict, key, value, 1, 1);
+}
 
-    lock(dict);
-    i = key_to_index(dict, key);
-    if (dict->tab[i] == NULL) {
-	dict->tab[i] = gwlist_create();
-	p = NULL;
-    } else
-	p = gwlist_search(dict->tab[i], key, item_has_key);
-    if (p == NULL) {
-    	p = item_create(key, value);
-	gwlist_append(dict->tab[i], p);
-        dict->key_count++;
-    } else {
-	if (dict->destroy_value != NULL)
-	    dict->destroy_value(p->value);
-	p->value = value;
+
+void dict_put_nocopy(Dict *dict, Octstr *key, void *value)
+{
+    if (handle_null_value(dict, key, value)) {
+        octstr_destroy(key);
+        return;
     }
-    unlock(dict);
+    put(dict, key, value, 0, 1);
 }
 
+
 int dict_put_once(Dict *dict, Octstr *key, void *value)
 {
-    int ret;
-
-    ret = 1;
     if (handle_null_value(dict, key, value))
         return 1;
-    if (dict_put_true(dict, key, value)) {
-        ret = 1;
-    } else {
-        ret = 0;
-    }
-    return ret;
+    return put(dict, key, value, 1, 0);
 }
 
+
 void *dict_get(Dict *dict, Octstr *key)
 {
-    long i;
-    Item *p;
+    Shard *shard;
+    unsigned long hash;
     void *value;
 
-    lock(dict);
-    i = key_to_index(dict, key);
-    if (dict->tab[i] == NULL)
-	p = NULL;
-    else
-        p = gwlist_search(dict->tab[i], key, item_has_key);
-    if (p == NULL)
-    	value = NULL;
-    else
-    	value = p->value;
-    unlock(dict);
+    hash = key_hash(key);
+    shard = shard_of(dict, hash);
+
+    lock(shard);
+    value = find_slot(dict, shard, key, hash)->value;
+    unlock(shard);
+
     return value;
 }
 
 
 void *dict_remove(Dict *dict, Octstr *key)
 {
-    long i;
-    Item *p;
+    Shard *shard;
+    unsigned long hash;
+    Octstr *old_key;
     void *value;
-    List *list;
+    Item *p;
 
-    lock(dict);
-    i = key_to_index(dict, key);
-    if (dict->tab[i] == NULL)
-        list = NULL;
-    else
-        list = gwlist_extract_matching(dict->tab[i], key, item_has_key);
-    gw_assert(list == NULL || gwlist_len(list) == 1);
-    if (list == NULL)
-    	value = NULL;
-    else {
-	p = gwlist_get(list, 0);
-	gwlist_destroy(list, NULL);
-    	value = p->value;
-	item_destroy(p);
-	dict->key_count--;
-    }
-    unlock(dict);
+    hash = key_hash(key);
+    shard = shard_of(dict, hash);
+
+    lock(shard);
+    p = find_slot(dict, shard, key, hash);
+    old_key = p->key;
+    value = p->value;
+    if (old_key != NULL)
+        delete_slot(dict, shard, p);
+    unlock(shard);
+
+    octstr_destroy(old_key);
     return value;
 }
 
 
 long dict_key_count(Dict *dict)
 {
-    long result;
-
-    lock(dict);
-    result = dict->key_count;
-    unlock(dict);
-
-    return result;
+    return __atomic_load_n(&dict->key_count, __ATOMIC_RELAXED);
 }
 
 
 List *dict_keys(Dict *dict)
 {
     List *list;
-    Item *item;
-    long i, j;
+    Shard *shard;
+    unsigned long i, j;
     
     list = gwlist_create();
 
-    lock(dict);
-    for (i = 0; i < dict->size; ++i) {
-	if (dict->tab[i] == NULL)
-	    continue;
-	for (j = 0; j < gwlist_len(dict->tab[i]); ++j) {
-	    item = gwlist_get(dict->tab[i], j);
-	    gwlist_append(list, octstr_duplicate(item->key));
-	}
+    lock_all(dict);
+    for (i = 0; i < dict->num_shards; ++i) {
+        shard = &dict->shards[i];
+        for (j = 0; j < shard->size; ++j) {
+            if (shard->tab[j].key != NULL)
+                gwlist_append(list, octstr_duplicate(shard->tab[j].key));
+        }
     }
-    unlock(dict);
+    unlock_all(dict);
     
     return list;
 }
@@ -369,21 +492,20 @@ List *dict_keys(Dict *dict)
 
 Dict *dict_duplicate(Dict *dict, void *(*duplicate_value)(void *))
 {
-    Item *item;
-    long i, j;
+    Shard *shard;
+    unsigned long i, j;
     Dict *dup;
 
-    lock(dict);
-    dup = dict_create(dict->size, dict->destroy_value);
-    for (i = 0; i < dict->size; ++i) {
-        if (dict->tab[i] == NULL)
-            continue;
-        for (j = 0; j < gwlist_len(dict->tab[i]); ++j) {
-            item = gwlist_get(dict->tab[i], j);
-            dict_put(dup, item->key, duplicate_value(item->value));
+    lock_all(dict);
+    dup = dict_create(dict->key_count, dict->destroy_value);
+    for (i = 0; i < dict->num_shards; ++i) {
+        shard = &dict->shards[i];
+        for (j = 0; j < shard->size; ++j) {
+            if (shard->tab[j].key != NULL)
+                dict_put(dup, shard->tab[j].key, duplicate_value(shard->tab[j].value));
         }
     }
-    unlock(dict);
+    unlock_all(dict);
 
     return dup;
 }
@@ -391,20 +513,21 @@ Dict *dict_duplicate(Dict *dict, void *(*duplicate_value)(void *))
 
 long dict_traverse(Dict *dict, void (*func)(Octstr *, void *, void *), void *data)
 {
-    Item *item;
-    long i, j, r = 0;
-
-    lock(dict);
-    for (i = 0; i < dict->size; ++i) {
-        if (dict->tab[i] == NULL)
-            continue;
-        for (j = 0; j < gwlist_len(dict->tab[i]); ++j) {
-            item = gwlist_get(dict->tab[i], j);
-            func(item->key, item->value, data);
+    Shard *shard;
+    unsigned long i, j;
+    long r = 0;
+
+    lock_all(dict);
+    for (i = 0; i < dict->num_shards; ++i) {
+        shard = &dict->shards[i];
+        for (j = 0; j < shard->size; ++j) {
+            if (shard->tab[j].key == NULL)
+                continue;
+            func(shard->tab[j].key, shard->tab[j].value, data);
             r++;
         }
     }
-    unlock(dict);
+    unlock_all(dict);
 
     return r;
 }
@@ -413,19 +536,21 @@ long dict_traverse(Dict *dict, void (*func)(Octstr *, void *, void *), void *dat
 long dict_traverse_sorted(Dict *dict, int (*cmp)(const void *, const void *),
 						  void (*func)(Octstr *, void *, void *), void *data)
 {
+    Shard *shard;
     Item *item;
-    long i, j, r = 0;
+    unsigned long i, j;
+    long r = 0;
     List *l;
 
     l = gwlist_create();
-    lock(dict);
+    lock_all(dict);
 
     /* We need to aggregate a list of all item elements first. */
-    for (i = 0; i < dict->size; ++i) {
-        if (dict->tab[i] == NULL)
-            continue;
-        for (j = 0; j < gwlist_len(dict->tab[i]); ++j) {
-            gwlist_append(l, gwlist_get(dict->tab[i], j));
+    for (i = 0; i < dict->num_shards; ++i) {
+        shard = &dict->shards[i];
+        for (j = 0; j < shard->size; ++j) {
+            if (shard->tab[j].key != NULL)
+                gwlist_append(l, &shard->tab[j]);
         }
     }
 
@@ -434,11 +559,11 @@ long dict_traverse_sorted(Dict *dict, int (*cmp)(const void *, const void *),
 
     /* And traverse the list. */
     r = gwlist_len(l);
-    while ((item = gwlist_consume(l)) != NULL) {
+    while ((item = gwlist_extract_first(l)) != NULL) {
         func(item->key, item->value, data);
     }
 
-    unlock(dict);
+    unlock_all(dict);
     gwlist_destroy(l, NULL);
 
     return r;
@@ -95,6 +95,13 @@ void dict_destroy(Dict *dict);
  */
 void dict_put(Dict *dict, Octstr *key, void *value);
 
+/*
+ * Same as dict_put(), but the Dict takes over `key' instead of storing a
+ * copy of it. The key is destroyed along with the entry, or right away
+ * if the key existed already. The caller must not use `key' afterwards.
+ */
+void dict_put_nocopy(Dict *dict, Octstr *key, void *value);
+
 /*
  * Put a new value into a Dict. Return error, if the same key existed all-
  * ready.
@@ -56,6 +56,13 @@
 
 /*
  * fdset.c - module for managing a large collection of file descriptors
+ *
+ * On systems that have it, the set is driven by epoll(7): registration
+ * changes are pushed to the kernel as they happen and only the ready
+ * descriptors are returned, so the cost of a poll round does not grow
+ * with the number of idle connections.  Elsewhere the classic poll()
+ * array is used.  Entries are indexed by fd in both cases, and idle
+ * timeouts are tracked on a timer wheel instead of scanning all entries.
  */
 
 #include "gw-config.h"
@@ -64,8 +71,41 @@
 #include <unistd.h>
 #include <errno.h>
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
 #include "gwlib/gwlib.h"
 
+/* Number of one second slots on the idle timeout wheel.  Timeouts longer
+ * than this are fine, such entries just go round the wheel more than once. */
+#define WHEEL_SIZE 256
+
+/* Maximum number of ready descriptors fetched per epoll_wait() call.
+ * Anything left over is reported again on the next round. */
+#define EPOLL_BATCH 256
+
+
+struct fdentry
+{
+    int fd;
+    int events;                 /* events we listen for, in poll() format */
+    fdset_callback_t *callback;
+    void *data;
+    time_t last;                /* time of last event or events change */
+    int deleted;                /* unregistered while the set was scanned */
+
+    /* Position on the timeout wheel; slot is -1 when not on the wheel.
+     * The next pointer is also used to chain deleted entries. */
+    int slot;
+    struct fdentry *prev;
+    struct fdentry *next;
+
+#ifndef USE_EPOLL
+    int index;                  /* position in the pollinfo array */
+#endif
+};
 
 struct FDSet
 {
@@ -78,45 +118,48 @@ struct FDSet
     /* The following fields are for use by the polling thread only.
      * No-one else may touch them.  It's not protected by any lock. */
 
-    /* Array for use with poll().  Elements 0 through size-1 are allocated.
-     * Elements 0 through entries-1 are in use. */
-    struct pollfd *pollinfo;
+    /* Entries indexed by fd.  Elements 0 through size-1 are allocated,
+     * unused ones are NULL.  entries is the number of registered fds. */
+    struct fdentry **fds;
     int size;
     int entries;
-    
-    /* Array of times when appropriate fd got any event or events bitmask changed */
-    time_t *times;
 
     /* timeout for this fdset */
     long timeout;
 
-    /* Arrays of callback and data fields.  They are kept in sync with
-     * the pollinfo array, and are basically extra fields that we couldn't
-     * put in struct pollfd because that structure is defined externally. */
-    fdset_callback_t **callbacks;
-    void **datafields;
-
-    /* The poller function loops over the table after poll() returns,
-     * and calls callback functions that may modify the table that is
-     * being scanned.  We can't just copy the table to avoid interference,
-     * because fdset_unregister and fdset_listen guarantee that their
-     * operations are complete when they return -- that does not work
-     * if poller() is scanning an outdated copy of the table.
-     * To solve this, we have a field that marks when the table is
-     * being scanned.  If this field is true, fdset_unregister merely
-     * sets the fd to -1 instead of deleting the whole entry.
-     * fdset_listen will takes care to modify revents as well as
-     * events. fdset_register always adds to the end of the table,
-     * so it does not have to do anything special.
-     */
+    /* Timeout wheel.  An entry is filed in the slot of the second its
+     * idle timeout expires.  Activity only updates the entry's last
+     * time; the entry is moved forward when its slot comes due.
+     * wheel_time is the last second that has been processed. */
+    struct fdentry *wheel[WHEEL_SIZE];
+    time_t wheel_time;
+
+    /* The poller function calls callback functions while it walks the
+     * ready events, and those callbacks may unregister any fd, including
+     * ones whose events have not been handled yet.  fdset_unregister and
+     * fdset_listen guarantee that their operations are complete when
+     * they return, so while "scanning" is true fdset_unregister only
+     * detaches the entry and marks it deleted; the poller skips deleted
+     * entries and frees them, chained on the deleted list, once the
+     * round is over.  fdset_listen needs nothing special because the
+     * poller masks the reported events with the current events field
+     * right before calling back.  New entries have no pending events,
+     * so fdset_register does not have to care either. */
     int scanning;
-
-    /* This field keeps track of how many fds were set to -1 by
-     * fdset_unregister while "scanning" is true.  That way we can
-     * efficiently check if we need to scan the table to really 
-     * delete those entries. */
-    int deleted_entries;
-
+    struct fdentry *deleted;
+
+#ifdef USE_EPOLL
+    int epfd;
+    struct epoll_event events[EPOLL_BATCH];
+#else
+    /* Array for use with poll().  Elements 0 through pollsize-1 are
+     * allocated, elements 0 through pollentries-1 are in use.  entry[i]
+     * is the fdentry of pollinfo[i]. */
+    struct pollfd *pollinfo;
+    struct fdentry **entry;
+    int pollsize;
+    int pollentries;
+#endif
     
     /* The following fields are for general use, and are of types that
      * have internal locks. */
@@ -219,6 +262,8 @@ static void submit_action_nosync(FDSet *set, struct action *action)
     gwthread_wakeup(set->poll_thread);
 }
 
+static void set_timeout(FDSet *set, long timeout);
+
 /* Do one action for this thread and confirm that it's been done by
  * appending the action to its done list.  May only be called by
  * the polling thread.  Returns 0 normally, and returns -1 if the
@@ -249,7 +294,7 @@ static int handle_action(FDSet *set, struct action *action)
         result = -1;
         break;
     case SET_TIMEOUT:
-        set->timeout = action->timeout;
+        set_timeout(set, action->timeout);
         break;
     default:
         panic(0, "fdset: handle_action got unknown action type %d.",
@@ -264,49 +309,354 @@ static int handle_action(FDSet *set, struct action *action)
     return result;
 }
 
-/* Look up the entry number in the pollinfo array for this fd.
- * Right now it's a linear search, this may have to be improved. */
-static int find_entry(FDSet *set, int fd)
+/* Look up the entry for this fd. */
+static struct fdentry *find_entry(FDSet *set, int fd)
 {
-    int i;
-
     gw_assert(set != NULL);
     gw_assert(gwthread_self() == set->poll_thread);
 
-    for (i = 0; i < set->entries; i++) {
-        if (set->pollinfo[i].fd == fd)
-            return i;
-    }
+    if (fd < 0 || fd >= set->size)
+        return NULL;
+
+    return set->fds[fd];
+}
+
+
+/*
+ * Timeout wheel.
+ */
 
-    return -1;
+static void wheel_add(FDSet *set, struct fdentry *entry, time_t expires)
+{
+    int slot = expires % WHEEL_SIZE;
+
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = set->wheel[slot];
+    if (entry->next != NULL)
+        entry->next->prev = entry;
+    set->wheel[slot] = entry;
 }
 
-static void remove_entry(FDSet *set, int entry)
+static void wheel_remove(FDSet *set, struct fdentry *entry)
 {
-    if (entry != set->entries - 1) {
-        /* We need to keep the array contiguous, so move the last element
-         * to fill in the hole. */
-        set->pollinfo[entry] = set->pollinfo[set->entries - 1];
-        set->callbacks[entry] = set->callbacks[set->entries - 1];
-        set->datafields[entry] = set->datafields[set->entries - 1];
-        set->times[entry] = set->times[set->entries - 1];
+    if (entry->slot < 0)
+        return;
+
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        set->wheel[entry->slot] = entry->next;
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+
+    entry->slot = -1;
+    entry->prev = entry->next = NULL;
+}
+
+/* Re-file all entries after the timeout changed. */
+static void set_timeout(FDSet *set, long timeout)
+{
+    struct fdentry *entry;
+    int fd;
+
+    set->timeout = timeout;
+    for (fd = 0; fd < set->size; fd++) {
+        if ((entry = set->fds[fd]) == NULL)
+            continue;
+        wheel_remove(set, entry);
+        if (set->timeout > 0)
+            wheel_add(set, entry, entry->last + set->timeout);
     }
-    set->entries--;
 }
 
-static void remove_deleted_entries(FDSet *set)
+/* Process the wheel slots up to now and call back all entries that have
+ * been idle for longer than the timeout.  Entries that are still
+ * registered afterwards are called again every second until they show
+ * activity or get unregistered.  Must be called while scanning. */
+static void check_timeouts(FDSet *set, time_t now)
 {
-    int i;
+    struct fdentry *entry, *next;
+    List *expired;
+    long n;
+    time_t t;
+
+    if (set->timeout <= 0 || now <= set->wheel_time) {
+        set->wheel_time = now;
+        return;
+    }
 
-    i = 0;
-    while (i < set->entries && set->deleted_entries > 0) {
-        if (set->pollinfo[i].fd < 0) {
-            remove_entry(set, i);
-	    set->deleted_entries--;
-	} else {
-	    i++;
+    expired = NULL;
+    n = now - set->wheel_time;
+    if (n > WHEEL_SIZE)
+        n = WHEEL_SIZE;
+    for (t = now - n + 1; t <= now; t++) {
+        entry = set->wheel[t % WHEEL_SIZE];
+        set->wheel[t % WHEEL_SIZE] = NULL;
+        for (; entry != NULL; entry = next) {
+            next = entry->next;
+            entry->slot = -1;
+            entry->prev = entry->next = NULL;
+            if (difftime(entry->last + set->timeout, now) > 0) {
+                wheel_add(set, entry, entry->last + set->timeout);
+            } else {
+                wheel_add(set, entry, now + 1);
+                if (expired == NULL)
+                    expired = gwlist_create();
+                gwlist_append(expired, entry);
+            }
         }
     }
+    set->wheel_time = now;
+
+    if (expired == NULL)
+        return;
+
+    /* Callbacks may unregister entries still waiting on this list, but
+     * they are not freed before the scan is over. */
+    while ((entry = gwlist_extract_first(expired)) != NULL) {
+        if (entry->deleted)
+            continue;
+        debug("gwlib.fdset", 0, "Timeout for fd:%d appears.", entry->fd);
+        entry->callback(entry->fd, POLLERR, entry->data);
+    }
+    gwlist_destroy(expired, NULL);
+}
+
+
+/*
+ * Polling backends.  Each one provides:
+ *
+ * backend_init    - set up the backend, return -1 on failure
+ * backend_cleanup - release what backend_init set up
+ * backend_add     - start watching a new entry, return -1 on failure
+ * backend_modify  - entry's events field changed
+ * backend_remove  - stop watching an entry.  May be called while scanning,
+ *                   in which case the entry is freed only after the scan.
+ * backend_release - called right before a removed entry is freed
+ * backend_wait    - block until events are ready or the thread is woken
+ *                   up, return the number of ready events or -1
+ * backend_dispatch - call back the ready entries reported by backend_wait
+ */
+
+#ifdef USE_EPOLL
+
+static int backend_init(FDSet *set)
+{
+    set->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (set->epfd < 0) {
+        error(errno, "fdset: epoll_create1 failed.");
+        return -1;
+    }
+    return 0;
+}
+
+static void backend_cleanup(FDSet *set)
+{
+    if (set->epfd >= 0)
+        close(set->epfd);
+}
+
+static unsigned int poll_to_epoll(int events)
+{
+    unsigned int ev = 0;
+
+    if (events & POLLIN)
+        ev |= EPOLLIN;
+    if (events & POLLPRI)
+        ev |= EPOLLPRI;
+    if (events & POLLOUT)
+        ev |= EPOLLOUT;
+    return ev;
+}
+
+static int epoll_to_poll(unsigned int ev)
+{
+    int events = 0;
+
+    if (ev & EPOLLIN)
+        events |= POLLIN;
+    if (ev & EPOLLPRI)
+        events |= POLLPRI;
+    if (ev & EPOLLOUT)
+        events |= POLLOUT;
+    if (ev & EPOLLERR)
+        events |= POLLERR;
+    if (ev & EPOLLHUP)
+        events |= POLLHUP;
+    return events;
+}
+
+static int backend_ctl(FDSet *set, int op, struct fdentry *entry)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = poll_to_epoll(entry->events);
+    ev.data.ptr = entry;
+    return epoll_ctl(set->epfd, op, entry->fd, &ev);
+}
+
+static int backend_add(FDSet *set, struct fdentry *entry)
+{
+    if (backend_ctl(set, EPOLL_CTL_ADD, entry) < 0) {
+        error(errno, "fdset: cannot add fd %d to epoll set.", entry->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void backend_modify(FDSet *set, struct fdentry *entry)
+{
+    if (backend_ctl(set, EPOLL_CTL_MOD, entry) < 0)
+        error(errno, "fdset: cannot modify fd %d in epoll set.", entry->fd);
+}
+
+static void backend_remove(FDSet *set, struct fdentry *entry)
+{
+    /* The fd may already have been closed, which removed it from the
+     * epoll set implicitly, so errors are expected here. */
+    backend_ctl(set, EPOLL_CTL_DEL, entry);
+}
+
+static void backend_release(FDSet *set, struct fdentry *entry)
+{
+}
+
+static int backend_wait(FDSet *set, double timeout)
+{
+    int ret;
+
+    /* Wait on the epoll fd itself, so that gwthread_wakeup works. */
+    ret = gwthread_pollfd(set->epfd, POLLIN, timeout);
+    if (ret <= 0)
+        return ret;
+
+    return epoll_wait(set->epfd, set->events, EPOLL_BATCH, 0);
+}
+
+static void backend_dispatch(FDSet *set, int ready, time_t now)
+{
+    struct fdentry *entry;
+    int i, revents;
+
+    for (i = 0; i < ready; i++) {
+        entry = set->events[i].data.ptr;
+        if (entry->deleted)
+            continue;
+        revents = epoll_to_poll(set->events[i].events) &
+                  (entry->events | POLLERR | POLLHUP);
+        if (revents == 0)
+            continue;
+        entry->last = now;
+        entry->callback(entry->fd, revents, entry->data);
+    }
+}
+
+#else /* !USE_EPOLL */
+
+static int backend_init(FDSet *set)
+{
+    /* Start off with space for one element because we can't malloc 0 bytes
+     * and we don't want to worry about these pointers being NULL. */
+    set->pollsize = 1;
+    set->pollentries = 0;
+    set->pollinfo = gw_malloc(sizeof(set->pollinfo[0]) * set->pollsize);
+    set->entry = gw_malloc(sizeof(set->entry[0]) * set->pollsize);
+    return 0;
+}
+
+static void backend_cleanup(FDSet *set)
+{
+    gw_free(set->pollinfo);
+    gw_free(set->entry);
+}
+
+static int backend_add(FDSet *set, struct fdentry *entry)
+{
+    int new;
+
+    if (set->pollentries >= set->pollsize) {
+        set->pollsize *= 2;
+        set->pollinfo = gw_realloc(set->pollinfo,
+                                   sizeof(set->pollinfo[0]) * set->pollsize);
+        set->entry = gw_realloc(set->entry,
+                                sizeof(set->entry[0]) * set->pollsize);
+    }
+
+    new = set->pollentries++;
+    set->pollinfo[new].fd = entry->fd;
+    set->pollinfo[new].events = entry->events;
+    set->pollinfo[new].revents = 0;
+    set->entry[new] = entry;
+    entry->index = new;
+    return 0;
+}
+
+static void backend_modify(FDSet *set, struct fdentry *entry)
+{
+    set->pollinfo[entry->index].events = entry->events;
+}
+
+static void backend_remove(FDSet *set, struct fdentry *entry)
+{
+    /* poll() ignores negative fds, the slot is reclaimed on release. */
+    set->pollinfo[entry->index].fd = -1;
+}
+
+static void backend_release(FDSet *set, struct fdentry *entry)
+{
+    int last = --set->pollentries;
+
+    /* We need to keep the array contiguous, so move the last element
+     * to fill in the hole. */
+    if (entry->index != last) {
+        set->pollinfo[entry->index] = set->pollinfo[last];
+        set->entry[entry->index] = set->entry[last];
+        set->entry[entry->index]->index = entry->index;
+    }
+}
+
+static int backend_wait(FDSet *set, double timeout)
+{
+    return gwthread_poll(set->pollinfo, set->pollentries, timeout);
+}
+
+static void backend_dispatch(FDSet *set, int ready, time_t now)
+{
+    struct fdentry *entry;
+    int i, revents;
+
+    /* Entries registered by callbacks are appended with no revents,
+     * and none are moved before the scan is over. */
+    for (i = 0; i < set->pollentries && ready > 0; i++) {
+        if (set->pollinfo[i].revents == 0)
+            continue;
+        ready--;
+        entry = set->entry[i];
+        if (entry->deleted)
+            continue;
+        revents = set->pollinfo[i].revents &
+                  (entry->events | POLLERR | POLLHUP | POLLNVAL);
+        if (revents == 0)
+            continue;
+        entry->last = now;
+        entry->callback(entry->fd, revents, entry->data);
+    }
+}
+
+#endif /* USE_EPOLL */
+
+
+static void free_deleted_entries(FDSet *set)
+{
+    struct fdentry *entry;
+
+    while ((entry = set->deleted) != NULL) {
+        set->deleted = entry->next;
+        backend_release(set, entry);
+        gw_free(entry);
+    }
 }
 
 /* Main function for polling thread.  Most its time is spent blocking
@@ -320,7 +670,6 @@ static void poller(void *arg)
     FDSet *set = arg;
     struct action *action;
     int ret;
-    int i;
     time_t now;
 
     gw_assert(set != NULL);
@@ -332,8 +681,10 @@ static void poller(void *arg)
                 return;
         }
 
-        /* Block for defined timeout, waiting for activity */
-        ret = gwthread_poll(set->pollinfo, set->entries, set->timeout);
+        /* Block waiting for activity.  With a timeout set, wake up
+         * every second so that the timeout wheel keeps turning. */
+        ret = backend_wait(set, (set->timeout > 0 && set->entries > 0) ?
+                                1.0 : -1);
 
         if (ret < 0) {
             if (errno != EINTR) {
@@ -343,24 +694,15 @@ static void poller(void *arg)
             continue;
         }
         time(&now);
-        /* Callbacks may modify the table while we scan it, so be careful. */
+        /* Callbacks may modify the set while we scan it, so be careful. */
         set->scanning = 1;
-        for (i = 0; i < set->entries; i++) {
-            if (set->pollinfo[i].revents != 0) {
-                set->callbacks[i](set->pollinfo[i].fd,
-                                set->pollinfo[i].revents,
-                                set->datafields[i]);
-                /* update event time */
-                time(&set->times[i]);
-            } else if (set->timeout > 0 && difftime(set->times[i] + set->timeout, now) <= 0) {
-                debug("gwlib.fdset", 0, "Timeout for fd:%d appears.", set->pollinfo[i].fd);
-                set->callbacks[i](set->pollinfo[i].fd, POLLERR, set->datafields[i]);
-            }
-        }
+        if (ret > 0)
+            backend_dispatch(set, ret, now);
+        check_timeouts(set, now);
         set->scanning = 0;
 
-    if (set->deleted_entries > 0)
-        remove_deleted_entries(set);
+        if (set->deleted != NULL)
+            free_deleted_entries(set);
     }
 }
 
@@ -368,23 +710,28 @@ static void poller(void *arg)
 FDSet *fdset_create_real(long timeout)
 {
     FDSet *new;
+    int i;
 
     new = gw_malloc(sizeof(*new));
 
-    /* Start off with space for one element because we can't malloc 0 bytes
-     * and we don't want to worry about these pointers being NULL. */
-    new->size = 1;
+    new->size = 0;
     new->entries = 0;
-    new->pollinfo = gw_malloc(sizeof(new->pollinfo[0]) * new->size);
-    new->callbacks = gw_malloc(sizeof(new->callbacks[0]) * new->size);
-    new->datafields = gw_malloc(sizeof(new->datafields[0]) * new->size);
-    new->times = gw_malloc(sizeof(new->times[0]) * new->size);
+    new->fds = NULL;
     new->timeout = timeout > 0 ? timeout : -1;
+    for (i = 0; i < WHEEL_SIZE; i++)
+        new->wheel[i] = NULL;
+    time(&new->wheel_time);
     new->scanning = 0;
-    new->deleted_entries = 0;
+    new->deleted = NULL;
 
     new->actions = gwlist_create();
 
+    if (backend_init(new) < 0) {
+        gwlist_destroy(new->actions, NULL);
+        gw_free(new);
+        return NULL;
+    }
+
     new->poll_thread = gwthread_create(poller, new);
     if (new->poll_thread < 0) {
         error(0, "Could not start internal thread for fdset.");
@@ -397,6 +744,8 @@ FDSet *fdset_create_real(long timeout)
 
 void fdset_destroy(FDSet *set)
 {
+    int fd;
+
     if (set == NULL)
         return;
 
@@ -405,10 +754,11 @@ void fdset_destroy(FDSet *set)
             warning(0, "Destroying fdset with %d active entries.",
                     set->entries);
         }
-        gw_free(set->pollinfo);
-        gw_free(set->callbacks);
-        gw_free(set->datafields);
-        gw_free(set->times);
+        for (fd = 0; fd < set->size; fd++)
+            gw_free(set->fds[fd]);
+        gw_free(set->fds);
+        free_deleted_entries(set);
+        backend_cleanup(set);
         if (gwlist_len(set->actions) > 0) {
             error(0, "Destroying fdset with %ld pending actions.",
                   gwlist_len(set->actions));
@@ -425,7 +775,7 @@ void fdset_destroy(FDSet *set)
 void fdset_register(FDSet *set, int fd, int events,
                     fdset_callback_t callback, void *data)
 {
-    int new;
+    struct fdentry *entry;
 
     gw_assert(set != NULL);
 
@@ -441,35 +791,50 @@ void fdset_register(FDSet *set, int fd, int events,
         return;
     }
 
-    gw_assert(set->entries <= set->size);
+    gw_assert(fd >= 0);
 
-    if (set->entries >= set->size) {
-        int newsize = set->entries + 1;
-        set->pollinfo = gw_realloc(set->pollinfo,
-                                   sizeof(set->pollinfo[0]) * newsize);
-        set->callbacks = gw_realloc(set->callbacks,
-                                   sizeof(set->callbacks[0]) * newsize);
-        set->datafields = gw_realloc(set->datafields,
-                                   sizeof(set->datafields[0]) * newsize);
-        set->times = gw_realloc(set->times, sizeof(set->times[0]) * newsize);
+    if (find_entry(set, fd) != NULL) {
+        warning(0, "fdset_register called on already registered fd %d.", fd);
+        fdset_unregister(set, fd);
+    }
+
+    if (fd >= set->size) {
+        int newsize = set->size > 0 ? set->size : 64;
+        int i;
+
+        while (newsize <= fd)
+            newsize *= 2;
+        set->fds = gw_realloc(set->fds, sizeof(set->fds[0]) * newsize);
+        for (i = set->size; i < newsize; i++)
+            set->fds[i] = NULL;
         set->size = newsize;
     }
 
-    /* We don't check set->scanning.  Adding new entries is not harmful
-     * because their revents fields are 0. */
+    entry = gw_malloc(sizeof(*entry));
+    entry->fd = fd;
+    entry->events = events;
+    entry->callback = callback;
+    entry->data = data;
+    time(&entry->last);
+    entry->deleted = 0;
+    entry->slot = -1;
+    entry->prev = entry->next = NULL;
+
+    if (backend_add(set, entry) < 0) {
+        gw_free(entry);
+        return;
+    }
 
-    new = set->entries++;
-    set->pollinfo[new].fd = fd;
-    set->pollinfo[new].events = events;
-    set->pollinfo[new].revents = 0;
-    set->callbacks[new] = callback;
-    set->datafields[new] = data;
-    time(&set->times[new]);
+    set->fds[fd] = entry;
+    set->entries++;
+    if (set->timeout > 0)
+        wheel_add(set, entry, entry->last + set->timeout);
 }
 
 void fdset_listen(FDSet *set, int fd, int mask, int events)
 {
-    int entry;
+    struct fdentry *entry;
+    int newevents;
 
     gw_assert(set != NULL);
 
@@ -485,31 +850,25 @@ void fdset_listen(FDSet *set, int fd, int mask, int events)
     }
 
     entry = find_entry(set, fd);   
-    if (entry < 0) {
+    if (entry == NULL) {
         warning(0, "fdset_listen called on unregistered fd %d.", fd);
         return;
     }
 
     /* Copy the bits from events specified by the mask, and preserve the
      * bits not specified by the mask. */
-    set->pollinfo[entry].events =
-	(set->pollinfo[entry].events & ~mask) | (events & mask);
-
-    /* If poller is currently scanning the array, then change the
-     * revents field so that the callback function will not be called
-     * for events we should no longer listen for.  The idea is the
-     * same as for the events field, except that we only turn bits off. */
-    if (set->scanning) {
-        set->pollinfo[entry].revents =
-            set->pollinfo[entry].revents & (events | ~mask);
+    newevents = (entry->events & ~mask) | (events & mask);
+    if (newevents != entry->events) {
+        entry->events = newevents;
+        backend_modify(set, entry);
     }
-    
-    time(&set->times[entry]);
+
+    time(&entry->last);
 }
 
 void fdset_unregister(FDSet *set, int fd)
 {
-    int entry;
+    struct fdentry *entry;
 
     gw_assert(set != NULL);
 
@@ -522,25 +881,26 @@ void fdset_unregister(FDSet *set, int fd)
         return;
     }
 
-    /* Remove the entry from the pollinfo array */
-
     entry = find_entry(set, fd);
-    if (entry < 0) {
-        warning(0, "fdset_listen called on unregistered fd %d.", fd);
+    if (entry == NULL) {
+        warning(0, "fdset_unregister called on unregistered fd %d.", fd);
         return;
     }
 
-    if (entry == set->entries - 1) {
-        /* It's the last entry.  We can safely remove it even while
-         * the array is being scanned, because the scan checks set->entries. */
-        set->entries--;
-    } else if (set->scanning) {
-        /* We can't remove entries because the array is being
-         * scanned.  Mark it as deleted.  */
-        set->pollinfo[entry].fd = -1;
-        set->deleted_entries++;
+    set->fds[fd] = NULL;
+    set->entries--;
+    wheel_remove(set, entry);
+    backend_remove(set, entry);
+
+    if (set->scanning) {
+        /* The poller may still hold pointers to this entry, so free
+         * it only when the scan is over. */
+        entry->deleted = 1;
+        entry->next = set->deleted;
+        set->deleted = entry;
     } else {
-        remove_entry(set, entry);
+        backend_release(set, entry);
+        gw_free(entry);
     }
 }
 
@@ -556,5 +916,5 @@ void fdset_set_timeout(FDSet *set, long timeout)
         submit_action(set, action);
         return;
     }
-    set->timeout = timeout;
+    set_timeout(set, timeout);
 }
@@ -0,0 +1,393 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-mpmcqueue.c - multi-producer/multi-consumer FIFO queue.
+ *
+ * The fast path is the bounded ring buffer described by Dmitry Vyukov:
+ * every cell carries a sequence number telling whether it is free for
+ * the producer claiming position pos (seq == pos) or holds the item for
+ * the consumer claiming position pos (seq == pos + 1). Producers and
+ * consumers claim positions with a single compare-and-swap on their own
+ * cache line and never take a lock.
+ *
+ * Items that do not fit into the ring go to a plain List (the spill).
+ * As long as the spill is non-empty producers keep appending to it and
+ * consumers only take from it once the ring is drained, which keeps the
+ * items of every producer in order.
+ *
+ * Sleeping consumers announce themselves in queue->sleepers before they
+ * check queue->len under the mutex; producers bump queue->len before
+ * they check queue->sleepers. Both sides use sequentially consistent
+ * atomics, so one of them always sees the other and no wakeup is lost.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "gwlib.h"
+
+/* keep hot counters of different parties on different cache lines */
+#define CACHE_LINE 64
+
+struct cell {
+    unsigned long seq;
+    void *item;
+};
+
+struct gw_mpmcqueue {
+    struct cell *ring;
+    unsigned long mask;
+    char pad0[CACHE_LINE];
+    unsigned long enqueue_pos;
+    char pad1[CACHE_LINE];
+    unsigned long dequeue_pos;
+    char pad2[CACHE_LINE];
+    long len;
+    long spilled;
+    long sleepers;
+    long producers;
+    char pad3[CACHE_LINE];
+    List *spill;
+    Mutex *mutex;
+    pthread_cond_t nonempty;
+};
+
+
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ADD(p, v)       __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define SUB(p, v)       __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define SEQ_LOAD(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define CAS(p, e, v)    __atomic_compare_exchange_n((p), (e), (v), 1, \
+                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+
+static int ring_push(gw_mpmcqueue_t *queue, void *item)
+{
+    struct cell *cell;
+    unsigned long pos, seq;
+    long dif;
+
+    pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &queue->ring[pos & queue->mask];
+        seq = LOAD(&cell->seq);
+        dif = (long) seq - (long) pos;
+        if (dif == 0) {
+            if (CAS(&queue->enqueue_pos, &pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            return 0; /* full */
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->item = item;
+    STORE(&cell->seq, pos + 1);
+
+    return 1;
+}
+
+
+static void *ring_pop(gw_mpmcqueue_t *queue)
+{
+    struct cell *cell;
+    unsigned long pos, seq;
+    void *item;
+    long dif;
+
+    pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &queue->ring[pos & queue->mask];
+        seq = LOAD(&cell->seq);
+        dif = (long) seq - (long) (pos + 1);
+        if (dif == 0) {
+            if (CAS(&queue->dequeue_pos, &pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            /*
+             * Either the ring is empty or a producer claimed this cell and
+             * did not fill it yet. In the latter case wait for it, items
+             * behind it must not overtake it through the spill.
+             */
+            if (LOAD(&queue->enqueue_pos) == pos)
+                return NULL;
+            sched_yield();
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    item = cell->item;
+    STORE(&cell->seq, pos + queue->mask + 1);
+
+    return item;
+}
+
+
+static void *take(gw_mpmcqueue_t *queue)
+{
+    void *item;
+
+    item = ring_pop(queue);
+    if (item == NULL && SEQ_LOAD(&queue->spilled) > 0) {
+        item = gwlist_extract_first(queue->spill);
+        if (item != NULL)
+            SUB(&queue->spilled, 1);
+    }
+    if (item != NULL)
+        SUB(&queue->len, 1);
+
+    return item;
+}
+
+
+/*
+ * Sleep until there might be an item for us, there are no producers left
+ * or abstime (if not NULL) has passed. Returns 0 on timeout.
+ */
+static int park(gw_mpmcqueue_t *queue, const struct timespec *abstime)
+{
+    int rc = 0;
+
+    ADD(&queue->sleepers, 1);
+    mutex_lock(queue->mutex);
+    while (SEQ_LOAD(&queue->len) <= 0 && SEQ_LOAD(&queue->producers) > 0) {
+        queue->mutex->owner = -1;
+        pthread_cleanup_push((void(*)(void*))pthread_mutex_unlock, &queue->mutex->mutex);
+        if (abstime != NULL)
+            rc = pthread_cond_timedwait(&queue->nonempty, &queue->mutex->mutex, abstime);
+        else
+            pthread_cond_wait(&queue->nonempty, &queue->mutex->mutex);
+        pthread_cleanup_pop(0);
+        queue->mutex->owner = gwthread_self();
+        if (rc == ETIMEDOUT)
+            break;
+    }
+    mutex_unlock(queue->mutex);
+    SUB(&queue->sleepers, 1);
+
+    return rc != ETIMEDOUT;
+}
+
+
+gw_mpmcqueue_t *gw_mpmcqueue_create(long capacity)
+{
+    gw_mpmcqueue_t *ret;
+    unsigned long size, i;
+
+    gw_assert(capacity > 0);
+
+    for (size = 2; size < (unsigned long) capacity; size <<= 1)
+        ;
+
+    ret = gw_malloc(sizeof(*ret));
+    memset(ret, 0, sizeof(*ret));
+    ret->ring = gw_malloc(sizeof(*ret->ring) * size);
+    for (i = 0; i < size; i++) {
+        ret->ring[i].seq = i;
+        ret->ring[i].item = NULL;
+    }
+    ret->mask = size - 1;
+    ret->spill = gwlist_create();
+    ret->mutex = mutex_create();
+    pthread_cond_init(&ret->nonempty, NULL);
+
+    return ret;
+}
+
+
+void gw_mpmcqueue_destroy(gw_mpmcqueue_t *queue, void(*item_destroy)(void*))
+{
+    void *item;
+
+    if (queue == NULL)
+        return;
+
+    while ((item = ring_pop(queue)) != NULL) {
+        if (item_destroy != NULL)
+            item_destroy(item);
+    }
+    gwlist_destroy(queue->spill, item_destroy);
+    mutex_destroy(queue->mutex);
+    pthread_cond_destroy(&queue->nonempty);
+    gw_free(queue->ring);
+    gw_free(queue);
+}
+
+
+long gw_mpmcqueue_len(gw_mpmcqueue_t *queue)
+{
+    long len;
+
+    if (queue == NULL)
+        return 0;
+
+    /* may be transiently negative while a producer is half way through */
+    len = SEQ_LOAD(&queue->len);
+
+    return len > 0 ? len : 0;
+}
+
+
+void gw_mpmcqueue_produce(gw_mpmcqueue_t *queue, void *item)
+{
+    gw_assert(queue != NULL);
+    gw_assert(item != NULL);
+
+    if (SEQ_LOAD(&queue->spilled) > 0 || !ring_push(queue, item)) {
+        gwlist_append(queue->spill, item);
+        ADD(&queue->spilled, 1);
+    }
+    ADD(&queue->len, 1);
+
+    if (SEQ_LOAD(&queue->sleepers) > 0) {
+        mutex_lock(queue->mutex);
+        pthread_cond_signal(&queue->nonempty);
+        mutex_unlock(queue->mutex);
+    }
+}
+
+
+void *gw_mpmcqueue_extract_first(gw_mpmcqueue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    return take(queue);
+}
+
+
+void *gw_mpmcqueue_consume(gw_mpmcqueue_t *queue)
+{
+    void *item;
+
+    gw_assert(queue != NULL);
+
+    while ((item = take(queue)) == NULL) {
+        if (SEQ_LOAD(&queue->producers) <= 0 && SEQ_LOAD(&queue->len) <= 0)
+            break;
+        park(queue, NULL);
+    }
+
+    return item;
+}
+
+
+void *gw_mpmcqueue_timed_consume(gw_mpmcqueue_t *queue, long sec)
+{
+    struct timespec abstime;
+    void *item;
+
+    gw_assert(queue != NULL);
+
+    abstime.tv_sec = time(NULL) + sec;
+    abstime.tv_nsec = 0;
+
+    while ((item = take(queue)) == NULL) {
+        if (SEQ_LOAD(&queue->producers) <= 0 && SEQ_LOAD(&queue->len) <= 0)
+            break;
+        if (!park(queue, &abstime)) {
+            item = take(queue);
+            break;
+        }
+    }
+
+    return item;
+}
+
+
+int gw_mpmcqueue_wait_until_nonempty(gw_mpmcqueue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    while (SEQ_LOAD(&queue->len) <= 0) {
+        if (SEQ_LOAD(&queue->producers) <= 0)
+            return -1;
+        park(queue, NULL);
+    }
+
+    return 1;
+}
+
+
+void gw_mpmcqueue_add_producer(gw_mpmcqueue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    ADD(&queue->producers, 1);
+}
+
+
+void gw_mpmcqueue_remove_producer(gw_mpmcqueue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    mutex_lock(queue->mutex);
+    gw_assert(SEQ_LOAD(&queue->producers) > 0);
+    SUB(&queue->producers, 1);
+    pthread_cond_broadcast(&queue->nonempty);
+    mutex_unlock(queue->mutex);
+}
+
+
+long gw_mpmcqueue_producer_count(gw_mpmcqueue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    return SEQ_LOAD(&queue->producers);
+}
@@ -0,0 +1,143 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-mpmcqueue.h - multi-producer/multi-consumer FIFO queue.
+ *
+ * Same producer/consumer semantics as the List functions gwlist_produce,
+ * gwlist_consume, gwlist_add_producer etc., but items pass through a
+ * bounded lock-free ring buffer (one compare-and-swap per operation, no
+ * mutex), so many threads can feed and drain the queue without all
+ * serializing on one lock. Consumers only take a lock when the queue is
+ * empty and they have to sleep, producers only when somebody sleeps.
+ *
+ * The queue never refuses an item: once the ring is full, further items
+ * go to a locked overflow list until consumers have caught up again.
+ * Items of one producer are always consumed in the order produced.
+ */
+
+#ifndef GW_MPMCQUEUE_H
+#define GW_MPMCQUEUE_H 1
+
+typedef struct gw_mpmcqueue gw_mpmcqueue_t;
+
+/**
+ * Create queue
+ * @capacity - size of the lock-free ring, rounded up to a power of two
+ * @return newly created queue
+ */
+gw_mpmcqueue_t *gw_mpmcqueue_create(long capacity);
+
+/**
+ * Destroy queue
+ * @queue - queue to destroy
+ * @item_destroy - item destructor, may be NULL
+ */
+void gw_mpmcqueue_destroy(gw_mpmcqueue_t *queue, void(*item_destroy)(void*));
+
+/**
+ * Return number of items in the queue
+ */
+long gw_mpmcqueue_len(gw_mpmcqueue_t *queue);
+
+/**
+ * Append item to the queue and wake up a sleeping consumer.
+ * @item - must not be NULL
+ */
+void gw_mpmcqueue_produce(gw_mpmcqueue_t *queue, void *item);
+
+/**
+ * Remove first item from the queue, but not block if producers
+ * available and no items in the queue
+ * @return first item or NULL if the queue is empty
+ */
+void *gw_mpmcqueue_extract_first(gw_mpmcqueue_t *queue);
+
+/**
+ * Remove first item from the queue, block if producers available and no
+ * items in the queue
+ * @return first item or NULL if no items and no producers in the queue
+ */
+void *gw_mpmcqueue_consume(gw_mpmcqueue_t *queue);
+
+/**
+ * Same as gw_mpmcqueue_consume, but wait at most sec seconds
+ * @return first item or NULL if nothing arrived in time
+ */
+void *gw_mpmcqueue_timed_consume(gw_mpmcqueue_t *queue, long sec);
+
+/**
+ * Block until there is an item in the queue or no producers left
+ * @return 1 if the queue is not empty; -1 otherwise
+ */
+int gw_mpmcqueue_wait_until_nonempty(gw_mpmcqueue_t *queue);
+
+/**
+ * Add producer to the queue
+ */
+void gw_mpmcqueue_add_producer(gw_mpmcqueue_t *queue);
+
+/**
+ * Remove producer from the queue, wakes all consumers if it was the last
+ */
+void gw_mpmcqueue_remove_producer(gw_mpmcqueue_t *queue);
+
+/**
+ * Return producer count for the queue
+ */
+long gw_mpmcqueue_producer_count(gw_mpmcqueue_t *queue);
+
+#endif
@@ -0,0 +1,169 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-ratelimit.c - token bucket rate limiter.
+ *
+ * The bucket holds up to burst tokens plus some slack, the tokens earned
+ * in SLACK_SECONDS but at least half a token. A caller that wakes up late,
+ * e.g. because poll() only counts milliseconds, still finds the tokens
+ * earned while oversleeping and keeps the configured rate.
+ */
+
+#include <time.h>
+
+#include "gwlib.h"
+
+#define SLACK_SECONDS 0.01
+
+struct gw_ratelimit {
+    Mutex *lock;
+    double rate;
+    double capacity;
+    double tokens;
+    double last;    /* monotonic time of the last refill */
+};
+
+
+/* must be called with the lock held */
+static void refill(gw_ratelimit_t *limit)
+{
+    double now = date_monotonic_now();
+
+    limit->tokens += (now - limit->last) * limit->rate;
+    if (limit->tokens > limit->capacity)
+        limit->tokens = limit->capacity;
+    limit->last = now;
+}
+
+
+gw_ratelimit_t *gw_ratelimit_create(double rate, double burst)
+{
+    gw_ratelimit_t *limit;
+
+    gw_assert(rate > 0);
+
+    limit = gw_malloc(sizeof(*limit));
+    limit->lock = mutex_create();
+    limit->rate = rate;
+    limit->capacity = (burst < 1 ? 1 : burst) +
+                      (rate * SLACK_SECONDS > 0.5 ? rate * SLACK_SECONDS : 0.5);
+    limit->tokens = limit->capacity;
+    limit->last = date_monotonic_now();
+
+    return limit;
+}
+
+
+void gw_ratelimit_destroy(gw_ratelimit_t *limit)
+{
+    if (limit == NULL)
+        return;
+
+    mutex_destroy(limit->lock);
+    gw_free(limit);
+}
+
+
+int gw_ratelimit_take(gw_ratelimit_t *limit)
+{
+    int ret = 0;
+
+    gw_assert(limit != NULL);
+
+    mutex_lock(limit->lock);
+    refill(limit);
+    if (limit->tokens >= 1) {
+        limit->tokens -= 1;
+        ret = 1;
+    }
+    mutex_unlock(limit->lock);
+
+    return ret;
+}
+
+
+double gw_ratelimit_delay(gw_ratelimit_t *limit)
+{
+    double delay = 0;
+
+    gw_assert(limit != NULL);
+
+    mutex_lock(limit->lock);
+    refill(limit);
+    if (limit->tokens < 1)
+        delay = (1 - limit->tokens) / limit->rate;
+    mutex_unlock(limit->lock);
+
+    return delay;
+}
+
+
+int gw_ratelimit_wait(gw_ratelimit_t *limit)
+{
+    double delay;
+
+    gw_assert(limit != NULL);
+
+    if (gw_ratelimit_take(limit))
+        return 1;
+
+    delay = gw_ratelimit_delay(limit);
+    if (delay > 0)
+        gwthread_sleep_micro(delay);
+
+    return gw_ratelimit_take(limit);
+}
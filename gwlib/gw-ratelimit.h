@@ -0,0 +1,102 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-ratelimit.h - token bucket rate limiter.
+ *
+ * Tokens accumulate at `rate' per second, measured on the monotonic
+ * clock, up to `burst' tokens. Every operation that is limited takes one
+ * token. Because the bucket keeps fractions of tokens and a little slack,
+ * the long term rate does not depend on how precisely the caller sleeps.
+ */
+
+#ifndef GW_RATELIMIT_H
+#define GW_RATELIMIT_H 1
+
+typedef struct gw_ratelimit gw_ratelimit_t;
+
+/**
+ * Create rate limiter
+ * @rate - tokens per second, must be > 0
+ * @burst - tokens that may be taken back to back, at least 1
+ * @return newly created limiter with a full bucket
+ */
+gw_ratelimit_t *gw_ratelimit_create(double rate, double burst);
+
+/**
+ * Destroy rate limiter
+ */
+void gw_ratelimit_destroy(gw_ratelimit_t *limit);
+
+/**
+ * Take one token if there is one
+ * @return 1 if a token was taken; 0 otherwise
+ */
+int gw_ratelimit_take(gw_ratelimit_t *limit);
+
+/**
+ * Return seconds until gw_ratelimit_take would succeed, 0 if it would now
+ */
+double gw_ratelimit_delay(gw_ratelimit_t *limit);
+
+/**
+ * Sleep once until a token is due and take it. The sleep may be cut
+ * short by gwthread_wakeup(). Return 1 if a token was taken, 0 if not;
+ * the caller should then check its own state and call again.
+ */
+int gw_ratelimit_wait(gw_ratelimit_t *limit);
+
+#endif
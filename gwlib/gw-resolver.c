@@ -0,0 +1,342 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-resolver.c - asynchronous host name resolver with a cache.
+ *
+ * Every host has one cache entry. While a lookup for it is running the
+ * entry is marked pending and collects the callbacks of everybody asking
+ * for the host meanwhile, so that each host is resolved only once.
+ * Expired entries are dropped once every ttl seconds, and when the cache
+ * is full, so that it does not grow with every host ever asked for.
+ *
+ * The threads use the blocking resolver of the C library, so a host
+ * whose name server does not answer occupies a thread until the library
+ * times out, and the hosts queued behind it wait if all threads are
+ * busy like that.
+ */
+
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "gwlib.h"
+
+struct host_entry {
+    List *addrs;        /* NULL if the last lookup failed */
+    time_t expires;
+    int pending;
+    List *waiters;      /* struct waiter, while pending */
+};
+
+struct waiter {
+    gw_resolver_callback_t *callback;
+    void *data;
+};
+
+struct gw_resolver {
+    Mutex *lock;
+    Dict *cache;        /* host name -> struct host_entry */
+    List *queue;        /* host names to resolve */
+    long *threads;
+    long num_threads;
+    long ttl;
+    long negative_ttl;
+    long max_entries;
+    time_t next_sweep;
+};
+
+
+static void host_entry_destroy(void *p)
+{
+    struct host_entry *entry = p;
+
+    gwlist_destroy(entry->addrs, octstr_destroy_item);
+    gwlist_destroy(entry->waiters, NULL);
+    gw_free(entry);
+}
+
+
+static List *addrs_duplicate(List *addrs)
+{
+    List *copy;
+    long i;
+
+    if (addrs == NULL)
+        return NULL;
+
+    copy = gwlist_create();
+    for (i = 0; i < gwlist_len(addrs); i++)
+        gwlist_append(copy, octstr_duplicate(gwlist_get(addrs, i)));
+
+    return copy;
+}
+
+
+static List *resolve(Octstr *host)
+{
+    struct hostent hostinfo;
+    char *buff = NULL;
+    List *addrs = NULL;
+    long i;
+
+    if (gw_gethostbyname(&hostinfo, octstr_get_cstr(host), &buff) == 0 &&
+        hostinfo.h_addrtype == AF_INET && hostinfo.h_addr_list[0] != NULL) {
+        addrs = gwlist_create();
+        for (i = 0; hostinfo.h_addr_list[i] != NULL; i++)
+            gwlist_append(addrs, gw_netaddr_to_octstr(AF_INET, hostinfo.h_addr_list[i]));
+    }
+    gw_free(buff);
+
+    return addrs;
+}
+
+
+/*
+ * Drop the expired entries. If the cache is still full, also drop the
+ * entry that expires first, so there is room for one more. Entries with
+ * a lookup running are kept. Must be called with the lock held.
+ */
+static void cache_evict(gw_resolver_t *resolver, time_t now)
+{
+    struct host_entry *entry, *first;
+    List *keys;
+    Octstr *key, *first_key;
+
+    first = NULL;
+    first_key = NULL;
+    keys = dict_keys(resolver->cache);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        entry = dict_get(resolver->cache, key);
+        if (entry->pending) {
+            octstr_destroy(key);
+        } else if (entry->expires <= now) {
+            dict_remove(resolver->cache, key);
+            host_entry_destroy(entry);
+            octstr_destroy(key);
+        } else if (first == NULL || entry->expires < first->expires) {
+            octstr_destroy(first_key);
+            first = entry;
+            first_key = key;
+        } else
+            octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+
+    if (first != NULL && dict_key_count(resolver->cache) >= resolver->max_entries) {
+        dict_remove(resolver->cache, first_key);
+        host_entry_destroy(first);
+    }
+    octstr_destroy(first_key);
+    resolver->next_sweep = now + resolver->ttl;
+}
+
+
+static void resolver_thread(void *arg)
+{
+    gw_resolver_t *resolver = arg;
+    struct host_entry *entry;
+    struct waiter *waiter;
+    Octstr *host;
+    List *addrs, *waiters;
+
+    while ((host = gwlist_consume(resolver->queue)) != NULL) {
+        addrs = resolve(host);
+        if (addrs == NULL)
+            error(0, "Resolver: Cannot resolve host <%s>.",
+                  octstr_get_cstr(host));
+        else
+            debug("gwlib.resolver", 0, "Resolved <%s> to <%s> and %ld more.",
+                  octstr_get_cstr(host), octstr_get_cstr(gwlist_get(addrs, 0)),
+                  gwlist_len(addrs) - 1);
+
+        mutex_lock(resolver->lock);
+        entry = dict_get(resolver->cache, host);
+        gw_assert(entry != NULL && entry->pending);
+        gwlist_destroy(entry->addrs, octstr_destroy_item);
+        entry->addrs = addrs;
+        entry->expires = time(NULL) +
+            (addrs != NULL ? resolver->ttl : resolver->negative_ttl);
+        entry->pending = 0;
+        waiters = entry->waiters;
+        entry->waiters = NULL;
+        /* the entry may change as soon as we unlock, keep our own copy */
+        addrs = addrs_duplicate(addrs);
+        mutex_unlock(resolver->lock);
+
+        while ((waiter = gwlist_extract_first(waiters)) != NULL) {
+            waiter->callback(host, addrs_duplicate(addrs), waiter->data);
+            gw_free(waiter);
+        }
+        gwlist_destroy(waiters, NULL);
+        gwlist_destroy(addrs, octstr_destroy_item);
+        octstr_destroy(host);
+    }
+}
+
+
+gw_resolver_t *gw_resolver_create(long threads, long ttl, long negative_ttl,
+                                  long max_entries)
+{
+    gw_resolver_t *resolver;
+    long i;
+
+    gw_assert(threads > 0 && max_entries > 0);
+
+    resolver = gw_malloc(sizeof(*resolver));
+    resolver->lock = mutex_create();
+    resolver->cache = dict_create(64, host_entry_destroy);
+    resolver->queue = gwlist_create();
+    gwlist_add_producer(resolver->queue);
+    resolver->ttl = ttl;
+    resolver->negative_ttl = negative_ttl;
+    resolver->max_entries = max_entries;
+    resolver->next_sweep = time(NULL) + ttl;
+    resolver->threads = gw_malloc(sizeof(resolver->threads[0]) * threads);
+    resolver->num_threads = 0;
+
+    for (i = 0; i < threads; i++) {
+        resolver->threads[i] = gwthread_create(resolver_thread, resolver);
+        if (resolver->threads[i] == -1) {
+            error(0, "Resolver: Could not start resolver thread.");
+            break;
+        }
+        resolver->num_threads++;
+    }
+    if (resolver->num_threads == 0) {
+        gw_resolver_destroy(resolver);
+        return NULL;
+    }
+
+    return resolver;
+}
+
+
+void gw_resolver_destroy(gw_resolver_t *resolver)
+{
+    long i;
+
+    if (resolver == NULL)
+        return;
+
+    gwlist_remove_producer(resolver->queue);
+    for (i = 0; i < resolver->num_threads; i++)
+        gwthread_join(resolver->threads[i]);
+
+    gwlist_destroy(resolver->queue, octstr_destroy_item);
+    dict_destroy(resolver->cache);
+    mutex_destroy(resolver->lock);
+    gw_free(resolver->threads);
+    gw_free(resolver);
+}
+
+
+int gw_resolver_lookup(gw_resolver_t *resolver, Octstr *host, List **addrs,
+                       gw_resolver_callback_t *callback, void *data)
+{
+    struct host_entry *entry;
+    struct waiter *waiter;
+    struct in_addr numeric;
+    time_t now;
+    int ret;
+
+    gw_assert(resolver != NULL && host != NULL && addrs != NULL);
+
+    *addrs = NULL;
+
+    if (inet_pton(AF_INET, octstr_get_cstr(host), &numeric) == 1) {
+        *addrs = gwlist_create();
+        gwlist_append(*addrs, octstr_duplicate(host));
+        return 0;
+    }
+
+    now = time(NULL);
+    mutex_lock(resolver->lock);
+    entry = dict_get(resolver->cache, host);
+    if (entry != NULL && !entry->pending && entry->expires > now) {
+        if (entry->addrs != NULL) {
+            *addrs = addrs_duplicate(entry->addrs);
+            ret = 0;
+        } else
+            ret = -1;
+        mutex_unlock(resolver->lock);
+        return ret;
+    }
+
+    if (entry == NULL) {
+        if (now >= resolver->next_sweep ||
+            dict_key_count(resolver->cache) >= resolver->max_entries)
+            cache_evict(resolver, now);
+        entry = gw_malloc(sizeof(*entry));
+        entry->addrs = NULL;
+        entry->expires = 0;
+        entry->pending = 0;
+        entry->waiters = NULL;
+        dict_put(resolver->cache, host, entry);
+    }
+    waiter = gw_malloc(sizeof(*waiter));
+    waiter->callback = callback;
+    waiter->data = data;
+    if (entry->waiters == NULL)
+        entry->waiters = gwlist_create();
+    gwlist_append(entry->waiters, waiter);
+    if (!entry->pending) {
+        entry->pending = 1;
+        gwlist_produce(resolver->queue, octstr_duplicate(host));
+    }
+    mutex_unlock(resolver->lock);
+
+    return 1;
+}
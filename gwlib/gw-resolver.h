@@ -0,0 +1,111 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-resolver.h - asynchronous host name resolver with a cache.
+ *
+ * Lookups that are not answered from the cache are handed to a small
+ * pool of resolver threads, so the caller never blocks on DNS. Results
+ * are cached for `ttl' seconds, failures for `negative_ttl' seconds, for
+ * at most `max_entries' hosts.
+ * All IPv4 addresses of a host are kept, as dotted quads that can be
+ * passed to the conn_open_* functions instead of the host name.
+ */
+
+#ifndef GW_RESOLVER_H
+#define GW_RESOLVER_H 1
+
+typedef struct gw_resolver gw_resolver_t;
+
+/*
+ * Called from a resolver thread when a pending lookup is done. `addrs' is
+ * the list of addresses, owned by the callback from now on, or NULL if the
+ * host could not be resolved. `host' may not be kept, make a copy if needed.
+ */
+typedef void gw_resolver_callback_t(Octstr *host, List *addrs, void *data);
+
+/**
+ * Create resolver
+ * @threads - number of resolver threads, at least 1
+ * @ttl - seconds a resolved address is cached
+ * @negative_ttl - seconds a failed lookup is cached
+ * @max_entries - hosts kept in the cache, at least 1; hosts that are
+ *                still being resolved may exceed it
+ * @return newly created resolver, NULL if no thread could be started
+ */
+gw_resolver_t *gw_resolver_create(long threads, long ttl, long negative_ttl,
+                                  long max_entries);
+
+/**
+ * Destroy resolver. Lookups still pending are finished first and their
+ * callbacks called.
+ */
+void gw_resolver_destroy(gw_resolver_t *resolver);
+
+/**
+ * Look up `host'. Numeric addresses and cached results are returned at
+ * once, anything else is resolved in the background.
+ * @return 0 and the list of addresses in *addrs, which the caller must
+ *         destroy with its items;
+ *         -1 if the host is known not to resolve;
+ *         1 if the lookup is pending, `callback' will be called with
+ *         `data' when it is done. The callback may be called before
+ *         this function returns.
+ */
+int gw_resolver_lookup(gw_resolver_t *resolver, Octstr *host, List **addrs,
+                       gw_resolver_callback_t *callback, void *data);
+
+#endif
@@ -0,0 +1,371 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-timerwheel.c - hierarchical timing wheel for delayed items.
+ *
+ * The wheel has LEVELS levels of SLOTS slots. A slot on level 0 holds the
+ * items due in one millisecond, a slot on level n those due in the next
+ * SLOTS^n milliseconds. Whenever the time passes the start of a slot on a
+ * higher level, its items are cascaded down to the levels below. Items
+ * due beyond the reach of the top level wait in its farthest slot and are
+ * placed again when that is cascaded.
+ *
+ * A bit mask of the occupied slots of each level lets the wheel skip idle
+ * stretches in one step, so it does not matter how seldom it is expired.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "gwlib.h"
+
+#define LEVELS 4
+#define SLOT_BITS 6
+#define SLOTS (1 << SLOT_BITS)
+#define SLOT_MASK (SLOTS - 1)
+
+/* milliseconds covered by one slot of `level' */
+#define SLOT_SPAN(level) (1LL << (SLOT_BITS * (level)))
+
+struct timer_entry {
+    struct timer_entry *next;
+    long long due;
+    void *item;
+};
+
+struct timer_slot {
+    struct timer_entry *head;
+    struct timer_entry *tail;
+};
+
+struct gw_timerwheel {
+    Mutex *lock;
+    long long now;      /* the last millisecond expired */
+    long long next;     /* earliest time anything may be due */
+    long len;
+    int closed;         /* takes no more items */
+    unsigned long long occupied[LEVELS];
+    struct timer_slot slots[LEVELS][SLOTS];
+    struct timer_slot ready;    /* due, waiting to be expired */
+};
+
+
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+
+static void slot_append(struct timer_slot *slot, struct timer_entry *entry)
+{
+    entry->next = NULL;
+    if (slot->tail != NULL)
+        slot->tail->next = entry;
+    else
+        slot->head = entry;
+    slot->tail = entry;
+}
+
+
+/* must be called with the lock held */
+static void place(gw_timerwheel_t *wheel, struct timer_entry *entry)
+{
+    long long delta = entry->due - wheel->now;
+    int level, slot;
+
+    if (delta <= 0) {
+        slot_append(&wheel->ready, entry);
+        return;
+    }
+    for (level = 0; level < LEVELS - 1 && delta >= SLOT_SPAN(level + 1); level++)
+        ;
+    if (delta >= SLOT_SPAN(LEVELS))
+        slot = ((wheel->now >> (SLOT_BITS * level)) + SLOTS - 1) & SLOT_MASK;
+    else
+        slot = (entry->due >> (SLOT_BITS * level)) & SLOT_MASK;
+    slot_append(&wheel->slots[level][slot], entry);
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+
+/* must be called with the lock held */
+static void cascade(gw_timerwheel_t *wheel, int level, int slot)
+{
+    struct timer_entry *entry, *next;
+
+    entry = wheel->slots[level][slot].head;
+    wheel->slots[level][slot].head = wheel->slots[level][slot].tail = NULL;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    for (; entry != NULL; entry = next) {
+        next = entry->next;
+        place(wheel, entry);
+    }
+}
+
+
+/*
+ * Return the next time a slot is due to be expired or cascaded, LLONG_MAX
+ * if all slots are empty. Must be called with the lock held.
+ */
+static long long next_event(gw_timerwheel_t *wheel)
+{
+    long long best = LLONG_MAX, pos, t;
+    unsigned long long bits;
+    int level, shift;
+
+    for (level = 0; level < LEVELS; level++) {
+        if (wheel->occupied[level] == 0)
+            continue;
+        /* the first occupied slot after the current one, going round */
+        pos = wheel->now >> (SLOT_BITS * level);
+        shift = (pos + 1) & SLOT_MASK;
+        bits = wheel->occupied[level];
+        if (shift != 0)
+            bits = (bits >> shift) | (bits << (SLOTS - shift));
+        t = (pos + 1 + __builtin_ctzll(bits)) << (SLOT_BITS * level);
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+
+/* Advance the wheel to the next millisecond. Must be called with the lock held. */
+static void tick(gw_timerwheel_t *wheel)
+{
+    struct timer_slot *slot;
+    int level;
+
+    wheel->now++;
+
+    /* cascade the levels whose slot starts now, top down */
+    for (level = 1; level < LEVELS && (wheel->now & (SLOT_SPAN(level) - 1)) == 0; level++)
+        ;
+    while (--level > 0)
+        cascade(wheel, level, (wheel->now >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    slot = &wheel->slots[0][wheel->now & SLOT_MASK];
+    if (slot->head != NULL) {
+        if (wheel->ready.tail != NULL)
+            wheel->ready.tail->next = slot->head;
+        else
+            wheel->ready.head = slot->head;
+        wheel->ready.tail = slot->tail;
+        slot->head = slot->tail = NULL;
+        wheel->occupied[0] &= ~(1ULL << (wheel->now & SLOT_MASK));
+    }
+}
+
+
+/* Move all entries of `slot' to `items'. */
+static void slot_drain(struct timer_slot *slot, List *items)
+{
+    struct timer_entry *entry, *next;
+
+    for (entry = slot->head; entry != NULL; entry = next) {
+        next = entry->next;
+        gwlist_append(items, entry->item);
+        gw_free(entry);
+    }
+    slot->head = slot->tail = NULL;
+}
+
+
+gw_timerwheel_t *gw_timerwheel_create(void)
+{
+    gw_timerwheel_t *wheel;
+
+    wheel = gw_malloc(sizeof(*wheel));
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->lock = mutex_create();
+    wheel->now = monotonic_ms();
+    wheel->next = LLONG_MAX;
+
+    return wheel;
+}
+
+
+void gw_timerwheel_destroy(gw_timerwheel_t *wheel, void (*item_destroy)(void *))
+{
+    List *items;
+
+    if (wheel == NULL)
+        return;
+
+    items = gwlist_create();
+    gw_timerwheel_drain(wheel, items);
+    gwlist_destroy(items, item_destroy);
+    mutex_destroy(wheel->lock);
+    gw_free(wheel);
+}
+
+
+long gw_timerwheel_len(gw_timerwheel_t *wheel)
+{
+    long len;
+
+    gw_assert(wheel != NULL);
+
+    mutex_lock(wheel->lock);
+    len = wheel->len;
+    mutex_unlock(wheel->lock);
+
+    return len;
+}
+
+
+int gw_timerwheel_add(gw_timerwheel_t *wheel, void *item, long delay)
+{
+    struct timer_entry *entry;
+    int earliest = 0;
+
+    gw_assert(wheel != NULL);
+
+    entry = gw_malloc(sizeof(*entry));
+    entry->item = item;
+    entry->due = monotonic_ms() + (delay > 0 ? delay : 0);
+
+    mutex_lock(wheel->lock);
+    if (wheel->closed) {
+        mutex_unlock(wheel->lock);
+        gw_free(entry);
+        return -1;
+    }
+    place(wheel, entry);
+    wheel->len++;
+    if (entry->due < wheel->next) {
+        wheel->next = entry->due;
+        earliest = 1;
+    }
+    mutex_unlock(wheel->lock);
+
+    return earliest;
+}
+
+
+long gw_timerwheel_expire(gw_timerwheel_t *wheel, List *due)
+{
+    struct timer_entry *entry, *next;
+    long long target, event;
+    long wait;
+
+    gw_assert(wheel != NULL);
+
+    target = monotonic_ms();
+    mutex_lock(wheel->lock);
+    while (wheel->now < target) {
+        if ((event = next_event(wheel)) > target) {
+            wheel->now = target;
+            break;
+        }
+        wheel->now = event - 1;
+        tick(wheel);
+    }
+
+    for (entry = wheel->ready.head; entry != NULL; entry = next) {
+        next = entry->next;
+        gwlist_append(due, entry->item);
+        gw_free(entry);
+        wheel->len--;
+    }
+    wheel->ready.head = wheel->ready.tail = NULL;
+
+    if (wheel->len == 0) {
+        wheel->next = LLONG_MAX;
+        wait = -1;
+    } else {
+        wheel->next = next_event(wheel);
+        wait = wheel->next - wheel->now;
+    }
+    mutex_unlock(wheel->lock);
+
+    return wait;
+}
+
+
+void gw_timerwheel_drain(gw_timerwheel_t *wheel, List *items)
+{
+    int level, slot;
+
+    gw_assert(wheel != NULL);
+
+    mutex_lock(wheel->lock);
+    slot_drain(&wheel->ready, items);
+    for (level = 0; level < LEVELS; level++) {
+        for (slot = 0; slot < SLOTS; slot++)
+            slot_drain(&wheel->slots[level][slot], items);
+        wheel->occupied[level] = 0;
+    }
+    wheel->len = 0;
+    wheel->next = LLONG_MAX;
+    mutex_unlock(wheel->lock);
+}
+
+
+void gw_timerwheel_close(gw_timerwheel_t *wheel, List *items)
+{
+    gw_assert(wheel != NULL);
+
+    mutex_lock(wheel->lock);
+    wheel->closed = 1;
+    mutex_unlock(wheel->lock);
+    gw_timerwheel_drain(wheel, items);
+}
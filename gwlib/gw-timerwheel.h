@@ -0,0 +1,113 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-timerwheel.h - hierarchical timing wheel for delayed items.
+ *
+ * Holds items until a delay in milliseconds, measured on the monotonic
+ * clock, has passed. Adding an item and expiring it take constant time
+ * however many items are waiting, so the wheel suits large numbers of
+ * short lived timeouts, e.g. messages waiting to be retried.
+ */
+
+#ifndef GW_TIMERWHEEL_H
+#define GW_TIMERWHEEL_H 1
+
+typedef struct gw_timerwheel gw_timerwheel_t;
+
+/**
+ * Create timing wheel
+ * @return newly created, empty wheel
+ */
+gw_timerwheel_t *gw_timerwheel_create(void);
+
+/**
+ * Destroy timing wheel
+ * @item_destroy - destructor for the items still waiting, may be NULL
+ */
+void gw_timerwheel_destroy(gw_timerwheel_t *wheel, void (*item_destroy)(void *));
+
+/**
+ * Return the number of items waiting in the wheel
+ */
+long gw_timerwheel_len(gw_timerwheel_t *wheel);
+
+/**
+ * Add item to become due after delay milliseconds
+ * @return 1 if it is due before every other item, and so a thread
+ *         waiting for the wheel needs to be woken up; 0 otherwise;
+ *         -1 if the wheel has been closed, the item stays with the caller
+ */
+int gw_timerwheel_add(gw_timerwheel_t *wheel, void *item, long delay);
+
+/**
+ * Append the items that are due to list due, in the order they became due
+ * @return milliseconds until more items may be due, -1 if the wheel is empty
+ */
+long gw_timerwheel_expire(gw_timerwheel_t *wheel, List *due);
+
+/**
+ * Append all items to list items, due or not, and empty the wheel
+ */
+void gw_timerwheel_drain(gw_timerwheel_t *wheel, List *items);
+
+/**
+ * Drain the wheel for good, e.g. when nobody will expire it any more.
+ * Adding items afterwards fails.
+ */
+void gw_timerwheel_close(gw_timerwheel_t *wheel, List *items);
+
+#endif
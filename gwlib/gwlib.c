@@ -86,6 +86,7 @@ void gwlib_init(void)
     log_init();
     http_init();
     socket_init();
+    conn_init();
     charset_init();
     cfg_init();
     init = 1;
@@ -96,6 +97,7 @@ void gwlib_shutdown(void)
     gwlib_assert_init();
     charset_shutdown();
     http_shutdown();
+    conn_shutdown();
     socket_shutdown();
     gwthread_shutdown();
     octstr_shutdown();
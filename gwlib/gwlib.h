@@ -102,6 +102,10 @@
 #include "gw_uuid.h"
 #include "gw-rwlock.h"
 #include "gw-prioqueue.h"
+#include "gw-mpmcqueue.h"
+#include "gw-ratelimit.h"
+#include "gw-timerwheel.h"
+#include "gw-resolver.h"
 #include "gw-dlopen.h"
 #include "json.h"
 
@@ -90,6 +90,18 @@
 /* define http client connections timeout in seconds (set to -1 for disable) */
 static int http_client_timeout = 30;
 
+/* default number of http client write_request threads and fdsets */
+#define HTTP_CLIENT_THREADS 1
+
+/* default max connections per destination, 0 for no limit */
+#define HTTP_CLIENT_MAX_CONNECTIONS 0
+
+/* default resolver threads, cache lifetimes in seconds and size for client hosts */
+#define HTTP_RESOLVER_THREADS 4
+#define HTTP_RESOLVER_TTL 300
+#define HTTP_RESOLVER_NEGATIVE_TTL 10
+#define HTTP_RESOLVER_MAX_HOSTS 1024
+
 /* define http server connections timeout in seconds (set to -1 for disable) */
 #define HTTP_SERVER_TIMEOUT 60
 /* max accepted clients */
@@ -641,10 +653,26 @@ static volatile sig_atomic_t client_threads_are_running = 0;
 
 
 /*
- * Set of all connections to all servers. Used with conn_register to
- * do I/O on several connections with a single thread.
+ * Sets of all connections to all servers. Used with conn_register to
+ * do I/O on several connections with a single thread. There is one set
+ * and one write_request_thread per configured client thread, and a
+ * connection always lives in the set picked by its file descriptor.
+ */
+static long http_client_threads = HTTP_CLIENT_THREADS;
+static long http_resolver_threads = HTTP_RESOLVER_THREADS;
+static FDSet **client_fdsets = NULL;
+
+/*
+ * Host names are resolved in the background, so that a slow name server
+ * does not hold up the requests to all the other hosts.
  */
-static FDSet *client_fdset = NULL;
+static gw_resolver_t *client_resolver = NULL;
+
+
+static inline FDSet *client_fdset(Connection *conn)
+{
+    return client_fdsets[conn_get_id(conn) % http_client_threads];
+}
 
 /*
  * Maximum number of HTTP redirections to follow. Making this infinite
@@ -685,6 +713,10 @@ typedef struct {
     Connection *conn;
     Octstr *host;
     long port;
+    List *addrs;            /* resolved addresses of host or proxy */
+    long next_addr;         /* index of the next address to connect to */
+    int resolve_failed;
+    Octstr *pool_key;       /* destination we hold a connection slot of */
     int follow_remaining;
     Octstr *certkeyfile;
     int ssl;
@@ -718,6 +750,10 @@ static HTTPServer *server_create(HTTPCaller *caller, int method, Octstr *url,
     trans->conn = NULL;
     trans->host = NULL;
     trans->port = 0;
+    trans->addrs = NULL;
+    trans->next_addr = 0;
+    trans->resolve_failed = 0;
+    trans->pool_key = NULL;
     trans->username = NULL;
     trans->password = NULL;
     trans->follow_remaining = follow_remaining;
@@ -739,6 +775,8 @@ static void server_destroy(void *p)
     octstr_destroy(trans->request_body);
     entity_destroy(trans->response);
     octstr_destroy(trans->host);
+    gwlist_destroy(trans->addrs, octstr_destroy_item);
+    octstr_destroy(trans->pool_key);
     octstr_destroy(trans->certkeyfile);
     octstr_destroy(trans->username);
     octstr_destroy(trans->password);
@@ -747,22 +785,40 @@ static void server_destroy(void *p)
 
 
 /*
- * Pool of open, but unused connections to servers or proxies. Key is
- * "servername:port", value is List with Connection objects.
+ * Pool of connections to servers or proxies. Key is
+ * "servername:port:ssl:certfile:interface", value is ConnPoolEntry with
+ * the open, but unused connections to that destination. A transaction
+ * holds a slot of its destination from taking or opening a connection
+ * until it gives the connection back, so that the number of connections
+ * per destination can be limited. Transactions that find no free slot
+ * wait in the entry until another one gives its connection back.
  */
+typedef struct {
+    List *idle;         /* Connection, open but unused */
+    List *waiting;      /* HTTPServer, waiting for a slot */
+    long active;        /* slots held by transactions */
+} ConnPoolEntry;
+
 static Dict *conn_pool;
 static Mutex *conn_pool_lock;
+static long http_client_max_connections = HTTP_CLIENT_MAX_CONNECTIONS;
+static HTTPClientPoolStatus conn_pool_counters;
 
 
 static void conn_pool_item_destroy(void *item)
 {
-    gwlist_destroy(item, (void(*)(void*))conn_destroy);
+    ConnPoolEntry *entry = item;
+
+    gwlist_destroy(entry->idle, (void(*)(void*))conn_destroy);
+    gwlist_destroy(entry->waiting, server_destroy);
+    gw_free(entry);
 }
 
 static void conn_pool_init(void)
 {
     conn_pool = dict_create(1024, conn_pool_item_destroy);
     conn_pool_lock = mutex_create();
+    memset(&conn_pool_counters, 0, sizeof(conn_pool_counters));
 }
 
 
@@ -780,62 +836,107 @@ static inline Octstr *conn_pool_key(Octstr *host, int port, int ssl, Octstr *cer
 }
 
 
-static Connection *conn_pool_get(Octstr *host, int port, int ssl, Octstr *certkeyfile,
-		Octstr *our_host)
+/* Must be called with conn_pool_lock held. */
+static ConnPoolEntry *conn_pool_entry(Octstr *key)
 {
-    Octstr *key;
-    List *list = NULL;
-    Connection *conn = NULL;
-    int retry;
+    ConnPoolEntry *entry;
 
-    do {
-        retry = 0;
-        key = conn_pool_key(host, port, ssl, certkeyfile, our_host);
-        mutex_lock(conn_pool_lock);
-        list = dict_get(conn_pool, key);
-        if (list != NULL)
-            conn = gwlist_extract_first(list);
+    entry = dict_get(conn_pool, key);
+    if (entry == NULL) {
+        entry = gw_malloc(sizeof(*entry));
+        entry->idle = gwlist_create();
+        entry->waiting = gwlist_create();
+        entry->active = 0;
+        dict_put(conn_pool, key, entry);
+    }
+    return entry;
+}
+
+
+/*
+ * Take a slot of destination `key' for the transaction. Return 0 with
+ * trans->conn set to a pooled connection, or to NULL if a new connection
+ * has to be opened. Return 1 if the destination has no free slot; the
+ * transaction then waits in the pool and is put back into
+ * pending_requests by conn_pool_release() of another transaction.
+ */
+static int conn_pool_get(HTTPServer *trans, Octstr *key)
+{
+    ConnPoolEntry *entry;
+    Connection *conn;
+
+    mutex_lock(conn_pool_lock);
+    entry = conn_pool_entry(key);
+    if (gwlist_len(entry->idle) == 0 && http_client_max_connections > 0 &&
+        entry->active >= http_client_max_connections) {
+        gwlist_append(entry->waiting, trans);
+        conn_pool_counters.waits++;
+        mutex_unlock(conn_pool_lock);
+        debug("gwlib.http", 0, "HTTP: All %ld connections to <%s> busy, waiting.",
+              http_client_max_connections, octstr_get_cstr(key));
+        return 1;
+    }
+    entry->active++;
+    trans->pool_key = octstr_duplicate(key);
+
+    while ((conn = gwlist_extract_first(entry->idle)) != NULL) {
         mutex_unlock(conn_pool_lock);
         /*
          * Note: we don't hold conn_pool_lock when we check/destroy/unregister
          *       connection because otherwise we can deadlock! And it's even better
          *       not to delay other threads while we check connection.
          */
-        if (conn != NULL) {
 #ifdef USE_KEEPALIVE
-            /* unregister our server disconnect callback */
-            conn_unregister(conn);
+        /* unregister our server disconnect callback */
+        conn_unregister(conn);
 #endif 
-            /*
-             * Check whether the server has closed the connection while
-             * it has been in the pool.
-             */
-            conn_wait(conn, 0);
-            if (conn_eof(conn) || conn_error(conn)) {
-                debug("gwlib.http", 0, "HTTP:conn_pool_get: Server closed connection, destroying it <%s><%p><fd:%d>.",
-                      octstr_get_cstr(key), conn, conn_get_id(conn));
-                conn_destroy(conn);
-                retry = 1;
-                conn = NULL;
-            }
+        /*
+         * Check whether the server has closed the connection while
+         * it has been in the pool.
+         */
+        conn_wait(conn, 0);
+        if (!conn_eof(conn) && !conn_error(conn)) {
+            mutex_lock(conn_pool_lock);
+            break;
         }
-        octstr_destroy(key);
-    } while(retry == 1);
-    
-    if (conn == NULL) {
+        debug("gwlib.http", 0, "HTTP:conn_pool_get: Server closed connection, destroying it <%s><%p><fd:%d>.",
+              octstr_get_cstr(key), conn, conn_get_id(conn));
+        conn_destroy(conn);
+        mutex_lock(conn_pool_lock);
+    }
+    if (conn != NULL)
+        conn_pool_counters.hits++;
+    else
+        conn_pool_counters.misses++;
+    mutex_unlock(conn_pool_lock);
+
+    if (conn != NULL)
+        debug("gwlib.http", 0, "HTTP: Reusing connection to <%s> (fd=%d).",
+              octstr_get_cstr(key), conn_get_id(conn)); 
+    trans->conn = conn;
+
+    return 0;
+}
+
+
+/*
+ * Open a new connection to `host', which has been resolved to `addr'.
+ * The connection is put into the pool under `host' later on.
+ */
+static Connection *conn_pool_open(Octstr *addr, Octstr *host, int port, int ssl,
+                                  Octstr *certkeyfile, Octstr *our_host)
+{
+    Connection *conn;
+
 #ifdef HAVE_LIBSSL
-        if (ssl) 
-            conn = conn_open_ssl_nb(host, port, certkeyfile, our_host);
-        else
+    if (ssl) 
+        conn = conn_open_ssl_nb(addr, port, certkeyfile, our_host);
+    else
 #endif /* HAVE_LIBSSL */
-            conn = conn_open_tcp_nb(host, port, our_host);
-        debug("gwlib.http", 0, "HTTP: Opening connection to `%s:%d' (fd=%d).",
-              octstr_get_cstr(host), port, conn_get_id(conn));
-    } else {
-        debug("gwlib.http", 0, "HTTP: Reusing connection to `%s:%d' (fd=%d).",
-              octstr_get_cstr(host), port, conn_get_id(conn)); 
-    }
-    
+        conn = conn_open_tcp_nb(addr, port, our_host);
+    debug("gwlib.http", 0, "HTTP: Opening connection to `%s:%d' (%s, fd=%d).",
+          octstr_get_cstr(host), port, octstr_get_cstr(addr), conn_get_id(conn));
+
     return conn;
 }
 
@@ -850,10 +951,10 @@ static void check_pool_conn(Connection *conn, void *data)
     }
     /* check if connection still ok */
     if (conn_error(conn) || conn_eof(conn)) {
-        List *list;
+        ConnPoolEntry *entry;
         mutex_lock(conn_pool_lock);
-        list = dict_get(conn_pool, key);
-        if (list != NULL && gwlist_delete_equal(list, conn) > 0) {
+        entry = dict_get(conn_pool, key);
+        if (entry != NULL && gwlist_delete_equal(entry->idle, conn) > 0) {
             /*
              * ok, connection was still within pool. So it's
              * safe to destroy this connection.
@@ -872,26 +973,76 @@ static void check_pool_conn(Connection *conn, void *data)
         mutex_unlock(conn_pool_lock);
     }
 }
+#endif
 
 
-static void conn_pool_put(Connection *conn, Octstr *host, int port, int ssl, Octstr *certfile, Octstr *our_host)
+/*
+ * Give back the slot of the transaction. If `reuse' is set, trans->conn
+ * is kept in the pool, otherwise it is destroyed. The first transaction
+ * waiting for a slot of the same destination goes back to the queue.
+ */
+static void conn_pool_release(HTTPServer *trans, int reuse)
 {
-    Octstr *key;
-    List *list;
+    ConnPoolEntry *entry;
+    HTTPServer *waiter;
+    Connection *conn;
+
+    conn = trans->conn;
+    trans->conn = NULL;
+#ifndef USE_KEEPALIVE
+    reuse = 0;
+#endif
+    if (conn != NULL && !reuse) {
+        conn_destroy(conn);
+        conn = NULL;
+    }
+    if (trans->pool_key == NULL) {
+        gw_assert(conn == NULL);
+        return;
+    }
 
-    key = conn_pool_key(host, port, ssl, certfile, our_host);
     mutex_lock(conn_pool_lock);
-    list = dict_get(conn_pool, key);
-    if (list == NULL) {
-    	list = gwlist_create();
-        dict_put(conn_pool, key, list);
-    }
-    gwlist_append(list, conn);
-    /* register connection to get server disconnect */
-    conn_register_real(conn, client_fdset, check_pool_conn, key, octstr_destroy_item);
+    entry = dict_get(conn_pool, trans->pool_key);
+    gw_assert(entry != NULL && entry->active > 0);
+    entry->active--;
+#ifdef USE_KEEPALIVE
+    if (conn != NULL) {
+        gwlist_append(entry->idle, conn);
+        /* register connection to get server disconnect */
+        conn_register_real(conn, client_fdset(conn), check_pool_conn,
+                           octstr_duplicate(trans->pool_key), octstr_destroy_item);
+    }
+#endif
+    waiter = gwlist_extract_first(entry->waiting);
     mutex_unlock(conn_pool_lock);
+
+    octstr_destroy(trans->pool_key);
+    trans->pool_key = NULL;
+    if (waiter != NULL)
+        gwlist_insert(pending_requests, 0, waiter);
+}
+
+
+void http_client_pool_status(HTTPClientPoolStatus *status)
+{
+    List *keys;
+    ConnPoolEntry *entry;
+    long i;
+
+    keys = dict_keys(conn_pool);
+    mutex_lock(conn_pool_lock);
+    *status = conn_pool_counters;
+    status->open = status->waiting = 0;
+    for (i = 0; i < gwlist_len(keys); i++) {
+        entry = dict_get(conn_pool, gwlist_get(keys, i));
+        if (entry == NULL)
+            continue;
+        status->open += entry->active + gwlist_len(entry->idle);
+        status->waiting += gwlist_len(entry->waiting);
+    }
+    mutex_unlock(conn_pool_lock);
+    gwlist_destroy(keys, octstr_destroy_item);
 }
-#endif
 
 
 HTTPCaller *http_caller_create(void)
@@ -1057,7 +1208,15 @@ static void handle_transaction(Connection *conn, void *data)
             debug("gwlib.http", 0, "Get info about connecting socket");
             if (conn_get_connect_result(trans->conn) != 0) {
                 debug("gwlib.http", 0, "Socket not connected");
-                goto error;
+                if (trans->next_addr >= gwlist_len(trans->addrs))
+                    goto error;
+                /* try the next address, the connection slot is kept */
+                conn_unregister(trans->conn);
+                conn_destroy(trans->conn);
+                trans->conn = NULL;
+                trans->state = request_not_sent;
+                gwlist_insert(pending_requests, 0, trans);
+                return;
             }
 
             if ((rc = send_request(trans)) == 0) {
@@ -1146,17 +1305,7 @@ static void handle_transaction(Connection *conn, void *data)
         octstr_destroy(h);
     }
 
-#ifdef USE_KEEPALIVE 
-    if (trans->persistent) {
-        if (proxy_used_for_host(trans->host, trans->url))
-            conn_pool_put(trans->conn, proxy_hostname, proxy_port, trans->ssl, trans->certkeyfile, http_interface);
-        else 
-            conn_pool_put(trans->conn, trans->host, trans->port, trans->ssl, trans->certkeyfile, http_interface);
-    } else
-#endif
-        conn_destroy(trans->conn);
-
-    trans->conn = NULL;
+    conn_pool_release(trans, trans->persistent);
 
     /* 
      * Check if the HTTP server told us to look somewhere else,
@@ -1202,6 +1351,10 @@ static void handle_transaction(Connection *conn, void *data)
         octstr_destroy(trans->password);
         trans->host = NULL;
         trans->port = 0;
+        gwlist_destroy(trans->addrs, octstr_destroy_item);
+        trans->addrs = NULL;
+        trans->next_addr = 0;
+        trans->resolve_failed = 0;
         trans->uri = NULL;
         trans->username = NULL;
         trans->password = NULL;
@@ -1212,8 +1365,6 @@ static void handle_transaction(Connection *conn, void *data)
         entity_destroy(trans->response);
         trans->response = NULL;
         --trans->follow_remaining;
-        conn_destroy(trans->conn);
-        trans->conn = NULL;
 
         /* re-inject request to the front of the queue */
         gwlist_insert(pending_requests, 0, trans);
@@ -1225,11 +1376,9 @@ static void handle_transaction(Connection *conn, void *data)
     return;
 
 error:
-    if (trans->conn != NULL) {
+    if (trans->conn != NULL)
         conn_unregister(trans->conn);
-        conn_destroy(trans->conn);
-        trans->conn = NULL;
-    }
+    conn_pool_release(trans, 0);
     error(0, "Couldn't fetch <%s>", octstr_get_cstr(trans->url));
     trans->status = -1;
     gwlist_produce(trans->caller, trans);
@@ -1564,12 +1713,33 @@ static void parse2trans(HTTPURLParse *p, HTTPServer *t)
               && !t->ssl) ? 1 : 0;
 }
 
-static Connection *get_connection(HTTPServer *trans) 
+/*
+ * Called by the resolver once the host of a parked transaction has been
+ * looked up. Put the transaction back to the front of the queue.
+ */
+static void host_resolved(Octstr *host, List *addrs, void *data)
 {
-    Connection *conn = NULL;
-    Octstr *host;
+    HTTPServer *trans = data;
+
+    trans->addrs = addrs;
+    trans->next_addr = 0;
+    trans->resolve_failed = (addrs == NULL);
+    gwlist_insert(pending_requests, 0, trans);
+}
+
+
+/*
+ * Find the connection for the transaction, either from the pool or by
+ * opening a new one. Return 0 with trans->conn set, -1 on error, or 1 if
+ * the transaction has been parked: either all connections to the
+ * destination are busy, or the host is being resolved. It is then owned
+ * by the pool or the resolver until it is put back into pending_requests.
+ */
+static int get_connection(HTTPServer *trans) 
+{
+    Octstr *host, *key;
     HTTPURLParse *p;
-    int port, ssl;
+    int port, ssl, rc;
     
     /* if the parsing has not yet been done, then do it now */
     if (!trans->host && trans->port == 0 && trans->url != NULL) {
@@ -1591,17 +1761,43 @@ static Connection *get_connection(HTTPServer *trans)
         ssl = trans->ssl;
     }
 
-    conn = conn_pool_get(host, port, ssl, trans->certkeyfile,
-                         http_interface);
-    if (conn == NULL)
+    /* a transaction coming back from the resolver holds its slot already */
+    if (trans->pool_key == NULL) {
+        key = conn_pool_key(host, port, ssl, trans->certkeyfile, http_interface);
+        rc = conn_pool_get(trans, key);
+        octstr_destroy(key);
+        if (rc == 1 || trans->conn != NULL)
+            return rc;
+    }
+
+    if (trans->addrs == NULL) {
+        if (trans->resolve_failed)
+            goto error;
+        switch (gw_resolver_lookup(client_resolver, host, &trans->addrs,
+                                   host_resolved, trans)) {
+            case 1:
+                debug("gwlib.http", 0, "HTTP: Resolving host `%s'.",
+                      octstr_get_cstr(host));
+                return 1;
+            case -1:
+                goto error;
+        }
+    }
+
+    /* try the addresses of the host in turn until one can be opened */
+    while (trans->conn == NULL && trans->next_addr < gwlist_len(trans->addrs))
+        trans->conn = conn_pool_open(gwlist_get(trans->addrs, trans->next_addr++),
+                                     host, port, ssl, trans->certkeyfile,
+                                     http_interface);
+    if (trans->conn == NULL)
         goto error;
 
-    return conn;
+    return 0;
 
 error:
-    conn_destroy(conn);
+    conn_pool_release(trans, 0);
     error(0, "Couldn't send request to <%s>", octstr_get_cstr(trans->url));
-    return NULL;
+    return -1;
 }
 
 
@@ -1665,8 +1861,7 @@ static int send_request(HTTPServer *trans)
     return 0;
 
 error:
-    conn_destroy(trans->conn);
-    trans->conn = NULL;
+    conn_pool_release(trans, 0);
     octstr_destroy(request);
     error(0, "Couldn't send request to <%s>", octstr_get_cstr(trans->url));
     return -1;
@@ -1696,7 +1891,8 @@ static void write_request_thread(void *arg)
          * get the connection to use
          * also calls parse_url() to populate the trans values
          */
-        trans->conn = get_connection(trans);
+        if (get_connection(trans) == 1)
+            continue;
 
         if (trans->conn == NULL)
             gwlist_produce(trans->caller, trans);
@@ -1705,8 +1901,8 @@ static void write_request_thread(void *arg)
 
             if ((rc = send_request(trans)) == 0) {
                 trans->state = reading_status;
-                conn_register(trans->conn, client_fdset, handle_transaction, 
-                                trans);
+                conn_register(trans->conn, client_fdset(trans->conn),
+                              handle_transaction, trans);
             } else {
                 gwlist_produce(trans->caller, trans);
             }
@@ -1714,14 +1910,30 @@ static void write_request_thread(void *arg)
         } else { /* Socket not connected, wait for connection */
             debug("gwlib.http", 0, "Socket connecting");
             trans->state = connecting;
-            conn_register(trans->conn, client_fdset, handle_transaction, trans);
+            conn_register(trans->conn, client_fdset(trans->conn),
+                          handle_transaction, trans);
         }
     }
 }
 
 
+static void client_fdsets_destroy(void)
+{
+    long i;
+
+    if (client_fdsets == NULL)
+        return;
+    for (i = 0; i < http_client_threads; i++)
+        fdset_destroy(client_fdsets[i]);
+    gw_free(client_fdsets);
+    client_fdsets = NULL;
+}
+
+
 static void start_client_threads(void)
 {
+    long i;
+
     if (!client_threads_are_running) {
 	/* 
 	 * To be really certain, we must repeat the test, but use the
@@ -1731,10 +1943,23 @@ static void start_client_threads(void)
 	 */
 	mutex_lock(client_thread_lock);
 	if (!client_threads_are_running) {
-	    client_fdset = fdset_create_real(http_client_timeout);
-	    if (gwthread_create(write_request_thread, NULL) == -1) {
-                error(0, "HTTP: Could not start client write_request thread.");
-                fdset_destroy(client_fdset);
+	    client_resolver = gw_resolver_create(http_resolver_threads,
+	                                         HTTP_RESOLVER_TTL,
+	                                         HTTP_RESOLVER_NEGATIVE_TTL,
+	                                         HTTP_RESOLVER_MAX_HOSTS);
+	    client_fdsets = gw_malloc(sizeof(client_fdsets[0]) * http_client_threads);
+	    for (i = 0; i < http_client_threads; i++)
+	        client_fdsets[i] = fdset_create_real(http_client_timeout);
+	    for (i = 0; client_resolver != NULL && i < http_client_threads; i++) {
+	        if (gwthread_create(write_request_thread, NULL) == -1) {
+                    error(0, "HTTP: Could not start client write_request thread.");
+                    break;
+                }
+            }
+	    if (i == 0) {
+                gw_resolver_destroy(client_resolver);
+                client_resolver = NULL;
+                client_fdsets_destroy();
                 client_threads_are_running = 0;
             } else
                 client_threads_are_running = 1;
@@ -1750,11 +1975,47 @@ void http_set_interface(const Octstr *our_host)
 
 void http_set_client_timeout(long timeout)
 {
+    long i;
+
     http_client_timeout = timeout;
-    if (client_fdset != NULL) {
-        /* we are already initialized set timeout in fdset */
-        fdset_set_timeout(client_fdset, http_client_timeout);
+    if (client_fdsets != NULL) {
+        /* we are already initialized set timeout in fdsets */
+        for (i = 0; i < http_client_threads; i++)
+            fdset_set_timeout(client_fdsets[i], http_client_timeout);
+    }
+}
+
+void http_set_client_max_connections(long max)
+{
+    http_client_max_connections = (max > 0 ? max : 0);
+}
+
+void http_set_client_threads(long threads)
+{
+    if (threads < 1) {
+        warning(0, "HTTP: Invalid number of client threads %ld, ignored.", threads);
+        return;
     }
+    mutex_lock(client_thread_lock);
+    if (client_threads_are_running)
+        warning(0, "HTTP: Client threads already running, cannot change their number.");
+    else
+        http_client_threads = threads;
+    mutex_unlock(client_thread_lock);
+}
+
+void http_set_resolver_threads(long threads)
+{
+    if (threads < 1) {
+        warning(0, "HTTP: Invalid number of resolver threads %ld, ignored.", threads);
+        return;
+    }
+    mutex_lock(client_thread_lock);
+    if (client_threads_are_running)
+        warning(0, "HTTP: Client threads already running, cannot change the number of resolver threads.");
+    else
+        http_resolver_threads = threads;
+    mutex_unlock(client_thread_lock);
 }
 
 void http_start_request(HTTPCaller *caller, int method, Octstr *url, List *headers,
@@ -1849,11 +2110,13 @@ static void client_shutdown(void)
 {
     gwlist_remove_producer(pending_requests);
     gwthread_join_every(write_request_thread);
+    /* requests still being resolved go back into pending_requests */
+    gw_resolver_destroy(client_resolver);
+    client_resolver = NULL;
     client_threads_are_running = 0;
     gwlist_destroy(pending_requests, server_destroy);
     mutex_destroy(client_thread_lock);
-    fdset_destroy(client_fdset);
-    client_fdset = NULL;
+    client_fdsets_destroy();
     octstr_destroy(http_interface);
     http_interface = NULL;
 }
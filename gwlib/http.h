@@ -313,6 +313,40 @@ void http_set_interface(const Octstr *our_host);
  */
 void http_set_client_timeout(long timeout);
 
+/**
+ * Define the number of threads that open connections and send requests.
+ * Each of them gets its own set of connections to poll. Has to be called
+ * before the first request is started, default is 1.
+ */
+void http_set_client_threads(long threads);
+
+/**
+ * Define the number of threads that resolve the host names of requests.
+ * Has to be called before the first request is started, default is 4.
+ */
+void http_set_resolver_threads(long threads);
+
+/**
+ * Limit the number of connections to a single destination (host, port
+ * and SSL settings, or the proxy). Requests beyond the limit wait until
+ * a connection to the destination is free. 0 means no limit, which is
+ * the default.
+ */
+void http_set_client_max_connections(long max);
+
+/*
+ * Connection pool counters of the HTTP client, for monitoring.
+ */
+typedef struct {
+    long hits;              /* requests that reused a pooled connection */
+    long misses;            /* requests that opened a new connection */
+    long waits;             /* requests that had to wait for a connection */
+    long open;              /* connections currently open */
+    long waiting;           /* requests currently waiting */
+} HTTPClientPoolStatus;
+
+void http_client_pool_status(HTTPClientPoolStatus *status);
+
 /*
  * Functions for doing a GET request. The difference is that _real follows
  * redirections, plain http_get does not. Return value is the status
@@ -66,6 +66,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -114,6 +115,12 @@
  * always work.
  *
  * `immutable' defines whether the octet string is immutable or not.
+ * Immutables created by octstr_lit() are OCTSTR_LITERAL; struct
+ * OctstrLiteral in octstr.h must match this layout.
+ *
+ * `inline_data' is allocated together with the struct when the string is
+ * created short, so that it takes a single allocation. `data' points to
+ * it until the string grows out of it.
  */
 struct Octstr
 {
@@ -121,17 +128,29 @@ struct Octstr
     long len;
     long size;
     int immutable;
+    unsigned char inline_data[];
 };
 
+/*
+ * Strings created with up to OCTSTR_INLINE_MAX octets (including the
+ * terminating NUL) are stored inline, with room for at least
+ * OCTSTR_INLINE_MIN octets. That covers MSISDNs, smsc-ids and the like.
+ */
+#define OCTSTR_INLINE_MIN 24
+#define OCTSTR_INLINE_MAX 64
+
+#define octstr_is_inline(ostr) ((ostr)->data == (ostr)->inline_data)
+
 
 /**********************************************************************
- * Hash table of immutable octet strings.
+ * Hash table of immutable octet strings. Slots are filled once with a
+ * compare-and-swap and never change afterwards until octstr_shutdown,
+ * so lookups need no lock.
  */
 
 #define MAX_IMMUTABLES 1024
 
 static Octstr *immutables[MAX_IMMUTABLES];
-static Mutex immutables_mutex;
 static int immutables_init = 0;
 
 static char is_safe[UCHAR_MAX + 1];
@@ -177,9 +196,21 @@ static void seems_valid_real(const Octstr *ostr, const char *filename, long line
  */
 
 
+/* Replace the data area of 'ostr' with 'data' of 'size' octets */
+static void octstr_set_data(Octstr *ostr, unsigned char *data, long size)
+{
+    if (!octstr_is_inline(ostr))
+        gw_free(ostr->data);
+    ostr->data = data;
+    ostr->size = size;
+}
+
+
 /* Reserve space for at least 'size' octets */
 static void octstr_grow(Octstr *ostr, long size)
 {
+    unsigned char *data;
+
     gw_assert(!ostr->immutable);
     seems_valid(ostr);
     gw_assert(size >= 0);
@@ -189,12 +220,46 @@ static void octstr_grow(Octstr *ostr, long size)
     if (size > ostr->size) {
         /* always reallocate in 1kB chunks */
         size += 1024 - (size % 1024);
-        ostr->data = gw_realloc(ostr->data, size);
+        if (octstr_is_inline(ostr)) {
+            data = gw_malloc(size);
+            memcpy(data, ostr->data, ostr->len + 1);
+            ostr->data = data;
+        } else
+            ostr->data = gw_realloc(ostr->data, size);
         ostr->size = size;
     }
 }
 
 
+/*
+ * Allocate an octet string of 'len' octets, inline if it is short.
+ * The contents are left to the caller, apart from the terminating NUL.
+ */
+static Octstr *octstr_alloc(long len, const char *file, long line,
+                            const char *func)
+{
+    Octstr *ostr;
+    long size;
+
+    size = len + 1;
+    if (size <= OCTSTR_INLINE_MAX) {
+        if (size < OCTSTR_INLINE_MIN)
+            size = OCTSTR_INLINE_MIN;
+        ostr = gw_malloc_trace(sizeof(*ostr) + size, file, line, func);
+        ostr->data = ostr->inline_data;
+    } else {
+        ostr = gw_malloc_trace(sizeof(*ostr), file, line, func);
+        ostr->data = gw_malloc_trace(size, file, line, func);
+    }
+    ostr->len = len;
+    ostr->size = size;
+    ostr->data[len] = '\0';
+    ostr->immutable = 0;
+
+    return ostr;
+}
+
+
 /*
  * Fill is_safe table. is_safe[c] means that c can be left as such when
  * url-encoded.
@@ -218,7 +283,9 @@ static void urlcode_init(void)
 void octstr_init(void)
 {
     urlcode_init();
-    mutex_init_static(&immutables_mutex);
+    gw_assert(sizeof(struct OctstrLiteral) <= sizeof(struct Octstr) &&
+              offsetof(struct Octstr, immutable) ==
+              offsetof(struct OctstrLiteral, immutable));
     immutables_init = 1;
 }
 
@@ -231,12 +298,12 @@ void octstr_shutdown(void)
     for (i = 0; i < MAX_IMMUTABLES; ++i) {
         if (immutables[i] != NULL) {
 	    gw_free(immutables[i]);
+	    immutables[i] = NULL;
             ++n;
         }
     }
     if(n>0)
         debug("gwlib.octstr", 0, "Immutable octet strings: %ld.", n);
-    mutex_destroy(&immutables_mutex);
 }
 
 
@@ -262,19 +329,9 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
     if (len < 0 || (data == NULL && len != 0))
         return NULL;
 
-    ostr = gw_malloc_trace(sizeof(*ostr), file, line, func);
-    if (len == 0) {
-        ostr->len = 0;
-        ostr->size = 0;
-        ostr->data = NULL;
-    } else {
-        ostr->len = len;
-        ostr->size = len + 1;
-        ostr->data = gw_malloc_trace(ostr->size, file, line, func);
+    ostr = octstr_alloc(len, file, line, func);
+    if (len > 0)
         memcpy(ostr->data, data, len);
-        ostr->data[len] = '\0';
-    }
-    ostr->immutable = 0;
     seems_valid(ostr);
     return ostr;
 }
@@ -282,7 +339,7 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
 
 Octstr *octstr_imm(const char *cstr)
 {
-    Octstr *os;
+    Octstr *os, *new = NULL;
     long i, index;
     unsigned char *data;
 
@@ -292,30 +349,35 @@ Octstr *octstr_imm(const char *cstr)
     index = CSTR_TO_LONG(cstr) % MAX_IMMUTABLES;
     data = (unsigned char *) cstr;
 
-    mutex_lock(&immutables_mutex);
     i = index;
     for (; ; ) {
-	if (immutables[i] == NULL || immutables[i]->data == data)
+        os = __atomic_load_n(&immutables[i], __ATOMIC_ACQUIRE);
+        if (os == NULL) {
+            if (new == NULL) {
+                /*
+                 * Can't use octstr_create() because it copies the string,
+                 * which would break our hashing.
+                 */
+                new = gw_malloc(sizeof(*new));
+                new->data = data;
+                new->len = strlen(cstr);
+                new->size = new->len + 1;
+                new->immutable = 1;
+                seems_valid(new);
+            }
+            if (__atomic_compare_exchange_n(&immutables[i], &os, new, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+                return new;
+            /* lost the race for this slot, `os' is the winner's string */
+        }
+        if (os->data == data)
             break;
         i = (i + 1) % MAX_IMMUTABLES;
         if (i == index)
             panic(0, "Too many immutable strings.");
     }
-    os = immutables[i];
-    if (os == NULL) {
-	/*
-	 * Can't use octstr_create() because it copies the string,
-	 * which would break our hashing.
-	 */
-	os = gw_malloc(sizeof(*os));
-        os->data = data;
-        os->len = strlen(data);
-        os->size = os->len + 1;
-        os->immutable = 1;
-	immutables[i] = os;
-	seems_valid(os);
-    }
-    mutex_unlock(&immutables_mutex);
+    if (new != NULL)
+        gw_free(new);
 
     return os;
 }
@@ -326,7 +388,8 @@ void octstr_destroy(Octstr *ostr)
     if (ostr != NULL) {
         seems_valid(ostr);
 	if (!ostr->immutable) {
-            gw_free(ostr->data);
+            if (!octstr_is_inline(ostr))
+                gw_free(ostr->data);
             gw_free(ostr);
         }
     }
@@ -387,10 +450,7 @@ Octstr *octstr_cat(Octstr *ostr1, Octstr *ostr2)
     seems_valid(ostr1);
     seems_valid(ostr2);
 
-    ostr = octstr_create("");
-    ostr->len = ostr1->len + ostr2->len;
-    ostr->size = ostr->len + 1;
-    ostr->data = gw_malloc(ostr->size);
+    ostr = octstr_alloc(ostr1->len + ostr2->len, __FILE__, __LINE__, __func__);
 
     if (ostr1->len > 0)
         memcpy(ostr->data, ostr1->data, ostr1->len);
@@ -1733,9 +1793,7 @@ void octstr_url_encode(Octstr *ostr)
     
     /* we made replace in place */
     if (n) {
-        gw_free(ostr->data);
-        ostr->data = res;
-        ostr->size = len;
+        octstr_set_data(ostr, res, len);
         ostr->len = len - 1;
     }
 
@@ -1790,9 +1848,7 @@ void octstr_shell_escape(Octstr *ostr)
     *str2++ = '\'';  /* Closing quote */
     *str2 = '\0';
 
-    gw_free(ostr->data);
-    ostr->data = res;
-    ostr->size = len;
+    octstr_set_data(ostr, res, len);
     ostr->len = len - 1;
 
     seems_valid(ostr);
@@ -2604,8 +2660,9 @@ static void seems_valid_real(const Octstr *ostr, const char *filename, long line
     gw_assert(immutables_init);
     gw_assert_place(ostr != NULL,
                     filename, lineno, function);
-    gw_assert_allocated(ostr,
-                        filename, lineno, function);
+    if (ostr->immutable != OCTSTR_LITERAL)
+        gw_assert_allocated(ostr,
+                            filename, lineno, function);
     gw_assert_place(ostr->len >= 0,
                     filename, lineno, function);
     gw_assert_place(ostr->size >= 0,
@@ -2620,7 +2677,7 @@ static void seems_valid_real(const Octstr *ostr, const char *filename, long line
                         filename, lineno, function);
         gw_assert_place(ostr->data != NULL,
                         filename, lineno, function);
-	if (!ostr->immutable)
+	if (!ostr->immutable && !octstr_is_inline(ostr))
             gw_assert_allocated(ostr->data,
                                 filename, lineno, function);
         gw_assert_place(ostr->data[ostr->len] == '\0',
@@ -147,6 +147,30 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
 Octstr *octstr_imm(const char *cstr);
 
 
+/*
+ * Layout of struct Octstr, for octstr_lit() only. `immutable' is
+ * OCTSTR_LITERAL for octet strings that are not allocated at all.
+ */
+#define OCTSTR_LITERAL 2
+
+struct OctstrLiteral {
+    unsigned char *data;
+    long len;
+    long size;
+    int immutable;
+};
+
+/*
+ * Same as octstr_imm(), but for string literals only, and the octet
+ * string is built by the compiler instead of looked up at run time.
+ * Use it in hot paths, e.g. octstr_compare(os, octstr_lit("foo")).
+ */
+#define octstr_lit(lit) \
+    ({ static struct OctstrLiteral octstr_lit_ = \
+         { (unsigned char *) "" lit, sizeof(lit) - 1, sizeof(lit), OCTSTR_LITERAL }; \
+       (Octstr *) &octstr_lit_; })
+
+
 /*
  * Destroy an octet string, freeing all memory it uses. A NULL argument
  * is ignored.
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+# Drive bearerbox with one dead and ten live fake SMSCs to see how fast
+# live traffic is rerouted while messages for the dead one are parked.
+#
+# 10% of the messages are routed only to the dead SMSC, the others to
+# any of the live ones, each sending 100 msg/s. Once all messages are
+# submitted, one live fakesmsc is killed, and its queued messages are
+# failed back to bearerbox. The time until the remaining live links
+# have sent all live traffic is reported.
+#
+# Run it from the top of the build tree, set BEARERBOX to compare
+# another binary. Needs curl to read the status page.
+#
+# usage: test/drive_route_groups.sh [messages]
+
+messages=${1:-10000}
+bearerbox=${BEARERBOX:-gw/bearerbox}
+conf=drive_route_groups.conf
+live="23011 23012 23013 23014 23015 23016 23017 23018 23019 23020"
+
+cleanup() {
+    kill $bbpid $fakepids 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+cat > $conf <<CONF
+group = core
+admin-port = 23000
+admin-password = bar
+smsbox-port = 23001
+box-allow-ip = 127.0.0.1
+sms-incoming-queue-limit = -1
+
+group = smsbox
+bearerbox-host = 127.0.0.1
+
+group = smsc
+smsc = fake
+smsc-id = dead
+port = 23030
+connect-allow-ip = 127.0.0.1
+allowed-prefix = "+3584000000"
+CONF
+for port in $live
+do
+    cat >> $conf <<CONF
+
+group = smsc
+smsc = fake
+smsc-id = live
+port = $port
+connect-allow-ip = 127.0.0.1
+denied-prefix = "+3584000000"
+throughput = 100
+CONF
+done
+
+$bearerbox -v 2 $conf > drive_route_groups_bb.log 2>&1 &
+bbpid=$!
+sleep 1
+if ! kill -0 $bbpid 2>/dev/null
+then
+    echo "$bearerbox did not start, see drive_route_groups_bb.log" 1>&2
+    exit 1
+fi
+
+fakepids=
+dropped=
+for port in $live
+do
+    test/fakesmsc -H 127.0.0.1 -r $port -i 0 -m 0 -v 2 '1 2 text x' \
+        > drive_route_groups_$port.log 2>&1 &
+    fakepids="$fakepids $!"
+    dropped=${dropped:-$!}
+done
+sleep 2
+
+# receivers +35840000000 to +35840000999, the first 100 go to the dead one
+test/test_boxc -v 1 -p 23001 -n $messages 2>&1 | grep acked
+sleep 2
+
+sent() {
+    curl -s "http://127.0.0.1:23000/status.txt?password=bar" |
+        sed -n 's/.*SMS: received [0-9]* ([0-9]* queued), sent \([0-9]*\).*/\1/p'
+}
+
+clock() {
+    awk '{ print $1 }' /proc/uptime
+}
+
+echo "sent $(sent) messages before the link dropped"
+start=$(clock)
+kill -9 $dropped
+want=$((messages * 9 / 10 - 10))
+while :
+do
+    now=$(sent)
+    elapsed=$(awk "BEGIN { print $(clock) - $start }")
+    [ "${now:-0}" -ge $want ] && break
+    [ $(awk "BEGIN { print ($elapsed > 120) }") = 1 ] && break
+    sleep 0.05
+done
+echo "$bearerbox: sent ${now:-0} of $want live messages $elapsed s after the link dropped"
+
+rm -f $conf drive_route_groups_*.log
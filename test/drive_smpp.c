@@ -69,6 +69,7 @@
 #include "gwlib/gwlib.h"
 #include "gw/smsc/smpp_pdu.h"
 #include "gw/msg.h"
+#include "gw/dlr.h"
 
 
 static int quitting = 0;
@@ -89,6 +90,8 @@ static time_t last_from_esme = (time_t) -1;
 static time_t first_from_bb = (time_t) -1;
 static time_t last_to_bb = (time_t) -1;
 static long enquire_interval = 1; /* Measured in messages, not time. */
+static int with_receipts = 0;
+static Counter *num_receipts_to_bb;
 
 
 static void quit(void)
@@ -165,6 +168,24 @@ static SMPP_PDU *handle_submit_sm(ESME *esme, SMPP_PDU *pdu)
     time(&last_from_esme);
 
     resp = smpp_pdu_create(submit_sm_resp, pdu->u.submit_sm.sequence_number);
+    resp->u.submit_sm_resp.message_id = octstr_format("%lu", id);
+    if (with_receipts) {
+        Octstr *os;
+
+        /* the response first, then its delivery receipt right away */
+        os = smpp_pdu_pack(NULL, resp);
+        conn_write(esme->conn, os);
+        octstr_destroy(os);
+        smpp_pdu_destroy(resp);
+
+        resp = smpp_pdu_create(deliver_sm, counter_increase(message_id_counter));
+        resp->u.deliver_sm.source_addr = octstr_duplicate(pdu->u.submit_sm.destination_addr);
+        resp->u.deliver_sm.destination_addr = octstr_duplicate(pdu->u.submit_sm.source_addr);
+        resp->u.deliver_sm.esm_class = 0x04;
+        resp->u.deliver_sm.short_message = octstr_format(
+            "id:%lu sub:001 dlvrd:001 submit date:2601010000 done date:2601010000 "
+            "stat:DELIVRD err:000 text:", id);
+    }
     return resp;
 }
 
@@ -358,6 +379,10 @@ static void smsbox_thread(void *arg)
     msg->sms.sender = octstr_create("123");
     msg->sms.receiver = octstr_create("456");
     msg->sms.msgdata = octstr_create("hello world");
+    if (with_receipts) {
+        msg->sms.dlr_mask = DLR_SUCCESS | DLR_FAIL;
+        msg->sms.dlr_url = octstr_create("drive_smpp");
+    }
     reply_msg = msg_pack(msg);
     msg_destroy(msg);
 
@@ -370,6 +395,14 @@ static void smsbox_thread(void *arg)
 	    panic(0, "Couldn't connect to bearerbox as smsbox");
     }
 
+    /* bearerbox routes nothing to us before we identify */
+    msg = msg_create(admin);
+    msg->admin.command = cmd_identify;
+    os = msg_pack(msg);
+    conn_write_withlen(conn, os);
+    octstr_destroy(os);
+    msg_destroy(msg);
+
     while (!quitting && conn_wait(conn, -1.0) != -1) {
     	for (;;) {
 	    os = conn_read_withlen(conn);
@@ -384,6 +417,24 @@ static void smsbox_thread(void *arg)
 		error(0, "Bearerbox sent garbage to smsbox");
 
 	    if (msg->type == sms) {
+		/* ack it like smsbox does, bearerbox holds back the rest otherwise */
+		Msg *mack = msg_create(ack);
+		Octstr *ack_os;
+
+		mack->ack.nack = ack_success;
+		mack->ack.time = msg->sms.time;
+		uuid_copy(mack->ack.id, msg->sms.id);
+		ack_os = msg_pack(mack);
+		conn_write_withlen(conn, ack_os);
+		octstr_destroy(ack_os);
+		msg_destroy(mack);
+	    }
+
+	    if (msg->type == sms && msg->sms.sms_type == report_mo) {
+		count = counter_increase(num_receipts_to_bb) + 1;
+		if (count == max_to_esme)
+		    info(0, "Bearerbox has sent all delivery reports to smsbox.");
+	    } else if (msg->type == sms) {
 		if (first_from_bb == (time_t) -1)
 		    time(&first_from_bb);
 		count = counter_increase(num_from_bearerbox) + 1;
@@ -448,7 +499,8 @@ static void handler(int signal)
 
 static void help(void)
 {
-    info(0, "drive_smpp [-h] [-v level][-l logfile][-p port][-m msgs][-c config]");
+    info(0, "drive_smpp [-h] [-v level][-l logfile][-p port][-m msgs][-c config][-d]");
+    info(0, "-d asks for and sends a delivery report of every message");
 }
 
 
@@ -480,9 +532,10 @@ int main(int argc, char **argv)
     num_from_esme = counter_create();
     num_to_bearerbox = counter_create();
     num_from_bearerbox = counter_create();
+    num_receipts_to_bb = counter_create();
     log_file = config_file = NULL;
 
-    while ((opt = getopt(argc, argv, "hv:p:m:l:c:")) != EOF) {
+    while ((opt = getopt(argc, argv, "hv:p:m:l:c:d")) != EOF) {
 	switch (opt) {
 	case 'v':
 	    log_set_output_level(atoi(optarg));
@@ -508,6 +561,10 @@ int main(int argc, char **argv)
         config_file = optarg;
         break;
 
+    case 'd':
+        with_receipts = 1;
+        break;
+
 	case '?':
 	default:
 	    error(0, "Invalid option %c", opt);
@@ -546,6 +603,9 @@ int main(int argc, char **argv)
     	 counter_value(num_to_bearerbox));
     info(0, "Number of messages sent to SMSC: %ld",
     	 counter_value(num_from_esme));
+    if (with_receipts)
+        info(0, "Number of delivery reports sent to smsbox: %ld",
+             counter_value(num_receipts_to_bb));
     info(0, "Time: %.0f secs", run_time);
     info(0, "Time until all sent to ESME: %.0f secs", 
     	 difftime(last_to_esme, start_time));
@@ -565,6 +625,7 @@ int main(int argc, char **argv)
     counter_destroy(num_from_esme);
     counter_destroy(num_to_bearerbox);
     counter_destroy(num_from_bearerbox);
+    counter_destroy(num_receipts_to_bb);
     counter_destroy(message_id_counter);
 
     gwlib_shutdown();
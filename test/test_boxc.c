@@ -57,9 +57,16 @@
 /*
  * test_boxc.c - test boxc connection module of bearerbox
  *
+ * With -n count, send that many MT messages over one connection and
+ * wait for their acks, reporting the rate and the write system calls
+ * per message of this box and, with -P, of the bearerbox. -b and -d
+ * turn on write batching like bearerbox-batch-size/-delay, -l spreads
+ * the messages over several links like bearerbox-links.
+ *
  * Stipe Tolj <stolj@wapme.de>
  */
              
+
 #include "gwlib/gwlib.h"
 #include "gw/msg.h"
 #include "gw/shared.h"
@@ -76,12 +83,125 @@ static void help(void)
     info(0, "    port for smsbox connections on bearerbox host (default: 13001)");
     info(0, "-c number");
     info(0, "    numer of sequential connections that are made and closed (default: 1)");
+    info(0, "-n number");
+    info(0, "    send this many MT messages and wait for their acks");
+    info(0, "-b number");
+    info(0, "    batch writes to bearerbox up to this many octets (default: 0, off)");
+    info(0, "-d number");
+    info(0, "    send a batch at the latest after this many ms (default: 1)");
+    info(0, "-l number");
+    info(0, "    number of parallel links to bearerbox (default: 1)");
+    info(0, "-P pid");
+    info(0, "    also report the write system calls of this bearerbox process");
 }
 
 /* global variables */
 static unsigned long port = 13001;
 static  unsigned int no_conn = 1;
 static Octstr *host;
+static long no_msgs = 0;
+static long batch_size = 0;
+static long batch_delay = 1;
+static long bb_pid = 0;
+static long no_links = 1;
+
+static volatile long acks;
+
+
+/* number of write system calls of a process so far, or -1 */
+static long write_calls(long pid)
+{
+    Octstr *name, *io;
+    long pos, calls = -1;
+
+    if (pid == 0)
+        name = octstr_create("/proc/self/io");
+    else
+        name = octstr_format("/proc/%ld/io", pid);
+    io = octstr_read_file(octstr_get_cstr(name));
+    if (io != NULL && (pos = octstr_search(io, octstr_imm("syscw: "), 0)) >= 0)
+        octstr_parse_long(&calls, io, pos + 7, 10);
+    octstr_destroy(io);
+    octstr_destroy(name);
+    return calls;
+}
+
+
+static void read_acks(void *arg)
+{
+    long link = (long) arg;
+    double idle = 0;
+    Msg *msg;
+    int ret;
+
+    while (acks < no_msgs) {
+        ret = read_from_bearerbox_link(link, &msg, 0.5);
+        if (ret == 1) {
+            /* the other links may still be busy */
+            if ((idle += 0.5) >= 10.0) {
+                error(0, "No ack for 10 seconds, %ld of %ld received.", acks, no_msgs);
+                break;
+            }
+            continue;
+        } else if (ret == -1)
+            break;
+        idle = 0;
+        if (msg_type(msg) == ack)
+            __atomic_add_fetch(&acks, 1, __ATOMIC_RELAXED);
+        msg_destroy(msg);
+    }
+}
+
+
+static void run_messages(void)
+{
+    Msg *msg;
+    long i, writes, bb_writes;
+    double start, elapsed;
+
+    connect_to_bearerbox_links(host, port, 0, NULL, no_links);
+
+    for (i = 0; i < no_links; i++) {
+        msg = msg_create(admin);
+        msg->admin.command = cmd_identify;
+        msg->admin.boxc_id = octstr_create("test-smsbox");
+        write_to_bearerbox_link(i, msg);
+    }
+
+    /* bearerbox accepts one box connection per second */
+    if (no_links > 1)
+        gwthread_sleep(no_links);
+
+    acks = 0;
+    for (i = 0; i < no_links; i++)
+        gwthread_create(read_acks, (void *) i);
+
+    writes = write_calls(0);
+    bb_writes = write_calls(bb_pid);
+    start = date_monotonic_now();
+    for (i = 0; i < no_msgs; i++) {
+        msg = msg_create(sms);
+        msg->sms.sms_type = mt_push;
+        msg->sms.sender = octstr_create("12345");
+        msg->sms.receiver = octstr_format("+35840%07ld", i % 1000);
+        msg->sms.msgdata = octstr_format("message %ld", i);
+        msg->sms.time = time(NULL);
+        uuid_generate(msg->sms.id);
+        write_to_bearerbox(msg);
+    }
+    gwthread_join_every(read_acks);
+    elapsed = date_monotonic_now() - start;
+    writes = write_calls(0) - writes;
+
+    info(0, "%ld of %ld messages acked over %ld link(s) in %.2f s, %.0f msg/s",
+         acks, no_msgs, no_links, elapsed, acks / elapsed);
+    info(0, "box: %.2f write calls per message", (double) writes / no_msgs);
+    if (bb_pid > 0)
+        info(0, "bearerbox: %.2f write calls per message",
+             (double) (write_calls(bb_pid) - bb_writes) / no_msgs);
+
+    close_connection_to_bearerbox();
+}
 
 static void run_connects(void)
 {
@@ -114,7 +234,7 @@ int main(int argc, char **argv)
 
     host = octstr_create("localhost");
 
-    while ((opt = getopt(argc, argv, "v:h:p:c:")) != EOF) {
+    while ((opt = getopt(argc, argv, "v:h:p:c:n:b:d:l:P:")) != EOF) {
         switch (opt) {
             case 'v':
                 log_set_output_level(atoi(optarg));
@@ -133,6 +253,26 @@ int main(int argc, char **argv)
                 no_conn = atoi(optarg);
                 break;
 
+            case 'n':
+                no_msgs = atol(optarg);
+                break;
+
+            case 'b':
+                batch_size = atol(optarg);
+                break;
+
+            case 'd':
+                batch_delay = atol(optarg);
+                break;
+
+            case 'l':
+                no_links = atol(optarg);
+                break;
+
+            case 'P':
+                bb_pid = atol(optarg);
+                break;
+
             case '?':
             default:
                 error(0, "Invalid option %c", opt);
@@ -146,7 +286,11 @@ int main(int argc, char **argv)
         exit(0);
     }
 
-    run_connects();
+    set_bearerbox_batching(batch_size, batch_delay / 1000.0);
+    if (no_msgs > 0)
+        run_messages();
+    else
+        run_connects();
 
     octstr_destroy(host);
 
@@ -218,7 +218,6 @@ static void oracle_client_thread(void *arg)
 #endif
 
 #ifdef HAVE_SQLITE3
-#include <sqlite3.h>
 
 static DBConf *sqlite3_create_conf(Octstr *db)
 {
@@ -227,26 +226,16 @@ static DBConf *sqlite3_create_conf(Octstr *db)
     conf->sqlite3 = gw_malloc(sizeof(SQLite3Conf));
 
     conf->sqlite3->file = octstr_duplicate(db);
+    conf->sqlite3->lock_timeout = 0;
 
     return conf;
 }
 
-static int callback3(void *not_used, int argc, char **argv, char **col_name)
-{
-    int i;
-    
-    for (i = 0; i < argc; i++) {
-        debug("",0,"SQLite3: result: %s = %s", col_name[i], argv[i]);
-    }
-
-    return 0;
-}
-
 static void sqlite3_client_thread(void *arg)
 {
     unsigned long i, succeeded, failed;
     DBPool *pool = arg;
-    char *errmsg = 0;
+    List *result;
 
     succeeded = failed = 0;
 
@@ -255,19 +244,21 @@ static void sqlite3_client_thread(void *arg)
     /* perform random queries on the pool */
     for (i = 1; i <= queries; i++) {
         DBPoolConn *pconn;
-        int state;
 
         /* provide us with a connection from the pool */
         pconn = dbpool_conn_consume(pool);
         debug("",0,"Query %ld/%ld: sqlite conn obj at %p",
               i, queries, (void*) pconn->conn);
 
-        state = sqlite3_exec(pconn->conn, octstr_get_cstr(sql), callback3, 0, &errmsg);
-        if (state != SQLITE_OK) {
-            error(0, "SQLite3: %s", errmsg);
-            failed++;
-        } else {
+        /* the same sql every time, so it is prepared once per connection */
+        if (dbpool_conn_select(pconn, sql, NULL, &result) == 0) {
+            List *row;
+            while ((row = gwlist_extract_first(result)) != NULL)
+                gwlist_destroy(row, octstr_destroy_item);
+            gwlist_destroy(result, NULL);
             succeeded++;
+        } else {
+            failed++;
         }
 
         /* return the connection to the pool */
@@ -356,10 +347,12 @@ int main(int argc, char **argv)
     DBPool *pool;
     DBConf *conf = NULL; /* for compiler please */
     unsigned int num_threads = 1;
+    long threads[MAX_THREADS];
     unsigned long i;
     int opt;
-    time_t start = 0, end = 0;
+    struct timespec start, end;
     double run_time;
+    DBPoolStatus status;
     Octstr *user, *pass, *db, *host, *db_type;
     int j, bail_out;
 
@@ -406,6 +399,8 @@ int main(int argc, char **argv)
 
             case 't':
                 num_threads = atoi(optarg);
+                if (num_threads > MAX_THREADS)
+                    num_threads = MAX_THREADS;
                 break;
 
             case 'T':
@@ -511,28 +506,34 @@ int main(int argc, char **argv)
     }
 
     for (i = 0; i < num_threads; ++i) {
-        if (gwthread_create(inc_dec_thread, pool) == -1)
+        if ((threads[i] = gwthread_create(inc_dec_thread, pool)) == -1)
             panic(0, "Could not create thread %ld", i);
     }
-    gwthread_join_all();
+    /* only ours, the log writer thread runs until shutdown */
+    for (i = 0; i < num_threads; ++i)
+        gwthread_join(threads[i]);
 
     info(0, "Connections within pool: %ld", dbpool_conn_count(pool));
     info(0, "Checked pool, %d connections still active and ok", dbpool_check(pool));
 
     /* queries */
     info(0,"SQL query is `%s'", octstr_get_cstr(sql));
-    time(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
     for (i = 0; i < num_threads; ++i) {
-        if (gwthread_create(client_thread, pool) == -1)
+        if ((threads[i] = gwthread_create(client_thread, pool)) == -1)
             panic(0, "Couldnot create thread %ld", i);
     }
 
-    gwthread_join_all();
-    time(&end);
+    for (i = 0; i < num_threads; ++i)
+        gwthread_join(threads[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-    run_time = difftime(end, start);
-    info(0, "%ld requests in %.2f seconds, %.2f requests/s.",
-         (queries * num_threads), run_time, (float) (queries * num_threads) / (run_time==0?1:run_time));
+    run_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    info(0, "%ld requests in %.2f seconds, %.2f requests/s, %.2f us per request.",
+         (queries * num_threads), run_time, (float) (queries * num_threads) / (run_time==0?1:run_time),
+         run_time * 1e6 / (queries * num_threads));
+    dbpool_status(&status);
+    info(0, "%ld statements prepared, %ld reused.", status.prepared, status.reused);
 
     /* check all active connections */
     debug("",0,"Connections within pool: %ld", dbpool_conn_count(pool));
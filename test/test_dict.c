@@ -57,27 +57,144 @@
 /*
  * test_dict.c - test Dict objects
  *
+ * Fills two Dicts crosswise with random UUID keys and checks them against
+ * each other, then measures put/get/remove rates, single threaded and
+ * with several threads working on the same Dict.
+ *
+ *   test/test_dict -n 1000000 -t 8
+ *
  * Lars Wirzenius
  * Stipe Tolj
  */
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "gwlib/gwlib.h"
 
-#define HUGE_SIZE 200000
+static long huge_size = 1000000;
+static long num_threads = 4;
+
+static Dict *bench_dict;
+static Octstr **bench_keys;
+
+
+static void report(const char *what, long ops, double start)
+{
+    double elapsed = date_monotonic_now() - start;
+
+    info(0, "%-28s %9ld ops %8.3f s %12.0f ops/s", what, ops, elapsed,
+         elapsed > 0 ? ops / elapsed : 0.0);
+}
+
+
+/* every thread works on its own slice of the keys, then reads all of them */
+static void bench_thread(void *arg)
+{
+    long slice = (long) arg;
+    long i, from, to;
+
+    from = slice * huge_size / num_threads;
+    to = (slice + 1) * huge_size / num_threads;
+    for (i = from; i < to; i++)
+        dict_put(bench_dict, bench_keys[i], bench_keys[i]);
+    for (i = 0; i < huge_size; i++)
+        dict_get(bench_dict, bench_keys[(i + from) % huge_size]);
+    for (i = from; i < to; i++) {
+        if (dict_remove(bench_dict, bench_keys[i]) != bench_keys[i])
+            panic(0, "dict_remove() returned the wrong value");
+    }
+}
+
 
-int main(void)
+static void benchmark(void)
+{
+    double start;
+    long i;
+
+    bench_keys = gw_malloc(sizeof(*bench_keys) * huge_size);
+    for (i = 0; i < huge_size; i++)
+        bench_keys[i] = octstr_format("%ld-%ld", i * 7919, i);
+
+    bench_dict = dict_create(huge_size, NULL);
+    start = date_monotonic_now();
+    for (i = 0; i < huge_size; i++)
+        dict_put(bench_dict, bench_keys[i], bench_keys[i]);
+    report("dict_put", huge_size, start);
+
+    start = date_monotonic_now();
+    for (i = 0; i < huge_size; i++) {
+        if (dict_get(bench_dict, bench_keys[i]) != bench_keys[i])
+            panic(0, "dict_get() returned the wrong value");
+    }
+    report("dict_get (hit)", huge_size, start);
+
+    start = date_monotonic_now();
+    for (i = 0; i < huge_size; i++)
+        dict_remove(bench_dict, bench_keys[i]);
+    report("dict_remove", huge_size, start);
+    if (dict_key_count(bench_dict) != 0)
+        panic(0, "%ld keys left after removing all", dict_key_count(bench_dict));
+
+    /* an undersized Dict has to grow along the way */
+    dict_destroy(bench_dict);
+    bench_dict = dict_create(16, NULL);
+    start = date_monotonic_now();
+    for (i = 0; i < huge_size; i++)
+        dict_put_nocopy(bench_dict, octstr_duplicate(bench_keys[i]), bench_keys[i]);
+    report("dict_put_nocopy (growing)", huge_size, start);
+    start = date_monotonic_now();
+    for (i = 0; i < huge_size; i++)
+        dict_get(bench_dict, bench_keys[i]);
+    report("dict_get (grown)", huge_size, start);
+    dict_destroy(bench_dict);
+
+    bench_dict = dict_create(huge_size, NULL);
+    start = date_monotonic_now();
+    for (i = 0; i < num_threads; i++)
+        gwthread_create(bench_thread, (void *) i);
+    gwthread_join_every(bench_thread);
+    report("threaded put/get/remove", huge_size * 2 + huge_size * num_threads, start);
+    if (dict_key_count(bench_dict) != 0)
+        panic(0, "%ld keys left after threaded run", dict_key_count(bench_dict));
+    dict_destroy(bench_dict);
+
+    for (i = 0; i < huge_size; i++)
+        octstr_destroy(bench_keys[i]);
+    gw_free(bench_keys);
+}
+
+
+int main(int argc, char **argv)
 {
     Dict *dict1, *dict2;
     Octstr *key;
-    unsigned long i;
+    long i;
     List *keys;
+    int opt;
      
     gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:n:t:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'n':
+                huge_size = atol(optarg);
+                break;
+            case 't':
+                num_threads = atol(optarg);
+                break;
+            default:
+                panic(0, "Usage: test_dict [-v loglevel] [-n keys] [-t threads]");
+        }
+    }
     
     debug("",0,"Dict populate phase.");
-    dict1 = dict_create(HUGE_SIZE, octstr_destroy_item);
-    dict2 = dict_create(HUGE_SIZE, octstr_destroy_item);
-    for (i = 1; i <= HUGE_SIZE; i++) {
+    dict1 = dict_create(huge_size, octstr_destroy_item);
+    dict2 = dict_create(huge_size, octstr_destroy_item);
+    for (i = 1; i <= huge_size; i++) {
         Octstr *okey, *oval;
         uuid_t id1, id2;
         char key[UUID_STR_LEN + 1];
@@ -92,14 +209,14 @@ int main(void)
         dict_put(dict2, oval, okey);
     }
 
-    if (dict_key_count(dict1) == HUGE_SIZE)
-        info(0, "ok, got %d entries in dict1.", HUGE_SIZE);
+    if (dict_key_count(dict1) == huge_size)
+        info(0, "ok, got %ld entries in dict1.", huge_size);
     else
-        error(0, "key count is %ld, should be %d in dict1.", dict_key_count(dict1), HUGE_SIZE);
-    if (dict_key_count(dict2) == HUGE_SIZE)
-        info(0, "ok, got %d entries in dict2.", HUGE_SIZE);
+        error(0, "key count is %ld, should be %ld in dict1.", dict_key_count(dict1), huge_size);
+    if (dict_key_count(dict2) == huge_size)
+        info(0, "ok, got %ld entries in dict2.", huge_size);
     else
-        error(0, "key count is %ld, should be %d in dict2.", dict_key_count(dict2), HUGE_SIZE);
+        error(0, "key count is %ld, should be %ld in dict2.", dict_key_count(dict2), huge_size);
 
     debug("",0,"Dict lookup phase.");
     keys = dict_keys(dict1);
@@ -125,6 +242,9 @@ int main(void)
     dict_destroy(dict1);
     dict_destroy(dict2);
 
+    debug("",0,"Dict benchmark phase.");
+    benchmark();
+
     gwlib_shutdown();
     return 0;
 }
@@ -0,0 +1,215 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_dlr.c - benchmark DLR storage lookups
+ *
+ * Fills the configured DLR storage (usually 'internal') with an increasing
+ * number of waiting entries and measures the average cost of dlr_find()
+ * at every power of ten. For a storage with constant time lookups the
+ * reported time per lookup has to stay flat while the storage grows.
+ *
+ *   test_dlr -n 10000000 kannel.conf
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+#include "gw/dlr.h"
+
+#define SMSC_COUNT 8
+
+static long entries = 1000000;
+static long lookups = 100000;
+
+static void help(void)
+{
+    info(0, "Usage: test_dlr [options] kannel.conf");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-n number");
+    info(0, "    number of waiting DLR entries to fill in (default: 1000000)");
+    info(0, "-l number");
+    info(0, "    number of lookups at each measuring point (default: 100000)");
+}
+
+static Octstr *smsc_ids[SMSC_COUNT];
+
+static void make_key(long i, Octstr **smsc, Octstr **ts, Octstr **dst)
+{
+    *smsc = smsc_ids[i % SMSC_COUNT];
+    *ts = octstr_format("%08lx", i);
+    *dst = octstr_format("+4915%09ld", i);
+}
+
+static void add_entry(long i)
+{
+    Octstr *smsc, *ts, *dst;
+    Msg *msg;
+
+    make_key(i, &smsc, &ts, &dst);
+    msg = msg_create(sms);
+    msg->sms.sender = octstr_create("12345");
+    msg->sms.receiver = dst;
+    msg->sms.service = octstr_create("bench");
+    msg->sms.dlr_url = octstr_create("http://127.0.0.1/dlr?status=%d");
+    msg->sms.dlr_mask = DLR_SUCCESS | DLR_FAIL | DLR_SMSC_SUCCESS;
+    dlr_add(smsc, ts, msg, 0);
+    msg_destroy(msg);
+    octstr_destroy(ts);
+}
+
+/*
+ * Look up random existing entries with a final status, which removes them
+ * from the storage, and add them back again to keep the size constant.
+ */
+static double measure(long count)
+{
+    Octstr *smsc, *ts, *dst;
+    double start, elapsed = 0;
+    long i, n, missing = 0;
+    Msg *msg;
+
+    for (n = 0; n < lookups; n++) {
+        i = gw_rand() % count;
+        make_key(i, &smsc, &ts, &dst);
+        start = date_monotonic_now();
+        msg = dlr_find(smsc, ts, dst, DLR_SUCCESS, 0);
+        elapsed += date_monotonic_now() - start;
+        if (msg == NULL)
+            missing++;
+        msg_destroy(msg);
+        octstr_destroy(ts);
+        octstr_destroy(dst);
+        add_entry(i);
+    }
+    if (missing > 0)
+        error(0, "%ld of %ld lookups did not find their entry.", missing, lookups);
+
+    return elapsed / lookups;
+}
+
+int main(int argc, char **argv)
+{
+    Cfg *cfg;
+    Octstr *name;
+    long i, next;
+    double start, add_time = 0;
+    int opt;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:n:l:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'n':
+            entries = atol(optarg);
+            break;
+        case 'l':
+            lookups = atol(optarg);
+            break;
+        case '?':
+        default:
+            error(0, "Invalid option %c", opt);
+            help();
+            panic(0, "Stopping.");
+        }
+    }
+
+    if (optind >= argc) {
+        error(0, "Missing arguments.");
+        help();
+        panic(0, "Stopping.");
+    }
+
+    name = octstr_create(argv[optind]);
+    cfg = cfg_create(name);
+    octstr_destroy(name);
+    if (cfg_read(cfg) == -1)
+        panic(0, "Couldn't read configuration file.");
+
+    dlr_init(cfg);
+    for (i = 0; i < SMSC_COUNT; i++)
+        smsc_ids[i] = octstr_format("smsc%ld", i);
+
+    for (i = 0, next = 1000; i < entries; i++) {
+        start = date_monotonic_now();
+        add_entry(i);
+        add_time += date_monotonic_now() - start;
+        if (i + 1 == next || i + 1 == entries) {
+            info(0, "%10ld entries: %.0f ns per dlr_add(), %.0f ns per dlr_find()",
+                 i + 1, add_time / (i + 1) * 1e9, measure(i + 1) * 1e9);
+            next *= 10;
+        }
+    }
+
+    if (dlr_messages() != entries)
+        error(0, "Storage holds %ld entries, should be %ld.", dlr_messages(), entries);
+
+    dlr_flush();
+    dlr_shutdown();
+    for (i = 0; i < SMSC_COUNT; i++)
+        octstr_destroy(smsc_ids[i]);
+    cfg_destroy(cfg);
+
+    gwlib_shutdown();
+    return 0;
+}
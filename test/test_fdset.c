@@ -0,0 +1,268 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_fdset.c - measure FDSet with many idle and a few busy descriptors
+ *
+ * Registers a large number of idle socket pairs and a small number of
+ * active ones, then bounces single bytes over the active ones through
+ * the fdset callback and reports registration cost and event throughput.
+ * With -T the idle descriptors are left to run into the idle timeout and
+ * the number of timeout callbacks is checked.
+ *
+ *   test/test_fdset -i 10000 -a 100 -d 5
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "gwlib/gwlib.h"
+
+static long num_idle = 10000;
+static long num_active = 100;
+static double duration = 5;
+static long idle_timeout = 0;
+
+static FDSet *set;
+static volatile long timeouts;
+
+
+/* Echo whatever arrives back to the sender. */
+static void active_cb(int fd, int revents, void *data)
+{
+    char buf[64];
+    ssize_t n;
+
+    if (revents & (POLLERR | POLLHUP)) {
+        fdset_unregister(set, fd);
+        return;
+    }
+    n = read(fd, buf, sizeof(buf));
+    if (n > 0 && write(fd, buf, n) != n)
+        error(errno, "echo write failed");
+}
+
+
+static void idle_cb(int fd, int revents, void *data)
+{
+    if (revents & POLLERR) {
+        timeouts++;
+        fdset_unregister(set, fd);
+    } else if (revents & POLLHUP) {
+        fdset_unregister(set, fd);
+    }
+}
+
+
+static void raise_fd_limit(long needed)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        return;
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t) needed) {
+        rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY ||
+                       rl.rlim_max >= (rlim_t) needed) ? (rlim_t) needed : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        rl.rlim_cur < (rlim_t) needed) {
+        long pairs = (rl.rlim_cur - 64) / 2 - num_active;
+        warning(0, "Only %ld file descriptors allowed, using %ld idle pairs.",
+                (long) rl.rlim_cur, pairs);
+        num_idle = pairs;
+    }
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_fdset [options]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-i number");
+    info(0, "    number of idle socket pairs (default: 10000)");
+    info(0, "-a number");
+    info(0, "    number of active socket pairs (default: 100)");
+    info(0, "-d seconds");
+    info(0, "    how long to bounce bytes over the active pairs (default: 5)");
+    info(0, "-T seconds");
+    info(0, "    idle timeout of the set, 0 for none (default: 0)");
+}
+
+
+int main(int argc, char **argv)
+{
+    int (*idle)[2], (*active)[2];
+    int opt, errors = 0;
+    long i, rounds;
+    double start, elapsed;
+    char c = 'x';
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:i:a:d:T:h")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'i':
+                num_idle = atol(optarg);
+                break;
+            case 'a':
+                num_active = atol(optarg);
+                break;
+            case 'd':
+                duration = atof(optarg);
+                break;
+            case 'T':
+                idle_timeout = atol(optarg);
+                break;
+            case 'h':
+                help();
+                exit(0);
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    raise_fd_limit(2 * (num_idle + num_active) + 64);
+
+    idle = gw_malloc(sizeof(idle[0]) * (num_idle > 0 ? num_idle : 1));
+    active = gw_malloc(sizeof(active[0]) * (num_active > 0 ? num_active : 1));
+    for (i = 0; i < num_idle; i++)
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, idle[i]) < 0)
+            panic(errno, "socketpair failed after %ld idle pairs", i);
+    for (i = 0; i < num_active; i++)
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, active[i]) < 0)
+            panic(errno, "socketpair failed after %ld active pairs", i);
+
+    set = fdset_create_real(idle_timeout);
+
+    /* registration from a foreign thread is queued, the final listen
+     * waits until the poll thread has caught up */
+    start = date_monotonic_now();
+    for (i = 0; i < num_idle; i++)
+        fdset_register(set, idle[i][0], POLLIN, idle_cb, NULL);
+    for (i = 0; i < num_active; i++)
+        fdset_register(set, active[i][0], POLLIN, active_cb, NULL);
+    if (num_active > 0)
+        fdset_listen(set, active[num_active - 1][0], POLLIN, POLLIN);
+    elapsed = date_monotonic_now() - start;
+    info(0, "registered %ld fds in %.3f s (%.2f us/fd)",
+         num_idle + num_active, elapsed,
+         elapsed * 1e6 / (num_idle + num_active));
+
+    /* every round sends one byte over each active pair and waits until
+     * all of them came back through the fdset thread */
+    rounds = 0;
+    start = date_monotonic_now();
+    do {
+        for (i = 0; i < num_active; i++)
+            if (write(active[i][1], &c, 1) != 1)
+                panic(errno, "write failed");
+        for (i = 0; i < num_active; i++)
+            if (read(active[i][1], &c, 1) != 1)
+                panic(errno, "read failed");
+        rounds++;
+        elapsed = date_monotonic_now() - start;
+    } while (num_active > 0 && elapsed < duration);
+    info(0, "%ld idle, %ld active: %ld events in %.3f s, %.0f events/s",
+         num_idle, num_active, rounds * num_active, elapsed,
+         rounds * num_active / elapsed);
+
+    start = date_monotonic_now();
+    for (i = 0; i < num_active; i++)
+        fdset_unregister(set, active[i][0]);
+    if (idle_timeout <= 0)
+        for (i = 0; i < num_idle; i++)
+            fdset_unregister(set, idle[i][0]);
+    elapsed = date_monotonic_now() - start;
+    info(0, "unregistered in %.3f s", elapsed);
+
+    if (idle_timeout > 0) {
+        gwthread_sleep(idle_timeout + 2);
+        if (timeouts != num_idle) {
+            error(0, "expected %ld idle timeouts, got %ld", num_idle, timeouts);
+            errors++;
+        } else {
+            info(0, "got %ld idle timeouts", timeouts);
+        }
+    }
+
+    fdset_destroy(set);
+
+    for (i = 0; i < num_idle; i++) {
+        close(idle[i][0]);
+        close(idle[i][1]);
+    }
+    for (i = 0; i < num_active; i++) {
+        close(active[i][0]);
+        close(active[i][1]);
+    }
+    gw_free(idle);
+    gw_free(active);
+
+    gwlib_shutdown();
+    return errors ? 1 : 0;
+}
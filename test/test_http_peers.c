@@ -0,0 +1,296 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+/*
+ * test_http_peers.c - measure the HTTP client with a slow peer around
+ *
+ * Runs an HTTP server that answers at once and a listener that accepts
+ * connections but never answers. A number of requests is parked at the
+ * slow peer first, then requests to the fast server are sent with a fixed
+ * concurrency and their throughput and latency reported. Give a host name
+ * with -H to park the slow requests behind a name lookup instead, e.g. a
+ * name the local resolver takes long to answer. With -m the connections
+ * per destination are limited and the pool counters show how many
+ * connections were opened.
+ *
+ *   test/test_http_peers -n 5000 -c 10 -s 200 -t 2
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "gwlib/gwlib.h"
+
+static long num_fast = 2000;
+static long concurrency = 10;
+static long num_slow = 100;
+static long client_threads = 1;
+static long max_connections = 0;
+static int port = 8090;
+static Octstr *slow_host = NULL;
+
+static volatile sig_atomic_t slow_running = 1;
+static List *slow_conns;
+
+
+static void fast_server(void *arg)
+{
+    HTTPClient *client;
+    Octstr *ip, *url, *body;
+    List *headers, *cgivars;
+
+    while ((client = http_accept_request(port, &ip, &url, &headers,
+                                         &body, &cgivars)) != NULL) {
+        http_send_reply(client, HTTP_OK, NULL, octstr_imm("ok"));
+        octstr_destroy(ip);
+        octstr_destroy(url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+        http_destroy_cgiargs(cgivars);
+    }
+}
+
+
+/* Accept everything and never say a word. */
+static void slow_server(void *arg)
+{
+    int fd, s;
+
+    fd = make_server_socket(port + 1, NULL);
+    if (fd < 0)
+        panic(0, "Cannot listen on port %d", port + 1);
+
+    while (slow_running) {
+        if (gwthread_pollfd(fd, POLLIN, 0.1) != POLLIN)
+            continue;
+        if ((s = accept(fd, NULL, NULL)) >= 0)
+            gwlist_append(slow_conns, (void *) (long) s);
+    }
+    close(fd);
+    while ((s = (long) gwlist_extract_first(slow_conns)) > 0)
+        close(s);
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_http_peers [options]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-n number");
+    info(0, "    number of requests to the fast server (default: 2000)");
+    info(0, "-c number");
+    info(0, "    fast requests outstanding at a time (default: 10)");
+    info(0, "-s number");
+    info(0, "    number of requests parked at the slow peer (default: 100)");
+    info(0, "-t number");
+    info(0, "    number of HTTP client threads (default: 1)");
+    info(0, "-m number");
+    info(0, "    max connections per destination, 0 for no limit (default: 0)");
+    info(0, "-p port");
+    info(0, "    port of the fast server, the slow one uses port+1 (default: 8090)");
+    info(0, "-H host");
+    info(0, "    host name of the slow peer (default: 127.0.0.1)");
+}
+
+
+int main(int argc, char **argv)
+{
+    HTTPCaller *caller, *slow_caller;
+    HTTPClientPoolStatus pool;
+    Octstr *url, *final_url, *body;
+    List *headers;
+    double *started, *latency, start, elapsed, sum;
+    long i, sent, done, failed;
+    int opt, status;
+    void *id;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:n:c:s:t:m:p:H:h")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'n':
+                num_fast = atol(optarg);
+                break;
+            case 'c':
+                concurrency = atol(optarg);
+                break;
+            case 's':
+                num_slow = atol(optarg);
+                break;
+            case 't':
+                client_threads = atol(optarg);
+                break;
+            case 'm':
+                max_connections = atol(optarg);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'H':
+                octstr_destroy(slow_host);
+                slow_host = octstr_create(optarg);
+                break;
+            case 'h':
+                help();
+                exit(0);
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+    if (num_fast < 1 || concurrency < 1)
+        panic(0, "Need at least one fast request.");
+    if (slow_host == NULL)
+        slow_host = octstr_create("127.0.0.1");
+
+    http_set_client_threads(client_threads);
+    http_set_client_max_connections(max_connections);
+
+    if (http_open_port(port, 0) == -1)
+        panic(0, "Cannot open port %d", port);
+    gwthread_create(fast_server, NULL);
+    slow_conns = gwlist_create();
+    gwthread_create(slow_server, NULL);
+    gwthread_sleep(0.2);
+
+    slow_caller = http_caller_create();
+    url = octstr_format("http://%S:%d/slow", slow_host, port + 1);
+    for (i = 0; i < num_slow; i++)
+        http_start_request(slow_caller, HTTP_METHOD_GET, url, NULL, NULL, 0,
+                           NULL, NULL);
+    octstr_destroy(url);
+
+    caller = http_caller_create();
+    url = octstr_format("http://127.0.0.1:%d/fast", port);
+    started = gw_malloc(sizeof(started[0]) * num_fast);
+    latency = gw_malloc(sizeof(latency[0]) * num_fast);
+    sent = done = failed = 0;
+    start = date_monotonic_now();
+    while (done < num_fast) {
+        while (sent < num_fast && sent - done < concurrency) {
+            started[sent] = date_monotonic_now();
+            http_start_request(caller, HTTP_METHOD_GET, url, NULL, NULL, 0,
+                               &started[sent], NULL);
+            sent++;
+        }
+        id = http_receive_result(caller, &status, &final_url, &headers, &body);
+        if (id == NULL)
+            panic(0, "HTTP caller went away.");
+        latency[done++] = date_monotonic_now() - *(double *) id;
+        if (status != HTTP_OK)
+            failed++;
+        octstr_destroy(final_url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+    }
+    elapsed = date_monotonic_now() - start;
+    octstr_destroy(url);
+
+    qsort(latency, num_fast, sizeof(latency[0]), cmp_double);
+    for (sum = 0, i = 0; i < num_fast; i++)
+        sum += latency[i];
+    info(0, "%ld threads, %ld slow, %ld fast in %.3f s: %.0f req/s, "
+         "latency avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms",
+         client_threads, num_slow, num_fast, elapsed, num_fast / elapsed,
+         sum * 1000 / num_fast, latency[num_fast / 2] * 1000,
+         latency[num_fast * 99 / 100] * 1000, latency[num_fast - 1] * 1000);
+    http_client_pool_status(&pool);
+    info(0, "pool: %ld reused, %ld opened, %ld waited, %ld open now",
+         pool.hits, pool.misses, pool.waits, pool.open);
+    if (failed > 0)
+        error(0, "%ld fast requests failed", failed);
+
+    /* drop the slow peer, its requests fail now */
+    slow_running = 0;
+    gwthread_join_every(slow_server);
+    for (i = 0; i < num_slow; i++) {
+        if (http_receive_result(slow_caller, &status, &final_url, &headers,
+                                &body) == NULL)
+            break;
+        octstr_destroy(final_url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+    }
+
+    http_caller_destroy(caller);
+    http_caller_destroy(slow_caller);
+    http_close_all_ports();
+    gwthread_join_every(fast_server);
+    gwlist_destroy(slow_conns, NULL);
+    octstr_destroy(slow_host);
+    gw_free(started);
+    gw_free(latency);
+    gwlib_shutdown();
+
+    return failed > 0;
+}
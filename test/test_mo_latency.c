@@ -0,0 +1,327 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_mo_latency.c - benchmark MO delivery latency to a churning smsbox
+ *
+ * Acts as both ends of the bearerbox: feeds MO messages through a fake
+ * SMSC connection at a fixed rate and accepts them as an smsbox that
+ * regularly drops its connection and comes back after a while, or
+ * temporarily rejects some of them. Reports the latency from submission
+ * until the box accepted each message.
+ *
+ *   gw/bearerbox gw/smskannel.conf &
+ *   test/test_mo_latency -n 20000 -r 2000 -c 2 -d 0.5 -k 1
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+#include "gw/shared.h"
+
+static Octstr *host;
+static long smsc_port = 20000;
+static long box_port = 13001;
+static long messages = 10000;
+static double rate = 1000;
+static double churn = 2.0;
+static double downtime = 0.5;
+static long nack_percent = 0;
+static Octstr *boxc_id;
+
+static double *sent_at;
+static double *latency;
+static long accepted;
+
+
+static void help(void)
+{
+    info(0, "Usage: test_mo_latency [options]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-h hostname");
+    info(0, "    hostname where bearerbox is running (default: localhost)");
+    info(0, "-s number");
+    info(0, "    port of the fake SMSC on bearerbox host (default: 20000)");
+    info(0, "-p number");
+    info(0, "    port for smsbox connections on bearerbox host (default: 13001)");
+    info(0, "-n number");
+    info(0, "    number of MO messages to send (default: 10000)");
+    info(0, "-r number");
+    info(0, "    messages per second (default: 1000)");
+    info(0, "-c seconds");
+    info(0, "    disconnect the box after being connected this long, 0 = never (default: 2)");
+    info(0, "-d seconds");
+    info(0, "    stay disconnected this long (default: 0.5)");
+    info(0, "-k number");
+    info(0, "    percentage of messages temporarily rejected by the box (default: 0)");
+    info(0, "-i boxc-id");
+    info(0, "    identify the box with this smsbox-id");
+}
+
+
+static void smsc_feeder(void *arg)
+{
+    Connection *conn;
+    Octstr *line;
+    double start, due;
+    long i;
+
+    conn = conn_open_tcp(host, smsc_port, NULL);
+    if (conn == NULL)
+        panic(0, "Cannot connect to the fake SMSC at port %ld", smsc_port);
+
+    start = date_monotonic_now();
+    for (i = 0; i < messages; i++) {
+        due = start + i / rate;
+        if (due > date_monotonic_now())
+            gwthread_sleep(due - date_monotonic_now());
+        line = octstr_format("%ld 456 text %ld\n", 1000 + i % 1000, i);
+        sent_at[i] = date_monotonic_now();
+        conn_write(conn, line);
+        octstr_destroy(line);
+        /* drop anything the bearerbox sends back */
+        while ((line = conn_read_line(conn)) != NULL)
+            octstr_destroy(line);
+    }
+    conn_flush(conn);
+    info(0, "Sent %ld messages in %.1f s", messages, date_monotonic_now() - start);
+
+    /* keep the SMSC connected until everything got through */
+    while (accepted < messages)
+        gwthread_sleep(0.5);
+    conn_destroy(conn);
+}
+
+
+static Connection *box_connect(void)
+{
+    Connection *conn;
+    Msg *msg;
+
+    conn = connect_to_bearerbox_real(host, box_port, 0, NULL);
+    if (conn == NULL)
+        panic(0, "Cannot connect to the bearerbox at port %ld", box_port);
+
+    msg = msg_create(admin);
+    msg->admin.command = cmd_identify;
+    msg->admin.boxc_id = octstr_duplicate(boxc_id);
+    write_to_bearerbox_real(conn, msg);
+
+    return conn;
+}
+
+
+static void run_box(void)
+{
+    Connection *conn;
+    Msg *msg, *reply;
+    double connected, last;
+    long seq;
+
+    conn = box_connect();
+    connected = last = date_monotonic_now();
+
+    while (accepted < messages) {
+        if (churn > 0 && date_monotonic_now() - connected > churn) {
+            debug("test", 0, "Dropping box connection for %.2f s", downtime);
+            close_connection_to_bearerbox_real(conn);
+            gwthread_sleep(downtime);
+            conn = box_connect();
+            connected = date_monotonic_now();
+        }
+
+        if (read_from_bearerbox_real(conn, &msg, 0.05) == -1)
+            panic(0, "Lost connection to the bearerbox");
+        if (msg == NULL) {
+            if (date_monotonic_now() - last > 120)
+                panic(0, "No message for two minutes, %ld of %ld accepted",
+                      accepted, messages);
+            continue;
+        }
+        last = date_monotonic_now();
+
+        if (msg_type(msg) == sms) {
+            reply = msg_create(ack);
+            uuid_copy(reply->ack.id, msg->sms.id);
+            reply->ack.time = msg->sms.time;
+            if (octstr_parse_long(&seq, msg->sms.msgdata, 0, 10) == -1)
+                seq = -1;
+            if (nack_percent > 0 && gw_rand() % 100 < nack_percent) {
+                reply->ack.nack = ack_failed_tmp;
+            } else {
+                reply->ack.nack = ack_success;
+                if (seq >= 0 && seq < messages && latency[seq] < 0) {
+                    latency[seq] = date_monotonic_now() - sent_at[seq];
+                    accepted++;
+                }
+            }
+            write_to_bearerbox_real(conn, reply);
+        }
+        msg_destroy(msg);
+    }
+
+    close_connection_to_bearerbox_real(conn);
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void report(void)
+{
+    double sum = 0;
+    long i;
+
+    qsort(latency, messages, sizeof(double), cmp_double);
+    for (i = 0; i < messages; i++)
+        sum += latency[i];
+
+    info(0, "MO latency over %ld messages (churn %.2f s, down %.2f s, %ld%% tmp nack):",
+         messages, churn, downtime, nack_percent);
+    info(0, "  avg %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms",
+         sum / messages * 1000,
+         latency[messages / 2] * 1000,
+         latency[messages * 90 / 100] * 1000,
+         latency[messages * 99 / 100] * 1000,
+         latency[messages - 1] * 1000);
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long i, feeder;
+
+    gwlib_init();
+
+    host = octstr_create("localhost");
+
+    while ((opt = getopt(argc, argv, "v:h:s:p:n:r:c:d:k:i:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'h':
+                octstr_destroy(host);
+                host = octstr_create(optarg);
+                break;
+            case 's':
+                smsc_port = atol(optarg);
+                break;
+            case 'p':
+                box_port = atol(optarg);
+                break;
+            case 'n':
+                messages = atol(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'c':
+                churn = atof(optarg);
+                break;
+            case 'd':
+                downtime = atof(optarg);
+                break;
+            case 'k':
+                nack_percent = atol(optarg);
+                break;
+            case 'i':
+                boxc_id = octstr_create(optarg);
+                break;
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    if (messages <= 0 || rate <= 0) {
+        help();
+        panic(0, "Stopping.");
+    }
+
+    sent_at = gw_malloc(sizeof(double) * messages);
+    latency = gw_malloc(sizeof(double) * messages);
+    for (i = 0; i < messages; i++)
+        latency[i] = -1;
+
+    if ((feeder = gwthread_create(smsc_feeder, NULL)) == -1)
+        panic(0, "Cannot start the SMSC feeder thread");
+    run_box();
+    gwthread_join(feeder);
+
+    report();
+
+    gw_free(sent_at);
+    gw_free(latency);
+    octstr_destroy(boxc_id);
+    octstr_destroy(host);
+
+    gwlib_shutdown();
+
+    return 0;
+}
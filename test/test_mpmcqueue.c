@@ -0,0 +1,278 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_mpmcqueue.c - compare List and gw_mpmcqueue under contention
+ *
+ * Runs the same number of producer and consumer threads against one
+ * queue, doubling the thread count up to the given maximum, and reports
+ * the throughput of both queue implementations.
+ *
+ *   test/test_mpmcqueue -n 200000 -t 64
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+
+static long items_per_producer = 100000;
+static long max_threads = 64;
+static long ring_size = 65536;
+
+
+struct queue_ops {
+    const char *name;
+    void *(*create)(void);
+    void (*destroy)(void *queue);
+    void (*add_producer)(void *queue);
+    void (*remove_producer)(void *queue);
+    void (*produce)(void *queue, void *item);
+    void *(*consume)(void *queue);
+};
+
+
+static void *list_create(void)
+{
+    return gwlist_create();
+}
+
+static void list_destroy(void *queue)
+{
+    gwlist_destroy(queue, NULL);
+}
+
+static void list_add_producer(void *queue)
+{
+    gwlist_add_producer(queue);
+}
+
+static void list_remove_producer(void *queue)
+{
+    gwlist_remove_producer(queue);
+}
+
+static void list_produce(void *queue, void *item)
+{
+    gwlist_produce(queue, item);
+}
+
+static void *list_consume(void *queue)
+{
+    return gwlist_consume(queue);
+}
+
+
+static void *mpmc_create(void)
+{
+    return gw_mpmcqueue_create(ring_size);
+}
+
+static void mpmc_destroy(void *queue)
+{
+    gw_mpmcqueue_destroy(queue, NULL);
+}
+
+static void mpmc_add_producer(void *queue)
+{
+    gw_mpmcqueue_add_producer(queue);
+}
+
+static void mpmc_remove_producer(void *queue)
+{
+    gw_mpmcqueue_remove_producer(queue);
+}
+
+static void mpmc_produce(void *queue, void *item)
+{
+    gw_mpmcqueue_produce(queue, item);
+}
+
+static void *mpmc_consume(void *queue)
+{
+    return gw_mpmcqueue_consume(queue);
+}
+
+
+static struct queue_ops ops[] = {
+    { "List", list_create, list_destroy, list_add_producer,
+      list_remove_producer, list_produce, list_consume },
+    { "gw_mpmcqueue", mpmc_create, mpmc_destroy, mpmc_add_producer,
+      mpmc_remove_producer, mpmc_produce, mpmc_consume },
+};
+
+
+struct run {
+    struct queue_ops *ops;
+    void *queue;
+    long consumed;
+};
+
+
+static void producer(void *arg)
+{
+    struct run *run = arg;
+    long i;
+
+    /* items only need to be non-NULL */
+    for (i = 1; i <= items_per_producer; i++)
+        run->ops->produce(run->queue, (void*) i);
+    run->ops->remove_producer(run->queue);
+}
+
+
+static void consumer(void *arg)
+{
+    struct run *run = arg;
+    long n = 0;
+
+    while (run->ops->consume(run->queue) != NULL)
+        n++;
+    __atomic_add_fetch(&run->consumed, n, __ATOMIC_RELAXED);
+}
+
+
+static double run_once(struct queue_ops *o, long threads)
+{
+    struct run run;
+    double start, elapsed;
+    long i;
+
+    run.ops = o;
+    run.queue = o->create();
+    run.consumed = 0;
+
+    for (i = 0; i < threads; i++)
+        o->add_producer(run.queue);
+
+    start = date_monotonic_now();
+    for (i = 0; i < threads; i++)
+        gwthread_create(consumer, &run);
+    for (i = 0; i < threads; i++)
+        gwthread_create(producer, &run);
+    gwthread_join_every(producer);
+    gwthread_join_every(consumer);
+    elapsed = date_monotonic_now() - start;
+
+    if (run.consumed != threads * items_per_producer)
+        panic(0, "%s: consumed %ld items, expected %ld", o->name,
+              run.consumed, threads * items_per_producer);
+    o->destroy(run.queue);
+
+    return threads * items_per_producer / elapsed;
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_mpmcqueue [options]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-n number");
+    info(0, "    items per producer thread (default: 100000)");
+    info(0, "-t number");
+    info(0, "    maximum number of producer (and consumer) threads (default: 64)");
+    info(0, "-s number");
+    info(0, "    ring size of the gw_mpmcqueue (default: 65536)");
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long threads;
+    unsigned long i;
+    double rate[sizeof(ops) / sizeof(ops[0])];
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:n:t:s:h")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'n':
+                items_per_producer = atol(optarg);
+                break;
+            case 't':
+                max_threads = atol(optarg);
+                break;
+            case 's':
+                ring_size = atol(optarg);
+                break;
+            case 'h':
+                help();
+                exit(0);
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    info(0, "%8s %14s %14s %8s", "threads", ops[0].name, ops[1].name, "ratio");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+            rate[i] = run_once(&ops[i], threads);
+        info(0, "%8ld %12.0f/s %12.0f/s %8.2f", threads, rate[0], rate[1],
+             rate[1] / rate[0]);
+    }
+
+    gwlib_shutdown();
+    return 0;
+}
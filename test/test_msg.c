@@ -59,20 +59,165 @@
  * 
  * This file is a test program for the message manipulation functions in 
  * msg.h and msg.c.
+ *
+ * With -b count, build a typical MT and measure msg_duplicate and packing
+ * and unpacking with the legacy and the binary codec: time and heap
+ * allocations per message.
  * 
  * Lars Wirzenius <liw@wapit.com> 
  */
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "gw/msg.h"
 #include "gwlib/gwlib.h"
 
-int main(void) {
+#ifdef __GLIBC__
+/*
+ * Count heap allocations of the whole process by interposing the glibc
+ * allocator entry points.
+ */
+static volatile long allocations;
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+#define ALLOCATIONS() (allocations)
+#else
+#define ALLOCATIONS() (0L)
+#endif
+
+
+static Msg *create_mt(void)
+{
+    Msg *msg;
+
+    msg = msg_create(sms);
+    msg->sms.sms_type = mt_push;
+    msg->sms.sender = octstr_create("12345");
+    msg->sms.receiver = octstr_create("+358401234567");
+    msg->sms.msgdata = octstr_create("Your verification code is 123456. "
+                                     "It expires in 10 minutes.");
+    msg->sms.smsc_id = octstr_create("smsc-operator-1");
+    msg->sms.service = octstr_create("otp");
+    msg->sms.account = octstr_create("customer-42");
+    msg->sms.boxc_id = octstr_create("smsbox-1");
+    msg->sms.dlr_url = octstr_create("http://app.example.com/dlr?id=7f3c&status=%d");
+    msg->sms.dlr_mask = 31;
+    msg->sms.time = time(NULL);
+    uuid_generate(msg->sms.id);
+
+    return msg;
+}
+
+
+static void bench_codec(const char *name, Msg *msg,
+                        Octstr *(*pack)(Msg *), long count)
+{
+    Msg *msg2;
+    Octstr *os, *os2;
+    long i, before;
+    double start, elapsed;
+
+    before = ALLOCATIONS();
+    start = date_monotonic_now();
+    for (i = 0; i < count; i++) {
+        os = pack(msg);
+        octstr_destroy(os);
+    }
+    elapsed = date_monotonic_now() - start;
+    info(0, "%s pack: %.0f ns, %.1f allocations per message",
+         name, elapsed * 1e9 / count, (double) (ALLOCATIONS() - before) / count);
+
+    os = pack(msg);
+    before = ALLOCATIONS();
+    start = date_monotonic_now();
+    for (i = 0; i < count; i++) {
+        msg2 = msg_unpack(os);
+        msg_destroy(msg2);
+    }
+    elapsed = date_monotonic_now() - start;
+    info(0, "%s unpack: %.0f ns, %.1f allocations per message, %ld octets",
+         name, elapsed * 1e9 / count, (double) (ALLOCATIONS() - before) / count,
+         octstr_len(os));
+
+    msg2 = msg_unpack(os);
+    os2 = pack(msg2);
+    if (octstr_compare(os, os2) != 0)
+        panic(0, "%s round trip changed the message", name);
+    octstr_destroy(os);
+    octstr_destroy(os2);
+    msg_destroy(msg2);
+}
+
+
+static void bench(long count)
+{
+    Msg *msg, *msg2;
+    long i, before;
+    double start, elapsed;
+
+    msg = create_mt();
+
+    before = ALLOCATIONS();
+    start = date_monotonic_now();
+    for (i = 0; i < count; i++) {
+        msg2 = msg_duplicate(msg);
+        msg_destroy(msg2);
+    }
+    elapsed = date_monotonic_now() - start;
+    info(0, "msg_duplicate: %.0f ns, %.1f allocations per message",
+         elapsed * 1e9 / count, (double) (ALLOCATIONS() - before) / count);
+
+    bench_codec("legacy", msg, msg_pack, count);
+    bench_codec("binary", msg, msg_pack_binary, count);
+
+    msg_destroy(msg);
+}
+
+
+int main(int argc, char **argv) {
 	Msg *msg, *msg2;
 	Octstr *os;
+	int opt;
 	
 	gwlib_init();
 
+	while ((opt = getopt(argc, argv, "b:")) != EOF) {
+	    switch (opt) {
+	    case 'b':
+		bench(atol(optarg));
+		gwlib_shutdown();
+		return 0;
+	    default:
+		panic(0, "Usage: test_msg [-b count]");
+	    }
+	}
+
 	info(0, "Creating msg.");
 	msg = msg_create(heartbeat);
 	msg->heartbeat.load = 42;
@@ -56,17 +56,154 @@
 
 /*
  * test_octstr_immutables.c - simple testing of octstr_imm()
+ *
+ * Without options, dump octstr_imm() of the first argument. With -b,
+ * check that octstr_imm() and octstr_lit() hand out the same octet
+ * string for the same literal and measure the calls per second from
+ * -t threads making -n calls each.
+ *
+ *   test/test_octstr_immutables -b -t 4 -n 10000000
  */
 
 #include <stdio.h>   
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "gwlib/gwlib.h"
 
+static long num_threads = 4;
+static long num_calls = 10000000;
+
+static const char *names[] = {
+    "Content-Type", "Content-Length", "Connection", "keep-alive",
+    "close", "Host", "X-Kannel-From", "X-Kannel-To"
+};
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+
+static void imm_thread(void *arg)
+{
+    long i, *len = arg;
+
+    for (i = 0; i < num_calls; i++)
+        *len += octstr_len(octstr_imm(names[i % NUM_NAMES]));
+}
+
+
+static Octstr *lit(long i)
+{
+    switch (i % NUM_NAMES) {
+        case 0: return octstr_lit("Content-Type");
+        case 1: return octstr_lit("Content-Length");
+        case 2: return octstr_lit("Connection");
+        case 3: return octstr_lit("keep-alive");
+        case 4: return octstr_lit("close");
+        case 5: return octstr_lit("Host");
+        case 6: return octstr_lit("X-Kannel-From");
+        default: return octstr_lit("X-Kannel-To");
+    }
+}
+
+
+static void lit_thread(void *arg)
+{
+    long i, *len = arg;
+
+    for (i = 0; i < num_calls; i++)
+        *len += octstr_len(lit(i));
+}
+
+
+static double run(gwthread_func_t *func, const char *name)
+{
+    long *len, i, total;
+    long *threads;
+    double start, elapsed;
+
+    len = gw_malloc(sizeof(len[0]) * num_threads);
+    threads = gw_malloc(sizeof(threads[0]) * num_threads);
+    start = date_monotonic_now();
+    for (i = 0; i < num_threads; i++) {
+        len[i] = 0;
+        threads[i] = gwthread_create(func, &len[i]);
+    }
+    for (i = 0; i < num_threads; i++)
+        gwthread_join(threads[i]);
+    elapsed = date_monotonic_now() - start;
+
+    for (total = 0, i = 0; i < num_threads; i++)
+        total += len[i];
+    info(0, "%s: %ld threads x %ld calls in %.3f s, %.1f M calls/s (%ld octets)",
+         name, num_threads, num_calls, elapsed,
+         num_threads * num_calls / elapsed / 1e6, total);
+    gw_free(len);
+    gw_free(threads);
+
+    return elapsed;
+}
+
+
+static int check(void)
+{
+    int errors = 0;
+    long i;
+
+    for (i = 0; i < (long) NUM_NAMES; i++) {
+        if (octstr_imm(names[i]) != octstr_imm(names[i])) {
+            error(0, "octstr_imm(\"%s\") not interned", names[i]);
+            errors++;
+        }
+        if (lit(i) != lit(i + NUM_NAMES)) {
+            error(0, "octstr_lit() #%ld not static", i);
+            errors++;
+        }
+        if (octstr_compare(lit(i), octstr_imm(names[i])) != 0 ||
+            octstr_len(lit(i)) != (long) strlen(names[i])) {
+            error(0, "octstr_lit() #%ld differs from <%s>", i, names[i]);
+            errors++;
+        }
+    }
+    octstr_destroy(lit(0));
+    if (octstr_len(octstr_lit("")) != 0) {
+        error(0, "octstr_lit(\"\") not empty");
+        errors++;
+    }
+
+    return errors;
+}
+
+
 int main(int argc, char **argv) 
 {
     Octstr *os;
+    int opt, bench = 0, errors = 0;
 
     gwlib_init();
+
+    while ((opt = getopt(argc, argv, "bt:n:")) != EOF) {
+        switch (opt) {
+            case 'b':
+                bench = 1;
+                break;
+            case 't':
+                num_threads = atol(optarg);
+                break;
+            case 'n':
+                num_calls = atol(optarg);
+                break;
+            case '?':
+            default:
+                panic(0, "Usage: test_octstr_immutables [-b [-t threads] [-n calls]] [string]");
+        }
+    }
+
+    if (bench) {
+        errors = check();
+        run(imm_thread, "octstr_imm");
+        run(lit_thread, "octstr_lit");
+        gwlib_shutdown();
+        return errors > 0;
+    }
 	
     if (optind >= argc) {
         os = octstr_imm("foo");
@@ -85,4 +222,3 @@ int main(int argc, char **argv)
 
     return 0;
 }
-
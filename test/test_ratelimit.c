@@ -0,0 +1,180 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_ratelimit.c - check the precision of gw_ratelimit
+ *
+ * Takes tokens as fast as the limiter allows for a few seconds at
+ * several rates and reports the achieved rate. Waits either with
+ * gw_ratelimit_wait() or, like the SMPP I/O thread, with a millisecond
+ * poll timeout. Fails if any rate is off by more than 1%.
+ *
+ *   test/test_ratelimit -d 5 -r 500
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+
+static double duration = 3;
+static long burst = 1;
+
+
+static double measure(double rate, int poll_mode)
+{
+    gw_ratelimit_t *limit;
+    double start, last;
+    long count = 0;
+
+    limit = gw_ratelimit_create(rate, burst);
+
+    /* empty the bucket first, we want the steady state rate */
+    while (gw_ratelimit_take(limit))
+        ;
+
+    /* count the intervals between the first and the last token */
+    start = last = 0;
+    while (last - start < duration) {
+        if (poll_mode) {
+            if (!gw_ratelimit_take(limit)) {
+                gwthread_sleep(gw_ratelimit_delay(limit) + 0.001);
+                continue;
+            }
+        } else {
+            while (!gw_ratelimit_wait(limit))
+                ;
+        }
+        last = date_monotonic_now();
+        if (count++ == 0)
+            start = last;
+    }
+
+    gw_ratelimit_destroy(limit);
+
+    return (count - 1) / (last - start);
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_ratelimit [options]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-d seconds");
+    info(0, "    measure every rate this long (default: 3)");
+    info(0, "-b number");
+    info(0, "    burst size of the limiter (default: 1)");
+    info(0, "-r rate");
+    info(0, "    only measure this rate (default: 10 100 500 1000 2000)");
+}
+
+
+int main(int argc, char **argv)
+{
+    static double rates[] = { 10, 100, 500, 1000, 2000 };
+    double rate, achieved, deviation;
+    int opt, mode, errors = 0;
+    long i, num_rates = sizeof(rates) / sizeof(rates[0]);
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:d:b:r:h")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'd':
+                duration = atof(optarg);
+                break;
+            case 'b':
+                burst = atol(optarg);
+                break;
+            case 'r':
+                rates[0] = atof(optarg);
+                num_rates = 1;
+                break;
+            case 'h':
+                help();
+                exit(0);
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    for (i = 0; i < num_rates; i++) {
+        rate = rates[i];
+        for (mode = 0; mode < 2; mode++) {
+            achieved = measure(rate, mode);
+            deviation = (achieved - rate) / rate * 100;
+            if (deviation < -1 || deviation > 1) {
+                error(0, "rate %8.1f/s %-5s achieved %10.2f/s (%+.2f%%)",
+                      rate, mode ? "poll" : "wait", achieved, deviation);
+                errors++;
+            } else {
+                info(0, "rate %8.1f/s %-5s achieved %10.2f/s (%+.2f%%)",
+                     rate, mode ? "poll" : "wait", achieved, deviation);
+            }
+        }
+    }
+
+    gwlib_shutdown();
+    return errors ? 1 : 0;
+}
@@ -57,9 +57,16 @@
 /*
  * test_urltrans.c - a simple program to test the URL translation module
  *
+ * With -b it instead generates the given number of keyword services and
+ * measures how fast MO messages are resolved, once with plain keywords
+ * and once with the same services written as keyword-regex:
+ *
+ *   test/test_urltrans -b 10000 -m 100000
+ *
  * Lars Wirzenius <liw@wapit.com>
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -69,12 +76,93 @@
 static void help(void) {
 	info(0, "Usage: test_urltrans [-r repeats] foo.smsconf pattern ...\n"
 		"where -r means the number of times the test should be\n"
-		"repeated.");
+		"repeated.\n"
+		"       test_urltrans -b services [-m messages]\n"
+		"benchmarks service lookup with that many keyword services.");
+}
+
+
+/*
+ * Resolve `messages' MO messages against `services' generated services,
+ * one in ten of them not matching any keyword. Both keyword flavours use
+ * the same regex text, which then is also the name of the service, so the
+ * results can be checked. Returns the number of wrong results.
+ */
+static long benchmark(long services, long messages, int use_regex)
+{
+	char path[] = "/tmp/test_urltrans.XXXXXX";
+	URLTranslationList *list;
+	URLTranslation *t;
+	Cfg *cfg;
+	Octstr *name, *expected;
+	FILE *f;
+	Msg *msg;
+	long i, n, errors = 0;
+	double start, elapsed;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1 || (f = fdopen(fd, "w")) == NULL)
+		panic(errno, "Cannot create temporary configuration file.");
+	for (i = 0; i < services; i++) {
+		if (use_regex)
+			fprintf(f, "group = sms-service\n"
+				"keyword-regex = \"^[ ]*(svc%05ld)[ ]*\"\n", i);
+		else
+			fprintf(f, "group = sms-service\nkeyword = svc%05ld\n", i);
+		fprintf(f, "text = \"service %ld\"\n\n", i);
+	}
+	fprintf(f, "group = sms-service\nkeyword = default\n"
+		"text = \"default\"\n");
+	fclose(f);
+
+	name = octstr_create(path);
+	cfg = cfg_create(name);
+	octstr_destroy(name);
+	if (cfg_read(cfg) == -1)
+		panic(0, "Couldn't read generated configuration file.");
+	unlink(path);
+
+	list = urltrans_create();
+	if (urltrans_add_cfg(list, cfg) == -1)
+		panic(0, "Error parsing generated configuration.");
+
+	msg = msg_create(sms);
+	start = date_monotonic_now();
+	for (i = 0; i < messages; i++) {
+		n = gw_rand() % services;
+		if (i % 10 == 0)
+			msg->sms.msgdata = octstr_format("nomatch%ld", n);
+		else	/* keywords are matched ignoring case, regexes aren't */
+			msg->sms.msgdata = octstr_format(use_regex ? "svc%05ld" :
+							 "SVC%05ld", n);
+		t = urltrans_find(list, msg);
+		if (i % 10 == 0)
+			expected = octstr_create("default");
+		else
+			expected = octstr_format("^[ ]*(svc%05ld)[ ]*", n);
+		if (t == NULL || octstr_compare(urltrans_name(t), expected) != 0)
+			errors++;
+		octstr_destroy(expected);
+		octstr_destroy(msg->sms.msgdata);
+		msg->sms.msgdata = NULL;
+	}
+	elapsed = date_monotonic_now() - start;
+	msg_destroy(msg);
+
+	info(0, "%ld %s services: %ld lookups in %.3f s, %.0f lookups/s, "
+	     "%ld wrong", services, use_regex ? "keyword-regex" : "keyword",
+	     messages, elapsed, messages / elapsed, errors);
+
+	urltrans_destroy(list);
+	cfg_destroy(cfg);
+
+	return errors;
 }
 
 int main(int argc, char **argv) {
 	int i, opt;
-	long repeats;
+	long repeats, services, messages, errors;
 	URLTranslationList *list;
 	URLTranslation *t;
 	Cfg *cfg;
@@ -83,13 +171,23 @@ int main(int argc, char **argv) {
 	gwlib_init();
 
 	repeats = 1;
+	services = 0;
+	messages = 100000;
 
-	while ((opt = getopt(argc, argv, "hr:")) != EOF) {
+	while ((opt = getopt(argc, argv, "hr:b:m:")) != EOF) {
 		switch (opt) {
 		case 'r':
 			repeats = atoi(optarg);
 			break;
 
+		case 'b':
+			services = atol(optarg);
+			break;
+
+		case 'm':
+			messages = atol(optarg);
+			break;
+
 		case 'h':
 			help();
 			exit(0);
@@ -102,6 +200,15 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	if (services > 0) {
+		log_set_output_level(GW_INFO);
+		/* every regex message runs all regexes, so use fewer of them */
+		errors = benchmark(services, messages, 0);
+		errors += benchmark(services, messages / 100 + 1, 1);
+		gwlib_shutdown();
+		return errors > 0;
+	}
+
 	if (optind + 1 >= argc) {
 		error(0, "Missing arguments.");
 		help();
@@ -0,0 +1,163 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2018 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * mknumlist.c - compile white/black number lists for fast loading
+ *
+ * Reads number lists in the text format of the white-list and black-list
+ * directives, one number per line and a trailing '*' for a prefix, and
+ * writes them as one compiled number list file. With -b it writes the
+ * delta against an earlier compiled list instead, to be installed as
+ * <list>.delta next to it. The gateway maps a compiled list given as a
+ * local file and applies its delta, see gw/numfilter.h.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#include "gwlib/gwlib.h"
+#include "numfilter.h"
+
+static void help(void)
+{
+    info(0, "Usage: mknumlist [-v loglevel] [-b base] -o output input...");
+    info(0, "Compile the number lists in the input files (- for stdin) into");
+    info(0, "the number list file output. With -b, write the delta from the");
+    info(0, "compiled list base instead, to be installed as base.delta.");
+}
+
+
+static int read_list(NumberFilter *filter, const char *name)
+{
+    char line[1024], *p;
+    long numbers = 0, lineno = 0;
+    FILE *f;
+
+    if (strcmp(name, "-") == 0)
+        f = stdin;
+    else if ((f = fopen(name, "r")) == NULL) {
+        error(errno, "Cannot open <%s>", name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        for (p = line; isspace((unsigned char) *p); p++)
+            ;
+        if (*p == '#' || *p == '\0')
+            continue;
+        if (number_filter_add_number(filter, 0, NUMFILTER_BLACK, p) == 0)
+            numbers++;
+        else
+            warning(0, "%s:%ld: corrupted line '%s'", name, lineno, p);
+    }
+    if (f != stdin)
+        fclose(f);
+    info(0, "Read from <%s> total of %ld numbers", name, numbers);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    NumberFilter *filter;
+    Octstr *output = NULL, *base = NULL;
+    int opt, i, ret;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "hv:b:o:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'b':
+            octstr_destroy(base);
+            base = octstr_create(optarg);
+            break;
+        case 'o':
+            octstr_destroy(output);
+            output = octstr_create(optarg);
+            break;
+        case 'h':
+        case '?':
+        default:
+            help();
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if (output == NULL || optind == argc) {
+        help();
+        exit(1);
+    }
+
+    filter = number_filter_create();
+    ret = 0;
+    for (i = optind; i < argc && ret == 0; i++)
+        ret = read_list(filter, argv[i]);
+    if (ret == 0)
+        ret = number_filter_write(filter, output, base);
+
+    number_filter_destroy(filter);
+    octstr_destroy(output);
+    octstr_destroy(base);
+    gwlib_shutdown();
+    return ret == 0 ? 0 : 1;
+}